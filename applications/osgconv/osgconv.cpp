@@ -20,6 +20,7 @@
 #include <osgDB/PluginQuery>
 
 #include <osgUtil/Optimizer>
+#include <osgUtil/QuadricSimplifier>
 #include <osgUtil/Simplifier>
 #include <osgUtil/SmoothingVisitor>
 
@@ -27,6 +28,7 @@
 #include <osgViewer/Version>
 
 #include <iostream>
+#include <sstream>
 
 #include "OrientationConverter.h"
 
@@ -500,6 +502,13 @@ static void usage( const char *prog, const char *msg )
                             <<"                         Example: --simplify .5" << std::endl
                             <<"                                 will produce a 50% reduced model." << std::endl
                             << std::endl;
+    osg::notify(osg::NOTICE)<<"    --lod-chain r,r... - Replace the model by an osg::LOD of it and copies" << std::endl
+                            <<"                         simplified to each of the comma separated sample" << std::endl
+                            <<"                         ratios, which must be decreasing and in (0,1], with" << std::endl
+                            <<"                         the quadric simplifier. The copies share the model's" << std::endl
+                            <<"                         vertices." << std::endl
+                            <<"                         Example: --lod-chain .5,.25,.1" << std::endl
+                            << std::endl;
     osg::notify(osg::NOTICE)<<"    -s scale           - Scale size of model.  Scale argument must be the \n"
                               "                         following :\n"
                               "\n"
@@ -700,6 +709,25 @@ int main( int argc, char **argv )
         do_simplify = true;
     }
 
+    osgUtil::QuadricSimplifier::SampleRatioList lodSampleRatios;
+    while ( arguments.read( "--lod-chain",str ) )
+    {
+        lodSampleRatios.clear();
+        std::stringstream sstr(str);
+        std::string ratioStr;
+        while ( std::getline( sstr, ratioStr, ',' ) )
+        {
+            double ratio = 1.0;
+            if( sscanf( ratioStr.c_str(), "%lf", &ratio ) != 1 || ratio<=0.0 || ratio>1.0 ||
+                (!lodSampleRatios.empty() && ratio>=lodSampleRatios.back()) )
+            {
+                usage( argv[0], "LOD chain argument format incorrect." );
+                return 1;
+            }
+            lodSampleRatios.push_back(ratio);
+        }
+    }
+
     while (arguments.read("-t",str))
     {
         osg::Vec3 trans(0,0,0);
@@ -852,6 +880,12 @@ int main( int argc, char **argv )
             root->accept( simple );
         }
 
+        if ( !lodSampleRatios.empty() )
+        {
+            osgUtil::QuadricSimplifier simplifier;
+            root = simplifier.createLOD( root.get(), lodSampleRatios );
+        }
+
         osgDB::ReaderWriter::WriteResult result = osgDB::Registry::instance()->writeNode(*root,fileNameOut,osgDB::Registry::instance()->getOptions());
         if (result.success())
         {
@@ -25,6 +25,42 @@ CullingSet::~CullingSet()
 {
 }
 
+bool CullingSet::isCulled(unsigned int num, const float* x, const float* y, const float* z, const float* radius, Polytope::ClippingMask* resultMasks, unsigned char* culled)
+{
+#ifdef COMPILE_WITH_SHADOW_OCCLUSION_CULLING
+    if ((_mask&SHADOW_OCCLUSION_CULLING) && !_occluderList.empty()) return false;
+#endif
+
+    if (_mask&VIEW_FRUSTUM_CULLING)
+    {
+        // contains() reports the spheres that are contained, so flip to get those that are culled.
+        _frustum.contains(num, x, y, z, radius, resultMasks, culled);
+        for(unsigned int i=0; i<num; ++i)
+        {
+            culled[i] ^= 1;
+        }
+    }
+    else
+    {
+        Polytope::ClippingMask resultMask = _frustum.getResultMask();
+        for(unsigned int i=0; i<num; ++i)
+        {
+            resultMasks[i] = resultMask;
+            culled[i] = 0;
+        }
+    }
+
+    if (_mask&SMALL_FEATURE_CULLING)
+    {
+        for(unsigned int i=0; i<num; ++i)
+        {
+            if (!culled[i] && ((Vec3(x[i], y[i], z[i])*_pixelSizeVector)*_smallFeatureCullingPixelSize)>radius[i]) culled[i] = 1;
+        }
+    }
+
+    return true;
+}
+
 void CullingSet::disableAndPushOccludersCurrentMask(NodePath& nodePath)
 {
     for(OccluderList::iterator itr=_occluderList.begin();
@@ -1077,6 +1077,9 @@ void Geometry::accept(PrimitiveFunctor& functor) const
         return;
     }
 
+    // integer vertices, such as those of quantized geometries, are passed on as floats.
+    std::vector<Vec3> convertedVertices;
+
     switch(vertices->getType())
     {
     case(Array::Vec2ArrayType):
@@ -1097,6 +1100,18 @@ void Geometry::accept(PrimitiveFunctor& functor) const
     case(Array::Vec4dArrayType):
         functor.setVertexArray(vertices->getNumElements(),static_cast<const Vec4d*>(vertices->getDataPointer()));
         break;
+    case(Array::Vec3sArrayType):
+        {
+            const Vec3s* begin = static_cast<const Vec3s*>(vertices->getDataPointer());
+            const Vec3s* end = begin + vertices->getNumElements();
+            convertedVertices.reserve(vertices->getNumElements());
+            for(const Vec3s* vitr = begin; vitr != end; ++vitr)
+            {
+                convertedVertices.push_back(Vec3(vitr->x(), vitr->y(), vitr->z()));
+            }
+            functor.setVertexArray(convertedVertices.size(),&convertedVertices.front());
+        }
+        break;
     default:
         OSG_WARN<<"Warning: Geometry::accept(PrimitiveFunctor&) cannot handle Vertex Array type"<<vertices->getType()<<std::endl;
         return;
@@ -19,6 +19,12 @@
 
 #include <osg/io_utils>
 
+#include <OpenThreads/Thread>
+
+#include <algorithm>
+#include <math.h>
+#include <float.h>
+
 using namespace osg;
 
 //#define VERBOSE_OUTPUT
@@ -31,9 +37,11 @@ using namespace osg;
 struct BuildKdTree
 {
     BuildKdTree(KdTree& kdTree):
-        _kdTree(kdTree) {}
+        _kdTree(kdTree),
+        _collectBounds(false) {}
 
     typedef std::vector< osg::Vec3 >            CenterList;
+    typedef std::vector< osg::BoundingBox >     BoundsList;
     typedef std::vector< unsigned int >           Indices;
     typedef std::vector< unsigned int >         AxisStack;
 
@@ -43,6 +51,12 @@ struct BuildKdTree
 
     int divide(KdTree::BuildOptions& options, osg::BoundingBox& bb, int nodeIndex, unsigned int level);
 
+    void divideSAH(const KdTree::BuildOptions& options, KdTree::KdNodeList& nodes, int istart, int iend, unsigned int level, unsigned int numThreads);
+
+    int partitionSAH(int istart, int iend);
+
+    void computeLeafBound(KdTree::KdNode& node);
+
     KdTree&             _kdTree;
 
     osg::BoundingBox    _bb;
@@ -50,6 +64,10 @@ struct BuildKdTree
     Indices             _primitiveIndices;
     CenterList          _centers;
 
+    // per primitive bounds, only collected for SURFACE_AREA_HEURISTIC builds
+    bool                _collectBounds;
+    BoundsList          _bounds;
+
 protected:
 
     BuildKdTree& operator = (const BuildKdTree&) { return *this; }
@@ -74,6 +92,7 @@ struct PrimitiveIndicesCollector
 
         _buildKdTree->_primitiveIndices.push_back(_buildKdTree->_centers.size());
         _buildKdTree->_centers.push_back(bb.center());
+        if (_buildKdTree->_collectBounds) _buildKdTree->_bounds.push_back(bb);
     }
 
     inline void operator () (unsigned int p0, unsigned int p1)
@@ -98,6 +117,7 @@ struct PrimitiveIndicesCollector
 
         _buildKdTree->_primitiveIndices.push_back(_buildKdTree->_centers.size());
         _buildKdTree->_centers.push_back(bb.center());
+        if (_buildKdTree->_collectBounds) _buildKdTree->_bounds.push_back(bb);
     }
 
     inline void operator () (unsigned int p0, unsigned int p1, unsigned int p2)
@@ -125,6 +145,7 @@ struct PrimitiveIndicesCollector
 
         _buildKdTree->_primitiveIndices.push_back(_buildKdTree->_centers.size());
         _buildKdTree->_centers.push_back(bb.center());
+        if (_buildKdTree->_collectBounds) _buildKdTree->_bounds.push_back(bb);
     }
 
     inline void operator () (unsigned int p0, unsigned int p1, unsigned int p2, unsigned int p3)
@@ -154,6 +175,7 @@ struct PrimitiveIndicesCollector
 
         _buildKdTree->_primitiveIndices.push_back(_buildKdTree->_centers.size());
         _buildKdTree->_centers.push_back(bb.center());
+        if (_buildKdTree->_collectBounds) _buildKdTree->_bounds.push_back(bb);
     }
 
     BuildKdTree* _buildKdTree;
@@ -192,9 +214,12 @@ bool BuildKdTree::build(KdTree::BuildOptions& options, osg::Geometry* geometry)
 
     options._numVerticesProcessed += vertices->size();
 
+    _collectBounds = (options._buildStrategy==KdTree::BuildOptions::SURFACE_AREA_HEURISTIC);
+
     unsigned int estimatedNumTriangles = vertices->size()*2;
     _primitiveIndices.reserve(estimatedNumTriangles);
     _centers.reserve(estimatedNumTriangles);
+    if (_collectBounds) _bounds.reserve(estimatedNumTriangles);
 
     osg::TemplatePrimitiveIndexFunctor<PrimitiveIndicesCollector> collectIndices;
     collectIndices._buildKdTree = this;
@@ -202,13 +227,22 @@ bool BuildKdTree::build(KdTree::BuildOptions& options, osg::Geometry* geometry)
 
     _primitiveIndices.reserve(vertices->size());
 
-    KdTree::KdNode node(-1, _primitiveIndices.size());
-    node.bb = _bb;
+    int nodeNum = 0;
+    if (_collectBounds)
+    {
+        unsigned int numThreads = options._numThreads>0 ? options._numThreads : static_cast<unsigned int>(OpenThreads::GetNumberOfProcessors());
+        divideSAH(options, _kdTree.getNodes(), 0, static_cast<int>(_primitiveIndices.size()), 0, numThreads);
+    }
+    else
+    {
+        KdTree::KdNode node(-1, _primitiveIndices.size());
+        node.bb = _bb;
 
-    int nodeNum = _kdTree.addNode(node);
+        nodeNum = _kdTree.addNode(node);
 
-    osg::BoundingBox bb = _bb;
-    nodeNum = divide(options, bb, nodeNum, 0);
+        osg::BoundingBox bb = _bb;
+        nodeNum = divide(options, bb, nodeNum, 0);
+    }
 
     osg::KdTree::Indices& primitiveIndices = _kdTree.getPrimitiveIndices();
 
@@ -282,35 +316,8 @@ int BuildKdTree::divide(KdTree::BuildOptions& options, osg::BoundingBox& bb, int
     {
         if (node.first<0)
         {
-            int istart = -node.first-1;
-            int iend = istart+node.second-1;
-
             // leaf is done, now compute bound on it.
-            node.bb.init();
-            for(int i=istart; i<=iend; ++i)
-            {
-                unsigned int primitiveIndex = _kdTree.getPrimitiveIndices()[_primitiveIndices[i]];
-                primitiveIndex++; //skip original Primitive index
-                unsigned int numPoints = _kdTree.getVertexIndices()[primitiveIndex++];
-
-                for(; numPoints>0; --numPoints)
-                {
-                    unsigned int vi = _kdTree.getVertexIndices()[primitiveIndex++];
-                    const osg::Vec3& v = (*_kdTree.getVertices())[vi];
-                    node.bb.expandBy(v);
-                }
-            }
-
-            if (node.bb.valid())
-            {
-                float epsilon = 1e-6f;
-                node.bb._min.x() -= epsilon;
-                node.bb._min.y() -= epsilon;
-                node.bb._min.z() -= epsilon;
-                node.bb._max.x() += epsilon;
-                node.bb._max.y() += epsilon;
-                node.bb._max.z() += epsilon;
-            }
+            computeLeafBound(node);
 
 #ifdef VERBOSE_OUTPUT
             if (!node.bb.valid())
@@ -469,6 +476,337 @@ int BuildKdTree::divide(KdTree::BuildOptions& options, osg::BoundingBox& bb, int
 
 }
 
+void BuildKdTree::computeLeafBound(KdTree::KdNode& node)
+{
+    int istart = -node.first-1;
+    int iend = istart+node.second-1;
+
+    node.bb.init();
+    for(int i=istart; i<=iend; ++i)
+    {
+        unsigned int primitiveIndex = _kdTree.getPrimitiveIndices()[_primitiveIndices[i]];
+        primitiveIndex++; //skip original Primitive index
+        unsigned int numPoints = _kdTree.getVertexIndices()[primitiveIndex++];
+
+        for(; numPoints>0; --numPoints)
+        {
+            unsigned int vi = _kdTree.getVertexIndices()[primitiveIndex++];
+            const osg::Vec3& v = (*_kdTree.getVertices())[vi];
+            node.bb.expandBy(v);
+        }
+    }
+
+    if (node.bb.valid())
+    {
+        float epsilon = 1e-6f;
+        node.bb._min.x() -= epsilon;
+        node.bb._min.y() -= epsilon;
+        node.bb._min.z() -= epsilon;
+        node.bb._max.x() += epsilon;
+        node.bb._max.y() += epsilon;
+        node.bb._max.z() += epsilon;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Surface area heuristic build
+
+// number of bins used along each axis when evaluating candidate splits
+static const int SAH_NUM_BINS = 16;
+
+// don't hand sub trees with fewer primitives than this to a separate thread.
+static const int SAH_MIN_PRIMITIVES_PER_THREAD = 4096;
+
+static inline float halfSurfaceArea(const osg::BoundingBox& bb)
+{
+    if (!bb.valid()) return 0.0f;
+    osg::Vec3 d = bb._max - bb._min;
+    return d.x()*d.y() + d.y()*d.z() + d.z()*d.x();
+}
+
+struct BuildSubTreeThread : public OpenThreads::Thread
+{
+    BuildSubTreeThread(BuildKdTree& buildKdTree, const KdTree::BuildOptions& options, int istart, int iend, unsigned int level, unsigned int numThreads):
+        _buildKdTree(buildKdTree),
+        _options(options),
+        _istart(istart),
+        _iend(iend),
+        _level(level),
+        _numThreads(numThreads) {}
+
+    virtual void run()
+    {
+        _buildKdTree.divideSAH(_options, _nodes, _istart, _iend, _level, _numThreads);
+    }
+
+    BuildKdTree&                _buildKdTree;
+    const KdTree::BuildOptions& _options;
+    int                         _istart;
+    int                         _iend;
+    unsigned int                _level;
+    unsigned int                _numThreads;
+    KdTree::KdNodeList          _nodes;
+
+protected:
+
+    BuildSubTreeThread& operator = (const BuildSubTreeThread&) { return *this; }
+};
+
+struct CenterBelowSplit
+{
+    CenterBelowSplit(const BuildKdTree::CenterList& centers, int axis, float origin, float scale, int splitBin):
+        _centers(centers), _axis(axis), _origin(origin), _scale(scale), _splitBin(splitBin) {}
+
+    bool operator() (unsigned int index) const
+    {
+        int bin = static_cast<int>((_centers[index][_axis]-_origin)*_scale);
+        if (bin>=SAH_NUM_BINS) bin = SAH_NUM_BINS-1;
+        return bin<_splitBin;
+    }
+
+    const BuildKdTree::CenterList&  _centers;
+    int                             _axis;
+    float                           _origin;
+    float                           _scale;
+    int                             _splitBin;
+
+protected:
+
+    CenterBelowSplit& operator = (const CenterBelowSplit&) { return *this; }
+};
+
+int BuildKdTree::partitionSAH(int istart, int iend)
+{
+    osg::BoundingBox centerBounds;
+    for(int i=istart; i<iend; ++i)
+    {
+        centerBounds.expandBy(_centers[_primitiveIndices[i]]);
+    }
+
+    float bestCost = FLT_MAX;
+    int bestAxis = -1;
+    int bestBin = 0;
+
+    for(int axis=0; axis<3; ++axis)
+    {
+        float extent = centerBounds._max[axis]-centerBounds._min[axis];
+        if (extent<=0.0f) continue;
+
+        float scale = float(SAH_NUM_BINS)/extent;
+
+        unsigned int binCounts[SAH_NUM_BINS];
+        osg::BoundingBox binBounds[SAH_NUM_BINS];
+        for(int b=0; b<SAH_NUM_BINS; ++b) binCounts[b] = 0;
+
+        for(int i=istart; i<iend; ++i)
+        {
+            unsigned int index = _primitiveIndices[i];
+            int bin = static_cast<int>((_centers[index][axis]-centerBounds._min[axis])*scale);
+            if (bin>=SAH_NUM_BINS) bin = SAH_NUM_BINS-1;
+            ++binCounts[bin];
+            binBounds[bin].expandBy(_bounds[index]);
+        }
+
+        // sweep from the right to get the cost of each candidate right hand side
+        float rightCosts[SAH_NUM_BINS];
+        osg::BoundingBox rightBounds;
+        unsigned int rightCount = 0;
+        for(int b=SAH_NUM_BINS-1; b>0; --b)
+        {
+            rightBounds.expandBy(binBounds[b]);
+            rightCount += binCounts[b];
+            rightCosts[b] = halfSurfaceArea(rightBounds)*float(rightCount);
+        }
+
+        // sweep from the left, combining with the right hand side costs
+        osg::BoundingBox leftBounds;
+        unsigned int leftCount = 0;
+        for(int b=1; b<SAH_NUM_BINS; ++b)
+        {
+            leftBounds.expandBy(binBounds[b-1]);
+            leftCount += binCounts[b-1];
+            if (leftCount==0 || leftCount==static_cast<unsigned int>(iend-istart)) continue;
+
+            float cost = halfSurfaceArea(leftBounds)*float(leftCount) + rightCosts[b];
+            if (cost<bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin = b;
+            }
+        }
+    }
+
+    if (bestAxis<0)
+    {
+        // all centers coincide so no spatial split is possible, just halve the primitive range.
+        return istart + (iend-istart)/2;
+    }
+
+    float origin = centerBounds._min[bestAxis];
+    float scale = float(SAH_NUM_BINS)/(centerBounds._max[bestAxis]-origin);
+    Indices::iterator mid = std::partition(_primitiveIndices.begin()+istart, _primitiveIndices.begin()+iend,
+                                           CenterBelowSplit(_centers, bestAxis, origin, scale, bestBin));
+
+    return static_cast<int>(mid-_primitiveIndices.begin());
+}
+
+void BuildKdTree::divideSAH(const KdTree::BuildOptions& options, KdTree::KdNodeList& nodes, int istart, int iend, unsigned int level, unsigned int numThreads)
+{
+    int nodeIndex = static_cast<int>(nodes.size());
+    nodes.push_back(KdTree::KdNode(-istart-1, iend-istart));
+
+    int numPrimitives = iend-istart;
+    bool needToDivide = level<options._maxNumLevels && static_cast<unsigned int>(numPrimitives)>options._targetNumTrianglesPerLeaf;
+
+    int mid = needToDivide ? partitionSAH(istart, iend) : istart;
+    if (mid<=istart || mid>=iend)
+    {
+        computeLeafBound(nodes[nodeIndex]);
+        return;
+    }
+
+    // first child always directly follows its parent so the tree is laid out depth first.
+    int leftChildIndex = nodeIndex+1;
+    int rightChildIndex = 0;
+
+    bool builtRightInThread = false;
+    if (numThreads>1 && (iend-mid)>=SAH_MIN_PRIMITIVES_PER_THREAD)
+    {
+        unsigned int numLeftThreads = numThreads/2;
+        BuildSubTreeThread rightThread(*this, options, mid, iend, level+1, numThreads-numLeftThreads);
+        if (rightThread.start()==0)
+        {
+            divideSAH(options, nodes, istart, mid, level+1, numLeftThreads);
+
+            rightThread.join();
+
+            // append the right sub tree, offsetting its internal node references.
+            rightChildIndex = static_cast<int>(nodes.size());
+            for(KdTree::KdNodeList::iterator itr = rightThread._nodes.begin();
+                itr != rightThread._nodes.end();
+                ++itr)
+            {
+                if (itr->first>0) itr->first += rightChildIndex;
+                if (itr->first>=0 && itr->second>0) itr->second += rightChildIndex;
+                nodes.push_back(*itr);
+            }
+
+            builtRightInThread = true;
+        }
+    }
+
+    if (!builtRightInThread)
+    {
+        divideSAH(options, nodes, istart, mid, level+1, 1);
+        rightChildIndex = static_cast<int>(nodes.size());
+        divideSAH(options, nodes, mid, iend, level+1, 1);
+    }
+
+    // take a fresh reference as the recursion above will have resized the node list.
+    KdTree::KdNode& node = nodes[nodeIndex];
+    node.first = leftChildIndex;
+    node.second = rightChildIndex;
+    node.bb.init();
+    node.bb.expandBy(nodes[leftChildIndex].bb);
+    node.bb.expandBy(nodes[rightChildIndex].bb);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Compact node layout
+
+struct BuildCompactKdNodes
+{
+    BuildCompactKdNodes(const KdTree::KdNodeList& nodes, KdTree::CompactKdNodeList& compactNodes):
+        _nodes(nodes),
+        _compactNodes(compactNodes) {}
+
+    // quantize the value relative to the parent's range, rounding down for minimum values and up for maximum values
+    // with the result checked against the same decoding that the traversal uses so the decoded bounds are always conservative.
+    static unsigned char quantize(float value, float parentMin, float parentMax, bool roundUp)
+    {
+        float step = (parentMax-parentMin)*(1.0f/255.0f);
+        if (step<=0.0f) return roundUp ? 255 : 0;
+
+        float q = (value-parentMin)/step;
+        int qi = roundUp ? static_cast<int>(ceilf(q)) : static_cast<int>(floorf(q));
+        if (qi<0) qi = 0;
+        if (qi>255) qi = 255;
+
+        if (roundUp) { while(qi<255 && parentMin+step*float(qi)<value) ++qi; }
+        else { while(qi>0 && parentMin+step*float(qi)>value) --qi; }
+
+        return static_cast<unsigned char>(qi);
+    }
+
+    unsigned int add(int nodeIndex, const osg::BoundingBox* parentBB)
+    {
+        const KdTree::KdNode& node = _nodes[nodeIndex];
+
+        unsigned int compactIndex = static_cast<unsigned int>(_compactNodes.size());
+        _compactNodes.push_back(KdTree::CompactKdNode());
+
+        osg::BoundingBox bb = node.bb;
+        if (parentBB)
+        {
+            KdTree::CompactKdNode& cn = _compactNodes.back();
+            for(int axis=0; axis<3; ++axis)
+            {
+                cn.qmin[axis] = quantize(node.bb._min[axis], parentBB->_min[axis], parentBB->_max[axis], false);
+                cn.qmax[axis] = quantize(node.bb._max[axis], parentBB->_min[axis], parentBB->_max[axis], true);
+            }
+            bb = cn.decodeBoundingBox(*parentBB);
+        }
+
+        if (node.first<0)
+        {
+            KdTree::CompactKdNode& cn = _compactNodes[compactIndex];
+            cn.flags = KdTree::CompactKdNode::LEAF;
+            cn.first = static_cast<unsigned int>(-node.first-1);
+            cn.second = static_cast<unsigned int>(node.second);
+            return compactIndex;
+        }
+
+        unsigned short flags = 0;
+        unsigned int secondIndex = 0;
+
+        if (node.first>0)
+        {
+            flags |= KdTree::CompactKdNode::HAS_FIRST_CHILD;
+            add(node.first, &bb);
+        }
+
+        if (node.second>0)
+        {
+            if (node.first>0)
+            {
+                flags |= KdTree::CompactKdNode::HAS_SECOND_CHILD;
+                secondIndex = add(node.second, &bb);
+            }
+            else
+            {
+                // a lone second child still directly follows its parent
+                flags |= KdTree::CompactKdNode::HAS_FIRST_CHILD;
+                add(node.second, &bb);
+            }
+        }
+
+        KdTree::CompactKdNode& cn = _compactNodes[compactIndex];
+        cn.flags = flags;
+        cn.first = secondIndex;
+        return compactIndex;
+    }
+
+    const KdTree::KdNodeList&       _nodes;
+    KdTree::CompactKdNodeList&      _compactNodes;
+
+protected:
+
+    BuildCompactKdNodes& operator = (const BuildCompactKdNodes&) { return *this; }
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // KdTree::BuildOptions
@@ -476,7 +814,10 @@ int BuildKdTree::divide(KdTree::BuildOptions& options, osg::BoundingBox& bb, int
 KdTree::BuildOptions::BuildOptions():
         _numVerticesProcessed(0),
         _targetNumTrianglesPerLeaf(4),
-        _maxNumLevels(32)
+        _maxNumLevels(32),
+        _buildStrategy(MEDIAN_SPLIT),
+        _nodeLayout(STANDARD_NODE_LAYOUT),
+        _numThreads(0)
 {
 }
 
@@ -492,14 +833,38 @@ KdTree::KdTree(const KdTree& rhs, const osg::CopyOp& copyop):
     Shape(rhs, copyop),
     _degenerateCount(rhs._degenerateCount),
     _vertices(rhs._vertices),
-    _kdNodes(rhs._kdNodes)
+    _kdNodes(rhs._kdNodes),
+    _compactKdNodes(rhs._compactKdNodes)
 {
 }
 
 bool KdTree::build(BuildOptions& options, osg::Geometry* geometry)
 {
     BuildKdTree build(*this);
-    return build.build(options, geometry);
+    if (!build.build(options, geometry)) return false;
+
+    if (options._nodeLayout==BuildOptions::COMPACT_NODE_LAYOUT) compactNodes();
+
+    return true;
+}
+
+void KdTree::compactNodes()
+{
+    _compactKdNodes.clear();
+    if (_kdNodes.empty()) return;
+
+    CompactKdNodeList compactNodes;
+    compactNodes.reserve(_kdNodes.size());
+
+    BuildCompactKdNodes builder(_kdNodes, compactNodes);
+    builder.add(0, 0);
+
+    _compactKdNodes.swap(compactNodes);
+
+    // retain just the bounds of the root node, which intersect() uses as the start of the compact traversal.
+    KdNode root(0, 0);
+    root.bb = _kdNodes.front().bb;
+    KdNodeList(1, root).swap(_kdNodes);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -14,8 +14,103 @@
 #include <osg/Polytope>
 #include <osg/Notify>
 
+#if !defined(OSG_USE_FLOAT_PLANE) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2))
+    #include <emmintrin.h>
+    #define POLYTOPE_USE_SSE2
+#endif
+
 using namespace osg;
 
+void Polytope::contains(unsigned int num, const float* x, const float* y, const float* z, const float* radius, ClippingMask* resultMasks, unsigned char* contained) const
+{
+    const ClippingMask mask = _maskStack.back();
+    if (!mask)
+    {
+        for(unsigned int i=0; i<num; ++i)
+        {
+            resultMasks[i] = _resultMask;
+            contained[i] = 1;
+        }
+        return;
+    }
+
+    unsigned int i = 0;
+
+#ifdef POLYTOPE_USE_SSE2
+    // test pairs of spheres at a time, using the same double precision operations in the same order as Plane::distance()
+    // so that the results are identical to those of contains(bs).
+    for(; i+2<=num; i+=2)
+    {
+        __m128d cx = _mm_cvtps_pd(_mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64*>(x+i)));
+        __m128d cy = _mm_cvtps_pd(_mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64*>(y+i)));
+        __m128d cz = _mm_cvtps_pd(_mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64*>(z+i)));
+        __m128d r = _mm_cvtps_pd(_mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64*>(radius+i)));
+        __m128d negative_r = _mm_sub_pd(_mm_setzero_pd(), r);
+
+        ClippingMask mask0 = mask;
+        ClippingMask mask1 = mask;
+        int outside = 0;
+
+        ClippingMask selector_mask = 0x1;
+        for(PlaneList::const_iterator itr=_planeList.begin();
+            itr!=_planeList.end() && outside!=3;
+            ++itr)
+        {
+            if (mask&selector_mask)
+            {
+                Plane::Vec4_type v = itr->asVec4();
+                __m128d d = _mm_add_pd(_mm_mul_pd(_mm_set1_pd(v[0]), cx), _mm_mul_pd(_mm_set1_pd(v[1]), cy));
+                d = _mm_add_pd(d, _mm_mul_pd(_mm_set1_pd(v[2]), cz));
+                d = _mm_add_pd(d, _mm_set1_pd(v[3]));
+
+                // Plane::intersect() holds the distance in a float before comparing it with the radius.
+                d = _mm_cvtps_pd(_mm_cvtpd_ps(d));
+
+                // planes that a sphere is completely above don't need to be tested against its children,
+                // the above test takes precedence as in Plane::intersect() so invalid spheres behave the same.
+                __m128d above_d = _mm_cmpgt_pd(d, r);
+                outside |= _mm_movemask_pd(_mm_andnot_pd(above_d, _mm_cmplt_pd(d, negative_r)));
+
+                int above = _mm_movemask_pd(above_d);
+                if (above&1) mask0 &= ~selector_mask;
+                if (above&2) mask1 &= ~selector_mask;
+            }
+            selector_mask <<= 1;
+        }
+
+        resultMasks[i] = mask0;
+        resultMasks[i+1] = mask1;
+        contained[i] = (outside&1) ? 0 : 1;
+        contained[i+1] = (outside&2) ? 0 : 1;
+    }
+#endif
+
+    for(; i<num; ++i)
+    {
+        BoundingSphere bs(Vec3(x[i], y[i], z[i]), radius[i]);
+
+        ClippingMask resultMask = mask;
+        unsigned char result = 1;
+
+        ClippingMask selector_mask = 0x1;
+        for(PlaneList::const_iterator itr=_planeList.begin();
+            itr!=_planeList.end();
+            ++itr)
+        {
+            if (resultMask&selector_mask)
+            {
+                int res=itr->intersect(bs);
+                if (res<0) { result = 0; break; }
+                else if (res>0) resultMask ^= selector_mask;
+            }
+            selector_mask <<= 1;
+        }
+
+        resultMasks[i] = resultMask;
+        contained[i] = result;
+    }
+}
+
 bool Polytope::contains(const osg::Vec3f& v0, const osg::Vec3f& v1, const osg::Vec3f& v2) const
 {
     if (!_maskStack.back()) return true;
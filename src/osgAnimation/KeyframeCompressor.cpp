@@ -0,0 +1,191 @@
+/*  -*-c++-*-
+ *
+ * This library is open source and may be redistributed and/or modified under
+ * the terms of the OpenSceneGraph Public License (OSGPL) version 0.0 or
+ * (at your option) any later version.  The full license is in LICENSE file
+ * included with this distribution, and on the openscenegraph.org website.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * OpenSceneGraph Public License for more details.
+ */
+
+#include <osgAnimation/KeyframeCompressor>
+
+using namespace osgAnimation;
+
+namespace
+{
+    // The largest number of keys a single interpolated span may replace, bounding the cost of reducing long runs of
+    // keys that interpolate exactly.
+    const unsigned int s_maximumSpan = 256;
+
+    // An upper bound of the angle by which packing a quaternion in 48 bits rotates it, from the error of half a
+    // step of 15 bits in each of the three components kept and of the one rebuilt from them.
+    const double s_quatPackingError = 2.0e-4;
+
+    struct Vec3Lerp
+    {
+        static osg::Vec3 interpolate(const osg::Vec3& v1, const osg::Vec3& v2, float blend) { return v1*(1-blend) + v2*blend; }
+        static double distance(const osg::Vec3& v1, const osg::Vec3& v2) { return (v1-v2).length(); }
+    };
+
+    struct QuatSlerp
+    {
+        static osg::Quat interpolate(const osg::Quat& q1, const osg::Quat& q2, float blend) { osg::Quat result; result.slerp(blend, q1, q2); return result; }
+        static double distance(const osg::Quat& q1, const osg::Quat& q2)
+        {
+            double length = q1.length() * q2.length();
+            if (length == 0.0) return 0.0;
+            double cosHalfAngle = osg::minimum(fabs(q1.asVec4() * q2.asVec4()) / length, 1.0);
+            return 2.0 * acos(cosHalfAngle);
+        }
+    };
+
+    // Greedily extends each span from the last key kept for as long as interpolating across it stays within
+    // tolerance of the keys it skips, blending as the interpolators do.
+    template<class T, class Method>
+    unsigned int reduceKeyframes(TemplateKeyframeContainer<T>& keys, double tolerance)
+    {
+        unsigned int numKeys = keys.size();
+        if (numKeys <= 2) return 0;
+
+        typename TemplateKeyframeContainer<T>::VectorType reduced;
+        reduced.push_back(keys[0]);
+
+        unsigned int start = 0;
+        while(start+1 < numKeys)
+        {
+            unsigned int end = start+1;
+            unsigned int limit = osg::minimum(start + s_maximumSpan + 1, numKeys-1);
+            for(unsigned int candidate = start+2; candidate <= limit; ++candidate)
+            {
+                double startTime = keys[start].getTime();
+                double duration = keys[candidate].getTime() - startTime;
+                bool fits = duration > 0.0;
+                for(unsigned int i = start+1; fits && i < candidate; ++i)
+                {
+                    float blend = (keys[i].getTime() - startTime) / duration;
+                    T value = Method::interpolate(keys[start].getValue(), keys[candidate].getValue(), blend);
+                    fits = Method::distance(value, keys[i].getValue()) <= tolerance;
+                }
+                if (!fits) break;
+                end = candidate;
+            }
+            reduced.push_back(keys[end]);
+            start = end;
+        }
+
+        unsigned int count = numKeys - reduced.size();
+        keys.swap(reduced);
+        return count;
+    }
+}
+
+KeyframeCompressor::KeyframeCompressor(double translationTolerance, double rotationTolerance):
+    _translationTolerance(translationTolerance),
+    _rotationTolerance(rotationTolerance)
+{
+}
+
+unsigned int KeyframeCompressor::reduce(Vec3KeyframeContainer& keys, double tolerance)
+{
+    return reduceKeyframes<osg::Vec3, Vec3Lerp>(keys, tolerance);
+}
+
+unsigned int KeyframeCompressor::reduce(QuatKeyframeContainer& keys, double tolerance)
+{
+    return reduceKeyframes<osg::Quat, QuatSlerp>(keys, tolerance);
+}
+
+Channel* KeyframeCompressor::compress(Channel& channel) const
+{
+    if (Vec3LinearChannel* vec3Channel = dynamic_cast<Vec3LinearChannel*>(&channel))
+    {
+        const Vec3KeyframeContainer* source = vec3Channel->getSamplerTyped() ? vec3Channel->getSamplerTyped()->getKeyframeContainerTyped() : 0;
+        if (!source || source->empty()) return 0;
+
+        osg::ref_ptr<Vec3KeyframeContainer> keys = new Vec3KeyframeContainer;
+        keys->VectorType::operator=(*source);
+
+        // packing moves the keys by up to half a step of the bounding box split in 2048, 2048 and 1024
+        std::vector<osg::Vec3> values;
+        values.reserve(keys->size());
+        for(Vec3KeyframeContainer::const_iterator itr = keys->begin(); itr != keys->end(); ++itr)
+            values.push_back(itr->getValue());
+        Vec3ArrayPacked packing;
+        packing.analyze(values);
+        double packingError = packing.mScale.length() * 0.5;
+
+        if (packingError >= _translationTolerance)
+        {
+            reduce(*keys, _translationTolerance);
+
+            Vec3LinearChannel* reduced = new Vec3LinearChannel(new Vec3LinearSampler, vec3Channel->getTargetTyped());
+            reduced->setName(channel.getName());
+            reduced->setTargetName(channel.getTargetName());
+            reduced->getSamplerTyped()->setKeyframeContainer(keys.get());
+            return reduced;
+        }
+
+        reduce(*keys, _translationTolerance - packingError);
+
+        Vec3PackedLinearChannel* compressed = new Vec3PackedLinearChannel(new Vec3PackedLinearSampler, vec3Channel->getTargetTyped());
+        compressed->setName(channel.getName());
+        compressed->setTargetName(channel.getTargetName());
+        compressed->getSamplerTyped()->getOrCreateKeyframeContainer()->compress(*keys);
+        return compressed;
+    }
+
+    if (QuatSphericalLinearChannel* quatChannel = dynamic_cast<QuatSphericalLinearChannel*>(&channel))
+    {
+        const QuatKeyframeContainer* source = quatChannel->getSamplerTyped() ? quatChannel->getSamplerTyped()->getKeyframeContainerTyped() : 0;
+        if (!source || source->empty()) return 0;
+
+        osg::ref_ptr<QuatKeyframeContainer> keys = new QuatKeyframeContainer;
+        keys->VectorType::operator=(*source);
+
+        if (s_quatPackingError >= _rotationTolerance)
+        {
+            reduce(*keys, _rotationTolerance);
+
+            QuatSphericalLinearChannel* reduced = new QuatSphericalLinearChannel(new QuatSphericalLinearSampler, quatChannel->getTargetTyped());
+            reduced->setName(channel.getName());
+            reduced->setTargetName(channel.getTargetName());
+            reduced->getSamplerTyped()->setKeyframeContainer(keys.get());
+            return reduced;
+        }
+
+        reduce(*keys, _rotationTolerance - s_quatPackingError);
+
+        QuatPackedSphericalLinearChannel* compressed = new QuatPackedSphericalLinearChannel(new QuatPackedSphericalLinearSampler, quatChannel->getTargetTyped());
+        compressed->setName(channel.getName());
+        compressed->setTargetName(channel.getTargetName());
+        QuatPackedKeyframeContainer* packed = compressed->getSamplerTyped()->getOrCreateKeyframeContainer();
+        packed->reserve(keys->size());
+        for(QuatKeyframeContainer::const_iterator itr = keys->begin(); itr != keys->end(); ++itr)
+        {
+            packed->addKeyframe(itr->getTime(), QuatPacked(itr->getValue()));
+        }
+        return compressed;
+    }
+
+    return 0;
+}
+
+unsigned int KeyframeCompressor::compress(Animation& animation) const
+{
+    unsigned int count = 0;
+    ChannelList& channels = animation.getChannels();
+    for(ChannelList::iterator itr = channels.begin(); itr != channels.end(); ++itr)
+    {
+        osg::ref_ptr<Channel> compressed = compress(**itr);
+        if (compressed.valid())
+        {
+            *itr = compressed;
+            ++count;
+        }
+    }
+    return count;
+}
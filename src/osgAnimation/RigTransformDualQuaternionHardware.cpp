@@ -0,0 +1,136 @@
+/*  -*-c++-*-
+ *
+ * This library is open source and may be redistributed and/or modified under
+ * the terms of the OpenSceneGraph Public License (OSGPL) version 0.0 or
+ * (at your option) any later version.  The full license is in LICENSE file
+ * included with this distribution, and on the openscenegraph.org website.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * OpenSceneGraph Public License for more details.
+ */
+
+#include <osgAnimation/RigTransformDualQuaternionHardware>
+#include <osgAnimation/DualQuaternion>
+#include <osgAnimation/RigGeometry>
+#include <osgDB/ReadFile>
+
+using namespace osgAnimation;
+
+// Blends the dual quaternions of up to 8 bones, 2 per boneWeight attribute as vec4(boneIndex0, weight0, boneIndex1, weight1),
+// bringing the rotations into the hemisphere of the first bone, and transforms the vertex and normal by the normalized blend.
+static const char* s_defaultVertexShaderSource =
+    "#version 120\n"
+    "uniform vec4 dualQuaternionPalette[2*MAX_MATRIX];\n"
+    "uniform int nbBonesPerVertex;\n"
+    "attribute vec4 boneWeight0;\n"
+    "attribute vec4 boneWeight1;\n"
+    "attribute vec4 boneWeight2;\n"
+    "attribute vec4 boneWeight3;\n"
+    "\n"
+    "vec4 blendReal;\n"
+    "vec4 blendDual;\n"
+    "\n"
+    "void accumulateDualQuaternions(vec4 boneWeight)\n"
+    "{\n"
+    "    for (int i = 0; i < 2; i++)\n"
+    "    {\n"
+    "        int index = int(boneWeight[0]);\n"
+    "        float weight = boneWeight[1];\n"
+    "        vec4 real = dualQuaternionPalette[2*index];\n"
+    "        vec4 dual = dualQuaternionPalette[2*index+1];\n"
+    "        if (dot(blendReal, real) < 0.0) weight = -weight;\n"
+    "        blendReal += weight * real;\n"
+    "        blendDual += weight * dual;\n"
+    "        boneWeight = boneWeight.zwxy;\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "void main( void )\n"
+    "{\n"
+    "    blendReal = vec4(0.0, 0.0, 0.0, 0.0);\n"
+    "    blendDual = vec4(0.0, 0.0, 0.0, 0.0);\n"
+    "    if (nbBonesPerVertex > 0)\n"
+    "        accumulateDualQuaternions(boneWeight0);\n"
+    "    if (nbBonesPerVertex > 2)\n"
+    "        accumulateDualQuaternions(boneWeight1);\n"
+    "    if (nbBonesPerVertex > 4)\n"
+    "        accumulateDualQuaternions(boneWeight2);\n"
+    "    if (nbBonesPerVertex > 6)\n"
+    "        accumulateDualQuaternions(boneWeight3);\n"
+    "\n"
+    "    float blendLength = length(blendReal);\n"
+    "    vec4 real = blendReal / blendLength;\n"
+    "    vec4 dual = blendDual / blendLength;\n"
+    "\n"
+    "    vec3 translation = 2.0 * (real.w * dual.xyz - dual.w * real.xyz + cross(real.xyz, dual.xyz));\n"
+    "    vec3 position = gl_Vertex.xyz + 2.0 * cross(real.xyz, cross(real.xyz, gl_Vertex.xyz) + real.w * gl_Vertex.xyz) + translation * gl_Vertex.w;\n"
+    "    vec3 normal = gl_Normal + 2.0 * cross(real.xyz, cross(real.xyz, gl_Normal) + real.w * gl_Normal);\n"
+    "\n"
+    "    normal = normalize(gl_NormalMatrix * normal);\n"
+    "    vec3 lightDir = normalize(vec3(gl_LightSource[0].position));\n"
+    "    float NdotL = max(dot(normal, lightDir), 0.0);\n"
+    "    gl_FrontColor = vec4(gl_Color.rgb * (gl_LightModel.ambient.rgb + NdotL * gl_LightSource[0].diffuse.rgb), gl_Color.a);\n"
+    "    gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+    "    gl_Position = gl_ModelViewProjectionMatrix * vec4(position, gl_Vertex.w);\n"
+    "}\n";
+
+RigTransformDualQuaternionHardware::RigTransformDualQuaternionHardware()
+{
+}
+
+RigTransformDualQuaternionHardware::RigTransformDualQuaternionHardware(const RigTransformDualQuaternionHardware& rth, const osg::CopyOp& copyop):
+    RigTransformHardware(rth, copyop),
+    _uniformDualQuaternionPalette(rth._uniformDualQuaternionPalette)
+{
+}
+
+void RigTransformDualQuaternionHardware::computeDualQuaternionPaletteUniform(const osg::Matrix& transformFromSkeletonToGeometry, const osg::Matrix& invTransformFromSkeletonToGeometry)
+{
+    for (unsigned int i = 0; i <  _bonePalette.size(); ++i)
+    {
+        const Bone* bone = _bonePalette[i].get();
+        const osg::Matrix& invBindMatrix = bone->getInvBindMatrixInSkeletonSpace();
+        const osg::Matrix& boneMatrix = bone->getMatrixInSkeletonSpace();
+        DualQuaternion dq(transformFromSkeletonToGeometry * invBindMatrix * boneMatrix * invTransformFromSkeletonToGeometry);
+        if (!_uniformDualQuaternionPalette->setElement(2*i, osg::Vec4(dq.getReal().asVec4())) ||
+            !_uniformDualQuaternionPalette->setElement(2*i+1, osg::Vec4(dq.getDual().asVec4())))
+            OSG_WARN << "RigTransformDualQuaternionHardware::computeDualQuaternionPaletteUniform can't set uniform at " << i << " elements" << std::endl;
+    }
+}
+
+bool RigTransformDualQuaternionHardware::init(RigGeometry& rig)
+{
+    // RigTransformHardware::init() replaces MAX_MATRIX in the source of the shader, so the default shader is only set for
+    // the call, the next init starting from the original source again
+    osg::ref_ptr<osg::Shader> shader = _shader;
+    if (!_shader.valid() && !_perVertexInfluences.empty())
+    {
+        _shader = osgDB::readRefShaderFile(osg::Shader::VERTEX, "skinningDualQuaternion.vert");
+        if (!_shader.valid()) _shader = new osg::Shader(osg::Shader::VERTEX, s_defaultVertexShaderSource);
+    }
+
+    bool result = RigTransformHardware::init(rig);
+    _shader = shader;
+    if (!result)
+        return false;
+
+    // replace the matrix palette set up by RigTransformHardware by the dual quaternion palette
+    _uniformDualQuaternionPalette = new osg::Uniform(osg::Uniform::FLOAT_VEC4, "dualQuaternionPalette", 2*_bonePalette.size());
+
+    osg::StateSet* stateset = rig.getOrCreateStateSet();
+    stateset->removeUniform("matrixPalette");
+    stateset->removeUniform("dualQuaternionPalette");
+    stateset->addUniform(_uniformDualQuaternionPalette.get());
+
+    return true;
+}
+
+void RigTransformDualQuaternionHardware::operator()(RigGeometry& geom)
+{
+    if (_needInit)
+        if (!init(geom))
+            return;
+    computeDualQuaternionPaletteUniform(geom.getMatrixFromSkeletonToGeometry(), geom.getInvMatrixFromSkeletonToGeometry());
+}
@@ -0,0 +1,71 @@
+/*  -*-c++-*-
+ *
+ * This library is open source and may be redistributed and/or modified under
+ * the terms of the OpenSceneGraph Public License (OSGPL) version 0.0 or
+ * (at your option) any later version.  The full license is in LICENSE file
+ * included with this distribution, and on the openscenegraph.org website.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * OpenSceneGraph Public License for more details.
+ */
+
+#include <osgAnimation/RigTransformDualQuaternionSoftware>
+#include <osgAnimation/RigGeometry>
+
+#include <algorithm>
+
+using namespace osgAnimation;
+
+RigTransformDualQuaternionSoftware::RigTransformDualQuaternionSoftware()
+{
+}
+
+RigTransformDualQuaternionSoftware::RigTransformDualQuaternionSoftware(const RigTransformDualQuaternionSoftware& rts, const osg::CopyOp& copyop):
+    RigTransformSoftware(rts, copyop)
+{
+}
+
+void RigTransformDualQuaternionSoftware::computeGroupMatrices(const osg::Matrix& transform, const osg::Matrix& invTransform)
+{
+    _boneDualQuaternions.resize(_boneMatrixComputed.size());
+    std::fill(_boneMatrixComputed.begin(), _boneMatrixComputed.end(), 0);
+
+    for(unsigned int g = 0; g < _uniqVertexGroupList.size(); ++g)
+    {
+        VertexGroup& uniq = _uniqVertexGroupList[g];
+        BonePtrWeightList& boneWeights = uniq.getBoneWeights();
+        if (boneWeights.empty())
+        {
+            uniq.computeMatrixForVertexSet();
+            _groupMatrices[g] = transform * uniq.getMatrix() * invTransform;
+            continue;
+        }
+
+        // the bones are blended in the space of the geometry, as a blend of rigid transformations can't be moved
+        // into another space afterwards as a blend of matrices can
+        DualQuaternion blend;
+        blend.clear();
+        const DualQuaternion* reference = 0;
+        for(BonePtrWeightList::iterator bwit = boneWeights.begin(); bwit != boneWeights.end(); ++bwit)
+        {
+            const Bone* bone = bwit->getBonePtr();
+            if (!bone)
+            {
+                osg::notify(osg::WARN) << &uniq << " RigTransformDualQuaternionSoftware::computeGroupMatrices Warning a bone is null, skip it" << std::endl;
+                continue;
+            }
+            unsigned int id = bwit->getBoneID();
+            if (!_boneMatrixComputed[id])
+            {
+                _boneDualQuaternions[id].set(transform * bone->getInvBindMatrixInSkeletonSpace() * bone->getMatrixInSkeletonSpace() * invTransform);
+                _boneMatrixComputed[id] = 1;
+            }
+            // the bone weights are sorted by decreasing weight, so the rotations are brought into the hemisphere of the heaviest
+            if (!reference) reference = &_boneDualQuaternions[id];
+            blend.accumulate(_boneDualQuaternions[id], *reference, bwit->getWeight());
+        }
+        _groupMatrices[g] = blend.getMatrix();
+    }
+}
@@ -19,10 +19,81 @@
 #include <osgAnimation/BoneMapVisitor>
 #include <osgAnimation/RigGeometry>
 
+#include <osgUtil/TaskThreadPool>
+#include <OpenThreads/Atomic>
+#include <OpenThreads/Thread>
+#include <OpenThreads/Mutex>
+#include <OpenThreads/ScopedLock>
+
 #include <algorithm>
+#include <map>
+#include <set>
+
+#if !defined(OSG_USE_FLOAT_MATRIX) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2))
+    #include <emmintrin.h>
+    #define RIGTRANSFORMSOFTWARE_USE_SSE2
+#endif
 
 using namespace osgAnimation;
 
+namespace
+{
+    // Transforms the vertices of a group by its matrix, positions as src*matrix and normals as transform3x3(src,matrix).
+    // With SSE2 the vertices are transformed two at a time, gathered into the lanes of registers holding their x, y and
+    // z, with the products and sums done in double precision in the same order as osg::Matrixd, so that the results
+    // are the same as the scalar code. Positions are only transformed this way when the matrix has no projective part,
+    // as preMult() then divides by exactly 1.
+    template<bool Normal>
+    void transformVertices(const osg::Matrix& matrix, const IndexList& indices, const osg::Vec3* src, osg::Vec3* dst)
+    {
+        unsigned int numIndices = indices.size();
+        unsigned int i = 0;
+
+#ifdef RIGTRANSFORMSOFTWARE_USE_SSE2
+        const osg::Matrix::value_type* m = matrix.ptr();
+        if (Normal || (m[3]==0.0 && m[7]==0.0 && m[11]==0.0 && m[15]==1.0))
+        {
+            const __m128d m00 = _mm_set1_pd(m[0]), m01 = _mm_set1_pd(m[1]), m02 = _mm_set1_pd(m[2]);
+            const __m128d m10 = _mm_set1_pd(m[4]), m11 = _mm_set1_pd(m[5]), m12 = _mm_set1_pd(m[6]);
+            const __m128d m20 = _mm_set1_pd(m[8]), m21 = _mm_set1_pd(m[9]), m22 = _mm_set1_pd(m[10]);
+            const __m128d m30 = _mm_set1_pd(m[12]), m31 = _mm_set1_pd(m[13]), m32 = _mm_set1_pd(m[14]);
+
+            float result[8];
+            for(; i+1<numIndices; i+=2)
+            {
+                const osg::Vec3& v0 = src[indices[i]];
+                const osg::Vec3& v1 = src[indices[i+1]];
+                __m128d x = _mm_set_pd(v1.x(), v0.x());
+                __m128d y = _mm_set_pd(v1.y(), v0.y());
+                __m128d z = _mm_set_pd(v1.z(), v0.z());
+
+                __m128d rx = _mm_add_pd(_mm_add_pd(_mm_mul_pd(m00, x), _mm_mul_pd(m10, y)), _mm_mul_pd(m20, z));
+                __m128d ry = _mm_add_pd(_mm_add_pd(_mm_mul_pd(m01, x), _mm_mul_pd(m11, y)), _mm_mul_pd(m21, z));
+                __m128d rz = _mm_add_pd(_mm_add_pd(_mm_mul_pd(m02, x), _mm_mul_pd(m12, y)), _mm_mul_pd(m22, z));
+                if (!Normal)
+                {
+                    rx = _mm_add_pd(rx, m30);
+                    ry = _mm_add_pd(ry, m31);
+                    rz = _mm_add_pd(rz, m32);
+                }
+
+                // result holds x0, x1, y0, y1, z0, z1
+                _mm_storeu_ps(result, _mm_movelh_ps(_mm_cvtpd_ps(rx), _mm_cvtpd_ps(ry)));
+                _mm_storeu_ps(result+4, _mm_cvtpd_ps(rz));
+                dst[indices[i]].set(result[0], result[2], result[4]);
+                dst[indices[i+1]].set(result[1], result[3], result[5]);
+            }
+        }
+#endif
+
+        for(; i<numIndices; ++i)
+        {
+            unsigned int index = indices[i];
+            dst[index] = Normal ? osg::Matrix::transform3x3(src[index], matrix) : src[index] * matrix;
+        }
+    }
+}
+
 RigTransformSoftware::RigTransformSoftware()
 {
     _needInit = true;
@@ -203,6 +274,10 @@ bool RigTransformSoftware::init(RigGeometry&rig)
         itvg->normalize();
     }
 
+    _boneMatrices.resize(localid2bone.size());
+    _boneMatrixComputed.resize(localid2bone.size());
+    _groupMatrices.resize(_uniqVertexGroupList.size());
+
     _needInit = false;
 
     return true;
@@ -229,16 +304,44 @@ void RigTransformSoftware::VertexGroup::normalize()
     }
 }
 
-void RigTransformSoftware::operator()(RigGeometry& geom)
+void RigTransformSoftware::computeGroupMatrices(const osg::Matrix& transform, const osg::Matrix& invTransform)
 {
-    if (_needInit && !init(geom)) return;
+    std::fill(_boneMatrixComputed.begin(), _boneMatrixComputed.end(), 0);
 
-    if (!geom.getSourceGeometry())
+    for(unsigned int g = 0; g < _uniqVertexGroupList.size(); ++g)
     {
-        OSG_WARN << this << " RigTransformSoftware no source geometry found on RigGeometry" << std::endl;
-        return;
+        VertexGroup& uniq = _uniqVertexGroupList[g];
+        BonePtrWeightList& boneWeights = uniq.getBoneWeights();
+        if (boneWeights.empty())
+        {
+            uniq.computeMatrixForVertexSet();
+        }
+        else
+        {
+            uniq.resetMatrix();
+            for(BonePtrWeightList::iterator bwit = boneWeights.begin(); bwit != boneWeights.end(); ++bwit)
+            {
+                const Bone* bone = bwit->getBonePtr();
+                if (!bone)
+                {
+                    osg::notify(osg::WARN) << &uniq << " RigTransformSoftware::computeMatrixForVertexSet Warning a bone is null, skip it" << std::endl;
+                    continue;
+                }
+                unsigned int id = bwit->getBoneID();
+                if (!_boneMatrixComputed[id])
+                {
+                    _boneMatrices[id] = bone->getInvBindMatrixInSkeletonSpace() * bone->getMatrixInSkeletonSpace();
+                    _boneMatrixComputed[id] = 1;
+                }
+                uniq.accummulateMatrix(_boneMatrices[id], bwit->getWeight());
+            }
+        }
+        _groupMatrices[g] = transform * uniq.getMatrix() * invTransform;
     }
-    
+}
+
+void RigTransformSoftware::skin(RigGeometry& geom)
+{
     osg::Geometry& source = *geom.getSourceGeometry();
     osg::Geometry& destination = geom;
 
@@ -247,20 +350,202 @@ void RigTransformSoftware::operator()(RigGeometry& geom)
     osg::Vec3Array* normalSrc = dynamic_cast<osg::Vec3Array*>(source.getNormalArray());
     osg::Vec3Array* normalDst = static_cast<osg::Vec3Array*>(destination.getNormalArray());
 
+    // the matrix of each group is computed once and used for both the vertices and the normals
+    computeGroupMatrices(geom.getMatrixFromSkeletonToGeometry(), geom.getInvMatrixFromSkeletonToGeometry());
 
-    compute<osg::Vec3>(geom.getMatrixFromSkeletonToGeometry(),
-                       geom.getInvMatrixFromSkeletonToGeometry(),
-                       &positionSrc->front(),
-                       &positionDst->front());    
+    for(unsigned int g = 0; g < _uniqVertexGroupList.size(); ++g)
+    {
+        transformVertices<false>(_groupMatrices[g], _uniqVertexGroupList[g].getVertices(), &positionSrc->front(), &positionDst->front());
+    }
     positionDst->dirty();
 
-    if (normalSrc )
+    if (normalSrc)
     {
-        computeNormal<osg::Vec3>(geom.getMatrixFromSkeletonToGeometry(),
-                                 geom.getInvMatrixFromSkeletonToGeometry(),
-                                 &normalSrc->front(),
-                                 &normalDst->front());
+        for(unsigned int g = 0; g < _uniqVertexGroupList.size(); ++g)
+        {
+            transformVertices<true>(_groupMatrices[g], _uniqVertexGroupList[g].getVertices(), &normalSrc->front(), &normalDst->front());
+        }
         normalDst->dirty();
     }
+}
+
+void RigTransformSoftware::operator()(RigGeometry& geom)
+{
+    if (_needInit && !init(geom)) return;
+
+    if (!geom.getSourceGeometry())
+    {
+        OSG_WARN << this << " RigTransformSoftware no source geometry found on RigGeometry" << std::endl;
+        return;
+    }
+
+    if (ParallelRigTransformSoftwareCallback::defer(this, &geom)) return;
+
+    skin(geom);
+}
+
+namespace
+{
+    // The callbacks whose traversals are running, by thread, so that rigs reached by the traversal can be deferred to them.
+    typedef std::map<OpenThreads::Thread*, ParallelRigTransformSoftwareCallback*> CurrentCallbackMap;
+
+    OpenThreads::Mutex s_currentCallbackMutex;
+    CurrentCallbackMap s_currentCallbacks;
+
+    // The number of callback traversals running, checked without locking so that rigs outside of any traversal don't contend for the mutex.
+    OpenThreads::Atomic s_numCurrentCallbacks;
+
+    // Skins a range of the rigs collected by a ParallelRigTransformSoftwareCallback.
+    class SkinOperation : public osg::Operation
+    {
+    public:
+        typedef std::pair< osg::ref_ptr<RigTransformSoftware>, osg::ref_ptr<RigGeometry> > RigEntry;
+
+        SkinOperation(const RigEntry* begin, const RigEntry* end):
+            osg::Operation("SkinOperation", false),
+            _begin(begin),
+            _end(end) {}
+
+        virtual void operator () (osg::Object*)
+        {
+            for(const RigEntry* itr = _begin; itr != _end; ++itr)
+            {
+                itr->first->skin(*(itr->second));
+            }
+        }
+
+    protected:
+        const RigEntry*                     _begin;
+        const RigEntry*                     _end;
+    };
+}
+
+ParallelRigTransformSoftwareCallback::ParallelRigTransformSoftwareCallback(unsigned int numThreads):
+    _numThreads(numThreads)
+{
+}
+
+ParallelRigTransformSoftwareCallback::ParallelRigTransformSoftwareCallback(const ParallelRigTransformSoftwareCallback& cb, const osg::CopyOp& copyop):
+    osg::Object(cb, copyop),
+    osg::Callback(cb, copyop),
+    osg::NodeCallback(cb, copyop),
+    _numThreads(cb._numThreads)
+{
+}
+
+ParallelRigTransformSoftwareCallback::~ParallelRigTransformSoftwareCallback()
+{
+}
+
+bool ParallelRigTransformSoftwareCallback::defer(RigTransformSoftware* transform, RigGeometry* geom)
+{
+    if (s_numCurrentCallbacks == 0) return false;
+
+    ParallelRigTransformSoftwareCallback* callback = 0;
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(s_currentCallbackMutex);
+        if (s_currentCallbacks.empty()) return false;
+
+        CurrentCallbackMap::iterator itr = s_currentCallbacks.find(OpenThreads::Thread::CurrentThread());
+        if (itr == s_currentCallbacks.end()) return false;
+        callback = itr->second;
+    }
+
+    callback->_rigs.push_back(RigEntry(transform, geom));
+    return true;
+}
+
+void ParallelRigTransformSoftwareCallback::operator()(osg::Node* node, osg::NodeVisitor* nv)
+{
+    OpenThreads::Thread* thread = OpenThreads::Thread::CurrentThread();
+    ParallelRigTransformSoftwareCallback* previous = 0;
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(s_currentCallbackMutex);
+        ParallelRigTransformSoftwareCallback*& current = s_currentCallbacks[thread];
+        previous = current;
+        current = this;
+    }
+    ++s_numCurrentCallbacks;
+
+    traverse(node, nv);
+
+    --s_numCurrentCallbacks;
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(s_currentCallbackMutex);
+        if (previous) s_currentCallbacks[thread] = previous;
+        else s_currentCallbacks.erase(thread);
+    }
+
+    // the bones have all been updated by the traversal so the rigs can now be skinned
+    skin();
+    _rigs.clear();
+}
+
+void ParallelRigTransformSoftwareCallback::sortRigs()
+{
+    // a rig reached through several parents is skinned once, and rigs sharing a transform are kept
+    // next to each other so that they end up in the same range, as the transform caches its matrices.
+    std::set<RigGeometry*> geometries;
+    std::map<RigTransformSoftware*, unsigned int> transformGroups;
+    std::vector< std::pair<unsigned int, unsigned int> > order;
+    for(unsigned int i = 0; i < _rigs.size(); ++i)
+    {
+        if (!geometries.insert(_rigs[i].second.get()).second) continue;
+
+        unsigned int group = transformGroups.insert(std::make_pair(_rigs[i].first.get(), static_cast<unsigned int>(transformGroups.size()))).first->second;
+        order.push_back(std::make_pair(group, i));
+    }
+    std::sort(order.begin(), order.end());
+
+    RigList rigs;
+    rigs.reserve(order.size());
+    for(unsigned int i = 0; i < order.size(); ++i)
+    {
+        rigs.push_back(_rigs[order[i].second]);
+    }
+    _rigs.swap(rigs);
+}
+
+void ParallelRigTransformSoftwareCallback::skin()
+{
+    if (_rigs.empty()) return;
+
+    sortRigs();
+
+    osgUtil::TaskThreadPool* pool = osgUtil::TaskThreadPool::instance().get();
+    unsigned int numThreads = _numThreads > 0 ? _numThreads : pool->getNumThreads()+1;
+    numThreads = osg::minimum(numThreads, static_cast<unsigned int>(_rigs.size()));
+    if (numThreads <= 1)
+    {
+        SkinOperation operation(&_rigs.front(), &_rigs.front() + _rigs.size());
+        operation(0);
+        return;
+    }
+
+    // split the rigs into contiguous ranges of about the same number of vertices, never between rigs sharing
+    // a transform, which this thread and the pool's threads then skin.
+    std::vector<unsigned int> endVertex(_rigs.size());
+    unsigned int numVertices = 0;
+    for(unsigned int i = 0; i < _rigs.size(); ++i)
+    {
+        const osg::Array* vertices = _rigs[i].second->getVertexArray();
+        numVertices += vertices ? vertices->getNumElements() : 0;
+        endVertex[i] = numVertices;
+    }
+
+    osgUtil::TaskThreadPool::Tasks tasks;
+    const RigEntry* rigs = &_rigs.front();
+    unsigned int begin = 0;
+    for(unsigned int t = 0; t < numThreads-1; ++t)
+    {
+        unsigned int target = static_cast<unsigned int>(static_cast<double>(numVertices)*(t+1)/numThreads);
+        unsigned int end = std::lower_bound(endVertex.begin(), endVertex.end(), target) - endVertex.begin();
+        end = osg::minimum(osg::maximum(end, begin), static_cast<unsigned int>(_rigs.size()));
+        while(end > begin && end < _rigs.size() && _rigs[end].first == _rigs[end-1].first) ++end;
+        tasks.push_back(new SkinOperation(rigs + begin, rigs + end));
+        begin = end;
+    }
+    tasks.push_back(new SkinOperation(rigs + begin, rigs + _rigs.size()));
 
+    pool->run(tasks, numThreads);
 }
@@ -12,17 +12,21 @@
 */
 
 #include <osgDB/DatabasePager>
+#include <osgDB/EstimateMemoryVisitor>
 #include <osgDB/WriteFile>
 #include <osgDB/FileNameUtils>
 #include <osgDB/FileUtils>
 #include <osgDB/Registry>
 
 #include <osg/Geode>
+#include <osg/Geometry>
 #include <osg/Timer>
 #include <osg/Texture>
 #include <osg/Notify>
 #include <osg/ProxyNode>
 #include <osg/ApplicationUsage>
+#include <osg/CullingSet>
+#include <osg/Transform>
 
 #include <OpenThreads/ScopedLock>
 
@@ -47,6 +51,9 @@ static osg::ApplicationUsageProxy DatabasePager_e0(osg::ApplicationUsage::ENVIRO
 static osg::ApplicationUsageProxy DatabasePager_e3(osg::ApplicationUsage::ENVIRONMENTAL_VARIABLE,"OSG_DATABASE_PAGER_DRAWABLE <mode>","Set the drawable policy for setting of loaded drawable to specified type.  mode can be one of DoNotModify, DisplayList, VBO or VertexArrays>.");
 static osg::ApplicationUsageProxy DatabasePager_e4(osg::ApplicationUsage::ENVIRONMENTAL_VARIABLE,"OSG_DATABASE_PAGER_PRIORITY <mode>", "Set the thread priority to DEFAULT, MIN, LOW, NOMINAL, HIGH or MAX.");
 static osg::ApplicationUsageProxy DatabasePager_e11(osg::ApplicationUsage::ENVIRONMENTAL_VARIABLE,"OSG_MAX_PAGEDLOD <num>","Set the target maximum number of PagedLOD to maintain.");
+static osg::ApplicationUsageProxy DatabasePager_e13(osg::ApplicationUsage::ENVIRONMENTAL_VARIABLE,"OSG_MAX_PAGEDLOD_CPU_MEMORY <MB>","Set the budget of the estimated CPU memory of the subgraphs loaded for PagedLOD.");
+static osg::ApplicationUsageProxy DatabasePager_e14(osg::ApplicationUsage::ENVIRONMENTAL_VARIABLE,"OSG_MAX_PAGEDLOD_GPU_MEMORY <MB>","Set the budget of the estimated GPU memory of the subgraphs loaded for PagedLOD.");
+static osg::ApplicationUsageProxy DatabasePager_e15(osg::ApplicationUsage::ENVIRONMENTAL_VARIABLE,"OSG_DATABASE_PAGER_PREFETCH_HORIZON <seconds>","Set how far ahead the motion of cameras is extrapolated to prefetch the PagedLOD children they will need.");
 static osg::ApplicationUsageProxy DatabasePager_e12(osg::ApplicationUsage::ENVIRONMENTAL_VARIABLE,"OSG_ASSIGN_PBO_TO_IMAGES <ON/OFF>","Set whether PixelBufferObjects should be assigned to Images to aid download to the GPU.");
 
 // Convert function objects that take pointer args into functions that a
@@ -401,11 +408,11 @@ protected:
 //
 struct DatabasePager::SortFileRequestFunctor
 {
-    bool operator() (const osg::ref_ptr<DatabasePager::DatabaseRequest>& lhs,const osg::ref_ptr<DatabasePager::DatabaseRequest>& rhs) const
+    bool operator() (const DatabasePager::DatabaseRequest* lhs,const DatabasePager::DatabaseRequest* rhs) const
     {
-        if (lhs->_timestampLastRequest>rhs->_timestampLastRequest) return true;
-        else if (lhs->_timestampLastRequest<rhs->_timestampLastRequest) return false;
-        else return (lhs->_priorityLastRequest>rhs->_priorityLastRequest);
+        if (lhs->_timestampQueued>rhs->_timestampQueued) return true;
+        else if (lhs->_timestampQueued<rhs->_timestampQueued) return false;
+        else return (lhs->_priorityQueued>rhs->_priorityQueued);
     }
 };
 
@@ -430,7 +437,9 @@ void DatabasePager::DatabaseRequest::invalidate()
 //
 DatabasePager::RequestQueue::RequestQueue(DatabasePager* pager):
     _pager(pager),
-    _frameNumberLastPruned(osg::UNINITIALIZED_FRAME_NUMBER)
+    _frameNumberLastPruned(osg::UNINITIALIZED_FRAME_NUMBER),
+    _numLocks(0),
+    _numContendedLocks(0)
 {
 }
 
@@ -445,6 +454,16 @@ DatabasePager::RequestQueue::~RequestQueue()
     }
 }
 
+void DatabasePager::RequestQueue::lock()
+{
+    if (_requestMutex.trylock()!=0)
+    {
+        _requestMutex.lock();
+        ++_numContendedLocks;
+    }
+    ++_numLocks;
+}
+
 void DatabasePager::RequestQueue::invalidate(DatabaseRequest* dr)
 {
     // OSG_NOTICE<<"DatabasePager::RequestQueue::invalidate(DatabaseRequest* dr) dr->_compileSet="<<dr->_compileSet.get()<<std::endl;
@@ -462,7 +481,7 @@ void DatabasePager::RequestQueue::invalidate(DatabaseRequest* dr)
 
 bool DatabasePager::RequestQueue::pruneOldRequestsAndCheckIfEmpty()
 {
-    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_requestMutex);
+    OpenThreads::ScopedLock<RequestQueue> lock(*this);
 
     unsigned int frameNumber = _pager->_frameNumber;
     if (_frameNumberLastPruned != frameNumber)
@@ -495,19 +514,19 @@ bool DatabasePager::RequestQueue::pruneOldRequestsAndCheckIfEmpty()
 
 bool DatabasePager::RequestQueue::empty()
 {
-    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_requestMutex);
+    OpenThreads::ScopedLock<RequestQueue> lock(*this);
     return _requestList.empty();
 }
 
 unsigned int DatabasePager::RequestQueue::size()
 {
-    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_requestMutex);
+    OpenThreads::ScopedLock<RequestQueue> lock(*this);
     return _requestList.size();
 }
 
 void DatabasePager::RequestQueue::clear()
 {
-    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_requestMutex);
+    OpenThreads::ScopedLock<RequestQueue> lock(*this);
 
     for(RequestList::iterator citr = _requestList.begin();
         citr != _requestList.end();
@@ -527,7 +546,7 @@ void DatabasePager::RequestQueue::clear()
 
 void DatabasePager::RequestQueue::add(DatabasePager::DatabaseRequest* databaseRequest)
 {
-    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_requestMutex);
+    OpenThreads::ScopedLock<RequestQueue> lock(*this);
 
     addNoLock(databaseRequest);
 }
@@ -535,7 +554,7 @@ void DatabasePager::RequestQueue::add(DatabasePager::DatabaseRequest* databaseRe
 void DatabasePager::RequestQueue::remove(DatabasePager::DatabaseRequest* databaseRequest)
 {
     // OSG_NOTICE<<"DatabasePager::RequestQueue::remove(DatabaseRequest* databaseRequest)"<<std::endl;
-    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_requestMutex);
+    OpenThreads::ScopedLock<RequestQueue> lock(*this);
     for(RequestList::iterator citr = _requestList.begin();
         citr != _requestList.end();
         ++citr)
@@ -558,13 +577,13 @@ void DatabasePager::RequestQueue::addNoLock(DatabasePager::DatabaseRequest* data
 
 void DatabasePager::RequestQueue::swap(RequestList& requestList)
 {
-    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_requestMutex);
+    OpenThreads::ScopedLock<RequestQueue> lock(*this);
     _requestList.swap(requestList);
 }
 
 void DatabasePager::RequestQueue::takeFirst(osg::ref_ptr<DatabaseRequest>& databaseRequest)
 {
-    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_requestMutex);
+    OpenThreads::ScopedLock<RequestQueue> lock(*this);
 
     if (!_requestList.empty())
     {
@@ -621,17 +640,306 @@ void DatabasePager::RequestQueue::takeFirst(osg::ref_ptr<DatabaseRequest>& datab
 //
 DatabasePager::ReadQueue::ReadQueue(DatabasePager* pager, const std::string& name):
     RequestQueue(pager),
+    _prefetchCredit(0.0),
+    _numRequestsTaken(0),
+    _totalTimeInQueue(0.0),
+    _maximumTimeInQueue(0.0),
     _name(name)
 {
     _block = new osg::RefBlock;
 }
 
+DatabasePager::ReadQueue::~ReadQueue()
+{
+    clearHeap(_requestHeap);
+    clearHeap(_prefetchHeap);
+}
+
 void DatabasePager::ReadQueue::updateBlock()
 {
-    _block->set((!_requestList.empty() || !_childrenToDeleteList.empty()) &&
+    _block->set((!_requestHeap.empty() || !_prefetchHeap.empty() || !_childrenToDeleteList.empty()) &&
                 !_pager->_databasePagerThreadPaused);
 }
 
+void DatabasePager::ReadQueue::setHeapEntry(RequestHeap& heap, unsigned int index, DatabaseRequest* databaseRequest)
+{
+    heap[index] = databaseRequest;
+    databaseRequest->_readQueueIndex = index;
+}
+
+void DatabasePager::ReadQueue::moveUp(RequestHeap& heap, unsigned int index)
+{
+    DatabasePager::SortFileRequestFunctor highPriority;
+
+    osg::ref_ptr<DatabaseRequest> databaseRequest = heap[index];
+    while(index>0)
+    {
+        unsigned int parent = (index-1)/2;
+        if (!highPriority(databaseRequest.get(), heap[parent].get())) break;
+
+        setHeapEntry(heap, index, heap[parent].get());
+        index = parent;
+    }
+    setHeapEntry(heap, index, databaseRequest.get());
+}
+
+void DatabasePager::ReadQueue::moveDown(RequestHeap& heap, unsigned int index)
+{
+    DatabasePager::SortFileRequestFunctor highPriority;
+
+    osg::ref_ptr<DatabaseRequest> databaseRequest = heap[index];
+    unsigned int size = heap.size();
+    for(;;)
+    {
+        unsigned int child = index*2+1;
+        if (child>=size) break;
+        if (child+1<size && highPriority(heap[child+1].get(), heap[child].get())) ++child;
+        if (!highPriority(heap[child].get(), databaseRequest.get())) break;
+
+        setHeapEntry(heap, index, heap[child].get());
+        index = child;
+    }
+    setHeapEntry(heap, index, databaseRequest.get());
+}
+
+void DatabasePager::ReadQueue::removeHeapEntry(RequestHeap& heap, unsigned int index)
+{
+    heap[index]->_readQueue = 0;
+
+    unsigned int last = heap.size()-1;
+    if (index!=last)
+    {
+        setHeapEntry(heap, index, heap[last].get());
+        heap.pop_back();
+
+        moveUp(heap, index);
+        moveDown(heap, index);
+    }
+    else
+    {
+        heap.pop_back();
+    }
+}
+
+void DatabasePager::ReadQueue::placeNoLock(DatabasePager::DatabaseRequest* databaseRequest)
+{
+    databaseRequest->_timestampQueued = databaseRequest->_timestampLastRequest;
+    databaseRequest->_priorityQueued = databaseRequest->_priorityLastRequest;
+
+    if (databaseRequest->_readQueue==this)
+    {
+        if (databaseRequest->_readQueuePrefetch==databaseRequest->_prefetch)
+        {
+            RequestHeap& heap = getHeap(databaseRequest);
+            moveUp(heap, databaseRequest->_readQueueIndex);
+            moveDown(heap, databaseRequest->_readQueueIndex);
+            return;
+        }
+
+        // a request from the cull traversal promotes a prefetch request to the heap of requests from the cull traversal
+        removeHeapEntry(getHeap(databaseRequest), databaseRequest->_readQueueIndex);
+    }
+    else
+    {
+        databaseRequest->_tickQueued = osg::Timer::instance()->tick();
+    }
+
+    databaseRequest->_readQueue = this;
+    databaseRequest->_readQueuePrefetch = databaseRequest->_prefetch;
+
+    RequestHeap& heap = getHeap(databaseRequest);
+    heap.push_back(databaseRequest);
+    moveUp(heap, heap.size()-1);
+}
+
+void DatabasePager::ReadQueue::addNoLock(DatabasePager::DatabaseRequest* databaseRequest)
+{
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> drLock(_pager->_dr_mutex);
+        placeNoLock(databaseRequest);
+    }
+
+    updateBlock();
+}
+
+void DatabasePager::ReadQueue::updatePriority(DatabasePager::DatabaseRequest* databaseRequest)
+{
+    OpenThreads::ScopedLock<RequestQueue> lock(*this);
+    OpenThreads::ScopedLock<OpenThreads::Mutex> drLock(_pager->_dr_mutex);
+
+    // the request may have been taken from the queue since the caller found it there
+    if (databaseRequest->_readQueue!=this) return;
+
+    placeNoLock(databaseRequest);
+}
+
+void DatabasePager::ReadQueue::remove(DatabasePager::DatabaseRequest* databaseRequest)
+{
+    OpenThreads::ScopedLock<RequestQueue> lock(*this);
+    OpenThreads::ScopedLock<OpenThreads::Mutex> drLock(_pager->_dr_mutex);
+
+    if (databaseRequest->_readQueue==this)
+    {
+        removeHeapEntry(getHeap(databaseRequest), databaseRequest->_readQueueIndex);
+        updateBlock();
+    }
+}
+
+void DatabasePager::ReadQueue::takeFirst(osg::ref_ptr<DatabaseRequest>& databaseRequest)
+{
+    OpenThreads::ScopedLock<RequestQueue> lock(*this);
+
+    int frameNumber = _pager->_frameNumber;
+    double prefetchShare = osg::clampBetween(static_cast<double>(_pager->_prefetchBandwidthShare), 0.0, 0.9);
+
+    // requests no longer current have older timestamps than the current ones so sink below them, and are
+    // only invalidated once they reach the top of a heap.
+    while(!_requestHeap.empty() || !_prefetchHeap.empty())
+    {
+        // prefetch requests take their share of the loads while requests from the cull traversal are waiting
+        bool prefetch = _requestHeap.empty() || (!_prefetchHeap.empty() && _prefetchCredit>=1.0);
+        RequestHeap& heap = prefetch ? _prefetchHeap : _requestHeap;
+
+        osg::ref_ptr<DatabaseRequest> first = heap.front();
+
+        OpenThreads::ScopedLock<OpenThreads::Mutex> drLock(_pager->_dr_mutex);
+        removeHeapEntry(heap, 0);
+
+        if (first->isRequestCurrent(frameNumber))
+        {
+            if (prefetch)
+            {
+                if (!_requestHeap.empty()) _prefetchCredit -= 1.0;
+            }
+            else if (!_prefetchHeap.empty())
+            {
+                _prefetchCredit += prefetchShare/(1.0-prefetchShare);
+            }
+
+            double timeInQueue = osg::Timer::instance()->delta_s(first->_tickQueued, osg::Timer::instance()->tick());
+            ++_numRequestsTaken;
+            _totalTimeInQueue += timeInQueue;
+            if (timeInQueue>_maximumTimeInQueue) _maximumTimeInQueue = timeInQueue;
+
+            databaseRequest = first;
+            OSG_INFO<<" DatabasePager::ReadQueue::takeFirst() Found DatabaseRequest size()="<<_requestHeap.size()+_prefetchHeap.size()<<std::endl;
+            break;
+        }
+
+        invalidate(first.get());
+
+        OSG_INFO<<"DatabasePager::ReadQueue::takeFirst(): Pruning "<<first.get()<<std::endl;
+    }
+
+    if (_prefetchHeap.empty()) _prefetchCredit = 0.0;
+
+    updateBlock();
+}
+
+void DatabasePager::ReadQueue::pruneHeap(RequestHeap& heap, unsigned int frameNumber)
+{
+    RequestHeap currentRequests;
+    for(RequestHeap::iterator citr = heap.begin();
+        citr != heap.end();
+        ++citr)
+    {
+        if ((*citr)->isRequestCurrent(frameNumber))
+        {
+            currentRequests.push_back(*citr);
+        }
+        else
+        {
+            (*citr)->_readQueue = 0;
+            invalidate(citr->get());
+
+            OSG_INFO<<"DatabasePager::ReadQueue::pruneOldRequestsAndCheckIfEmpty(): Pruning "<<citr->get()<<std::endl;
+        }
+    }
+
+    if (currentRequests.size()!=heap.size())
+    {
+        heap.swap(currentRequests);
+        for(unsigned int i=0; i<heap.size(); ++i)
+        {
+            heap[i]->_readQueueIndex = i;
+        }
+        for(unsigned int i=heap.size()/2; i>0; --i)
+        {
+            moveDown(heap, i-1);
+        }
+    }
+}
+
+bool DatabasePager::ReadQueue::pruneOldRequestsAndCheckIfEmpty()
+{
+    OpenThreads::ScopedLock<RequestQueue> lock(*this);
+
+    unsigned int frameNumber = _pager->_frameNumber;
+    if (_frameNumberLastPruned != frameNumber)
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> drLock(_pager->_dr_mutex);
+
+        pruneHeap(_requestHeap, frameNumber);
+        pruneHeap(_prefetchHeap, frameNumber);
+
+        _frameNumberLastPruned = frameNumber;
+
+        updateBlock();
+    }
+
+    return _requestHeap.empty() && _prefetchHeap.empty();
+}
+
+bool DatabasePager::ReadQueue::empty()
+{
+    OpenThreads::ScopedLock<RequestQueue> lock(*this);
+    return _requestHeap.empty() && _prefetchHeap.empty();
+}
+
+unsigned int DatabasePager::ReadQueue::size()
+{
+    OpenThreads::ScopedLock<RequestQueue> lock(*this);
+    return _requestHeap.size() + _prefetchHeap.size();
+}
+
+void DatabasePager::ReadQueue::clearHeap(RequestHeap& heap)
+{
+    for(RequestHeap::iterator citr = heap.begin();
+        citr != heap.end();
+        ++citr)
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> drLock(_pager->_dr_mutex);
+        (*citr)->_readQueue = 0;
+        invalidate(citr->get());
+    }
+
+    heap.clear();
+}
+
+void DatabasePager::ReadQueue::clear()
+{
+    OpenThreads::ScopedLock<RequestQueue> lock(*this);
+
+    clearHeap(_requestHeap);
+    clearHeap(_prefetchHeap);
+    _prefetchCredit = 0.0;
+
+    _frameNumberLastPruned = _pager->_frameNumber;
+
+    updateBlock();
+}
+
+void DatabasePager::ReadQueue::resetStats()
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_requestMutex);
+
+    _numLocks = 0;
+    _numContendedLocks = 0;
+    _numRequestsTaken = 0;
+    _totalTimeInQueue = 0.0;
+    _maximumTimeInQueue = 0.0;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //
 //  DatabaseThread
@@ -690,6 +998,50 @@ int DatabasePager::DatabaseThread::cancel()
 
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  DatabaseRequestCancellationToken
+//
+// Set on the Options of a DatabaseThread's read, and cancelled by the thread once its DatabaseRequest is no longer
+// current. The token of the application's Options is chained, so cancelling it still cancels the read.
+//
+class DatabasePager::DatabaseRequestCancellationToken : public osgDB::CancellationToken
+{
+public:
+
+    DatabaseRequestCancellationToken(DatabaseRequest* databaseRequest, osgDB::CancellationToken* token):
+        _databaseRequest(databaseRequest)
+    {
+        // Options kept from an earlier load may still carry the token of its request, only chain the application's.
+        DatabaseRequestCancellationToken* requestToken = dynamic_cast<DatabaseRequestCancellationToken*>(token);
+        _token = requestToken ? requestToken->_token.get() : token;
+    }
+
+    virtual bool isCancelled() const
+    {
+        return osgDB::CancellationToken::isCancelled() || (_token.valid() && _token->isCancelled());
+    }
+
+    osg::ref_ptr<DatabaseRequest>               _databaseRequest;
+    osg::ref_ptr<osgDB::CancellationToken>      _token;
+
+protected:
+
+    virtual ~DatabaseRequestCancellationToken() {}
+};
+
+void DatabasePager::DatabaseThread::cancelStaleRead()
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> drLock(_pager->_dr_mutex);
+
+    DatabaseRequestCancellationToken* token = static_cast<DatabaseRequestCancellationToken*>(_readCancellationToken.get());
+    if (token && !token->isCancelled() && !token->_databaseRequest->isRequestCurrent(_pager->_frameNumber))
+    {
+        OSG_INFO<<_name<<": Cancelling read of "<<token->_databaseRequest->_fileName<<std::endl;
+        token->cancel();
+    }
+}
+
 void DatabasePager::DatabaseThread::run()
 {
     OSG_INFO<<_name<<": DatabasePager::DatabaseThread::run"<<std::endl;
@@ -740,7 +1092,7 @@ void DatabasePager::DatabaseThread::run()
             ObjectList deleteList;
             {
                 // Don't hold lock during destruction of deleteList
-                OpenThreads::ScopedLock<OpenThreads::Mutex> lock(read_queue->_requestMutex);
+                OpenThreads::ScopedLock<RequestQueue> lock(*read_queue);
                 if (!read_queue->_childrenToDeleteList.empty())
                 {
                     deleteList.swap(read_queue->_childrenToDeleteList);
@@ -760,6 +1112,7 @@ void DatabasePager::DatabaseThread::run()
         osg::ref_ptr<FileCache> fileCache = osgDB::Registry::instance()->getFileCache();
         osg::ref_ptr<FileLocationCallback> fileLocationCallback = osgDB::Registry::instance()->getFileLocationCallback();
         osg::ref_ptr<Options> dr_loadOptions;
+        osg::ref_ptr<DatabaseRequestCancellationToken> cancellationToken;
         std::string fileName;
         int frameNumberLastRequest = 0;
         bool cacheNodes = false;
@@ -770,6 +1123,8 @@ void DatabasePager::DatabaseThread::run()
                 dr_loadOptions = databaseRequest->_loadOptions.valid() ? databaseRequest->_loadOptions->cloneOptions() : new osgDB::Options;
                 dr_loadOptions->setTerrain(databaseRequest->_terrain);
                 dr_loadOptions->setParentGroup(databaseRequest->_group);
+                cancellationToken = new DatabaseRequestCancellationToken(databaseRequest.get(), dr_loadOptions->getCancellationToken());
+                dr_loadOptions->setCancellationToken(cancellationToken.get());
                 fileName = databaseRequest->_fileName;
                 frameNumberLastRequest = databaseRequest->_frameNumberLastRequest;
             }
@@ -804,10 +1159,15 @@ void DatabasePager::DatabaseThread::run()
                 {
                     //OSG_NOTICE<<"Found object in cache "<<fileName<<std::endl;
 
+                    EstimateMemoryVisitor estimateMemory;
+                    modelFromCache->accept(estimateMemory);
+
                     // assign the cached model to the request
                     {
                         OpenThreads::ScopedLock<OpenThreads::Mutex> drLock(_pager->_dr_mutex);
                         databaseRequest->_loadedModel = modelFromCache;
+                        databaseRequest->_cpuMemory = estimateMemory.getCPUMemory();
+                        databaseRequest->_gpuMemory = estimateMemory.getGPUMemory();
                     }
 
                     // move the request to the dataToMerge list so it can be merged during the update phase of the frame.
@@ -905,14 +1265,35 @@ void DatabasePager::DatabaseThread::run()
             //osg::Timer_t before = osg::Timer::instance()->tick();
 
 
+            // let the pager cancel the read should the request stop being current whilst it is loading.
+            {
+                OpenThreads::ScopedLock<OpenThreads::Mutex> drLock(_pager->_dr_mutex);
+                _readCancellationToken = cancellationToken;
+            }
+
             // assume that readNode is thread safe...
             ReaderWriter::ReadResult rr = readFromFileCache ?
                         fileCache->readNode(fileName, dr_loadOptions.get(), false) :
                         Registry::instance()->readNode(fileName, dr_loadOptions.get(), false);
 
+            {
+                OpenThreads::ScopedLock<OpenThreads::Mutex> drLock(_pager->_dr_mutex);
+                _readCancellationToken = 0;
+            }
+
+            // the loaded model may keep the Options for its own requests, so restore the application's token.
+            dr_loadOptions->setCancellationToken(cancellationToken->_token.get());
+
             osg::ref_ptr<osg::Node> loadedModel;
             if (rr.validNode()) loadedModel = rr.getNode();
-            if (!rr.success()) OSG_WARN<<"Error in reading file "<<fileName<<" : "<<rr.statusMessage() << std::endl;
+            if (rr.cancelled())
+            {
+                OSG_INFO<<_name<<": Cancelled reading "<<fileName<<" as it is no longer required."<<std::endl;
+            }
+            else if (!rr.success())
+            {
+                OSG_WARN<<"Error in reading file "<<fileName<<" : "<<rr.statusMessage() << std::endl;
+            }
 
             if (loadedModel.valid() &&
                 fileCache.valid() &&
@@ -967,10 +1348,15 @@ void DatabasePager::DatabaseThread::run()
                 }
 
 
+                EstimateMemoryVisitor estimateMemory;
+                loadedModel->accept(estimateMemory);
+
                 {
                     OpenThreads::ScopedLock<OpenThreads::Mutex> drLock(_pager->_dr_mutex);
                     databaseRequest->_loadedModel = loadedModel;
                     databaseRequest->_compileSet = compileSet;
+                    databaseRequest->_cpuMemory = estimateMemory.getCPUMemory();
+                    databaseRequest->_gpuMemory = estimateMemory.getGPUMemory();
                 }
                 // Dereference the databaseRequest while the queue is
                 // locked. This prevents the request from being
@@ -1090,6 +1476,33 @@ DatabasePager::DatabasePager()
         OSG_NOTICE<<"_targetMaximumNumberOfPageLOD = "<<_targetMaximumNumberOfPageLOD<<std::endl;
     }
 
+    _targetMaximumCPUMemory = 0;
+    if( (str = getenv("OSG_MAX_PAGEDLOD_CPU_MEMORY")) != 0)
+    {
+        _targetMaximumCPUMemory = static_cast<uint64_t>(osg::asciiToDouble(str)*1024.0*1024.0);
+        OSG_NOTICE<<"_targetMaximumCPUMemory = "<<_targetMaximumCPUMemory<<std::endl;
+    }
+
+    _targetMaximumGPUMemory = 0;
+    if( (str = getenv("OSG_MAX_PAGEDLOD_GPU_MEMORY")) != 0)
+    {
+        _targetMaximumGPUMemory = static_cast<uint64_t>(osg::asciiToDouble(str)*1024.0*1024.0);
+        OSG_NOTICE<<"_targetMaximumGPUMemory = "<<_targetMaximumGPUMemory<<std::endl;
+    }
+
+    _cpuMemoryInUse = 0;
+    _gpuMemoryInUse = 0;
+    _numSubgraphsExpiredForMemory = 0;
+
+    _prefetchHorizon = 0.0;
+    if( (str = getenv("OSG_DATABASE_PAGER_PREFETCH_HORIZON")) != 0)
+    {
+        _prefetchHorizon = osg::asciiToDouble(str);
+        OSG_NOTICE<<"_prefetchHorizon = "<<_prefetchHorizon<<std::endl;
+    }
+
+    _prefetchBandwidthShare = 0.25f;
+
 
     _doPreCompile = true;
     if( (str = getenv("OSG_DO_PRE_COMPILE")) != 0)
@@ -1171,6 +1584,15 @@ DatabasePager::DatabasePager(const DatabasePager& rhs)
 
     _targetMaximumNumberOfPageLOD = rhs._targetMaximumNumberOfPageLOD;
 
+    _targetMaximumCPUMemory = rhs._targetMaximumCPUMemory;
+    _targetMaximumGPUMemory = rhs._targetMaximumGPUMemory;
+    _cpuMemoryInUse = 0;
+    _gpuMemoryInUse = 0;
+    _numSubgraphsExpiredForMemory = 0;
+
+    _prefetchHorizon = rhs._prefetchHorizon;
+    _prefetchBandwidthShare = rhs._prefetchBandwidthShare;
+
     _doPreCompile = rhs._doPreCompile;
 
     _fileRequestQueue = new ReadQueue(this,"fileRequestQueue");
@@ -1370,6 +1792,10 @@ void DatabasePager::clear()
     // note, no need to use a mutex as the list is only accessed from the update thread.
     _activePagedLODList->clear();
 
+    _pagedSubgraphs.clear();
+    _cpuMemoryInUse = 0;
+    _gpuMemoryInUse = 0;
+
     // ??
     // _activeGraphicsContexts
 }
@@ -1381,6 +1807,43 @@ void DatabasePager::resetStats()
     _maximumTimeToMergeTile = -DBL_MAX;
     _totalTimeToMergeTiles = 0.0;
     _numTilesMerges = 0;
+
+    if (_fileRequestQueue.valid()) _fileRequestQueue->resetStats();
+    if (_httpRequestQueue.valid()) _httpRequestQueue->resetStats();
+}
+
+double DatabasePager::getAverageTimeInRequestQueue() const
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> fileLock(_fileRequestQueue->_requestMutex);
+    OpenThreads::ScopedLock<OpenThreads::Mutex> httpLock(_httpRequestQueue->_requestMutex);
+
+    unsigned int numRequestsTaken = _fileRequestQueue->_numRequestsTaken + _httpRequestQueue->_numRequestsTaken;
+    double totalTimeInQueue = _fileRequestQueue->_totalTimeInQueue + _httpRequestQueue->_totalTimeInQueue;
+    return (numRequestsTaken > 0) ? totalTimeInQueue/static_cast<double>(numRequestsTaken) : 0.0;
+}
+
+double DatabasePager::getMaximumTimeInRequestQueue() const
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> fileLock(_fileRequestQueue->_requestMutex);
+    OpenThreads::ScopedLock<OpenThreads::Mutex> httpLock(_httpRequestQueue->_requestMutex);
+
+    return osg::maximum(_fileRequestQueue->_maximumTimeInQueue, _httpRequestQueue->_maximumTimeInQueue);
+}
+
+unsigned int DatabasePager::getNumRequestQueueLocks() const
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> fileLock(_fileRequestQueue->_requestMutex);
+    OpenThreads::ScopedLock<OpenThreads::Mutex> httpLock(_httpRequestQueue->_requestMutex);
+
+    return _fileRequestQueue->_numLocks + _httpRequestQueue->_numLocks;
+}
+
+unsigned int DatabasePager::getNumRequestQueueContendedLocks() const
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> fileLock(_fileRequestQueue->_requestMutex);
+    OpenThreads::ScopedLock<OpenThreads::Mutex> httpLock(_httpRequestQueue->_requestMutex);
+
+    return _fileRequestQueue->_numContendedLocks + _httpRequestQueue->_numContendedLocks;
 }
 
 bool DatabasePager::getRequestsInProgress() const
@@ -1401,10 +1864,332 @@ bool DatabasePager::getRequestsInProgress() const
 }
 
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  PrefetchVisitor
+//
+// Traverses a subgraph as seen from the predicted views of a camera, requesting the PagedLOD children that any of
+// the views is going to need, mirroring the range selection that PagedLOD::traverse() does in the cull traversal.
+//
+class DatabasePager::PrefetchVisitor : public osg::NodeVisitor
+{
+public:
+
+    struct PredictedView
+    {
+        osg::Vec3d      _eye;
+        osg::Polytope   _frustum;
+        osg::Vec4       _pixelSizeVector;
+    };
+
+    typedef std::vector<PredictedView> PredictedViews;
+
+    PrefetchVisitor(DatabasePager* pager, const PredictedViews& views, float lodScale):
+        osg::NodeVisitor(osg::NodeVisitor::NODE_VISITOR, osg::NodeVisitor::TRAVERSE_ACTIVE_CHILDREN),
+        _pager(pager),
+        _views(views),
+        _lodScale(lodScale),
+        _radiusScale(1.0),
+        _numRequests(0)
+    {
+    }
+
+    META_NodeVisitor(osgDB, PrefetchVisitor)
+
+    virtual void apply(osg::Node& node)
+    {
+        if (isVisible(node.getBound())) traverse(node);
+    }
+
+    virtual void apply(osg::Camera&)
+    {
+        // nested cameras have their own views, leave them to their own cull traversals.
+    }
+
+    virtual void apply(osg::Transform& transform)
+    {
+        if (!isVisible(transform.getBound())) return;
+
+        osg::Matrixd previousMatrix = _matrix;
+        double previousRadiusScale = _radiusScale;
+
+        transform.computeLocalToWorldMatrix(_matrix, this);
+
+        osg::Vec3d scale = _matrix.getScale();
+        _radiusScale = osg::maximum(scale.x(), osg::maximum(scale.y(), scale.z()));
+
+        traverse(transform);
+
+        _matrix = previousMatrix;
+        _radiusScale = previousRadiusScale;
+    }
+
+    virtual void apply(osg::LOD& lod)
+    {
+        osg::BoundingSphere bound = toWorld(lod.getBound());
+        if (!bound.valid()) return;
+
+        osg::Vec3d center = osg::Vec3d(lod.getCenter()) * _matrix;
+
+        std::vector<bool> childInRange(lod.getNumChildren(), false);
+        for(PredictedViews::iterator itr = _views.begin();
+            itr != _views.end();
+            ++itr)
+        {
+            if (!itr->_frustum.contains(bound)) continue;
+
+            float required_range = requiredRange(lod, *itr, center, bound);
+            for(unsigned int i=0; i<childInRange.size() && i<lod.getNumRanges(); ++i)
+            {
+                if (lod.getMinRange(i)<=required_range && required_range<lod.getMaxRange(i)) childInRange[i] = true;
+            }
+        }
+
+        for(unsigned int i=0; i<childInRange.size(); ++i)
+        {
+            if (childInRange[i]) lod.getChild(i)->accept(*this);
+        }
+    }
+
+    virtual void apply(osg::PagedLOD& plod)
+    {
+        osg::BoundingSphere bound = toWorld(plod.getBound());
+        if (!bound.valid()) return;
+
+        osg::Vec3d center = osg::Vec3d(plod.getCenter()) * _matrix;
+
+        unsigned int numChildren = plod.getNumChildren();
+        std::vector<bool> childInRange(numChildren, false);
+        bool needToLoadChild = false;
+        float priority = 0.0f;
+
+        for(PredictedViews::iterator itr = _views.begin();
+            itr != _views.end();
+            ++itr)
+        {
+            if (!itr->_frustum.contains(bound)) continue;
+
+            float required_range = requiredRange(plod, *itr, center, bound);
+            bool viewNeedsChild = false;
+            for(unsigned int i=0; i<plod.getNumRanges(); ++i)
+            {
+                if (plod.getMinRange(i)<=required_range && required_range<plod.getMaxRange(i))
+                {
+                    if (i<numChildren) childInRange[i] = true;
+                    else viewNeedsChild = true;
+                }
+            }
+
+            if (viewNeedsChild && numChildren<plod.getNumFileNames() && numChildren<plod.getNumRanges())
+            {
+                // compute priority from where abouts in the required range the distance falls, as PagedLOD does.
+                float minRange = plod.getMinRange(numChildren);
+                float maxRange = plod.getMaxRange(numChildren);
+                float viewPriority = (maxRange-required_range)/(maxRange-minRange);
+                if (plod.getRangeMode()==osg::LOD::PIXEL_SIZE_ON_SCREEN) viewPriority = -viewPriority;
+
+                // keep the priority of the view that needs the child soonest.
+                if (!needToLoadChild || viewPriority>priority) priority = viewPriority;
+                needToLoadChild = true;
+            }
+        }
+
+        if (needToLoadChild)
+        {
+            // the children already loaded below the one needed may hold PagedLODs of their own.
+            if (numChildren>0) childInRange[numChildren-1] = true;
+
+            if (!plod.getDisableExternalChildrenPaging())
+            {
+                priority = plod.getPriorityOffset(numChildren) + priority * plod.getPriorityScale(numChildren);
+
+                _pager->requestNodeFileImplementation(plod.getDatabasePath()+plod.getFileName(numChildren), getNodePath(),
+                                                      priority, getFrameStamp(),
+                                                      plod.getDatabaseRequest(numChildren), plod.getDatabaseOptions(),
+                                                      true);
+                ++_numRequests;
+            }
+        }
+
+        for(unsigned int i=0; i<numChildren; ++i)
+        {
+            if (childInRange[i]) plod.getChild(i)->accept(*this);
+        }
+    }
+
+    unsigned int getNumRequests() const { return _numRequests; }
+
+protected:
+
+    osg::BoundingSphere toWorld(const osg::BoundingSphere& bs) const
+    {
+        if (!bs.valid()) return bs;
+        return osg::BoundingSphere(bs.center()*_matrix, bs.radius()*_radiusScale);
+    }
+
+    bool isVisible(const osg::BoundingSphere& bs)
+    {
+        osg::BoundingSphere bound = toWorld(bs);
+        if (!bound.valid()) return false;
+
+        for(PredictedViews::iterator itr = _views.begin();
+            itr != _views.end();
+            ++itr)
+        {
+            if (itr->_frustum.contains(bound)) return true;
+        }
+        return false;
+    }
+
+    float requiredRange(const osg::LOD& lod, const PredictedView& view, const osg::Vec3d& center, const osg::BoundingSphere& bound) const
+    {
+        if (lod.getRangeMode()==osg::LOD::DISTANCE_FROM_EYE_POINT)
+        {
+            return (center-view._eye).length()*_lodScale;
+        }
+
+        if (_lodScale>0.0f)
+        {
+            return fabs(bound.radius()/(osg::Vec3(bound.center())*view._pixelSizeVector)) / _lodScale;
+        }
+
+        // fallback to selecting the highest res child by finding out the max range
+        float required_range = 0.0f;
+        for(unsigned int i=0; i<lod.getNumRanges(); ++i)
+        {
+            required_range = osg::maximum(required_range, lod.getMinRange(i));
+        }
+        return required_range;
+    }
+
+    DatabasePager*          _pager;
+    PredictedViews          _views;
+    float                   _lodScale;
+    osg::Matrixd            _matrix;
+    double                  _radiusScale;
+    unsigned int            _numRequests;
+};
+
+void DatabasePager::prefetch(osg::Camera* camera, osg::Node* subgraph, const osg::FrameStamp* framestamp)
+{
+    if (_prefetchHorizon<=0.0 || !camera || !subgraph || !framestamp || !_acceptNewRequests) return;
+
+    osg::Vec3d eye, center, up;
+    camera->getViewMatrixAsLookAt(eye, center, up);
+
+    osg::Vec3d direction = center-eye;
+    direction.normalize();
+    up.normalize();
+
+    double time = framestamp->getReferenceTime();
+
+    PrefetchMotion motion;
+    bool motionKnown = false;
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_prefetchMutex);
+
+        // forget the cameras that have since been deleted.
+        for(PrefetchMotionMap::iterator itr = _prefetchMotions.begin();
+            itr != _prefetchMotions.end();)
+        {
+            if (itr->first.valid()) ++itr;
+            else _prefetchMotions.erase(itr++);
+        }
+
+        osg::observer_ptr<osg::Camera> key(camera);
+        PrefetchMotionMap::iterator itr = _prefetchMotions.find(key);
+        if (itr != _prefetchMotions.end())
+        {
+            PrefetchMotion& previous = itr->second;
+            double dt = time-previous._time;
+            if (dt>0.0)
+            {
+                osg::Vec3d velocity = (eye-previous._eye)/dt;
+
+                osg::Vec3d axis = previous._direction ^ direction;
+                double angle = atan2(axis.length(), previous._direction*direction);
+                osg::Vec3d angularVelocity;
+                if (axis.normalize()>0.0) angularVelocity = axis*(angle/dt);
+
+                // smooth the velocities over the recent frames so a single uneven frame doesn't throw the prediction.
+                const double smoothing = 0.5;
+                previous._velocity = previous._velocity*(1.0-smoothing) + velocity*smoothing;
+                previous._angularVelocity = previous._angularVelocity*(1.0-smoothing) + angularVelocity*smoothing;
+            }
+            motionKnown = true;
+        }
+
+        PrefetchMotion& current = _prefetchMotions[key];
+        current._time = time;
+        current._eye = eye;
+        current._direction = direction;
+        current._up = up;
+
+        motion = current;
+    }
+
+    // the motion of a camera is only known from its second frame on.
+    if (!motionKnown) return;
+
+    double angularSpeed = motion._angularVelocity.length();
+    if (motion._velocity.length2()==0.0 && angularSpeed==0.0)
+    {
+        // a still camera needs nothing more than the cull traversal has already requested.
+        return;
+    }
+
+    const osg::Matrixd& projection = camera->getProjectionMatrix();
+    const osg::Viewport* viewport = camera->getViewport();
+
+    // sample the predicted path at even steps up to the horizon, so that the tiles passed on the way are requested too.
+    const unsigned int numSteps = 3;
+    PrefetchVisitor::PredictedViews views;
+    for(unsigned int step=1; step<=numSteps; ++step)
+    {
+        double t = _prefetchHorizon*double(step)/double(numSteps);
+
+        osg::Vec3d predictedEye = eye + motion._velocity*t;
+
+        osg::Quat rotation;
+        if (angularSpeed>0.0) rotation.makeRotate(osg::minimum(angularSpeed*t, osg::PI_2), motion._angularVelocity/angularSpeed);
+
+        osg::Vec3d predictedDirection = rotation*direction;
+        osg::Vec3d predictedUp = rotation*up;
+
+        osg::Matrixd viewMatrix = osg::Matrixd::lookAt(predictedEye, predictedEye+predictedDirection, predictedUp);
+
+        PrefetchVisitor::PredictedView view;
+        view._eye = predictedEye;
+
+        // leave out the near and far planes, the cull traversal computes its own.
+        view._frustum.setToUnitFrustum(false, false);
+        view._frustum.transformProvidingInverse(viewMatrix*projection);
+
+        if (viewport) view._pixelSizeVector = osg::CullingSet::computePixelSizeVector(*viewport, projection, viewMatrix);
+
+        views.push_back(view);
+    }
+
+    PrefetchVisitor pv(this, views, camera->getLODScale());
+    pv.setTraversalMask(camera->getCullMask());
+    pv.setFrameStamp(const_cast<osg::FrameStamp*>(framestamp));
+    subgraph->accept(pv);
+
+    OSG_DEBUG<<"DatabasePager::prefetch() made "<<pv.getNumRequests()<<" requests"<<std::endl;
+}
+
 void DatabasePager::requestNodeFile(const std::string& fileName, osg::NodePath& nodePath,
                                     float priority, const osg::FrameStamp* framestamp,
                                     osg::ref_ptr<osg::Referenced>& databaseRequestRef,
                                     const osg::Referenced* options)
+{
+    requestNodeFileImplementation(fileName, nodePath, priority, framestamp, databaseRequestRef, options, false);
+}
+
+void DatabasePager::requestNodeFileImplementation(const std::string& fileName, osg::NodePath& nodePath,
+                                                  float priority, const osg::FrameStamp* framestamp,
+                                                  osg::ref_ptr<osg::Referenced>& databaseRequestRef,
+                                                  const osg::Referenced* options, bool prefetch)
 {
     osgDB::Options* loadOptions = dynamic_cast<osgDB::Options*>(const_cast<osg::Referenced*>(options));
     if (!loadOptions)
@@ -1466,6 +2251,7 @@ void DatabasePager::requestNodeFile(const std::string& fileName, osg::NodePath&
     {
         DatabaseRequest* databaseRequest = dynamic_cast<DatabaseRequest*>(databaseRequestRef.get());
         bool requeue = false;
+        ReadQueue* readQueue = 0;
         if (databaseRequest)
         {
             OpenThreads::ScopedLock<OpenThreads::Mutex> drLock(_dr_mutex);
@@ -1474,6 +2260,11 @@ void DatabasePager::requestNodeFile(const std::string& fileName, osg::NodePath&
                 OSG_INFO<<"DatabaseRequest has been previously invalidated whilst still attached to scene graph."<<std::endl;
                 databaseRequest = 0;
             }
+            else if (prefetch && !databaseRequest->_prefetch)
+            {
+                // the request is made by the cull traversal, which is left to keep it current
+                foundEntry = true;
+            }
             else
             {
                 OSG_INFO<<"DatabasePager::requestNodeFile("<<fileName<<") updating already assigned."<<std::endl;
@@ -1483,6 +2274,7 @@ void DatabasePager::requestNodeFile(const std::string& fileName, osg::NodePath&
                 databaseRequest->_frameNumberLastRequest = frameNumber;
                 databaseRequest->_timestampLastRequest = timestamp;
                 databaseRequest->_priorityLastRequest = priority;
+                databaseRequest->_prefetch = prefetch;
                 ++(databaseRequest->_numOfRequests);
 
                 foundEntry = true;
@@ -1500,18 +2292,24 @@ void DatabasePager::requestNodeFile(const std::string& fileName, osg::NodePath&
                     databaseRequest->_objectCache = 0;
                     requeue = true;
                 }
+                else
+                {
+                    readQueue = databaseRequest->_readQueue;
+                }
 
             }
         }
         if (requeue)
             _fileRequestQueue->add(databaseRequest);
+        else if (readQueue)
+            readQueue->updatePriority(databaseRequest);
     }
 
     if (!foundEntry)
     {
         OSG_INFO<<"In DatabasePager::requestNodeFile("<<fileName<<")"<<std::endl;
 
-        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_fileRequestQueue->_requestMutex);
+        OpenThreads::ScopedLock<RequestQueue> lock(*_fileRequestQueue);
 
         if (!databaseRequestRef.valid() || databaseRequestRef->referenceCount()==1)
         {
@@ -1531,6 +2329,7 @@ void DatabasePager::requestNodeFile(const std::string& fileName, osg::NodePath&
             databaseRequest->_terrain = terrain;
             databaseRequest->_loadOptions = loadOptions;
             databaseRequest->_objectCache = 0;
+            databaseRequest->_prefetch = prefetch;
 
             _fileRequestQueue->addNoLock(databaseRequest.get());
         }
@@ -1583,6 +2382,14 @@ void DatabasePager::signalBeginFrame(const osg::FrameStamp* framestamp)
         //OSG_INFO << "signalBeginFrame "<<framestamp->getFrameNumber()<<">>>>>>>>>>>>>>>>"<<std::endl;
         _frameNumber.exchange(framestamp->getFrameNumber());
 
+        // stop the reads of the requests that the last frame no longer made.
+        for(DatabaseThreadList::iterator itr = _databaseThreads.begin();
+            itr != _databaseThreads.end();
+            ++itr)
+        {
+            (*itr)->cancelStaleRead();
+        }
+
     } //else OSG_INFO << "signalBeginFrame >>>>>>>>>>>>>>>>"<<std::endl;
 }
 
@@ -1597,11 +2404,11 @@ void DatabasePager::setDatabasePagerThreadPause(bool pause)
 
     _databasePagerThreadPaused = pause;
     {
-        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_fileRequestQueue->_requestMutex);
+        OpenThreads::ScopedLock<RequestQueue> lock(*_fileRequestQueue);
         _fileRequestQueue->updateBlock();
     }
     {
-        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_httpRequestQueue->_requestMutex);
+        OpenThreads::ScopedLock<RequestQueue> lock(*_httpRequestQueue);
         _httpRequestQueue->updateBlock();
     }
 }
@@ -1703,6 +2510,19 @@ void DatabasePager::addLoadedDataToSceneGraph(const osg::FrameStamp &frameStamp)
 
             group->addChild(databaseRequest->_loadedModel.get());
 
+            if (plod)
+            {
+                PagedSubgraph pagedSubgraph;
+                pagedSubgraph._pagedLOD = plod;
+                pagedSubgraph._subgraph = databaseRequest->_loadedModel.get();
+                pagedSubgraph._cpuMemory = databaseRequest->_cpuMemory;
+                pagedSubgraph._gpuMemory = databaseRequest->_gpuMemory;
+                _pagedSubgraphs.push_back(pagedSubgraph);
+
+                _cpuMemoryInUse += databaseRequest->_cpuMemory;
+                _gpuMemoryInUse += databaseRequest->_gpuMemory;
+            }
+
             // Check if parent plod was already registered if not start visitor from parent
             if( plod &&
                 !_activePagedLODList->containsPagedLOD( plod ) )
@@ -1791,30 +2611,29 @@ void DatabasePager::removeExpiredSubgraphs(const osg::FrameStamp& frameStamp)
     if (s_total_max_stage_a<time_a) s_total_max_stage_a = time_a;
 
 
-    if (numPagedLODs <= _targetMaximumNumberOfPageLOD)
-    {
-        // nothing to do
-        return;
-    }
-
-    int numToPrune = numPagedLODs - _targetMaximumNumberOfPageLOD;
-
     ObjectList childrenRemoved;
 
     double expiryTime = frameStamp.getReferenceTime() - 0.1;
     unsigned int expiryFrame = frameStamp.getFrameNumber() - 1;
 
-    // First traverse inactive PagedLODs, as their children will
-    // certainly have expired. Then traverse active nodes if we still
-    // need to prune.
-    //OSG_NOTICE<<"numToPrune "<<numToPrune;
-    if (numToPrune>0)
-        _activePagedLODList->removeExpiredChildren(
-            numToPrune, expiryTime, expiryFrame, childrenRemoved, false);
-    numToPrune = _activePagedLODList->size() - _targetMaximumNumberOfPageLOD;
-    if (numToPrune>0)
-        _activePagedLODList->removeExpiredChildren(
-            numToPrune, expiryTime, expiryFrame, childrenRemoved, true);
+    if (numPagedLODs > _targetMaximumNumberOfPageLOD)
+    {
+        int numToPrune = numPagedLODs - _targetMaximumNumberOfPageLOD;
+
+        // First traverse inactive PagedLODs, as their children will
+        // certainly have expired. Then traverse active nodes if we still
+        // need to prune.
+        //OSG_NOTICE<<"numToPrune "<<numToPrune;
+        if (numToPrune>0)
+            _activePagedLODList->removeExpiredChildren(
+                numToPrune, expiryTime, expiryFrame, childrenRemoved, false);
+        numToPrune = _activePagedLODList->size() - _targetMaximumNumberOfPageLOD;
+        if (numToPrune>0)
+            _activePagedLODList->removeExpiredChildren(
+                numToPrune, expiryTime, expiryFrame, childrenRemoved, true);
+    }
+
+    removeSubgraphsOverMemoryBudget(expiryTime, expiryFrame, childrenRemoved);
 
     osg::Timer_t end_b_Tick = osg::Timer::instance()->tick();
     double time_b = osg::Timer::instance()->delta_m(end_a_Tick,end_b_Tick);
@@ -1830,7 +2649,7 @@ void DatabasePager::removeExpiredSubgraphs(const osg::FrameStamp& frameStamp)
         // pass the objects across to the database pager delete list
         if (_deleteRemovedSubgraphsInDatabaseThread)
         {
-            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_fileRequestQueue->_requestMutex);
+            OpenThreads::ScopedLock<RequestQueue> lock(*_fileRequestQueue);
             // splice transfers the entire list in constant time.
             _fileRequestQueue->_childrenToDeleteList.splice(
                 _fileRequestQueue->_childrenToDeleteList.end(),
@@ -1854,6 +2673,114 @@ void DatabasePager::removeExpiredSubgraphs(const osg::FrameStamp& frameStamp)
                               " C="<<time_c<<" avg="<<s_total_time_stage_c/s_total_iter_stage_c<<" max = "<<s_total_max_stage_c<<std::endl;
 }
 
+namespace
+{
+    struct LeastRecentlyCulledFunctor
+    {
+        bool operator() (const std::pair<unsigned int, unsigned int>& lhs, const std::pair<unsigned int, unsigned int>& rhs) const
+        {
+            return lhs.first < rhs.first;
+        }
+    };
+}
+
+void DatabasePager::removeSubgraphsOverMemoryBudget(double expiryTime, unsigned int expiryFrame, ObjectList& childrenRemoved)
+{
+    _numSubgraphsExpiredForMemory = 0;
+
+    // drop the subgraphs that have left the scene graph since the last frame, expired by the target number of PagedLOD
+    // or along with the subgraph of a parent PagedLOD, whose PagedLODs are then no longer in the active list.
+    PagedSubgraphList::iterator end = _pagedSubgraphs.begin();
+    for(PagedSubgraphList::iterator itr = _pagedSubgraphs.begin();
+        itr != _pagedSubgraphs.end();
+        ++itr)
+    {
+        osg::ref_ptr<osg::PagedLOD> plod;
+        osg::ref_ptr<osg::Node> subgraph;
+        if (itr->_pagedLOD.lock(plod) && itr->_subgraph.lock(subgraph) &&
+            plod->getChildIndex(subgraph.get()) < plod->getNumChildren() &&
+            _activePagedLODList->containsPagedLOD(itr->_pagedLOD))
+        {
+            if (end != itr) *end = *itr;
+            ++end;
+        }
+        else
+        {
+            _cpuMemoryInUse -= itr->_cpuMemory;
+            _gpuMemoryInUse -= itr->_gpuMemory;
+        }
+    }
+    _pagedSubgraphs.erase(end, _pagedSubgraphs.end());
+
+    bool overCPUBudget = _targetMaximumCPUMemory > 0 && _cpuMemoryInUse > _targetMaximumCPUMemory;
+    bool overGPUBudget = _targetMaximumGPUMemory > 0 && _gpuMemoryInUse > _targetMaximumGPUMemory;
+    if (!overCPUBudget && !overGPUBudget) return;
+
+    // only the last child of a PagedLOD can be expired, so order those by the frame they were last culled in.
+    typedef std::vector< std::pair<unsigned int, unsigned int> > Candidates;
+    Candidates candidates;
+    for(unsigned int i = 0; i < _pagedSubgraphs.size(); ++i)
+    {
+        osg::ref_ptr<osg::PagedLOD> plod;
+        _pagedSubgraphs[i]._pagedLOD.lock(plod);
+        unsigned int lastChild = plod->getNumChildren()-1;
+        if (plod->getChild(lastChild)==_pagedSubgraphs[i]._subgraph.get() && lastChild < plod->getNumFileNames())
+        {
+            candidates.push_back(std::pair<unsigned int, unsigned int>(plod->getFrameNumber(lastChild), i));
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), LeastRecentlyCulledFunctor());
+
+    for(Candidates::iterator itr = candidates.begin();
+        itr != candidates.end() && (overCPUBudget || overGPUBudget);
+        ++itr)
+    {
+        PagedSubgraph& pagedSubgraph = _pagedSubgraphs[itr->second];
+
+        osg::ref_ptr<osg::PagedLOD> plod;
+        if (!pagedSubgraph._pagedLOD.lock(plod)) continue;
+
+        // PagedLOD::removeExpiredChildren() leaves the subgraphs culled since the expiry time and frame in place
+        ExpirePagedLODsVisitor expirePagedLODsVisitor;
+        osg::NodeList expiredChildren;
+        if (!expirePagedLODsVisitor.removeExpiredChildrenAndFindPagedLODs(plod.get(), expiryTime, expiryFrame, expiredChildren)) continue;
+
+        osg::NodeList expiredPagedLODs(expirePagedLODsVisitor._childPagedLODs.begin(), expirePagedLODsVisitor._childPagedLODs.end());
+        _activePagedLODList->removeNodes(expiredPagedLODs);
+
+        std::copy(expiredChildren.begin(), expiredChildren.end(), std::back_inserter(childrenRemoved));
+
+        _cpuMemoryInUse -= pagedSubgraph._cpuMemory;
+        _gpuMemoryInUse -= pagedSubgraph._gpuMemory;
+        pagedSubgraph._cpuMemory = 0;
+        pagedSubgraph._gpuMemory = 0;
+        ++_numSubgraphsExpiredForMemory;
+
+        overCPUBudget = _targetMaximumCPUMemory > 0 && _cpuMemoryInUse > _targetMaximumCPUMemory;
+        overGPUBudget = _targetMaximumGPUMemory > 0 && _gpuMemoryInUse > _targetMaximumGPUMemory;
+    }
+
+    // the subgraphs of the PagedLODs expired along with the subgraphs removed are dropped next frame
+    OSG_INFO<<"DatabasePager::removeSubgraphsOverMemoryBudget() expired "<<_numSubgraphsExpiredForMemory<<" subgraphs, CPU memory = "<<_cpuMemoryInUse<<" GPU memory = "<<_gpuMemoryInUse<<std::endl;
+}
+
+static void addToStatsAttribute(osg::Stats& stats, unsigned int frameNumber, const std::string& name, double value)
+{
+    double previousValue = 0.0;
+    stats.getAttribute(frameNumber, name, previousValue);
+    stats.setAttribute(frameNumber, name, previousValue + value);
+}
+
+void DatabasePager::reportStats(unsigned int frameNumber, osg::Stats& stats) const
+{
+    // add to the values already reported for the frame, so that the pagers of several scenes are summed
+    addToStatsAttribute(stats, frameNumber, "DatabasePager CPU memory", static_cast<double>(_cpuMemoryInUse));
+    addToStatsAttribute(stats, frameNumber, "DatabasePager GPU memory", static_cast<double>(_gpuMemoryInUse));
+    addToStatsAttribute(stats, frameNumber, "DatabasePager CPU memory budget", static_cast<double>(_targetMaximumCPUMemory));
+    addToStatsAttribute(stats, frameNumber, "DatabasePager GPU memory budget", static_cast<double>(_targetMaximumGPUMemory));
+    addToStatsAttribute(stats, frameNumber, "DatabasePager subgraphs expired for memory", static_cast<double>(_numSubgraphsExpiredForMemory));
+}
+
 class DatabasePager::FindPagedLODsVisitor : public osg::NodeVisitor
 {
 public:
@@ -0,0 +1,103 @@
+/* -*-c++-*- OpenSceneGraph - Copyright (C) 1998-2006 Robert Osfield
+ *
+ * This library is open source and may be redistributed and/or modified under
+ * the terms of the OpenSceneGraph Public License (OSGPL) version 0.0 or
+ * (at your option) any later version.  The full license is in LICENSE file
+ * included with this distribution, and on the openscenegraph.org website.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * OpenSceneGraph Public License for more details.
+*/
+
+#include <osgDB/EstimateMemoryVisitor>
+
+#include <osg/Geometry>
+#include <osg/Texture>
+
+using namespace osgDB;
+
+EstimateMemoryVisitor::EstimateMemoryVisitor():
+    osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN),
+    _cpuMemory(0),
+    _gpuMemory(0)
+{
+}
+
+void EstimateMemoryVisitor::reset()
+{
+    _visited.clear();
+    _cpuMemory = 0;
+    _gpuMemory = 0;
+}
+
+void EstimateMemoryVisitor::apply(osg::Node& node)
+{
+    applyStateSet(node.getStateSet());
+    traverse(node);
+}
+
+void EstimateMemoryVisitor::apply(osg::Drawable& drawable)
+{
+    applyStateSet(drawable.getStateSet());
+
+    osg::Geometry* geometry = drawable.asGeometry();
+    if (!geometry) return;
+
+    bool onGPU = geometry->getUseVertexBufferObjects() || geometry->getUseDisplayList();
+
+    osg::Geometry::ArrayList arrays;
+    geometry->getArrayList(arrays);
+    for(osg::Geometry::ArrayList::iterator itr = arrays.begin();
+        itr != arrays.end();
+        ++itr)
+    {
+        applyBufferData(itr->get(), onGPU);
+    }
+
+    osg::Geometry::DrawElementsList drawElements;
+    geometry->getDrawElementsList(drawElements);
+    for(osg::Geometry::DrawElementsList::iterator itr = drawElements.begin();
+        itr != drawElements.end();
+        ++itr)
+    {
+        applyBufferData(*itr, onGPU);
+    }
+}
+
+void EstimateMemoryVisitor::applyStateSet(const osg::StateSet* stateset)
+{
+    if (!stateset || !_visited.insert(stateset).second) return;
+
+    for(unsigned int unit = 0; unit < stateset->getTextureAttributeList().size(); ++unit)
+    {
+        const osg::Texture* texture = dynamic_cast<const osg::Texture*>(stateset->getTextureAttribute(unit, osg::StateAttribute::TEXTURE));
+        if (!texture || !_visited.insert(texture).second) continue;
+
+        bool mipmapped = texture->getFilter(osg::Texture::MIN_FILTER)!=osg::Texture::LINEAR &&
+                         texture->getFilter(osg::Texture::MIN_FILTER)!=osg::Texture::NEAREST;
+
+        for(unsigned int i = 0; i < texture->getNumImages(); ++i)
+        {
+            const osg::Image* image = texture->getImage(i);
+            if (!image || !_visited.insert(image).second) continue;
+
+            uint64_t size = image->getTotalSizeInBytesIncludingMipmaps();
+            if (!texture->getUnRefImageDataAfterApply()) _cpuMemory += size;
+
+            // mipmaps generated on the GPU add a third to the base level
+            if (mipmapped && !image->isMipmap()) size += size/3;
+            _gpuMemory += size;
+        }
+    }
+}
+
+void EstimateMemoryVisitor::applyBufferData(const osg::BufferData* bufferData, bool onGPU)
+{
+    if (!bufferData || !_visited.insert(bufferData).second) return;
+
+    uint64_t size = bufferData->getTotalDataSize();
+    _cpuMemory += size;
+    if (onGPU) _gpuMemory += size;
+}
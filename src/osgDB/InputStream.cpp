@@ -904,6 +904,14 @@ osg::ref_ptr<osg::Object> InputStream::readObject( osg::Object* existingObj )
 
 osg::ref_ptr<osg::Object> InputStream::readObjectFields( const std::string& className, unsigned int id, osg::Object* existingObj )
 {
+    if ( _options.valid() && _options->isCancelled() )
+    {
+        // fail the stream so the wrappers still reading unwind without parsing the rest of the file.
+        if ( _in->getStream() ) _in->getStream()->setstate( std::ios::failbit );
+        throwException( "InputStream: Read cancelled." );
+        return NULL;
+    }
+
     ObjectWrapper* wrapper = Registry::instance()->getObjectWrapperManager()->findWrapper( className );
     if ( !wrapper )
     {
@@ -13,6 +13,7 @@
 
 #include <osgDB/ObjectCache>
 #include <osgDB/Options>
+#include <osgDB/EstimateMemoryVisitor>
 
 using namespace osgDB;
 
@@ -41,7 +42,9 @@ bool ObjectCache::ClassComp::operator() (const ObjectCache::FileNameOptionsPair&
 // ObjectCache
 //
 ObjectCache::ObjectCache():
-    osg::Referenced(true)
+    osg::Referenced(true),
+    _maximumSize(0),
+    _size(0)
 {
 //    OSG_NOTICE<<"Constructed ObjectCache"<<std::endl;
 }
@@ -51,33 +54,226 @@ ObjectCache::~ObjectCache()
 //    OSG_NOTICE<<"Destructed ObjectCache"<<std::endl;
 }
 
+unsigned int ObjectCache::getShardIndex(const std::string& fileName) const
+{
+    // FNV-1a hash of the filename, so entries with the same filename and different Options share a shard.
+    unsigned int hash = 2166136261u;
+    for(std::string::const_iterator itr = fileName.begin(); itr != fileName.end(); ++itr)
+    {
+        hash = (hash ^ static_cast<unsigned char>(*itr)) * 16777619u;
+    }
+    return hash % NUM_SHARDS;
+}
+
+void ObjectCache::setMaximumSize(uint64_t bytes)
+{
+    _maximumSize = bytes;
+    if (_maximumSize==0) return;
+
+    // the entries added while the cache was unbounded weren't estimated.
+    for(unsigned int i = 0; i < NUM_SHARDS; ++i)
+    {
+        Shard& shard = _shards[i];
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(shard._mutex);
+        for(ObjectCacheMap::iterator itr = shard._objectCache.begin();
+            itr != shard._objectCache.end();
+            ++itr)
+        {
+            if (itr->second._size!=0) continue;
+
+            itr->second._size = estimateSize(itr->second._object.get());
+            shard._size += itr->second._size;
+            changeSize(itr->second._size, 0);
+        }
+    }
+
+    evict(0);
+}
+
+uint64_t ObjectCache::getSize() const
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_sizeMutex);
+    return _size;
+}
+
+unsigned int ObjectCache::getNumObjects() const
+{
+    unsigned int numObjects = 0;
+    for(unsigned int i = 0; i < NUM_SHARDS; ++i)
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_shards[i]._mutex);
+        numObjects += static_cast<unsigned int>(_shards[i]._objectCache.size());
+    }
+    return numObjects;
+}
+
+void ObjectCache::resetStats()
+{
+    _numHits.exchange(0);
+    _numMisses.exchange(0);
+    _numEvictions.exchange(0);
+}
+
+uint64_t ObjectCache::estimateSize(const osg::Object* object) const
+{
+    if (!object) return 0;
+
+    EstimateMemoryVisitor emv;
+
+    if (const osg::Node* node = dynamic_cast<const osg::Node*>(object))
+    {
+        const_cast<osg::Node*>(node)->accept(emv);
+    }
+    else if (const osg::StateSet* stateset = dynamic_cast<const osg::StateSet*>(object))
+    {
+        emv.applyStateSet(stateset);
+    }
+    else if (const osg::BufferData* bufferData = dynamic_cast<const osg::BufferData*>(object))
+    {
+        emv.applyBufferData(bufferData, false);
+    }
+
+    // count the object itself, so that every entry has a cost.
+    return emv.getCPUMemory() + sizeof(osg::Object);
+}
+
+void ObjectCache::addEntryNoLock(Shard& shard, const FileNameOptionsPair& key, osg::Object* object, double timestamp, uint64_t size)
+{
+    ObjectCacheMap::iterator itr = shard._objectCache.find(key);
+    if (itr==shard._objectCache.end())
+    {
+        itr = shard._objectCache.insert(ObjectCacheMap::value_type(key, ObjectCacheEntry())).first;
+        itr->second._lruPosition = shard._lruList.insert(shard._lruList.begin(), &(itr->first));
+    }
+    else
+    {
+        shard._size -= itr->second._size;
+        changeSize(0, itr->second._size);
+        shard._lruList.splice(shard._lruList.begin(), shard._lruList, itr->second._lruPosition);
+    }
+
+    itr->second._object = object;
+    itr->second._timestamp = timestamp;
+    itr->second._size = size;
+    shard._size += size;
+    changeSize(size, 0);
+}
+
+void ObjectCache::removeEntryNoLock(Shard& shard, ObjectCacheMap::iterator itr)
+{
+    shard._size -= itr->second._size;
+    changeSize(0, itr->second._size);
+    shard._lruList.erase(itr->second._lruPosition);
+    shard._objectCache.erase(itr);
+}
+
+void ObjectCache::changeSize(uint64_t added, uint64_t removed)
+{
+    if (added==removed) return;
+
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_sizeMutex);
+    _size = _size + added - removed;
+}
+
+void ObjectCache::evict(unsigned int firstShard)
+{
+    if (_maximumSize==0) return;
+
+    // while the cache is over its maximum size at least one shard is over its share, so visiting each shard
+    // in turn brings the cache back within it unless the remaining objects are referenced from elsewhere.
+    for(unsigned int i = 0; i < NUM_SHARDS && getSize()>_maximumSize; ++i)
+    {
+        Shard& shard = _shards[(firstShard + i) % NUM_SHARDS];
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(shard._mutex);
+        evictNoLock(shard);
+    }
+}
+
+void ObjectCache::evictNoLock(Shard& shard)
+{
+    if (_maximumSize==0) return;
+
+    uint64_t shardMaximumSize = _maximumSize/NUM_SHARDS;
+
+    // walk from the least recently used entry, passing over the objects still referenced from elsewhere as
+    // evicting them wouldn't free their memory.
+    LRUList::iterator litr = shard._lruList.end();
+    while(shard._size>shardMaximumSize && getSize()>_maximumSize && litr!=shard._lruList.begin())
+    {
+        --litr;
+
+        ObjectCacheMap::iterator itr = shard._objectCache.find(**litr);
+        if (itr->second._object.valid() && itr->second._object->referenceCount()>1) continue;
+
+        // step back onto the next entry before the current one is erased along with its LRU position.
+        ++litr;
+        removeEntryNoLock(shard, itr);
+        ++_numEvictions;
+    }
+}
+
 void ObjectCache::addObjectCache(ObjectCache* objectCache)
 {
     // don't allow a cache to be added to itself.
     if (objectCache==this) return;
 
-    // lock both ObjectCache to prevent their contents from being modified by other threads while we merge.
-    OpenThreads::ScopedLock<OpenThreads::Mutex> lock1(_objectCacheMutex);
-    OpenThreads::ScopedLock<OpenThreads::Mutex> lock2(objectCache->_objectCacheMutex);
+    for(unsigned int i = 0; i < NUM_SHARDS; ++i)
+    {
+        // a filename maps to the same shard in both caches, so shards can be merged pairwise.
+        Shard& shard = _shards[i];
+        Shard& otherShard = objectCache->_shards[i];
+
+        // lock both shards to prevent their contents from being modified by other threads while we merge.
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock1(shard._mutex);
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock2(otherShard._mutex);
+
+        OSG_DEBUG<<"Inserting objects to main ObjectCache "<<otherShard._objectCache.size()<<std::endl;
+
+        // insert from the least recently used, so the order of the merged entries is kept, and keep the entries
+        // already in this cache as std::map::insert() does.
+        for(LRUList::reverse_iterator litr = otherShard._lruList.rbegin();
+            litr != otherShard._lruList.rend();
+            ++litr)
+        {
+            if (shard._objectCache.count(**litr)!=0) continue;
+
+            // entries added to an unbounded cache haven't been estimated.
+            const ObjectCacheEntry& entry = otherShard._objectCache.find(**litr)->second;
+            uint64_t size = entry._size;
+            if (_maximumSize>0 && size==0) size = estimateSize(entry._object.get());
+            else if (_maximumSize==0) size = 0;
 
-    OSG_DEBUG<<"Inserting objects to main ObjectCache "<<objectCache->_objectCache.size()<<std::endl;
+            addEntryNoLock(shard, **litr, entry._object.get(), entry._timestamp, size);
+        }
+    }
 
-    _objectCache.insert(objectCache->_objectCache.begin(), objectCache->_objectCache.end());
+    evict(0);
 }
 
 
 void ObjectCache::addEntryToObjectCache(const std::string& filename, osg::Object* object, double timestamp, const Options *options)
 {
-    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_objectCacheMutex);
-    _objectCache[FileNameOptionsPair(filename, osg::clone(options))] = ObjectTimeStampPair(object,timestamp);
-    OSG_DEBUG<<"Adding "<<filename<<" with options '"<<(options ? options->getOptionString() : "")<<"' to ObjectCache "<<this<<std::endl;
+    // estimate outside of the lock as it may traverse a whole subgraph, and only when the size is bounded.
+    uint64_t size = _maximumSize>0 ? estimateSize(object) : 0;
+
+    unsigned int shardIndex = getShardIndex(filename);
+    {
+        Shard& shard = _shards[shardIndex];
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(shard._mutex);
+        addEntryNoLock(shard, FileNameOptionsPair(filename, osg::clone(options)), object, timestamp, size);
+        OSG_DEBUG<<"Adding "<<filename<<" with options '"<<(options ? options->getOptionString() : "")<<"' to ObjectCache "<<this<<std::endl;
+    }
+
+    evict(shardIndex);
 }
 
 osg::Object* ObjectCache::getFromObjectCache(const std::string& fileName, const Options *options)
 {
-    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_objectCacheMutex);
-    ObjectCacheMap::iterator itr = _objectCache.find(FileNameOptionsPair(fileName, options));
-    if (itr!=_objectCache.end())
+    Shard& shard = _shards[getShardIndex(fileName)];
+
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(shard._mutex);
+    ObjectCacheMap::iterator itr = shard._objectCache.find(FileNameOptionsPair(fileName, options));
+    if (itr!=shard._objectCache.end())
     {
         osg::ref_ptr<const osgDB::Options> o = itr->first.second;
         if (o.valid())
@@ -88,17 +284,25 @@ osg::Object* ObjectCache::getFromObjectCache(const std::string& fileName, const
         {
             OSG_DEBUG<<"Found "<<fileName<<" in ObjectCache "<<this<<std::endl;
         }
-        return itr->second.first.get();
+        ++_numHits;
+        shard._lruList.splice(shard._lruList.begin(), shard._lruList, itr->second._lruPosition);
+        return itr->second._object.get();
+    }
+    else
+    {
+        ++_numMisses;
+        return 0;
     }
-    else return 0;
 }
 
 osg::ref_ptr<osg::Object> ObjectCache::getRefFromObjectCache(const std::string& fileName, const Options *options)
 {
-    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_objectCacheMutex);
+    Shard& shard = _shards[getShardIndex(fileName)];
+
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(shard._mutex);
     ObjectCacheMap::iterator itr;
-    itr = _objectCache.find(FileNameOptionsPair(fileName, options));
-    if (itr!=_objectCache.end())
+    itr = shard._objectCache.find(FileNameOptionsPair(fileName, options));
+    if (itr!=shard._objectCache.end())
     {
         osg::ref_ptr<const osgDB::Options> o = itr->first.second;
         if (o.valid())
@@ -109,70 +313,97 @@ osg::ref_ptr<osg::Object> ObjectCache::getRefFromObjectCache(const std::string&
         {
             OSG_DEBUG<<"Found "<<fileName<<" in ObjectCache "<<this<<std::endl;
         }
-        return itr->second.first.get();
+        ++_numHits;
+        shard._lruList.splice(shard._lruList.begin(), shard._lruList, itr->second._lruPosition);
+        return itr->second._object.get();
+    }
+    else
+    {
+        ++_numMisses;
+        return 0;
     }
-    else return 0;
 }
 
 void ObjectCache::updateTimeStampOfObjectsInCacheWithExternalReferences(double referenceTime)
 {
-    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_objectCacheMutex);
-
-    // look for objects with external references and update their time stamp.
-    for(ObjectCacheMap::iterator itr=_objectCache.begin();
-        itr!=_objectCache.end();
-        ++itr)
+    for(unsigned int i = 0; i < NUM_SHARDS; ++i)
     {
-        // if ref count is greater the 1 the object has an external reference.
-        if (itr->second.first->referenceCount()>1)
+        Shard& shard = _shards[i];
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(shard._mutex);
+
+        // look for objects with external references and update their time stamp.
+        for(ObjectCacheMap::iterator itr=shard._objectCache.begin();
+            itr!=shard._objectCache.end();
+            ++itr)
         {
-            // so update it time stamp.
-            itr->second.second = referenceTime;
+            // if ref count is greater the 1 the object has an external reference.
+            if (itr->second._object->referenceCount()>1)
+            {
+                // so update it time stamp.
+                itr->second._timestamp = referenceTime;
+            }
         }
     }
 }
 
 void ObjectCache::removeExpiredObjectsInCache(double expiryTime)
 {
-    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_objectCacheMutex);
-
-    // Remove expired entries from object cache
-    ObjectCacheMap::iterator oitr = _objectCache.begin();
-    while(oitr != _objectCache.end())
+    for(unsigned int i = 0; i < NUM_SHARDS; ++i)
     {
-        if (oitr->second.second<=expiryTime)
-        {
-            _objectCache.erase(oitr++);
-        }
-        else
+        Shard& shard = _shards[i];
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(shard._mutex);
+
+        // Remove expired entries from object cache
+        ObjectCacheMap::iterator oitr = shard._objectCache.begin();
+        while(oitr != shard._objectCache.end())
         {
-            ++oitr;
+            if (oitr->second._timestamp<=expiryTime)
+            {
+                removeEntryNoLock(shard, oitr++);
+            }
+            else
+            {
+                ++oitr;
+            }
         }
     }
 }
 
 void ObjectCache::removeFromObjectCache(const std::string& fileName, const Options *options)
 {
-    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_objectCacheMutex);
-    ObjectCacheMap::iterator itr = _objectCache.find(FileNameOptionsPair(fileName, options));
-    if (itr!=_objectCache.end()) _objectCache.erase(itr);
+    Shard& shard = _shards[getShardIndex(fileName)];
+
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(shard._mutex);
+    ObjectCacheMap::iterator itr = shard._objectCache.find(FileNameOptionsPair(fileName, options));
+    if (itr!=shard._objectCache.end()) removeEntryNoLock(shard, itr);
 }
 
 void ObjectCache::clear()
 {
-    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_objectCacheMutex);
-    _objectCache.clear();
+    for(unsigned int i = 0; i < NUM_SHARDS; ++i)
+    {
+        Shard& shard = _shards[i];
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(shard._mutex);
+        shard._objectCache.clear();
+        shard._lruList.clear();
+        changeSize(0, shard._size);
+        shard._size = 0;
+    }
 }
 
 void ObjectCache::releaseGLObjects(osg::State* state)
 {
-    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_objectCacheMutex);
-
-    for(ObjectCacheMap::iterator itr = _objectCache.begin();
-        itr != _objectCache.end();
-        ++itr)
+    for(unsigned int i = 0; i < NUM_SHARDS; ++i)
     {
-        osg::Object* object = itr->second.first.get();
-        object->releaseGLObjects(state);
+        Shard& shard = _shards[i];
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(shard._mutex);
+
+        for(ObjectCacheMap::iterator itr = shard._objectCache.begin();
+            itr != shard._objectCache.end();
+            ++itr)
+        {
+            osg::Object* object = itr->second._object.get();
+            object->releaseGLObjects(state);
+        }
     }
 }
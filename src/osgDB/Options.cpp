@@ -30,6 +30,7 @@ Options::Options(const Options& options,const osg::CopyOp& copyop):
     _readFileCallback(options._readFileCallback),
     _writeFileCallback(options._writeFileCallback),
     _fileLocationCallback(options._fileLocationCallback),
+    _cancellationToken(options._cancellationToken),
     _fileCache(options._fileCache),
     _terrain(options._terrain),
     _parentGroup(options._parentGroup) {}
@@ -63,6 +63,9 @@ static osg::ApplicationUsageProxy Registry_e1(osg::ApplicationUsage::ENVIRONMENT
 #endif
 
 static osg::ApplicationUsageProxy Registry_e2(osg::ApplicationUsage::ENVIRONMENTAL_VARIABLE,"OSG_BUILD_KDTREES on/off","Enable/disable the automatic building of KdTrees for each loaded Geometry.");
+static osg::ApplicationUsageProxy Registry_e3(osg::ApplicationUsage::ENVIRONMENTAL_VARIABLE,"OSG_KDTREE_BUILD_STRATEGY MEDIAN/SAH","Set whether KdTrees are divided at the mid point of the longest axis or using the surface area heuristic.");
+static osg::ApplicationUsageProxy Registry_e4(osg::ApplicationUsage::ENVIRONMENTAL_VARIABLE,"OSG_KDTREE_NODE_LAYOUT STANDARD/COMPACT","Set whether KdTree nodes are stored with full bounding boxes or in the compact depth first layout.");
+static osg::ApplicationUsageProxy Registry_e5(osg::ApplicationUsage::ENVIRONMENTAL_VARIABLE,"OSG_KDTREE_NUM_THREADS <value>","Set the maximum number of threads used to build each KdTree with the surface area heuristic, 0 uses all processors.");
 
 
 // from MimeTypes.cpp
@@ -235,6 +238,30 @@ Registry::Registry()
         else _buildKdTreesHint = Options::BUILD_KDTREES;
     }
 
+    osg::KdTree::BuildOptions& kdTreeBuildOptions = _kdTreeBuilder->_buildOptions;
+
+    const char* kdtree_strategy_str = getenv("OSG_KDTREE_BUILD_STRATEGY");
+    if (kdtree_strategy_str)
+    {
+        if (strcmp(kdtree_strategy_str, "SAH")==0 || strcmp(kdtree_strategy_str, "sah")==0) kdTreeBuildOptions._buildStrategy = osg::KdTree::BuildOptions::SURFACE_AREA_HEURISTIC;
+        else kdTreeBuildOptions._buildStrategy = osg::KdTree::BuildOptions::MEDIAN_SPLIT;
+    }
+
+    const char* kdtree_layout_str = getenv("OSG_KDTREE_NODE_LAYOUT");
+    if (kdtree_layout_str)
+    {
+        if (strcmp(kdtree_layout_str, "COMPACT")==0 || strcmp(kdtree_layout_str, "compact")==0) kdTreeBuildOptions._nodeLayout = osg::KdTree::BuildOptions::COMPACT_NODE_LAYOUT;
+        else kdTreeBuildOptions._nodeLayout = osg::KdTree::BuildOptions::STANDARD_NODE_LAYOUT;
+    }
+
+    const char* kdtree_threads_str = getenv("OSG_KDTREE_NUM_THREADS");
+    if (kdtree_threads_str)
+    {
+        // 0 uses all processors, negative values are clamped to a single thread.
+        int numThreads = atoi(kdtree_threads_str);
+        kdTreeBuildOptions._numThreads = numThreads<0 ? 1u : static_cast<unsigned int>(numThreads);
+    }
+
     const char* ptr=0;
 
     _expiryDelay = 10.0;
@@ -1186,12 +1213,12 @@ ReaderWriter::ReadResult Registry::read(const ReadFunctor& readFunctor)
     typedef std::vector<ReaderWriter::ReadResult> Results;
     Results results;
 
-    // first attempt to load the file from existing ReaderWriter's
+    // first attempt to load the file from existing ReaderWriter's, a cancelled read isn't retried with other ReaderWriter's.
     AvailableReaderWriterIterator itr(_rwList, _pluginMutex);
     for(;itr.valid();++itr)
     {
         ReaderWriter::ReadResult rr = readFunctor.doRead(*itr);
-        if (readFunctor.isValid(rr)) return rr;
+        if (readFunctor.isValid(rr) || rr.cancelled()) return rr;
         else results.push_back(rr);
     }
 
@@ -1200,7 +1227,7 @@ ReaderWriter::ReadResult Registry::read(const ReadFunctor& readFunctor)
     for(;aaitr.valid();++aaitr)
     {
         ReaderWriter::ReadResult rr = readFunctor.doRead(*aaitr);
-        if (readFunctor.isValid(rr)) return rr;
+        if (readFunctor.isValid(rr) || rr.cancelled()) return rr;
         else
         {
             // don't pass on FILE_NOT_FOUND results as we don't want to prevent non archive plugins that haven't been
@@ -1216,7 +1243,7 @@ ReaderWriter::ReadResult Registry::read(const ReadFunctor& readFunctor)
         for(;itr.valid();++itr)
         {
             ReaderWriter::ReadResult rr = readFunctor.doRead(*itr);
-            if (readFunctor.isValid(rr)) return rr;
+            if (readFunctor.isValid(rr) || rr.cancelled()) return rr;
             else results.push_back(rr);
         }
     }
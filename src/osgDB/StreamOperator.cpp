@@ -20,8 +20,13 @@ void InputIterator::checkStream() const
 {
     if (_in->rdstate()&_in->failbit)
     {
-        OSG_NOTICE<<"InputIterator::checkStream() : _in->rdstate() "<<_in->rdstate()<<", "<<_in->failbit<<std::endl;
-        OSG_NOTICE<<"                               _in->tellg() = "<<_in->tellg()<<std::endl;
+        // only report the first failure, the reads that follow it fail too, and not the failure of a cancelled read.
+        const Options* options = _inputStream ? _inputStream->getOptions() : 0;
+        if (!_failed && !(options && options->isCancelled()))
+        {
+            OSG_NOTICE<<"InputIterator::checkStream() : _in->rdstate() "<<_in->rdstate()<<", "<<_in->failbit<<std::endl;
+            OSG_NOTICE<<"                               _in->tellg() = "<<_in->tellg()<<std::endl;
+        }
         _failed = true;
     }
 }
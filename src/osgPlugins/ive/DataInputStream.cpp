@@ -1704,6 +1704,14 @@ osg::Shape* DataInputStream::readShape()
 
 osg::Node* DataInputStream::readNode()
 {
+    if (_options.valid() && _options->isCancelled())
+    {
+        // fail the stream so the nodes still reading unwind without parsing the rest of the file.
+        _istream->setstate(std::ios::failbit);
+        throwException("DataInputStream::readNode(): Read cancelled.");
+        return 0;
+    }
+
     // Read node unique ID.
     int id = readInt();
     // See if node is already in the list.
@@ -99,7 +99,13 @@ class ReaderWriterIVE : public ReaderWriter
                 return in.getException()->getError();
             }
 
-            return in.readNode();
+            osg::Node* node = in.readNode();
+            if (in.getException() && options && options->isCancelled())
+            {
+                return ReadResult::READ_CANCELLED;
+            }
+
+            return node;
         }
 
         virtual WriteResult writeObject(const Object& object,const std::string& fileName, const osgDB::ReaderWriter::Options* options) const
@@ -309,7 +309,7 @@ public:
     {
         std::string passString;
         unsigned int blocks = 0;
-        while ( !_in->eof() )
+        while ( _in->good() )
         {
             passString.clear();
             readString( passString );
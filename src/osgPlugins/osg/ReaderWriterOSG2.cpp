@@ -26,6 +26,13 @@ using namespace osgDB;
 #define CATCH_EXCEPTION(s) \
     if (s.getException()) return (s.getException()->getError() + " At " + s.getException()->getField());
 
+#define CATCH_INPUT_EXCEPTION(s) \
+    if (s.getException()) \
+    { \
+        if (s.getOptions() && s.getOptions()->isCancelled()) return ReadResult::READ_CANCELLED; \
+        return (s.getException()->getError() + " At " + s.getException()->getField()); \
+    }
+
 #define OSG_REVERSE(value) ( ((value & 0x000000ff)<<24) | ((value & 0x0000ff00)<<8) | ((value & 0x00ff0000)>>8) | ((value & 0xff000000)>>24) )
 
 InputIterator* readInputIterator( std::istream& fin, const Options* options )
@@ -196,12 +203,12 @@ public:
         osgDB::InputStream::ReadType readType = is.start(ii.get());
         if ( readType==InputStream::READ_UNKNOWN )
         {
-            CATCH_EXCEPTION(is);
+            CATCH_INPUT_EXCEPTION(is);
             return ReadResult::FILE_NOT_HANDLED;
         }
-        is.decompress(); CATCH_EXCEPTION(is);
+        is.decompress(); CATCH_INPUT_EXCEPTION(is);
 
-        osg::ref_ptr<osg::Object> obj = is.readObject(); CATCH_EXCEPTION(is);
+        osg::ref_ptr<osg::Object> obj = is.readObject(); CATCH_INPUT_EXCEPTION(is);
         return obj;
     }
 
@@ -226,12 +233,12 @@ public:
         InputStream is( options );
         if ( is.start(ii.get())!=InputStream::READ_IMAGE )
         {
-            CATCH_EXCEPTION(is);
+            CATCH_INPUT_EXCEPTION(is);
             return ReadResult::FILE_NOT_HANDLED;
         }
 
-        is.decompress(); CATCH_EXCEPTION(is);
-        osg::ref_ptr<osg::Image> image = is.readImage(); CATCH_EXCEPTION(is);
+        is.decompress(); CATCH_INPUT_EXCEPTION(is);
+        osg::ref_ptr<osg::Image> image = is.readImage(); CATCH_INPUT_EXCEPTION(is);
 
         return image;
     }
@@ -257,12 +264,12 @@ public:
         osgDB::InputStream::ReadType readType = is.start(ii.get());
         if ( readType!=InputStream::READ_SCENE && readType!=InputStream::READ_OBJECT )
         {
-            CATCH_EXCEPTION(is);
+            CATCH_INPUT_EXCEPTION(is);
             return ReadResult::FILE_NOT_HANDLED;
         }
 
-        is.decompress(); CATCH_EXCEPTION(is);
-        osg::ref_ptr<osg::Node> node = is.readObjectOfType<osg::Node>(); CATCH_EXCEPTION(is);
+        is.decompress(); CATCH_INPUT_EXCEPTION(is);
+        osg::ref_ptr<osg::Node> node = is.readObjectOfType<osg::Node>(); CATCH_INPUT_EXCEPTION(is);
         if ( !node ) return ReadResult::FILE_NOT_HANDLED;
         return node;
     }
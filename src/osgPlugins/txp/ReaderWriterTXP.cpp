@@ -104,6 +104,10 @@ osgDB::ReaderWriter::ReadResult ReaderWriterTXP::local_readNode(const std::strin
         if (!archive->getTileInfo(x,y,lod,info))
             return ReadResult::ERROR_IN_READING_FILE;
 
+        // tiles are the object boundaries at which a txp read can be cancelled.
+        if (options && options->isCancelled())
+            return ReadResult::READ_CANCELLED;
+
         std::vector<TXPArchive::TileLocationInfo> childrenLoc;
         osg::ref_ptr<osg::Node> tileContent = getTileContent(info,x,y,lod,archive.get(), childrenLoc);
 
@@ -265,6 +269,9 @@ osgDB::ReaderWriter::ReadResult ReaderWriterTXP::local_readNode(const std::strin
                 if (!archive->getTileInfo(loc,info))
                     continue;
 
+                if (options && options->isCancelled())
+                    return ReadResult::READ_CANCELLED;
+
                 osg::ref_ptr<osg::Node> tileContent = getTileContent(info, loc, archive.get(), childrenChildLoc);
 
                 tileContent->setName("TileContent");
@@ -374,6 +381,9 @@ osgDB::ReaderWriter::ReadResult ReaderWriterTXP::local_readNode(const std::strin
                     if (!archive->getTileInfo(tileX,tileY,tileLOD,info))
                     continue;
 
+                    if (options && options->isCancelled())
+                        return ReadResult::READ_CANCELLED;
+
                     osg::ref_ptr<osg::Node> tileContent = getTileContent(info,tileX,tileY,tileLOD,archive.get(), childrenLoc);
 
                     tileContent->setName("TileContent");
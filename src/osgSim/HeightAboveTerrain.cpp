@@ -83,9 +83,17 @@ void HeightAboveTerrain::computeIntersections(osg::Node* scene, osg::Node::NodeM
 
     _intersectionVisitor.reset();
     _intersectionVisitor.setTraversalMask(traversalMask);
-    _intersectionVisitor.setIntersector( intersectorGroup.get() );
 
-    scene->accept(_intersectionVisitor);
+    if (_intersectionThreadPool.valid())
+    {
+        _intersectionThreadPool->computeIntersections(scene, intersectorGroup.get(), _intersectionVisitor);
+    }
+    else
+    {
+        _intersectionVisitor.setIntersector( intersectorGroup.get() );
+
+        scene->accept(_intersectionVisitor);
+    }
 
     unsigned int index = 0;
     osgUtil::IntersectorGroup::Intersectors& intersectors = intersectorGroup->getIntersectors();
@@ -32,14 +32,29 @@ void DatabaseCacheReadCallback::clearDatabaseCache()
 
 void DatabaseCacheReadCallback::pruneUnusedDatabaseCache()
 {
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+
+    for(FileNameSceneMap::iterator itr = _filenameSceneMap.begin();
+        itr != _filenameSceneMap.end();
+        )
+    {
+        // only referenced by the cache so no traversal is using it.
+        if (itr->second->referenceCount()==1) _filenameSceneMap.erase(itr++);
+        else ++itr;
+    }
 }
 
 osg::ref_ptr<osg::Node> DatabaseCacheReadCallback::readNodeFile(const std::string& filename)
 {
-    // first check to see if file is already loaded.
+    // first check to see if file is already loaded, or is being loaded by another thread.
     {
         OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
 
+        while(_filesBeingRead.count(filename)!=0)
+        {
+            _fileReadCondition.wait(&_mutex);
+        }
+
         FileNameSceneMap::iterator itr = _filenameSceneMap.find(filename);
         if (itr != _filenameSceneMap.end())
         {
@@ -47,41 +62,52 @@ osg::ref_ptr<osg::Node> DatabaseCacheReadCallback::readNodeFile(const std::strin
 
             return itr->second.get();
         }
+
+        _filesBeingRead.insert(filename);
     }
 
     // now load the file.
     osg::ref_ptr<osg::Node> node = osgDB::readRefNodeFile(filename);
 
+    // compute the bounds before the subgraph is shared with other threads so that they only ever read it.
+    if (node.valid()) node->getBound();
+
     // insert into the cache.
-    if (node.valid())
     {
         OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
 
-        if (_filenameSceneMap.size() < _maxNumFilesToCache)
+        if (node.valid())
         {
-            OSG_INFO<<"Inserting into cache "<<filename<<std::endl;
+            if (_filenameSceneMap.size() < _maxNumFilesToCache)
+            {
+                OSG_INFO<<"Inserting into cache "<<filename<<std::endl;
 
-            _filenameSceneMap[filename] = node;
-        }
-        else
-        {
-            // for time being implement a crude search for a candidate to chuck out from the cache.
-            for(FileNameSceneMap::iterator itr = _filenameSceneMap.begin();
-                itr != _filenameSceneMap.end();
-                ++itr)
+                _filenameSceneMap[filename] = node;
+            }
+            else
             {
-                if (itr->second->referenceCount()==1)
+                // for time being implement a crude search for a candidate to chuck out from the cache.
+                for(FileNameSceneMap::iterator itr = _filenameSceneMap.begin();
+                    itr != _filenameSceneMap.end();
+                    ++itr)
                 {
-                    OSG_NOTICE<<"Erasing "<<itr->first<<std::endl;
-                    // found a node which is only referenced in the cache so we can discard it
-                    // and know that the actual memory will be released.
-                    _filenameSceneMap.erase(itr);
-                    break;
+                    if (itr->second->referenceCount()==1)
+                    {
+                        OSG_NOTICE<<"Erasing "<<itr->first<<std::endl;
+                        // found a node which is only referenced in the cache so we can discard it
+                        // and know that the actual memory will be released.
+                        _filenameSceneMap.erase(itr);
+                        break;
+                    }
                 }
+                OSG_INFO<<"And the replacing with "<<filename<<std::endl;
+                _filenameSceneMap[filename] = node;
             }
-            OSG_INFO<<"And the replacing with "<<filename<<std::endl;
-            _filenameSceneMap[filename] = node;
         }
+
+        // wake up any threads waiting on this file, on failure they'll go on to try reading it themselves.
+        _filesBeingRead.erase(filename);
+        _fileReadCondition.broadcast();
     }
 
     return node;
@@ -118,9 +144,17 @@ void LineOfSight::computeIntersections(osg::Node* scene, osg::Node::NodeMask tra
 
     _intersectionVisitor.reset();
     _intersectionVisitor.setTraversalMask(traversalMask);
-    _intersectionVisitor.setIntersector( intersectorGroup.get() );
 
-    scene->accept(_intersectionVisitor);
+    if (_intersectionThreadPool.valid())
+    {
+        _intersectionThreadPool->computeIntersections(scene, intersectorGroup.get(), _intersectionVisitor);
+    }
+    else
+    {
+        _intersectionVisitor.setIntersector( intersectorGroup.get() );
+
+        scene->accept(_intersectionVisitor);
+    }
 
     unsigned int index = 0;
     osgUtil::IntersectorGroup::Intersectors& intersectors = intersectorGroup->getIntersectors();
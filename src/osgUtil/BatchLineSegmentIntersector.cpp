@@ -0,0 +1,727 @@
+/* -*-c++-*- OpenSceneGraph - Copyright (C) 1998-2006 Robert Osfield
+ *
+ * This library is open source and may be redistributed and/or modified under
+ * the terms of the OpenSceneGraph Public License (OSGPL) version 0.0 or
+ * (at your option) any later version.  The full license is in LICENSE file
+ * included with this distribution, and on the openscenegraph.org website.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * OpenSceneGraph Public License for more details.
+*/
+
+#include <osgUtil/BatchLineSegmentIntersector>
+
+#include <osg/Geometry>
+#include <osg/KdTree>
+#include <osg/Notify>
+#include <osg/TemplatePrimitiveFunctor>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2)
+    #include <emmintrin.h>
+    #define OSGUTIL_BATCH_USE_SSE2
+#endif
+
+using namespace osgUtil;
+
+namespace BatchLineSegmentIntersectorUtils
+{
+
+// number of segments tested together against a bounding box or triangle
+const unsigned int PACKET_WIDTH = 4;
+
+struct RayPacket
+{
+    // segments are stored structure of arrays, with t running from 0 to 1 along the clipped segment
+    std::vector<float>          ox, oy, oz;
+    std::vector<float>          dx, dy, dz;
+    std::vector<float>          invdx, invdy, invdz;
+    std::vector<float>          tmax;
+
+    // mapping of each lane back onto the original segment
+    std::vector<unsigned int>   segmentIndex;
+    std::vector<double>         ratioStart;
+    std::vector<double>         ratioScale;
+
+    unsigned int                numRays;
+
+    RayPacket(): numRays(0) {}
+
+    void reserve(unsigned int n)
+    {
+        ox.reserve(n); oy.reserve(n); oz.reserve(n);
+        dx.reserve(n); dy.reserve(n); dz.reserve(n);
+        invdx.reserve(n); invdy.reserve(n); invdz.reserve(n);
+        tmax.reserve(n);
+        segmentIndex.reserve(n); ratioStart.reserve(n); ratioScale.reserve(n);
+    }
+
+    static inline float safeInverse(float d)
+    {
+        // avoid infinities so that 0*inf doesn't turn into a NaN in the slab tests.
+        const float minValue = 1e-20f;
+        if (d>=0.0f && d<minValue) d = minValue;
+        else if (d<0.0f && d>-minValue) d = -minValue;
+        return 1.0f/d;
+    }
+
+    void add(const osg::Vec3& o, const osg::Vec3& d, unsigned int segment, double r0, double rs)
+    {
+        ox.push_back(o.x()); oy.push_back(o.y()); oz.push_back(o.z());
+        dx.push_back(d.x()); dy.push_back(d.y()); dz.push_back(d.z());
+        invdx.push_back(safeInverse(d.x())); invdy.push_back(safeInverse(d.y())); invdz.push_back(safeInverse(d.z()));
+        tmax.push_back(1.0f);
+        segmentIndex.push_back(segment);
+        ratioStart.push_back(r0);
+        ratioScale.push_back(rs);
+        ++numRays;
+    }
+
+    /** pad out to a whole number of packets with lanes that can never hit anything.*/
+    void pad()
+    {
+        while((ox.size() % PACKET_WIDTH)!=0)
+        {
+            ox.push_back(0.0f); oy.push_back(0.0f); oz.push_back(0.0f);
+            dx.push_back(0.0f); dy.push_back(0.0f); dz.push_back(0.0f);
+            invdx.push_back(0.0f); invdy.push_back(0.0f); invdz.push_back(0.0f);
+            tmax.push_back(-1.0f);
+            segmentIndex.push_back(0);
+            ratioStart.push_back(0.0);
+            ratioScale.push_back(0.0);
+        }
+    }
+
+    unsigned int getNumPackets() const { return static_cast<unsigned int>(ox.size()/PACKET_WIDTH); }
+};
+
+struct Settings : public osg::Referenced
+{
+    Settings():
+        _intersector(0),
+        _iv(0),
+        _drawable(0),
+        _packet(0) {}
+
+    BatchLineSegmentIntersector*    _intersector;
+    osgUtil::IntersectionVisitor*   _iv;
+    osg::Drawable*                  _drawable;
+    osg::ref_ptr<osg::Vec3Array>    _vertices;
+    RayPacket*                      _packet;
+    Intersector::IntersectionLimit  _intersectionLimit;
+
+    // nearest hit found so far for each lane when using LIMIT_NEAREST
+    std::vector<BatchLineSegmentIntersector::Intersection> _nearest;
+};
+
+// Test the four lanes of packet p against the triangle, returning a bit mask of hits and the hit t, u and v.
+inline unsigned int intersectTriangle(const RayPacket& packet, unsigned int p, unsigned int laneMask,
+                                      const osg::Vec3& v0, const osg::Vec3& v1, const osg::Vec3& v2,
+                                      float* t_out, float* u_out, float* v_out)
+{
+    const unsigned int base = p*PACKET_WIDTH;
+
+    osg::Vec3 e1 = v1-v0;
+    osg::Vec3 e2 = v2-v0;
+
+#ifdef OSGUTIL_BATCH_USE_SSE2
+    __m128 dx = _mm_loadu_ps(&packet.dx[base]);
+    __m128 dy = _mm_loadu_ps(&packet.dy[base]);
+    __m128 dz = _mm_loadu_ps(&packet.dz[base]);
+
+    __m128 e1x = _mm_set1_ps(e1.x()), e1y = _mm_set1_ps(e1.y()), e1z = _mm_set1_ps(e1.z());
+    __m128 e2x = _mm_set1_ps(e2.x()), e2y = _mm_set1_ps(e2.y()), e2z = _mm_set1_ps(e2.z());
+
+    // P = d ^ e2
+    __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+    __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+    __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+
+    __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+    __m128 inv_det = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+    // T = o - v0
+    __m128 tx = _mm_sub_ps(_mm_loadu_ps(&packet.ox[base]), _mm_set1_ps(v0.x()));
+    __m128 ty = _mm_sub_ps(_mm_loadu_ps(&packet.oy[base]), _mm_set1_ps(v0.y()));
+    __m128 tz = _mm_sub_ps(_mm_loadu_ps(&packet.oz[base]), _mm_set1_ps(v0.z()));
+
+    __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), inv_det);
+
+    // Q = T ^ e1
+    __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+    __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+    __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+
+    __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inv_det);
+    __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv_det);
+
+    __m128 zero = _mm_setzero_ps();
+    __m128 one = _mm_set1_ps(1.0f);
+
+    // comparisons against NaN are false, so degenerate (det==0) lanes drop out here.
+    __m128 hit = _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero));
+    hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), one));
+    hit = _mm_and_ps(hit, _mm_cmpge_ps(t, zero));
+    hit = _mm_and_ps(hit, _mm_cmple_ps(t, _mm_loadu_ps(&packet.tmax[base])));
+    hit = _mm_and_ps(hit, _mm_cmpneq_ps(det, zero));
+
+    unsigned int mask = static_cast<unsigned int>(_mm_movemask_ps(hit)) & laneMask;
+    if (mask)
+    {
+        _mm_storeu_ps(t_out, t);
+        _mm_storeu_ps(u_out, u);
+        _mm_storeu_ps(v_out, v);
+    }
+    return mask;
+#else
+    unsigned int mask = 0;
+    for(unsigned int lane=0; lane<PACKET_WIDTH; ++lane)
+    {
+        if ((laneMask & (1u<<lane))==0) continue;
+
+        unsigned int i = base+lane;
+        osg::Vec3 d(packet.dx[i], packet.dy[i], packet.dz[i]);
+        osg::Vec3 P = d ^ e2;
+        float det = e1*P;
+        if (det==0.0f) continue;
+
+        float inv_det = 1.0f/det;
+        osg::Vec3 T(packet.ox[i]-v0.x(), packet.oy[i]-v0.y(), packet.oz[i]-v0.z());
+        float u = (T*P)*inv_det;
+        if (u<0.0f || u>1.0f) continue;
+
+        osg::Vec3 Q = T ^ e1;
+        float v = (d*Q)*inv_det;
+        if (v<0.0f || u+v>1.0f) continue;
+
+        float t = (e2*Q)*inv_det;
+        if (t<0.0f || t>packet.tmax[i]) continue;
+
+        t_out[lane] = t;
+        u_out[lane] = u;
+        v_out[lane] = v;
+        mask |= (1u<<lane);
+    }
+    return mask;
+#endif
+}
+
+// Test the four lanes of packet p against the bounding box, returning a bit mask of the lanes that pass through it.
+inline unsigned int intersectBoundingBox(const RayPacket& packet, unsigned int p, unsigned int laneMask, const osg::BoundingBox& bb)
+{
+    const unsigned int base = p*PACKET_WIDTH;
+
+#ifdef OSGUTIL_BATCH_USE_SSE2
+    __m128 invdx = _mm_loadu_ps(&packet.invdx[base]);
+    __m128 invdy = _mm_loadu_ps(&packet.invdy[base]);
+    __m128 invdz = _mm_loadu_ps(&packet.invdz[base]);
+
+    __m128 ox = _mm_loadu_ps(&packet.ox[base]);
+    __m128 oy = _mm_loadu_ps(&packet.oy[base]);
+    __m128 oz = _mm_loadu_ps(&packet.oz[base]);
+
+    __m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bb.xMin()), ox), invdx);
+    __m128 t2x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bb.xMax()), ox), invdx);
+    __m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bb.yMin()), oy), invdy);
+    __m128 t2y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bb.yMax()), oy), invdy);
+    __m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bb.zMin()), oz), invdz);
+    __m128 t2z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(bb.zMax()), oz), invdz);
+
+    __m128 tnear = _mm_max_ps(_mm_max_ps(_mm_min_ps(t1x, t2x), _mm_min_ps(t1y, t2y)), _mm_max_ps(_mm_min_ps(t1z, t2z), _mm_setzero_ps()));
+    __m128 tfar = _mm_min_ps(_mm_min_ps(_mm_max_ps(t1x, t2x), _mm_max_ps(t1y, t2y)), _mm_min_ps(_mm_max_ps(t1z, t2z), _mm_loadu_ps(&packet.tmax[base])));
+
+    return static_cast<unsigned int>(_mm_movemask_ps(_mm_cmple_ps(tnear, tfar))) & laneMask;
+#else
+    unsigned int mask = 0;
+    for(unsigned int lane=0; lane<PACKET_WIDTH; ++lane)
+    {
+        if ((laneMask & (1u<<lane))==0) continue;
+
+        unsigned int i = base+lane;
+        float t1x = (bb.xMin()-packet.ox[i])*packet.invdx[i], t2x = (bb.xMax()-packet.ox[i])*packet.invdx[i];
+        float t1y = (bb.yMin()-packet.oy[i])*packet.invdy[i], t2y = (bb.yMax()-packet.oy[i])*packet.invdy[i];
+        float t1z = (bb.zMin()-packet.oz[i])*packet.invdz[i], t2z = (bb.zMax()-packet.oz[i])*packet.invdz[i];
+
+        float tnear = osg::maximum(osg::maximum(osg::minimum(t1x, t2x), osg::minimum(t1y, t2y)), osg::maximum(osg::minimum(t1z, t2z), 0.0f));
+        float tfar = osg::minimum(osg::minimum(osg::maximum(t1x, t2x), osg::maximum(t1y, t2y)), osg::minimum(osg::maximum(t1z, t2z), packet.tmax[i]));
+        if (tnear<=tfar) mask |= (1u<<lane);
+    }
+    return mask;
+#endif
+}
+
+struct PacketIntersectFunctor
+{
+    osg::ref_ptr<Settings>      _settings;
+
+    unsigned int                _primitiveIndex;
+
+    // active lane masks, one per packet for each level of the KdTree traversal
+    std::vector<unsigned char>  _masks;
+    unsigned int                _numPackets;
+
+    PacketIntersectFunctor():
+        _primitiveIndex(0),
+        _numPackets(0) {}
+
+    void set(Settings* settings)
+    {
+        _settings = settings;
+        _numPackets = settings->_packet->getNumPackets();
+
+        _masks.clear();
+        for(unsigned int p=0; p<_numPackets; ++p)
+        {
+            unsigned char mask = 0;
+            for(unsigned int lane=0; lane<PACKET_WIDTH; ++lane)
+            {
+                if (settings->_packet->tmax[p*PACKET_WIDTH+lane]>=0.0f) mask |= (1u<<lane);
+            }
+            _masks.push_back(mask);
+        }
+    }
+
+    inline const unsigned char* currentMasks() const { return &_masks[_masks.size()-_numPackets]; }
+
+    bool enter(const osg::BoundingBox& bb)
+    {
+        const RayPacket& packet = *(_settings->_packet);
+
+        unsigned int previous = static_cast<unsigned int>(_masks.size())-_numPackets;
+        bool anyActive = false;
+        for(unsigned int p=0; p<_numPackets; ++p)
+        {
+            unsigned int mask = _masks[previous+p];
+            if (mask) mask = intersectBoundingBox(packet, p, mask, bb);
+            if (mask) anyActive = true;
+            _masks.push_back(static_cast<unsigned char>(mask));
+        }
+
+        if (!anyActive)
+        {
+            _masks.resize(previous+_numPackets);
+            return false;
+        }
+        return true;
+    }
+
+    void leave()
+    {
+        _masks.resize(_masks.size()-_numPackets);
+    }
+
+    void addHit(unsigned int lane, float t, float u, float v,
+                const osg::Vec3& v0, const osg::Vec3& v1, const osg::Vec3& v2,
+                int i0, int i1, int i2)
+    {
+        RayPacket& packet = *(_settings->_packet);
+        BatchLineSegmentIntersector* intersector = _settings->_intersector;
+
+        unsigned int segment = packet.segmentIndex[lane];
+        double ratio = packet.ratioStart[lane] + double(t)*packet.ratioScale[lane];
+
+        const osg::Vec3d& start = intersector->getStart(segment);
+        const osg::Vec3d& end = intersector->getEnd(segment);
+
+        osg::Vec3 normal = (v1-v0)^(v2-v0);
+        normal.normalize();
+
+        BatchLineSegmentIntersector::Intersection hit;
+        hit.ratio = ratio;
+        hit.matrix = _settings->_iv->getModelMatrix();
+        hit.nodePath = _settings->_iv->getNodePath();
+        hit.drawable = _settings->_drawable;
+        hit.primitiveIndex = _primitiveIndex;
+        hit.localIntersectionPoint = start*(1.0-ratio) + end*ratio;
+        hit.localIntersectionNormal = normal;
+
+        if (i0>=0)
+        {
+            float r0 = 1.0f-u-v;
+            hit.indexList.reserve(3);
+            hit.ratioList.reserve(3);
+            if (r0!=0.0f) { hit.indexList.push_back(i0); hit.ratioList.push_back(r0); }
+            if (u!=0.0f) { hit.indexList.push_back(i1); hit.ratioList.push_back(u); }
+            if (v!=0.0f) { hit.indexList.push_back(i2); hit.ratioList.push_back(v); }
+        }
+
+        switch(_settings->_intersectionLimit)
+        {
+            case(Intersector::LIMIT_NEAREST):
+                // only closer hits can now be accepted for this lane
+                packet.tmax[lane] = t;
+                _settings->_nearest[lane] = hit;
+                break;
+            case(Intersector::LIMIT_ONE_PER_DRAWABLE):
+            case(Intersector::LIMIT_ONE):
+                // retire the lane, both the triangle and bounding box tests reject negative tmax
+                packet.tmax[lane] = -1.0f;
+                intersector->getIntersections(segment).insert(hit);
+                break;
+            default:
+                intersector->getIntersections(segment).insert(hit);
+                break;
+        }
+    }
+
+    void intersect(const osg::Vec3& v0, const osg::Vec3& v1, const osg::Vec3& v2, int i0, int i1, int i2)
+    {
+        const unsigned char* masks = currentMasks();
+
+        float t[PACKET_WIDTH], u[PACKET_WIDTH], v[PACKET_WIDTH];
+        for(unsigned int p=0; p<_numPackets; ++p)
+        {
+            if (!masks[p]) continue;
+
+            unsigned int hits = intersectTriangle(*(_settings->_packet), p, masks[p], v0, v1, v2, t, u, v);
+            for(unsigned int lane=0; hits!=0; ++lane, hits>>=1)
+            {
+                if (hits & 1) addHit(p*PACKET_WIDTH+lane, t[lane], u[lane], v[lane], v0, v1, v2, i0, i1, i2);
+            }
+        }
+    }
+
+    int indexOf(const osg::Vec3& v) const
+    {
+        const osg::Vec3Array* vertices = _settings->_vertices.get();
+        if (!vertices || vertices->empty()) return -1;
+
+        const osg::Vec3* first = &(vertices->front());
+        if (&v<first || &v>=first+vertices->size()) return -1;
+        return static_cast<int>(&v-first);
+    }
+
+    // handle points and lines
+    void operator()(const osg::Vec3&, bool /*treatVertexDataAsTemporary*/)
+    {
+        ++_primitiveIndex;
+    }
+
+    void operator()(const osg::Vec3&, const osg::Vec3&, bool /*treatVertexDataAsTemporary*/)
+    {
+        ++_primitiveIndex;
+    }
+
+    // handle triangles
+    void operator()(const osg::Vec3& v0, const osg::Vec3& v1, const osg::Vec3& v2, bool /*treatVertexDataAsTemporary*/)
+    {
+        intersect(v0, v1, v2, indexOf(v0), indexOf(v1), indexOf(v2));
+        ++_primitiveIndex;
+    }
+
+    void operator()(const osg::Vec3& v0, const osg::Vec3& v1, const osg::Vec3& v2, const osg::Vec3& v3, bool /*treatVertexDataAsTemporary*/)
+    {
+        intersect(v0, v1, v3, indexOf(v0), indexOf(v1), indexOf(v3));
+        intersect(v1, v2, v3, indexOf(v1), indexOf(v2), indexOf(v3));
+        ++_primitiveIndex;
+    }
+
+    // KdTree callbacks
+    void intersect(const osg::Vec3Array*, int , unsigned int)
+    {
+    }
+
+    void intersect(const osg::Vec3Array*, int, unsigned int, unsigned int)
+    {
+    }
+
+    void intersect(const osg::Vec3Array* vertices, int primitiveIndex, unsigned int p0, unsigned int p1, unsigned int p2)
+    {
+        _primitiveIndex = primitiveIndex;
+        intersect((*vertices)[p0], (*vertices)[p1], (*vertices)[p2], p0, p1, p2);
+    }
+
+    void intersect(const osg::Vec3Array* vertices, int primitiveIndex, unsigned int p0, unsigned int p1, unsigned int p2, unsigned int p3)
+    {
+        _primitiveIndex = primitiveIndex;
+        intersect((*vertices)[p0], (*vertices)[p1], (*vertices)[p3], p0, p1, p3);
+        intersect((*vertices)[p1], (*vertices)[p2], (*vertices)[p3], p1, p2, p3);
+    }
+};
+
+// clip the segment s to e against the bounding box, returning the range of ratios that lie within it.
+inline bool clipRatios(const osg::Vec3d& s, const osg::Vec3d& e, const osg::BoundingBox& bb, double& r0, double& r1)
+{
+    const double epsilon = 1e-5;
+
+    r0 = 0.0;
+    r1 = 1.0;
+
+    osg::Vec3d d = e-s;
+    for(int axis=0; axis<3; ++axis)
+    {
+        double bmin = bb._min[axis];
+        double bmax = bb._max[axis];
+        if (d[axis]==0.0)
+        {
+            if (s[axis]<bmin || s[axis]>bmax) return false;
+            continue;
+        }
+
+        double inv = 1.0/d[axis];
+        double t1 = (bmin-s[axis])*inv;
+        double t2 = (bmax-s[axis])*inv;
+        if (t1>t2) std::swap(t1, t2);
+        if (t1>r0) r0 = t1;
+        if (t2<r1) r1 = t2;
+        if (r0>r1) return false;
+    }
+
+    // pad the range slightly so that hits on the bounding box faces aren't lost to float precision.
+    r0 = osg::maximum(0.0, r0-epsilon);
+    r1 = osg::minimum(1.0, r1+epsilon);
+    return true;
+}
+
+} // namespace BatchLineSegmentIntersectorUtils
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+//  BatchLineSegmentIntersector
+//
+
+BatchLineSegmentIntersector::BatchLineSegmentIntersector(CoordinateFrame cf, osgUtil::Intersector::IntersectionLimit intersectionLimit):
+    Intersector(cf, intersectionLimit),
+    _parent(0)
+{
+}
+
+unsigned int BatchLineSegmentIntersector::addSegment(const osg::Vec3d& start, const osg::Vec3d& end)
+{
+    _segments.push_back(Segment(start, end));
+    _intersections.push_back(Intersections());
+    return static_cast<unsigned int>(_segments.size()-1);
+}
+
+void BatchLineSegmentIntersector::clearSegments()
+{
+    _segments.clear();
+    _intersections.clear();
+    _activeSegments.clear();
+    _activeSegmentsStack.clear();
+}
+
+Intersector* BatchLineSegmentIntersector::clone(osgUtil::IntersectionVisitor& iv)
+{
+    osg::ref_ptr<BatchLineSegmentIntersector> bsi = new BatchLineSegmentIntersector(MODEL, _intersectionLimit);
+    bsi->_parent = this;
+    bsi->setPrecisionHint(getPrecisionHint());
+    bsi->_segments.reserve(_segments.size());
+
+    if (_coordinateFrame==MODEL && iv.getModelMatrix()==0)
+    {
+        bsi->_segments = _segments;
+        return bsi.release();
+    }
+
+    // compute the matrix that takes this Intersector from its CoordinateFrame into the local MODEL coordinate frame
+    // that geometry in the scene graph will always be in.
+    osg::Matrix matrix(LineSegmentIntersector::getTransformation(iv, _coordinateFrame));
+
+    for(Segments::const_iterator itr = _segments.begin();
+        itr != _segments.end();
+        ++itr)
+    {
+        bsi->_segments.push_back(Segment(itr->start * matrix, itr->end * matrix));
+    }
+
+    return bsi.release();
+}
+
+bool BatchLineSegmentIntersector::segmentReachedLimit(unsigned int i)
+{
+    return _intersectionLimit == LIMIT_ONE && containsIntersections(i);
+}
+
+bool BatchLineSegmentIntersector::intersects(unsigned int i, const osg::BoundingSphere& bs)
+{
+    // if bs not valid then return true based on the assumption that an invalid sphere is yet to be defined.
+    if (!bs.valid()) return true;
+
+    const osg::Vec3d& start = _segments[i].start;
+    const osg::Vec3d& end = _segments[i].end;
+
+    osg::Vec3d sm = start - bs._center;
+    double c = sm.length2()-bs._radius*bs._radius;
+    if (c<0.0) return true;
+
+    osg::Vec3d se = end-start;
+    double a = se.length2();
+    double b = (sm*se)*2.0;
+    double d = b*b-4.0*a*c;
+
+    if (d<0.0) return false;
+
+    d = sqrt(d);
+
+    double div = 1.0/(2.0*a);
+
+    double r1 = (-b-d)*div;
+    double r2 = (-b+d)*div;
+
+    if (r1<=0.0 && r2<=0.0) return false;
+
+    if (r1>=1.0 && r2>=1.0) return false;
+
+    if (_intersectionLimit == LIMIT_NEAREST && !getIntersections(i).empty())
+    {
+        double ratio = (sm.length() - bs._radius) / sqrt(a);
+        if (ratio >= getIntersections(i).begin()->ratio) return false;
+    }
+
+    return true;
+}
+
+bool BatchLineSegmentIntersector::enter(const osg::Node& node)
+{
+    if (_activeSegmentsStack.empty())
+    {
+        // at the top of the traversal all segments that haven't reached their limit are active.
+        _activeSegments.clear();
+        for(unsigned int i=0; i<_segments.size(); ++i)
+        {
+            if (!segmentReachedLimit(i)) _activeSegments.push_back(i);
+        }
+    }
+
+    unsigned int levelStart = _activeSegmentsStack.empty() ? 0 : _activeSegmentsStack.back();
+    unsigned int levelEnd = static_cast<unsigned int>(_activeSegments.size());
+
+    // cull the active segments against the node's bound, keeping the survivors as the active set for the children.
+    bool cullingActive = node.isCullingActive();
+    const osg::BoundingSphere& bs = node.getBound();
+    for(unsigned int i=levelStart; i<levelEnd; ++i)
+    {
+        unsigned int segment = _activeSegments[i];
+        if (segmentReachedLimit(segment)) continue;
+        if (!cullingActive || intersects(segment, bs)) _activeSegments.push_back(segment);
+    }
+
+    if (_activeSegments.size()==levelEnd)
+    {
+        if (_activeSegmentsStack.empty()) _activeSegments.clear();
+        return false;
+    }
+
+    _activeSegmentsStack.push_back(levelEnd);
+    return true;
+}
+
+void BatchLineSegmentIntersector::leave()
+{
+    if (_activeSegmentsStack.empty()) return;
+
+    _activeSegments.resize(_activeSegmentsStack.back());
+    _activeSegmentsStack.pop_back();
+}
+
+void BatchLineSegmentIntersector::intersect(osgUtil::IntersectionVisitor& iv, osg::Drawable* drawable)
+{
+    using namespace BatchLineSegmentIntersectorUtils;
+
+    SegmentIndices allSegments;
+    const SegmentIndices* active = &_activeSegments;
+    unsigned int levelStart = 0;
+    if (_activeSegmentsStack.empty())
+    {
+        for(unsigned int i=0; i<_segments.size(); ++i) allSegments.push_back(i);
+        active = &allSegments;
+    }
+    else
+    {
+        levelStart = _activeSegmentsStack.back();
+    }
+
+    // gather the segments that pass through the drawable's bounding box into a packet,
+    // with each ray expressed relative to its clipped segment to retain float precision.
+    RayPacket packet;
+    packet.reserve(static_cast<unsigned int>(active->size()-levelStart)+PACKET_WIDTH);
+
+    const osg::BoundingBox& bb = drawable->getBoundingBox();
+    bool cullingActive = drawable->isCullingActive() && bb.valid();
+    for(unsigned int i=levelStart; i<active->size(); ++i)
+    {
+        unsigned int segment = (*active)[i];
+        if (segmentReachedLimit(segment)) continue;
+
+        const osg::Vec3d& s = _segments[segment].start;
+        const osg::Vec3d& e = _segments[segment].end;
+
+        double r0 = 0.0, r1 = 1.0;
+        if (cullingActive && !clipRatios(s, e, bb, r0, r1)) continue;
+
+        if (_intersectionLimit==LIMIT_NEAREST && !getIntersections(segment).empty())
+        {
+            // no need to look beyond the nearest hit found so far.
+            r1 = osg::minimum(r1, getIntersections(segment).begin()->ratio);
+            if (r0>=r1) continue;
+        }
+
+        osg::Vec3d d = e-s;
+        packet.add(osg::Vec3(s + d*r0), osg::Vec3(d*(r1-r0)), segment, r0, r1-r0);
+    }
+
+    if (packet.numRays==0) return;
+
+    if (iv.getDoDummyTraversal()) return;
+
+    packet.pad();
+
+    osg::ref_ptr<Settings> settings = new Settings;
+    settings->_intersector = this;
+    settings->_iv = &iv;
+    settings->_drawable = drawable;
+    settings->_packet = &packet;
+    settings->_intersectionLimit = _intersectionLimit;
+    if (_intersectionLimit==LIMIT_NEAREST) settings->_nearest.resize(packet.ox.size());
+
+    osg::Geometry* geometry = drawable->asGeometry();
+    if (geometry)
+    {
+        settings->_vertices = dynamic_cast<osg::Vec3Array*>(geometry->getVertexArray());
+    }
+
+    osg::KdTree* kdTree = iv.getUseKdTreeWhenAvailable() ? dynamic_cast<osg::KdTree*>(drawable->getShape()) : 0;
+
+    osg::TemplatePrimitiveFunctor<PacketIntersectFunctor> intersector;
+    intersector.set(settings.get());
+
+    if (kdTree) kdTree->intersect(intersector, kdTree->getNode(0));
+    else drawable->accept(intersector);
+
+    if (_intersectionLimit==LIMIT_NEAREST)
+    {
+        for(unsigned int lane=0; lane<packet.numRays; ++lane)
+        {
+            if (settings->_nearest[lane].drawable.valid()) getIntersections(packet.segmentIndex[lane]).insert(settings->_nearest[lane]);
+        }
+    }
+}
+
+void BatchLineSegmentIntersector::reset()
+{
+    Intersector::reset();
+
+    _activeSegments.clear();
+    _activeSegmentsStack.clear();
+
+    for(std::vector<Intersections>::iterator itr = _intersections.begin();
+        itr != _intersections.end();
+        ++itr)
+    {
+        itr->clear();
+    }
+}
+
+bool BatchLineSegmentIntersector::containsIntersections()
+{
+    std::vector<Intersections>& intersections = _parent ? _parent->_intersections : _intersections;
+    for(std::vector<Intersections>::iterator itr = intersections.begin();
+        itr != intersections.end();
+        ++itr)
+    {
+        if (!itr->empty()) return true;
+    }
+    return false;
+}
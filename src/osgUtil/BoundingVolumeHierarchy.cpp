@@ -0,0 +1,387 @@
+/* -*-c++-*- OpenSceneGraph - Copyright (C) 1998-2006 Robert Osfield
+ *
+ * This library is open source and may be redistributed and/or modified under
+ * the terms of the OpenSceneGraph Public License (OSGPL) version 0.0 or
+ * (at your option) any later version.  The full license is in LICENSE file
+ * included with this distribution, and on the openscenegraph.org website.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * OpenSceneGraph Public License for more details.
+*/
+
+#include <osgUtil/BoundingVolumeHierarchy>
+
+#include <osg/Geode>
+#include <osg/Billboard>
+#include <osg/LOD>
+#include <osg/Switch>
+#include <osg/Sequence>
+#include <osg/ProxyNode>
+#include <osg/Projection>
+#include <osg/Camera>
+#include <osg/MatrixTransform>
+#include <osg/PositionAttitudeTransform>
+#include <osg/Notify>
+
+#include <algorithm>
+#include <string.h>
+
+using namespace osgUtil;
+
+namespace BoundingVolumeHierarchyUtils
+{
+
+/** Flatten a subgraph into the leaves of a BoundingVolumeHierarchy. Plain groups, Geodes and relative
+  * MatrixTransform/PositionAttitudeTransform are traversed, everything else is left for the IntersectionVisitor
+  * to traverse when it's reached.*/
+class FlattenVisitor : public osg::NodeVisitor
+{
+    public:
+
+        FlattenVisitor(osg::Node* root, BoundingVolumeHierarchy::Leaves& leaves):
+            osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN),
+            _root(root),
+            _leaves(leaves),
+            _rootIsLeaf(false)
+        {
+            // node masks are checked when the hierarchy is traversed so that they can change without a rebuild.
+            setNodeMaskOverride(0xffffffff);
+
+            _matrixStack.push_back(0);
+        }
+
+        void apply(osg::Node& node) { addLeaf(node); }
+
+        void apply(osg::Drawable& drawable) { addLeaf(drawable, drawable.getBoundingBox()); }
+
+        void apply(osg::Geode& geode)
+        {
+            if (strcmp(geode.libraryName(),"osg")==0) traverse(geode);
+            else addLeaf(geode);
+        }
+
+        void apply(osg::Billboard& billboard) { addLeaf(billboard); }
+
+        void apply(osg::Group& group)
+        {
+            // groups from other libraries may implement their own traversal so have to be left to the IntersectionVisitor.
+            if (strcmp(group.libraryName(),"osg")==0) traverse(group);
+            else addLeaf(group);
+        }
+
+        void apply(osg::Switch& node) { addLeaf(node); }
+        void apply(osg::Sequence& node) { addLeaf(node); }
+        void apply(osg::LOD& node) { addLeaf(node); }
+        void apply(osg::ProxyNode& node) { addLeaf(node); }
+        void apply(osg::Projection& node) { addLeaf(node); }
+        void apply(osg::Camera& node) { addLeaf(node); }
+        void apply(osg::Transform& node) { addLeaf(node); }
+
+        void apply(osg::MatrixTransform& transform) { applyTransform(transform); }
+        void apply(osg::PositionAttitudeTransform& transform) { applyTransform(transform); }
+
+        void applyTransform(osg::Transform& transform)
+        {
+            if (transform.getReferenceFrame()!=osg::Transform::RELATIVE_RF) { addLeaf(transform); return; }
+
+            // the root's own transform will have already been applied by the IntersectionVisitor.
+            if (&transform==_root) { traverse(transform); return; }
+
+            osg::ref_ptr<osg::RefMatrix> matrix = _matrixStack.back().valid() ? new osg::RefMatrix(*_matrixStack.back()) : new osg::RefMatrix;
+            transform.computeLocalToWorldMatrix(*matrix, this);
+
+            _matrixStack.push_back(matrix);
+            traverse(transform);
+            _matrixStack.pop_back();
+        }
+
+        void addLeaf(osg::Node& node)
+        {
+            const osg::BoundingSphere& bs = node.getBound();
+            osg::BoundingBox bb;
+            if (bs.valid()) bb.expandBy(bs);
+
+            addLeaf(node, bb);
+        }
+
+        void addLeaf(osg::Node& node, const osg::BoundingBox& localBB)
+        {
+            if (&node==_root)
+            {
+                _rootIsLeaf = true;
+                return;
+            }
+
+            // empty nodes can't be intersected, and any change to their bound will trigger a rebuild.
+            if (!localBB.valid()) return;
+
+            _leaves.push_back(BoundingVolumeHierarchy::Leaf());
+            BoundingVolumeHierarchy::Leaf& leaf = _leaves.back();
+
+            // the node path of the visitor includes the root which isn't required as it'll be on the IntersectionVisitor's path.
+            leaf.nodePath.assign(getNodePath().begin()+1, getNodePath().end());
+            leaf.matrix = _matrixStack.back();
+
+            if (leaf.matrix.valid())
+            {
+                for(unsigned int i=0; i<8; ++i)
+                {
+                    leaf.bb.expandBy(localBB.corner(i) * (*leaf.matrix));
+                }
+            }
+            else
+            {
+                leaf.bb = localBB;
+            }
+        }
+
+        osg::Node*                                  _root;
+        BoundingVolumeHierarchy::Leaves&            _leaves;
+        bool                                        _rootIsLeaf;
+        std::vector< osg::ref_ptr<osg::RefMatrix> > _matrixStack;
+};
+
+struct LessCentre
+{
+    LessCentre(const BoundingVolumeHierarchy::Leaves& leaves, unsigned int axis): _leaves(leaves), _axis(axis) {}
+
+    bool operator() (unsigned int lhs, unsigned int rhs) const
+    {
+        return _leaves[lhs].bb.center()[_axis] < _leaves[rhs].bb.center()[_axis];
+    }
+
+    const BoundingVolumeHierarchy::Leaves&  _leaves;
+    unsigned int                            _axis;
+};
+
+}
+
+using namespace BoundingVolumeHierarchyUtils;
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy():
+    _maximumNumLeavesPerNode(2),
+    _dirty(true),
+    _root(0),
+    _hierarchy(new Hierarchy)
+{
+}
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy(const BoundingVolumeHierarchy& bvh, const osg::CopyOp& copyop):
+    osg::Node::ComputeBoundingSphereCallback(bvh, copyop),
+    _computeBoundCallback(bvh._computeBoundCallback),
+    _maximumNumLeavesPerNode(bvh._maximumNumLeavesPerNode),
+    _dirty(true),
+    _root(0),
+    _hierarchy(new Hierarchy)
+{
+}
+
+BoundingVolumeHierarchy* BoundingVolumeHierarchy::attach(osg::Node* node)
+{
+    if (!node) return 0;
+
+    BoundingVolumeHierarchy* bvh = get(node);
+    if (bvh) return bvh;
+
+    bvh = new BoundingVolumeHierarchy;
+    bvh->setComputeBoundingSphereCallback(node->getComputeBoundingSphereCallback());
+    node->setComputeBoundingSphereCallback(bvh);
+    node->dirtyBound();
+    return bvh;
+}
+
+osg::BoundingSphere BoundingVolumeHierarchy::computeBound(const osg::Node& node) const
+{
+    // the root's bound is only recomputed after a dirtyBound() from below it so the leaves will need recomputing.
+    _dirty = true;
+
+    return _computeBoundCallback.valid() ? _computeBoundCallback->computeBound(node) : node.computeBound();
+}
+
+bool BoundingVolumeHierarchy::build(osg::Node& root)
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+    return buildNoLock(root);
+}
+
+bool BoundingVolumeHierarchy::buildNoLock(osg::Node& root)
+{
+    // make sure that all the bounds below the root are up to date.
+    root.getBound();
+
+    osg::ref_ptr<Hierarchy> hierarchy = new Hierarchy;
+
+    FlattenVisitor fv(&root, hierarchy->leaves);
+    root.accept(fv);
+
+    hierarchy->valid = !fv._rootIsLeaf;
+
+    if (hierarchy->valid && !hierarchy->leaves.empty())
+    {
+        Leaves& leaves = hierarchy->leaves;
+        hierarchy->leafIndices.reserve(leaves.size());
+        for(unsigned int i=0; i<leaves.size(); ++i)
+        {
+            hierarchy->leafIndices.push_back(i);
+        }
+
+        hierarchy->nodes.reserve(leaves.size()*2/osg::maximum(_maximumNumLeavesPerNode,1u)+1);
+        divide(*hierarchy, 0, hierarchy->leafIndices.size());
+
+        OSG_INFO<<"BoundingVolumeHierarchy::build() "<<leaves.size()<<" leaves, "<<hierarchy->nodes.size()<<" nodes"<<std::endl;
+    }
+
+    _hierarchy = hierarchy;
+    _root = &root;
+    _dirty = false;
+
+    return hierarchy->valid;
+}
+
+int BoundingVolumeHierarchy::divide(Hierarchy& hierarchy, unsigned int start, unsigned int end)
+{
+    const Leaves& leaves = hierarchy.leaves;
+    std::vector<unsigned int>& leafIndices = hierarchy.leafIndices;
+    BVHNodeList& nodes = hierarchy.nodes;
+
+    int nodeIndex = nodes.size();
+    nodes.push_back(BVHNode());
+
+    osg::BoundingBox bb;
+    osg::BoundingBox centreBB;
+    for(unsigned int i=start; i<end; ++i)
+    {
+        const osg::BoundingBox& leafBB = leaves[leafIndices[i]].bb;
+        bb.expandBy(leafBB);
+        centreBB.expandBy(leafBB.center());
+    }
+
+    int first, second;
+    if (end-start<=_maximumNumLeavesPerNode)
+    {
+        first = -static_cast<int>(start)-1;
+        second = end-start;
+    }
+    else
+    {
+        // split at the median of the leaf centres along the longest axis.
+        osg::Vec3 dimensions = centreBB._max - centreBB._min;
+        unsigned int axis = 0;
+        if (dimensions.y()>dimensions[axis]) axis = 1;
+        if (dimensions.z()>dimensions[axis]) axis = 2;
+
+        unsigned int mid = (start+end)/2;
+        std::nth_element(leafIndices.begin()+start, leafIndices.begin()+mid, leafIndices.begin()+end, LessCentre(leaves, axis));
+
+        first = divide(hierarchy, start, mid);
+        second = divide(hierarchy, mid, end);
+    }
+
+    BVHNode& node = nodes[nodeIndex];
+    node.bb = bb;
+    node.bs.expandBy(bb);
+    node.first = first;
+    node.second = second;
+
+    return nodeIndex;
+}
+
+bool BoundingVolumeHierarchy::intersect(IntersectionVisitor& iv, osg::Node& root)
+{
+    osg::ref_ptr<Hierarchy> hierarchy;
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+
+        // intersectors don't always get the bound of the nodes they enter, so make sure that any dirtyBound() below
+        // the root has reached computeBound() to mark the hierarchy as dirty.
+        root.getBound();
+
+        if (_dirty || _root!=&root) buildNoLock(root);
+        hierarchy = _hierarchy;
+    }
+
+    if (!hierarchy->valid) return false;
+
+    if (hierarchy->nodes.empty()) return true;
+
+    // the intersectors test nodes for intersection so use a node without children to carry the bound of each hierarchy node.
+    osg::ref_ptr<osg::Node> proxy = new osg::Node;
+    intersect(iv, *hierarchy, *proxy, 0);
+
+    return true;
+}
+
+void BoundingVolumeHierarchy::intersect(IntersectionVisitor& iv, const Hierarchy& hierarchy, osg::Node& proxy, int nodeIndex)
+{
+    const BVHNode& node = hierarchy.nodes[nodeIndex];
+
+    proxy.setInitialBound(node.bs);
+    if (!iv.enter(proxy)) return;
+
+    if (node.first<0)
+    {
+        unsigned int istart = -node.first-1;
+        unsigned int iend = istart + node.second;
+        for(unsigned int i=istart; i<iend; ++i)
+        {
+            intersect(iv, hierarchy.leaves[hierarchy.leafIndices[i]]);
+        }
+    }
+    else
+    {
+        intersect(iv, hierarchy, proxy, node.first);
+        intersect(iv, hierarchy, proxy, node.second);
+    }
+
+    iv.leave();
+}
+
+void BoundingVolumeHierarchy::intersect(IntersectionVisitor& iv, const Leaf& leaf)
+{
+    const osg::NodePath& nodePath = leaf.nodePath;
+    unsigned int numParents = nodePath.size()-1;
+
+    for(unsigned int i=0; i<numParents; ++i)
+    {
+        if (!iv.validNodeMask(*nodePath[i])) return;
+    }
+
+    // push the nodes between the root and the leaf so that intersections record the full node path.
+    for(unsigned int i=0; i<numParents; ++i)
+    {
+        iv.pushOntoNodePath(nodePath[i]);
+    }
+
+    if (leaf.matrix.valid())
+    {
+        iv.pushModelMatrix(iv.getModelMatrix() ? new osg::RefMatrix(*leaf.matrix * *iv.getModelMatrix()) : new osg::RefMatrix(*leaf.matrix));
+
+        // now push an new intersector clone transform to the new local coordinates
+        iv.push_clone();
+    }
+
+    osg::Node* node = nodePath.back();
+    osg::Drawable* drawable = node->asDrawable();
+    if (drawable && numParents>0 && nodePath[numParents-1]->asGeode())
+    {
+        // Drawables of Geodes are intersected directly, just as IntersectionVisitor::apply(Geode&) does.
+        iv.intersect(drawable);
+    }
+    else
+    {
+        node->accept(iv);
+    }
+
+    if (leaf.matrix.valid())
+    {
+        iv.pop_clone();
+        iv.popModelMatrix();
+    }
+
+    for(unsigned int i=0; i<numParents; ++i)
+    {
+        iv.popFromNodePath();
+    }
+}
@@ -0,0 +1,73 @@
+/* -*-c++-*- OpenSceneGraph - Copyright (C) 1998-2006 Robert Osfield
+ *
+ * This library is open source and may be redistributed and/or modified under
+ * the terms of the OpenSceneGraph Public License (OSGPL) version 0.0 or
+ * (at your option) any later version.  The full license is in LICENSE file
+ * included with this distribution, and on the openscenegraph.org website.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * OpenSceneGraph Public License for more details.
+*/
+
+#include <osgUtil/CullThreadPool>
+
+#include <osg/ApplicationUsage>
+#include <osg/Math>
+#include <osg/Notify>
+
+#include <stdlib.h>
+
+using namespace osgUtil;
+
+static osg::ApplicationUsageProxy CullThreadPool_e0(osg::ApplicationUsage::ENVIRONMENTAL_VARIABLE,"OSG_NUM_CULL_THREADS <value>","Set the number of threads used to cull the children of wide Groups in parallel, 0 disables parallel culling (the default).");
+
+CullThreadPool::CullThreadPool(unsigned int numThreads):
+    _taskThreadPool(TaskThreadPool::instance()),
+    _numThreads(numThreads),
+    _minimumNumChildren(64),
+    _minimumNumChildrenPerChunk(16)
+{
+}
+
+unsigned int CullThreadPool::getNumThreads() const
+{
+    if (!_taskThreadPool) return 0;
+
+    unsigned int numThreads = _taskThreadPool->getNumThreads();
+    return _numThreads>0 ? osg::minimum(_numThreads, numThreads) : numThreads;
+}
+
+void CullThreadPool::run(const TaskThreadPool::Tasks& tasks, osg::Operation* callerTask)
+{
+    if (_taskThreadPool.valid())
+    {
+        _taskThreadPool->run(tasks, getNumThreads()+1, callerTask);
+        return;
+    }
+
+    if (callerTask) (*callerTask)(0);
+    for(TaskThreadPool::Tasks::const_iterator itr = tasks.begin();
+        itr != tasks.end();
+        ++itr)
+    {
+        (**itr)(0);
+    }
+}
+
+static CullThreadPool* createDefaultCullThreadPool()
+{
+    const char* str = getenv("OSG_NUM_CULL_THREADS");
+    int numThreads = str ? atoi(str) : 0;
+    if (numThreads<=0) return 0;
+
+    OSG_INFO<<"CullThreadPool::instance() creating pool of "<<numThreads<<" cull threads"<<std::endl;
+    return new CullThreadPool(numThreads);
+}
+
+osg::ref_ptr<CullThreadPool>& CullThreadPool::instance()
+{
+    static osg::ref_ptr<CullThreadPool> s_cullThreadPool = createDefaultCullThreadPool();
+    return s_cullThreadPool;
+}
@@ -31,6 +31,7 @@
 #include <osgUtil/CullVisitor>
 
 #include <float.h>
+#include <string.h>
 #include <algorithm>
 
 #include <osg/Timer>
@@ -52,9 +53,15 @@ CullVisitor::CullVisitor():
     _computed_znear(FLT_MAX),
     _computed_zfar(-FLT_MAX),
     _currentReuseRenderLeafIndex(0),
-    _numberOfEncloseOverrideRenderBinDetails(0)
+    _numberOfEncloseOverrideRenderBinDetails(0),
+    _minimumNumChildrenForBatchCulling(32),
+    _batchCulledNode(0),
+    _batchCulled(false),
+    _batchCulledResultMask(0),
+    _softwareOcclusionCullerRasterized(false)
 {
     _identifier = new Identifier;
+    _cullThreadPool = CullThreadPool::instance();
 }
 
 CullVisitor::CullVisitor(const CullVisitor& rhs):
@@ -68,7 +75,14 @@ CullVisitor::CullVisitor(const CullVisitor& rhs):
     _computed_zfar(-FLT_MAX),
     _currentReuseRenderLeafIndex(0),
     _numberOfEncloseOverrideRenderBinDetails(0),
-    _identifier(rhs._identifier)
+    _identifier(rhs._identifier),
+    _cullThreadPool(rhs._cullThreadPool),
+    _minimumNumChildrenForBatchCulling(rhs._minimumNumChildrenForBatchCulling),
+    _batchCulledNode(0),
+    _batchCulled(false),
+    _batchCulledResultMask(0),
+    _softwareOcclusionCuller(rhs._softwareOcclusionCuller.valid() ? new SoftwareOcclusionCuller(*rhs._softwareOcclusionCuller) : 0),
+    _softwareOcclusionCullerRasterized(false)
 {
 }
 
@@ -110,6 +124,9 @@ void CullVisitor::reset()
     _computed_znear = FLT_MAX;
     _computed_zfar = -FLT_MAX;
 
+    // the occluders are rasterized again with the next frame's matrices.
+    _softwareOcclusionCullerRasterized = false;
+
 
     osg::Vec3 lookVector(0.0,0.0,-1.0);
 
@@ -133,6 +150,15 @@ void CullVisitor::reset()
 
     _nearPlaneCandidateMap.clear();
     _farPlaneCandidateMap.clear();
+
+    // the RenderLeaf's of the parallel CullVisitors have been merged into this CullVisitor's StateGraph so are reset along with its own.
+    for(ParallelCullVisitorList::iterator itr = _parallelCullVisitors.begin();
+        itr != _parallelCullVisitors.end();
+        ++itr)
+    {
+        (*itr)->reset();
+        if ((*itr)->_rootStateGraph.valid()) (*itr)->_rootStateGraph->prune();
+    }
 }
 
 float CullVisitor::getDistanceToEyePoint(const Vec3& pos, bool withLODScale) const
@@ -998,7 +1024,7 @@ void CullVisitor::apply(osg::Drawable& drawable)
         }
     }
 
-    if (drawable.isCullingActive() && isCulled(bb)) return;
+    if (drawable.isCullingActive() && (isCulled(bb) || (_softwareOcclusionCuller.valid() && isOccluded(bb)))) return;
 
 
     if (_computeNearFar && bb.valid())
@@ -1224,7 +1250,11 @@ void CullVisitor::apply(Group& node)
     StateSet* node_state = node.getStateSet();
     if (node_state) pushStateSet(node_state);
 
-    handle_cull_callbacks_and_traverse(node);
+    bool traversed = (_cullThreadPool.valid() && cullChildrenInParallel(node)) || cullChildrenInBatch(node);
+    if (!traversed)
+    {
+        handle_cull_callbacks_and_traverse(node);
+    }
 
     // pop the node's state off the render graph stack.
     if (node_state) popStateSet();
@@ -1233,6 +1263,400 @@ void CullVisitor::apply(Group& node)
     popCurrentMask();
 }
 
+namespace CullVisitorUtils
+{
+
+struct ParallelCullOperation : public osg::Operation
+{
+    ParallelCullOperation(CullVisitor* cv, osg::Group* group, unsigned int start, unsigned int end):
+        osg::Operation("ParallelCullOperation", false),
+        _cv(cv),
+        _group(group),
+        _start(start),
+        _end(end) {}
+
+    virtual void operator () (osg::Object*)
+    {
+        for(unsigned int i=_start; i<_end; ++i)
+        {
+            _group->getChild(i)->accept(*_cv);
+        }
+    }
+
+    // not ref counted as the originating CullVisitor, which keeps its clones, may not be heap allocated.
+    CullVisitor*                        _cv;
+    osg::ref_ptr<osg::Group>            _group;
+    unsigned int                        _start;
+    unsigned int                        _end;
+};
+
+/** Moves the RenderLeaf's of the StateGraphs filled in by a parallel CullVisitor onto the equivalent StateGraphs
+  * of the CullVisitor it was cloned from, replacing the StateGraphs in the bins of the parallel CullVisitor's RenderStage
+  * so that the bins can then be merged into the original RenderStage.*/
+class ParallelCullMerger
+{
+    public:
+
+        ParallelCullMerger(StateGraph* rootStateGraph, StateGraph* parallelRootStateGraph, RenderStage* stage, RenderStage* parallelStage, unsigned int traversalNumberOffset):
+            _rootStateGraph(rootStateGraph),
+            _parallelRootStateGraph(parallelRootStateGraph),
+            _stage(stage),
+            _parallelStage(parallelStage),
+            _traversalNumberOffset(traversalNumberOffset) {}
+
+        StateGraph* getStateGraph(StateGraph* sg)
+        {
+            if (sg==_parallelRootStateGraph) return _rootStateGraph;
+
+            StateGraphMap::iterator itr = _stateGraphMap.find(sg);
+            if (itr!=_stateGraphMap.end()) return itr->second;
+
+            StateGraph* mappedStateGraph = getStateGraph(sg->_parent)->find_or_insert(sg->getStateSet());
+            _stateGraphMap[sg] = mappedStateGraph;
+            return mappedStateGraph;
+        }
+
+        void moveStateGraphs(RenderBin* bin)
+        {
+            RenderBin::StateGraphList& stateGraphList = bin->getStateGraphList();
+            RenderBin::StateGraphList::iterator dest_itr = stateGraphList.begin();
+            for(RenderBin::StateGraphList::iterator itr = stateGraphList.begin();
+                itr != stateGraphList.end();
+                ++itr)
+            {
+                StateGraph* sg = *itr;
+                StateGraph* mappedStateGraph = getStateGraph(sg);
+
+                // StateGraphs that already have leaves are already in a bin, the others take the place of the parallel StateGraph.
+                bool alreadyInBin = !mappedStateGraph->leaves_empty();
+                if (!alreadyInBin) mappedStateGraph->_sortKeyID = dest_itr - stateGraphList.begin();
+
+                for(StateGraph::LeafList::iterator leaf_itr = sg->_leaves.begin();
+                    leaf_itr != sg->_leaves.end();
+                    ++leaf_itr)
+                {
+                    RenderLeaf* leaf = leaf_itr->get();
+                    leaf->_traversalNumber += _traversalNumberOffset;
+                    leaf->_sortKey = (leaf->_sortKey & 0xffffffff00000000ull) | mappedStateGraph->_sortKeyID;
+                    mappedStateGraph->addLeaf(leaf);
+                }
+                sg->_leaves.clear();
+
+                if (!alreadyInBin) *(dest_itr++) = mappedStateGraph;
+            }
+            stateGraphList.erase(dest_itr, stateGraphList.end());
+
+            for(RenderBin::RenderBinList::iterator itr = bin->getRenderBinList().begin();
+                itr != bin->getRenderBinList().end();
+                ++itr)
+            {
+                moveStateGraphs(itr->second.get());
+            }
+
+            RenderStage* rs = dynamic_cast<RenderStage*>(bin);
+            if (rs)
+            {
+                moveStateGraphs(rs->getPreRenderList());
+                moveStateGraphs(rs->getPostRenderList());
+            }
+        }
+
+        void moveStateGraphs(RenderStage::RenderStageList& renderStageList)
+        {
+            for(RenderStage::RenderStageList::iterator itr = renderStageList.begin();
+                itr != renderStageList.end();
+                ++itr)
+            {
+                RenderStage* rs = itr->second.get();
+                if (rs->getInheritedPositionalStateContainer()==_parallelStage->getPositionalStateContainer())
+                {
+                    rs->setInheritedPositionalStateContainer(_stage->getPositionalStateContainer());
+                }
+
+                moveStateGraphs(rs);
+            }
+        }
+
+    protected:
+
+        typedef std::map<StateGraph*, StateGraph*> StateGraphMap;
+
+        StateGraph*     _rootStateGraph;
+        StateGraph*     _parallelRootStateGraph;
+        RenderStage*    _stage;
+        RenderStage*    _parallelStage;
+        unsigned int    _traversalNumberOffset;
+        StateGraphMap   _stateGraphMap;
+};
+
+}
+
+using namespace CullVisitorUtils;
+
+bool CullVisitor::cullChildrenInParallel(osg::Group& group)
+{
+    unsigned int numChildren = group.getNumChildren();
+    unsigned int numThreads = _cullThreadPool->getNumThreads();
+    if (numThreads==0 || numChildren<_cullThreadPool->getMinimumNumChildren()) return false;
+
+    // subclasses of Group and cull callbacks may implement their own traversal so only plain Groups can be forked.
+    if (group.getCullCallback() || strcmp(group.className(),"Group")!=0 || strcmp(group.libraryName(),"osg")!=0) return false;
+
+    unsigned int minimumNumChildrenPerChunk = osg::maximum(_cullThreadPool->getMinimumNumChildrenPerChunk(), 1u);
+    unsigned int numChunks = osg::minimum(numThreads+1, numChildren/minimumNumChildrenPerChunk);
+    if (numChunks<2) return false;
+
+    while(_parallelCullVisitors.size()<numChunks-1)
+    {
+        osg::ref_ptr<CullVisitor> cv = clone();
+        cv->setCullThreadPool(0);
+        _parallelCullVisitors.push_back(cv);
+    }
+
+    RenderStage* stage = getCurrentRenderStage();
+    osg::Vec4 clearColor = stage->getClearColor();
+    GLbitfield clearMask = stage->getClearMask();
+
+    StateGraph* rootStateGraph = _currentStateGraph;
+    while(rootStateGraph->_parent) rootStateGraph = rootStateGraph->_parent;
+
+    // the clones have to be set up before this CullVisitor carries on with the traversal.
+    for(unsigned int i=1; i<numChunks; ++i)
+    {
+        setUpParallelCullVisitor(*_parallelCullVisitors[i-1]);
+    }
+
+    TaskThreadPool::Tasks tasks;
+    for(unsigned int i=1; i<numChunks; ++i)
+    {
+        tasks.push_back(new ParallelCullOperation(_parallelCullVisitors[i-1].get(), &group, (numChildren*i)/numChunks, (numChildren*(i+1))/numChunks));
+    }
+
+    // cull the first chunk directly into this CullVisitor's StateGraph and RenderStage on this thread.
+    osg::ref_ptr<ParallelCullOperation> firstChunk = new ParallelCullOperation(this, &group, 0, numChildren/numChunks);
+    _cullThreadPool->run(tasks, firstChunk.get());
+
+    // merge in child order so that the bins end up in the same order as those of a serial traversal.
+    for(unsigned int i=1; i<numChunks; ++i)
+    {
+        CullVisitor& cv = *_parallelCullVisitors[i-1];
+
+        // ClearNodes set the clear values of the current RenderStage directly.
+        RenderStage* parallelStage = cv.getRenderStage();
+        if (parallelStage->getClearColor()!=clearColor) stage->setClearColor(parallelStage->getClearColor());
+        if (parallelStage->getClearMask()!=clearMask) stage->setClearMask(parallelStage->getClearMask());
+
+        mergeParallelCullVisitor(cv, stage, rootStateGraph);
+    }
+
+    return true;
+}
+
+// bottom of a fast_back_stack, which holds all but the back in its vector.
+static inline const osg::ref_ptr<osg::RefMatrix>& bottomOfStack(const osg::CullStack::MatrixStack& stack)
+{
+    return stack._stack.empty() ? stack._value : stack._stack.front();
+}
+
+bool CullVisitor::isOccluded(const osg::BoundingBox& bb)
+{
+    if (!_softwareOcclusionCuller || _projectionStack.empty() || _modelviewStack.empty()) return false;
+
+    // nested Cameras and Projection nodes push their own projection matrix, which the depth buffer doesn't match.
+    if (_projectionStack.back()!=bottomOfStack(_projectionStack)) return false;
+
+    if (!_softwareOcclusionCullerRasterized) rasterizeOccluders();
+
+    return _softwareOcclusionCuller->isOccluded(bb, (*getModelViewMatrix()) * (*getProjectionMatrix()));
+}
+
+void CullVisitor::rasterizeOccluders()
+{
+    _softwareOcclusionCullerRasterized = true;
+
+    if (_projectionStack.empty() || _modelviewStack.empty()) return;
+
+    // the bottom of the stacks hold the projection and view matrices of the camera the cull traversal started with.
+    _softwareOcclusionCuller->rasterize(*bottomOfStack(_modelviewStack), *bottomOfStack(_projectionStack));
+}
+
+bool CullVisitor::cullChildrenInBatch(osg::Group& group)
+{
+    unsigned int numChildren = group.getNumChildren();
+    if (_minimumNumChildrenForBatchCulling==0 || numChildren<_minimumNumChildrenForBatchCulling) return false;
+
+    // subclasses of Group and cull callbacks may implement their own traversal so only plain Groups can be batched.
+    if (group.getCullCallback() || strcmp(group.className(),"Group")!=0 || strcmp(group.libraryName(),"osg")!=0) return false;
+
+    CullingSet& cs = getCurrentCullingSet();
+    if ((cs.getCullingMask()&(CullingSet::VIEW_FRUSTUM_CULLING|CullingSet::SMALL_FEATURE_CULLING))==0) return false;
+
+    // nested groups append their children after those of the groups enclosing them.
+    unsigned int base = _batchCullResults.size();
+    unsigned int size = base + numChildren;
+    _batchCullX.resize(size);
+    _batchCullY.resize(size);
+    _batchCullZ.resize(size);
+    _batchCullRadius.resize(size);
+    _batchCullResultMasks.resize(size);
+    _batchCullResults.resize(size);
+
+    for(unsigned int i=0; i<numChildren; ++i)
+    {
+        const osg::BoundingSphere& bs = group.getChild(i)->getBound();
+        _batchCullX[base+i] = bs.center().x();
+        _batchCullY[base+i] = bs.center().y();
+        _batchCullZ[base+i] = bs.center().z();
+        _batchCullRadius[base+i] = bs.radius();
+    }
+
+    bool batched = cs.isCulled(numChildren, &_batchCullX[base], &_batchCullY[base], &_batchCullZ[base], &_batchCullRadius[base], &_batchCullResultMasks[base], &_batchCullResults[base]);
+    if (batched)
+    {
+        for(unsigned int i=0; i<numChildren; ++i)
+        {
+            // the child's own isCulled() picks up the result, so the traversal is otherwise unchanged.
+            osg::Node* child = group.getChild(i);
+            if (child->isCullingActive())
+            {
+                _batchCulledNode = child;
+                _batchCulled = _batchCullResults[base+i]!=0;
+                _batchCulledResultMask = _batchCullResultMasks[base+i];
+            }
+
+            child->accept(*this);
+
+            _batchCulledNode = 0;
+        }
+    }
+
+    _batchCullX.resize(base);
+    _batchCullY.resize(base);
+    _batchCullZ.resize(base);
+    _batchCullRadius.resize(base);
+    _batchCullResultMasks.resize(base);
+    _batchCullResults.resize(base);
+
+    return batched;
+}
+
+void CullVisitor::setUpParallelCullVisitor(CullVisitor& cv)
+{
+    cv.setTraversalMode(getTraversalMode());
+    cv.setTraversalMask(getTraversalMask());
+    cv.setNodeMaskOverride(getNodeMaskOverride());
+    cv.setTraversalNumber(getTraversalNumber());
+    cv.setDatabaseRequestHandler(getDatabaseRequestHandler());
+    cv.setImageRequestHandler(getImageRequestHandler());
+    cv.setUserDataContainer(getUserDataContainer());
+    cv._frameStamp = _frameStamp;
+    cv._nodePath = _nodePath;
+
+    cv.setCullSettings(*this);
+    cv._renderInfo = _renderInfo;
+    cv._identifier = _identifier;
+
+    // copy the current state of the CullStack, the matrices are shared as they aren't modified once pushed.
+    cv._occluderList = _occluderList;
+    cv._projectionStack = _projectionStack;
+    cv._modelviewStack = _modelviewStack;
+    cv._MVPW_Stack = _MVPW_Stack;
+    cv._viewportStack = _viewportStack;
+    cv._referenceViewPoints = _referenceViewPoints;
+    cv._eyePointStack = _eyePointStack;
+    cv._viewPointStack = _viewPointStack;
+    cv._clipspaceCullingStack = _clipspaceCullingStack;
+    cv._projectionCullingStack = _projectionCullingStack;
+    cv._modelviewCullingStack.assign(_modelviewCullingStack.begin(), _modelviewCullingStack.begin()+_index_modelviewCullingStack);
+    cv._index_modelviewCullingStack = _index_modelviewCullingStack;
+    cv._back_modelviewCullingStack = _index_modelviewCullingStack>0 ? &cv._modelviewCullingStack[_index_modelviewCullingStack-1] : 0;
+    cv._frustumVolume = _frustumVolume;
+    cv._bbCornerNear = _bbCornerNear;
+    cv._bbCornerFar = _bbCornerFar;
+
+    cv._renderBinStack.clear();
+    cv._numberOfEncloseOverrideRenderBinDetails = _numberOfEncloseOverrideRenderBinDetails;
+    cv._minimumNumChildrenForBatchCulling = _minimumNumChildrenForBatchCulling;
+    cv._batchCulledNode = 0;
+
+    // the occluders are rasterized once and the depth buffer shared by the clones.
+    if (_softwareOcclusionCuller.valid() && !_softwareOcclusionCullerRasterized) rasterizeOccluders();
+    cv._softwareOcclusionCuller = _softwareOcclusionCuller;
+    cv._softwareOcclusionCullerRasterized = _softwareOcclusionCullerRasterized;
+    cv._traversalNumber = 0;
+    cv._computed_znear = FLT_MAX;
+    cv._computed_zfar = -FLT_MAX;
+    cv._nearPlaneCandidateMap.clear();
+    cv._farPlaneCandidateMap.clear();
+
+    // reproduce the path from the root of the StateGraph to the current StateGraph.
+    if (!cv._rootStateGraph) cv._rootStateGraph = new StateGraph;
+    else cv._rootStateGraph->clean();
+
+    std::vector<const osg::StateSet*> statesets;
+    for(StateGraph* sg = _currentStateGraph; sg->_parent; sg = sg->_parent)
+    {
+        statesets.push_back(sg->getStateSet());
+    }
+
+    cv._currentStateGraph = cv._rootStateGraph.get();
+    for(std::vector<const osg::StateSet*>::reverse_iterator itr = statesets.rbegin();
+        itr != statesets.rend();
+        ++itr)
+    {
+        cv._currentStateGraph = cv._currentStateGraph->find_or_insert(*itr);
+    }
+
+    // the clone's RenderStage stands in for the current RenderStage, with the same nesting of bins down to the current bin.
+    RenderStage* stage = getCurrentRenderStage();
+    if (!cv._rootRenderStage) cv._rootRenderStage = osg::cloneType(_rootRenderStage.get());
+    else cv._rootRenderStage->reset();
+
+    RenderStage* parallelStage = cv._rootRenderStage.get();
+    parallelStage->setCamera(stage->getCamera());
+    parallelStage->setViewport(stage->getViewport());
+    parallelStage->setInitialViewMatrix(stage->getInitialViewMatrix());
+    parallelStage->setDrawBuffer(stage->getDrawBuffer(), stage->getDrawBufferApplyMask());
+    parallelStage->setReadBuffer(stage->getReadBuffer(), stage->getReadBufferApplyMask());
+    parallelStage->setClearColor(stage->getClearColor());
+    parallelStage->setClearMask(stage->getClearMask());
+
+    std::vector<int> binNumbers;
+    for(RenderBin* bin = _currentRenderBin; bin && bin!=stage; bin = bin->getParent())
+    {
+        binNumbers.push_back(bin->getBinNum());
+    }
+
+    // the bins are only used to carry the StateGraphs back to the existing bins so their type doesn't matter.
+    cv._currentRenderBin = parallelStage;
+    for(std::vector<int>::reverse_iterator itr = binNumbers.rbegin();
+        itr != binNumbers.rend();
+        ++itr)
+    {
+        cv._currentRenderBin = cv._currentRenderBin->find_or_insert(*itr, "RenderBin");
+    }
+}
+
+void CullVisitor::mergeParallelCullVisitor(CullVisitor& cv, RenderStage* stage, StateGraph* rootStateGraph)
+{
+    RenderStage* parallelStage = cv._rootRenderStage.get();
+
+    ParallelCullMerger merger(rootStateGraph, cv._rootStateGraph.get(), stage, parallelStage, _traversalNumber);
+    merger.moveStateGraphs(parallelStage);
+
+    stage->merge(parallelStage);
+
+    _traversalNumber += cv._traversalNumber;
+
+    if (cv._computed_znear<_computed_znear) _computed_znear = cv._computed_znear;
+    if (cv._computed_zfar>_computed_zfar) _computed_zfar = cv._computed_zfar;
+
+    _nearPlaneCandidateMap.insert(cv._nearPlaneCandidateMap.begin(), cv._nearPlaneCandidateMap.end());
+    _farPlaneCandidateMap.insert(cv._farPlaneCandidateMap.begin(), cv._farPlaneCandidateMap.end());
+    cv._nearPlaneCandidateMap.clear();
+    cv._farPlaneCandidateMap.clear();
+}
+
 void CullVisitor::apply(Transform& node)
 {
     if (isCulled(node)) return;
@@ -12,6 +12,7 @@
 */
 
 #include <osgUtil/DelaunayTriangulator>
+#include <osgUtil/TaskThreadPool>
 // NB this algorithm makes heavy use of the osgUtil::Tessellator for constrained triangulation.
 // truly it is built on the shoulders of giants.
 
@@ -19,8 +20,13 @@
 #include <osg/Vec3>
 #include <osg/Array>
 #include <osg/Notify>
+#include <osg/BoundingBox>
+#include <osg/OperationThread>
+
+#include <OpenThreads/Thread>
 
 #include <algorithm>
+#include <deque>
 #include <set>
 #include <map> //GWM July 2005 map is used in constraints.
 #include <osgUtil/Tessellator> // tessellator triangulates the constrained triangles
@@ -362,14 +368,16 @@ typedef std::set<Edge, Edge::Less> Edge_set;
 
 
 DelaunayTriangulator::DelaunayTriangulator():
-    osg::Referenced()
+    osg::Referenced(),
+    _bulkInsertion(false)
 {
 }
 
 DelaunayTriangulator::DelaunayTriangulator(osg::Vec3Array *points, osg::Vec3Array *normals):
     osg::Referenced(),
     points_(points),
-    normals_(normals)
+    normals_(normals),
+    _bulkInsertion(false)
 {
 }
 
@@ -377,7 +385,8 @@ DelaunayTriangulator::DelaunayTriangulator(const DelaunayTriangulator &copy, con
     osg::Referenced(copy),
     points_(static_cast<osg::Vec3Array *>(copyop(copy.points_.get()))),
     normals_(static_cast<osg::Vec3Array *>(copyop(copy.normals_.get()))),
-    prim_tris_(static_cast<osg::DrawElementsUInt *>(copyop(copy.prim_tris_.get())))
+    prim_tris_(static_cast<osg::DrawElementsUInt *>(copyop(copy.prim_tris_.get()))),
+    _bulkInsertion(copy._bulkInsertion)
 {
 }
 
@@ -740,6 +749,594 @@ osgUtil::DelaunayConstraint *getconvexhull(osg::Vec3Array *points)
     return dcconvexhull.release();
 }
 
+//////////////////////////////////////////////////////////////////////////////////////
+// BULK INSERTION
+
+// A triangulation held as a compact half-edge structure for inserting large numbers of points.
+// The half-edges of triangle t are 3t, 3t+1 and 3t+2 in anticlockwise order, half-edge e running from
+// vertex _triangles[e] to the start of the next half-edge of its triangle, and _halfedges[e] is the
+// opposite half-edge in the adjacent triangle, or -1 on the boundary of the super triangle.
+class HalfEdgeTriangulation
+{
+public:
+
+    typedef std::pair<unsigned int, unsigned int> VertexPair;
+
+    HalfEdgeTriangulation(const osg::Vec3Array& points);
+
+    // insert all of the points, in the order of a Hilbert curve through them
+    void insertPoints();
+
+    // recover the edge from u to v, splitting it at vertices lying on it; returns false if it crosses a
+    // constrained edge or cannot be recovered.
+    bool insertConstraint(unsigned int u, unsigned int v);
+
+    // the triangles not using the super triangle vertices, with any of zero area skipped.
+    void getTriangles(std::vector<GLuint>& indices) const;
+
+protected:
+
+    static inline int nextEdge(int e) { return (e % 3 == 2) ? e - 2 : e + 1; }
+    static inline int prevEdge(int e) { return (e % 3 == 0) ? e + 2 : e - 1; }
+
+    // twice the signed area of a, b, c, positive if anticlockwise.
+    inline double orient(unsigned int a, unsigned int b, unsigned int c) const
+    {
+        const osg::Vec2d& pa = _coords[a];
+        const osg::Vec2d& pb = _coords[b];
+        const osg::Vec2d& pc = _coords[c];
+        return (pb.x() - pa.x()) * (pc.y() - pa.y()) - (pb.y() - pa.y()) * (pc.x() - pa.x());
+    }
+
+    // true if d is strictly inside the circumcircle of the anticlockwise triangle a, b, c.
+    inline bool inCircle(unsigned int a, unsigned int b, unsigned int c, unsigned int d) const
+    {
+        const osg::Vec2d& pd = _coords[d];
+        double adx = _coords[a].x() - pd.x(), ady = _coords[a].y() - pd.y();
+        double bdx = _coords[b].x() - pd.x(), bdy = _coords[b].y() - pd.y();
+        double cdx = _coords[c].x() - pd.x(), cdy = _coords[c].y() - pd.y();
+        double alift = adx * adx + ady * ady;
+        double blift = bdx * bdx + bdy * bdy;
+        double clift = cdx * cdx + cdy * cdy;
+        return alift * (bdx * cdy - bdy * cdx) + blift * (cdx * ady - cdy * adx) + clift * (adx * bdy - ady * bdx) > 0.0;
+    }
+
+    inline void link(int a, int b)
+    {
+        _halfedges[a] = b;
+        if (b >= 0) _halfedges[b] = a;
+    }
+
+    inline int addTriangle(unsigned int a, unsigned int b, unsigned int c)
+    {
+        int t = _triangles.size() / 3;
+        _triangles.push_back(a); _triangles.push_back(b); _triangles.push_back(c);
+        _halfedges.push_back(-1); _halfedges.push_back(-1); _halfedges.push_back(-1);
+        return t;
+    }
+
+    inline bool isConstrained(unsigned int a, unsigned int b) const
+    {
+        return _constrained.count(a < b ? VertexPair(a, b) : VertexPair(b, a)) != 0;
+    }
+
+    int locate(unsigned int p);
+    void insertPoint(unsigned int p);
+    void flip(int a);
+    void legalize(int a);
+    int findEdge(unsigned int u, unsigned int v) const;
+
+    unsigned int                _numPoints;
+    std::vector<osg::Vec2d>     _coords;
+    std::vector<unsigned int>   _triangles;
+    std::vector<int>            _halfedges;
+    std::vector<int>            _vertexEdges;
+    std::vector<int>            _edgeStack;
+    std::set<VertexPair>        _constrained;
+    int                         _lastTriangle;
+};
+
+HalfEdgeTriangulation::HalfEdgeTriangulation(const osg::Vec3Array& points):
+    _numPoints(points.size()),
+    _lastTriangle(0)
+{
+    _coords.reserve(_numPoints + 3);
+
+    osg::BoundingBoxd bb;
+    for (osg::Vec3Array::const_iterator itr = points.begin(); itr != points.end(); ++itr)
+    {
+        _coords.push_back(osg::Vec2d(itr->x(), itr->y()));
+        bb.expandBy(itr->x(), itr->y(), 0.0);
+    }
+
+    // the super triangle is made large so that few edges of the convex hull need recovering as constraints.
+    double size = osg::maximum(bb.xMax() - bb.xMin(), bb.yMax() - bb.yMin());
+    if (size <= 0.0) size = 1.0;
+    osg::Vec2d centre(bb.center().x(), bb.center().y());
+    _coords.push_back(centre + osg::Vec2d(-20.0 * size, -size));
+    _coords.push_back(centre + osg::Vec2d(20.0 * size, -size));
+    _coords.push_back(centre + osg::Vec2d(0.0, 20.0 * size));
+
+    // each point inserted adds two triangles.
+    _triangles.reserve(6 * _numPoints + 3);
+    _halfedges.reserve(6 * _numPoints + 3);
+    addTriangle(_numPoints, _numPoints + 1, _numPoints + 2);
+}
+
+// Index along a Hilbert curve through a 65536x65536 grid.
+inline unsigned int hilbertIndex(unsigned int x, unsigned int y)
+{
+    unsigned int d = 0;
+    for (unsigned int s = 1u << 15; s > 0; s >>= 1)
+    {
+        unsigned int rx = (x & s) ? 1 : 0;
+        unsigned int ry = (y & s) ? 1 : 0;
+        d += s * s * ((3 * rx) ^ ry);
+        if (ry == 0)
+        {
+            if (rx == 1)
+            {
+                x = 0xffff - x;
+                y = 0xffff - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
+
+void HalfEdgeTriangulation::insertPoints()
+{
+    if (_numPoints == 0) return;
+
+    // inserting along a space filling curve keeps each point close to the last, so the walks locating them are short.
+    osg::BoundingBoxd bb;
+    for (unsigned int i = 0; i < _numPoints; ++i) bb.expandBy(_coords[i].x(), _coords[i].y(), 0.0);
+    double sx = bb.xMax() > bb.xMin() ? 65535.0 / (bb.xMax() - bb.xMin()) : 0.0;
+    double sy = bb.yMax() > bb.yMin() ? 65535.0 / (bb.yMax() - bb.yMin()) : 0.0;
+
+    std::vector< std::pair<unsigned int, unsigned int> > order(_numPoints);
+    for (unsigned int i = 0; i < _numPoints; ++i)
+    {
+        unsigned int x = static_cast<unsigned int>((_coords[i].x() - bb.xMin()) * sx);
+        unsigned int y = static_cast<unsigned int>((_coords[i].y() - bb.yMin()) * sy);
+        order[i] = std::make_pair(hilbertIndex(x, y), i);
+    }
+    std::sort(order.begin(), order.end());
+
+    for (unsigned int i = 0; i < _numPoints; ++i)
+        insertPoint(order[i].second);
+
+    _vertexEdges.assign(_coords.size(), -1);
+    for (unsigned int e = 0; e < _triangles.size(); ++e)
+        _vertexEdges[_triangles[e]] = e;
+}
+
+int HalfEdgeTriangulation::locate(unsigned int p)
+{
+    // walk from the last triangle towards p, crossing an edge that p is to the right of, starting the tests from
+    // a different edge each step so that the walk cannot cycle.
+    int t = _lastTriangle;
+    unsigned int numSteps = 0;
+    unsigned int maxSteps = _triangles.size() / 3;
+    while (numSteps++ < maxSteps)
+    {
+        int crossed = -1;
+        for (int i = 0; i < 3 && crossed < 0; ++i)
+        {
+            int e = 3 * t + (i + numSteps) % 3;
+            if (orient(_triangles[e], _triangles[nextEdge(e)], p) < 0.0) crossed = e;
+        }
+        if (crossed < 0) return t;
+        if (_halfedges[crossed] < 0) break;
+        t = _halfedges[crossed] / 3;
+    }
+
+    // rounding error can leave the walk lost, in which case fall back to testing every triangle.
+    for (t = 0; t < static_cast<int>(_triangles.size() / 3); ++t)
+    {
+        int e = 3 * t;
+        if (orient(_triangles[e], _triangles[e + 1], p) >= 0.0 &&
+            orient(_triangles[e + 1], _triangles[e + 2], p) >= 0.0 &&
+            orient(_triangles[e + 2], _triangles[e], p) >= 0.0) return t;
+    }
+    return -1;
+}
+
+void HalfEdgeTriangulation::insertPoint(unsigned int p)
+{
+    int t = locate(p);
+    if (t < 0)
+    {
+        OSG_INFO << "DelaunayTriangulator: failed to locate point " << p << std::endl;
+        return;
+    }
+
+    int onEdge = -1;
+    for (int i = 0; i < 3; ++i)
+    {
+        int e = 3 * t + i;
+        if (orient(_triangles[e], _triangles[nextEdge(e)], p) == 0.0 && _halfedges[e] >= 0) onEdge = e;
+    }
+
+    if (onEdge < 0)
+    {
+        // split triangle a, b, c into a, b, p and b, c, p and c, a, p.
+        int e0 = 3 * t;
+        unsigned int a = _triangles[e0], b = _triangles[e0 + 1], c = _triangles[e0 + 2];
+        int h1 = _halfedges[e0 + 1], h2 = _halfedges[e0 + 2];
+
+        _triangles[e0 + 2] = p;
+        int e1 = 3 * addTriangle(b, c, p);
+        int e2 = 3 * addTriangle(c, a, p);
+
+        link(e1, h1);
+        link(e2, h2);
+        link(e0 + 1, e1 + 2);
+        link(e1 + 1, e2 + 2);
+        link(e2 + 1, e0 + 2);
+
+        legalize(e0);
+        legalize(e1);
+        legalize(e2);
+    }
+    else
+    {
+        // split the edge a, b between triangles a, b, c and b, a, d into c, a, p and b, c, p and d, b, p and a, d, p.
+        int e = onEdge;
+        int f = _halfedges[e];
+        unsigned int a = _triangles[e], b = _triangles[nextEdge(e)], c = _triangles[prevEdge(e)], d = _triangles[prevEdge(f)];
+        int hbc = _halfedges[nextEdge(e)], hca = _halfedges[prevEdge(e)];
+        int had = _halfedges[nextEdge(f)], hdb = _halfedges[prevEdge(f)];
+
+        int t0 = e - e % 3, u0 = f - f % 3;
+        _triangles[t0] = c; _triangles[t0 + 1] = a; _triangles[t0 + 2] = p;
+        _triangles[u0] = d; _triangles[u0 + 1] = b; _triangles[u0 + 2] = p;
+        int t1 = 3 * addTriangle(b, c, p);
+        int u1 = 3 * addTriangle(a, d, p);
+
+        link(t0, hca);
+        link(t1, hbc);
+        link(u0, hdb);
+        link(u1, had);
+        link(t0 + 1, u1 + 2);
+        link(t0 + 2, t1 + 1);
+        link(t1 + 2, u0 + 1);
+        link(u0 + 2, u1 + 1);
+
+        legalize(t0);
+        legalize(t1);
+        legalize(u0);
+        legalize(u1);
+    }
+
+    _lastTriangle = t;
+}
+
+void HalfEdgeTriangulation::flip(int a)
+{
+    // flip the edge pr, pl between triangles pr, pl, p0 and pl, pr, p1 to make p1, pl, p0 and p0, pr, p1,
+    // the half-edges ar and bl becoming the new edge p0, p1.
+    int b = _halfedges[a];
+    int al = nextEdge(a), ar = prevEdge(a);
+    int br = nextEdge(b), bl = prevEdge(b);
+    unsigned int p0 = _triangles[ar], pr = _triangles[a], pl = _triangles[al], p1 = _triangles[bl];
+
+    _triangles[a] = p1;
+    _triangles[b] = p0;
+
+    int hbl = _halfedges[bl], har = _halfedges[ar];
+    link(a, hbl);
+    link(b, har);
+    link(ar, bl);
+
+    if (!_vertexEdges.empty())
+    {
+        _vertexEdges[p0] = ar;
+        _vertexEdges[p1] = bl;
+        _vertexEdges[pl] = al;
+        _vertexEdges[pr] = br;
+    }
+}
+
+void HalfEdgeTriangulation::legalize(int a)
+{
+    // a is opposite the point just inserted, which remains opposite a after a flip, with the other edge of
+    // the flipped pair opposite it pushed on the stack.
+    for (;;)
+    {
+        int b = _halfedges[a];
+        if (b >= 0)
+        {
+            unsigned int p0 = _triangles[prevEdge(a)], pr = _triangles[a], pl = _triangles[nextEdge(a)], p1 = _triangles[prevEdge(b)];
+            if (inCircle(p0, pr, pl, p1))
+            {
+                flip(a);
+                _edgeStack.push_back(nextEdge(b));
+                continue;
+            }
+        }
+        if (_edgeStack.empty()) break;
+        a = _edgeStack.back();
+        _edgeStack.pop_back();
+    }
+}
+
+int HalfEdgeTriangulation::findEdge(unsigned int u, unsigned int v) const
+{
+    int start = _vertexEdges[u];
+    if (start < 0) return -1;
+
+    int e = start;
+    do
+    {
+        if (_triangles[nextEdge(e)] == v) return e;
+        e = _halfedges[prevEdge(e)];
+    } while (e >= 0 && e != start);
+
+    if (e < 0)
+    {
+        // u is on the boundary, so also rotate the other way.
+        e = start;
+        while (_halfedges[e] >= 0)
+        {
+            e = nextEdge(_halfedges[e]);
+            if (_triangles[nextEdge(e)] == v) return e;
+        }
+    }
+    return -1;
+}
+
+bool HalfEdgeTriangulation::insertConstraint(unsigned int u, unsigned int v)
+{
+    if (u == v) return true;
+
+    if (findEdge(u, v) >= 0)
+    {
+        _constrained.insert(u < v ? VertexPair(u, v) : VertexPair(v, u));
+        return true;
+    }
+
+    const osg::Vec2d& pu = _coords[u];
+    osg::Vec2d uv = _coords[v] - pu;
+
+    // find the triangle around u that the edge leaves through, each of the edges it crosses being held with
+    // the vertex on its right first.
+    std::deque<VertexPair> crossing;
+    int start = _vertexEdges[u];
+    int e = start;
+    do
+    {
+        unsigned int x = _triangles[nextEdge(e)], y = _triangles[prevEdge(e)];
+        double ox = orient(u, v, x);
+        if (ox == 0.0)
+        {
+            osg::Vec2d ux = _coords[x] - pu;
+            if (ux * uv > 0.0 && ux.length2() < uv.length2())
+                return insertConstraint(u, x) && insertConstraint(x, v);
+        }
+        if (ox < 0.0 && orient(u, v, y) > 0.0)
+        {
+            crossing.push_back(VertexPair(x, y));
+            e = nextEdge(e);
+            break;
+        }
+        e = _halfedges[prevEdge(e)];
+    } while (e >= 0 && e != start);
+
+    if (crossing.empty()) return false;
+
+    // walk along the edge collecting the edges it crosses.
+    for (;;)
+    {
+        const VertexPair& edge = crossing.back();
+        if (isConstrained(edge.first, edge.second)) return false;
+
+        int t = _halfedges[e];
+        if (t < 0) return false;
+        unsigned int r = _triangles[prevEdge(t)];
+        if (r == v) break;
+
+        double o = orient(u, v, r);
+        if (o == 0.0) return insertConstraint(u, r) && insertConstraint(r, v);
+
+        if (o < 0.0)
+        {
+            crossing.push_back(VertexPair(r, edge.second));
+            e = prevEdge(t);
+        }
+        else
+        {
+            crossing.push_back(VertexPair(edge.first, r));
+            e = nextEdge(t);
+        }
+    }
+
+    // flip the crossing edges whose triangles form convex quadrilaterals until none cross, putting those
+    // still crossing back at the end of the queue.
+    std::vector<VertexPair> newEdges;
+    unsigned int numSkipped = 0;
+    while (!crossing.empty())
+    {
+        VertexPair edge = crossing.front();
+        crossing.pop_front();
+
+        int a = findEdge(edge.first, edge.second);
+        if (a < 0 || _halfedges[a] < 0) return false;
+        unsigned int c = _triangles[prevEdge(a)], d = _triangles[prevEdge(_halfedges[a])];
+
+        double oc = orient(c, d, edge.first), od = orient(c, d, edge.second);
+        if (!((oc < 0.0 && od > 0.0) || (oc > 0.0 && od < 0.0)))
+        {
+            crossing.push_back(edge);
+            if (++numSkipped > crossing.size()) return false;
+            continue;
+        }
+        numSkipped = 0;
+
+        flip(a);
+
+        double ou = orient(c, d, u), ov = orient(c, d, v);
+        double cu = orient(u, v, c), cv = orient(u, v, d);
+        bool crosses = c != u && c != v && d != u && d != v &&
+                       ((ou < 0.0 && ov > 0.0) || (ou > 0.0 && ov < 0.0)) &&
+                       ((cu < 0.0 && cv > 0.0) || (cu > 0.0 && cv < 0.0));
+        if (crosses) crossing.push_back(cu < 0.0 ? VertexPair(c, d) : VertexPair(d, c));
+        else newEdges.push_back(VertexPair(c, d));
+    }
+
+    _constrained.insert(u < v ? VertexPair(u, v) : VertexPair(v, u));
+
+    // restore the Delaunay property around the new edges, other than across constrained edges.
+    unsigned int maxPasses = newEdges.size() + 2;
+    bool flipped = true;
+    for (unsigned int pass = 0; flipped && pass < maxPasses; ++pass)
+    {
+        flipped = false;
+        for (std::vector<VertexPair>::iterator itr = newEdges.begin(); itr != newEdges.end(); ++itr)
+        {
+            if (isConstrained(itr->first, itr->second)) continue;
+
+            int a = findEdge(itr->first, itr->second);
+            if (a < 0 || _halfedges[a] < 0) continue;
+
+            unsigned int c = _triangles[prevEdge(a)], d = _triangles[prevEdge(_halfedges[a])];
+            if (inCircle(itr->first, itr->second, c, d))
+            {
+                flip(a);
+                *itr = VertexPair(c, d);
+                flipped = true;
+            }
+        }
+    }
+
+    return true;
+}
+
+void HalfEdgeTriangulation::getTriangles(std::vector<GLuint>& indices) const
+{
+    indices.reserve(_triangles.size());
+    for (unsigned int e = 0; e < _triangles.size(); e += 3)
+    {
+        unsigned int a = _triangles[e], b = _triangles[e + 1], c = _triangles[e + 2];
+        if (a < _numPoints && b < _numPoints && c < _numPoints && orient(a, b, c) > 0.0)
+        {
+            indices.push_back(a);
+            indices.push_back(b);
+            indices.push_back(c);
+        }
+    }
+}
+
+// comparison of sample points by X then Y for finding them in the sorted points.
+struct Sample_point_less_xy
+{
+    bool operator() (const osg::Vec3& p1, const osg::Vec3& p2) const
+    {
+        if (p1.x() != p2.x()) return p1.x() < p2.x();
+        return p1.y() < p2.y();
+    }
+};
+
+int findSortedIndex(const osg::Vec3& pt, const osg::Vec3Array& points)
+{
+    osg::Vec3Array::const_iterator itr = std::lower_bound(points.begin(), points.end(), pt, Sample_point_less_xy());
+    if (itr != points.end() && itr->x() == pt.x() && itr->y() == pt.y()) return itr - points.begin();
+    return -1;
+}
+
+bool DelaunayTriangulator::_triangulateBulk()
+{
+    osg::Vec3Array *points = points_.get();
+
+    // add the constraint vertices not already in the points, which are sorted and unique in X and Y.
+    std::set<osg::Vec3, Sample_point_less_xy> added;
+    for (linelist::iterator linitr=constraint_lines.begin(); linitr!=constraint_lines.end(); ++linitr)
+    {
+        const osg::Vec3Array* vercon = dynamic_cast<const osg::Vec3Array*>((*linitr)->getVertexArray());
+        if (!vercon) continue;
+
+        for (osg::Vec3Array::const_iterator vitr=vercon->begin(); vitr!=vercon->end(); ++vitr)
+        {
+            // points stays sorted while searching, the new vertices are appended once all are found.
+            if (findSortedIndex(*vitr, *points) < 0) added.insert(*vitr);
+        }
+    }
+
+    OSG_INFO << "DelaunayTriangulator: adding " << added.size() << " constraint vertices to the sample points\n";
+    points->insert(points->end(), added.begin(), added.end());
+
+    OSG_INFO << "DelaunayTriangulator: pre-sorting sample points\n";
+    std::sort(points->begin(), points->end(), Sample_point_compare);
+
+    if (points->size() < 3)
+    {
+        OSG_WARN << "Warning: DelaunayTriangulator::triangulate(): too few sample points" << std::endl;
+        return false;
+    }
+
+    osg::ref_ptr<osgUtil::DelaunayConstraint> dcconvexhull=getconvexhull(points);
+    addInputConstraint(dcconvexhull.get());
+
+    OSG_INFO << "DelaunayTriangulator: inserting " << points->size() << " points\n";
+    HalfEdgeTriangulation triangulation(*points);
+    triangulation.insertPoints();
+
+    OSG_INFO << "DelaunayTriangulator: inserting constraints\n";
+    for (linelist::iterator linitr=constraint_lines.begin(); linitr!=constraint_lines.end(); ++linitr)
+    {
+        DelaunayConstraint* dc=(*linitr).get();
+        const osg::Vec3Array* vercon = dynamic_cast<const osg::Vec3Array*>(dc->getVertexArray());
+        if (!vercon) continue;
+
+        for (unsigned int ipr=0; ipr<dc->getNumPrimitiveSets(); ++ipr)
+        {
+            const osg::PrimitiveSet* prset=dc->getPrimitiveSet(ipr);
+            if (prset->getMode()!=osg::PrimitiveSet::LINE_LOOP && prset->getMode()!=osg::PrimitiveSet::LINE_STRIP) continue;
+
+            unsigned int numIndices = prset->getNumIndices();
+            unsigned int numEdges = prset->getMode()==osg::PrimitiveSet::LINE_LOOP ? numIndices : numIndices-1;
+            for (unsigned int i=0; numIndices>1 && i<numEdges; ++i)
+            {
+                int ip1 = findSortedIndex((*vercon)[prset->index(i)], *points);
+                int ip2 = findSortedIndex((*vercon)[prset->index((i+1)%numIndices)], *points);
+                if (ip1<0 || ip2<0) continue;
+
+                if (!triangulation.insertConstraint(ip1, ip2))
+                {
+                    OSG_WARN << "DelaunayTriangulator: skipped a constraint edge crossing another from "
+                             << (*points)[ip1].x() << " " << (*points)[ip1].y() << " to "
+                             << (*points)[ip2].x() << " " << (*points)[ip2].y() << std::endl;
+                }
+            }
+        }
+    }
+
+    std::vector<GLuint> pt_indices;
+    triangulation.getTriangles(pt_indices);
+
+    if (!pt_indices.size())
+    {
+        OSG_WARN << "Warning: DelaunayTriangulator::triangulate(): no triangle generated" << std::endl;
+        return false;
+    }
+
+    if (normals_.valid())
+    {
+        for (unsigned int i=0; i<pt_indices.size(); i+=3)
+        {
+            osg::Vec3 N = ((*points)[pt_indices[i+1]] - (*points)[pt_indices[i]]) ^ ((*points)[pt_indices[i+2]] - (*points)[pt_indices[i]]);
+            normals_->push_back(N / N.length());
+        }
+    }
+
+    prim_tris_ = new osg::DrawElementsUInt(GL_TRIANGLES, pt_indices.size(), &(pt_indices.front()));
+
+    OSG_INFO << "DelaunayTriangulator: process done, " << prim_tris_->getNumPrimitives() << " triangles remain\n";
+
+    return true;
+}
+
 bool DelaunayTriangulator::triangulate()
 {
     // check validity of input array
@@ -760,6 +1357,7 @@ bool DelaunayTriangulator::triangulate()
     // Eliminate duplicate lat/lon points from input coordinates.
     _uniqueifyPoints();
 
+    if (_bulkInsertion) return _triangulateBulk();
 
     // initialize storage structures
     Triangle_list triangles;
@@ -1143,6 +1741,57 @@ bool DelaunayTriangulator::triangulate()
     return true;
 }
 
+class TriangulateOperation : public osg::Operation
+{
+public:
+    TriangulateOperation(DelaunayTriangulator* triangulator):
+        osg::Operation("DelaunayTriangulatorOperation", false),
+        _triangulator(triangulator),
+        _result(false) {}
+
+    virtual void operator () (osg::Object*)
+    {
+        _result = _triangulator->triangulate();
+    }
+
+    bool getResult() const { return _result; }
+
+protected:
+    osg::ref_ptr<DelaunayTriangulator> _triangulator;
+    bool _result;
+};
+
+bool DelaunayTriangulator::triangulate(const TriangulatorList& triangulators, unsigned int numThreads)
+{
+    if (numThreads == 0) numThreads = OpenThreads::GetNumberOfProcessors();
+    numThreads = std::min<unsigned int>(numThreads, triangulators.size());
+
+    bool result = true;
+    if (numThreads <= 1)
+    {
+        for (TriangulatorList::const_iterator itr=triangulators.begin(); itr!=triangulators.end(); ++itr)
+        {
+            if (!(*itr)->triangulate()) result = false;
+        }
+        return result;
+    }
+
+    std::vector< osg::ref_ptr<TriangulateOperation> > operations;
+    for (TriangulatorList::const_iterator itr=triangulators.begin(); itr!=triangulators.end(); ++itr)
+    {
+        operations.push_back(new TriangulateOperation(itr->get()));
+    }
+
+    TaskThreadPool::Tasks tasks(operations.begin(), operations.end());
+    TaskThreadPool::instance()->run(tasks, numThreads);
+
+    for (unsigned int i=0; i<operations.size(); ++i)
+    {
+        if (!operations[i]->getResult()) result = false;
+    }
+    return result;
+}
+
 void DelaunayTriangulator::removeInternalTriangles(DelaunayConstraint *dc )
 {
     if (dc) { // 16.12.06 just in case....
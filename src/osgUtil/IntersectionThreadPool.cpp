@@ -0,0 +1,119 @@
+/* -*-c++-*- OpenSceneGraph - Copyright (C) 1998-2006 Robert Osfield
+ *
+ * This library is open source and may be redistributed and/or modified under
+ * the terms of the OpenSceneGraph Public License (OSGPL) version 0.0 or
+ * (at your option) any later version.  The full license is in LICENSE file
+ * included with this distribution, and on the openscenegraph.org website.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * OpenSceneGraph Public License for more details.
+*/
+
+#include <osgUtil/IntersectionThreadPool>
+
+#include <osg/Math>
+#include <osg/Notify>
+
+using namespace osgUtil;
+
+namespace
+{
+
+struct IntersectOperation : public osg::Operation
+{
+    IntersectOperation(osg::Node* scene, IntersectionVisitor* iv):
+        osg::Operation("IntersectOperation", false),
+        _scene(scene),
+        _iv(iv) {}
+
+    virtual void operator () (osg::Object*)
+    {
+        _scene->accept(*_iv);
+    }
+
+    osg::ref_ptr<osg::Node>             _scene;
+    osg::ref_ptr<IntersectionVisitor>   _iv;
+};
+
+}
+
+IntersectionThreadPool::IntersectionThreadPool(unsigned int numThreads):
+    _taskThreadPool(TaskThreadPool::instance()),
+    _numThreads(numThreads),
+    _minimumNumIntersectorsPerChunk(16)
+{
+}
+
+unsigned int IntersectionThreadPool::getNumThreads() const
+{
+    if (!_taskThreadPool) return 0;
+
+    unsigned int numThreads = _taskThreadPool->getNumThreads();
+    return _numThreads>0 ? osg::minimum(_numThreads, numThreads) : numThreads;
+}
+
+osg::ref_ptr<IntersectionVisitor> IntersectionThreadPool::createIntersectionVisitor(Intersector* intersector, IntersectionVisitor& templateVisitor)
+{
+    osg::ref_ptr<IntersectionVisitor> iv = new IntersectionVisitor(intersector, templateVisitor.getReadCallback());
+
+    iv->setTraversalMode(templateVisitor.getTraversalMode());
+    iv->setTraversalMask(templateVisitor.getTraversalMask());
+    iv->setNodeMaskOverride(templateVisitor.getNodeMaskOverride());
+    iv->setUseKdTreeWhenAvailable(templateVisitor.getUseKdTreeWhenAvailable());
+    iv->setUseBoundingVolumeHierarchyWhenAvailable(templateVisitor.getUseBoundingVolumeHierarchyWhenAvailable());
+    iv->setDoDummyTraversal(templateVisitor.getDoDummyTraversal());
+    iv->setLODSelectionMode(templateVisitor.getLODSelectionMode());
+    iv->setReferenceEyePoint(templateVisitor.getReferenceEyePoint());
+    iv->setReferenceEyePointCoordinateFrame(templateVisitor.getReferenceEyePointCoordinateFrame());
+
+    // the matrices are only read during traversal so can be shared between the visitors.
+    if (templateVisitor.getWindowMatrix()) iv->pushWindowMatrix(templateVisitor.getWindowMatrix());
+    if (templateVisitor.getProjectionMatrix()) iv->pushProjectionMatrix(templateVisitor.getProjectionMatrix());
+    if (templateVisitor.getViewMatrix()) iv->pushViewMatrix(templateVisitor.getViewMatrix());
+    if (templateVisitor.getModelMatrix()) iv->pushModelMatrix(templateVisitor.getModelMatrix());
+
+    return iv;
+}
+
+void IntersectionThreadPool::computeIntersections(osg::Node* scene, IntersectorGroup* intersectorGroup, IntersectionVisitor& templateVisitor)
+{
+    if (!scene || !intersectorGroup) return;
+
+    // make sure the bounds are up to date before the threads start so that no lazy bound computation happens during the traversals.
+    scene->getBound();
+
+    IntersectorGroup::Intersectors& intersectors = intersectorGroup->getIntersectors();
+    unsigned int numIntersectors = static_cast<unsigned int>(intersectors.size());
+    if (numIntersectors==0) return;
+
+    // aim for a few chunks per thread so that threads finishing early can pick up more work.
+    unsigned int numThreads = getNumThreads();
+    unsigned int chunkSize = numThreads>0 ? (numIntersectors + numThreads*4 - 1)/(numThreads*4) : numIntersectors;
+    if (chunkSize<_minimumNumIntersectorsPerChunk) chunkSize = _minimumNumIntersectorsPerChunk;
+
+    unsigned int numChunks = (numIntersectors + chunkSize - 1)/chunkSize;
+    if (numThreads==0 || numChunks<=1)
+    {
+        osg::ref_ptr<IntersectionVisitor> iv = createIntersectionVisitor(intersectorGroup, templateVisitor);
+        scene->accept(*iv);
+        return;
+    }
+
+    TaskThreadPool::Tasks tasks;
+    for(unsigned int start=0; start<numIntersectors; start+=chunkSize)
+    {
+        unsigned int end = osg::minimum(start+chunkSize, numIntersectors);
+
+        osg::ref_ptr<IntersectorGroup> chunk = new IntersectorGroup;
+        for(unsigned int i=start; i<end; ++i)
+        {
+            chunk->addIntersector(intersectors[i].get());
+        }
+
+        tasks.push_back(new IntersectOperation(scene, createIntersectionVisitor(chunk.get(), templateVisitor).get()));
+    }
+
+    _taskThreadPool->run(tasks, numThreads+1);
+}
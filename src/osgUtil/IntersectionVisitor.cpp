@@ -14,6 +14,7 @@
 
 #include <osgUtil/IntersectionVisitor>
 #include <osgUtil/LineSegmentIntersector>
+#include <osgUtil/BoundingVolumeHierarchy>
 
 #include <osg/PagedLOD>
 #include <osg/Transform>
@@ -155,6 +156,7 @@ IntersectionVisitor::IntersectionVisitor(Intersector* intersector, ReadCallback*
     osg::NodeVisitor(osg::NodeVisitor::INTERSECTION_VISITOR, osg::NodeVisitor::TRAVERSE_ACTIVE_CHILDREN)
 {
     _useKdTreesWhenAvailable = true;
+    _useBoundingVolumeHierarchiesWhenAvailable = true;
     _dummyTraversal = false;
 
     _lodSelectionMode = USE_HIGHEST_LEVEL_OF_DETAIL;
@@ -212,11 +214,19 @@ void IntersectionVisitor::apply(osg::Node& node)
     leave();
 }
 
+bool IntersectionVisitor::traverseBoundingVolumeHierarchy(osg::Node& node)
+{
+    if (!_useBoundingVolumeHierarchiesWhenAvailable || !node.getComputeBoundingSphereCallback()) return false;
+
+    BoundingVolumeHierarchy* bvh = dynamic_cast<BoundingVolumeHierarchy*>(node.getComputeBoundingSphereCallback());
+    return bvh && bvh->intersect(*this, node);
+}
+
 void IntersectionVisitor::apply(osg::Group& group)
 {
     if (!enter(group)) return;
 
-    traverse(group);
+    if (!traverseBoundingVolumeHierarchy(group)) traverse(group);
 
     leave();
 }
@@ -411,7 +421,7 @@ void IntersectionVisitor::apply(osg::Transform& transform)
     // now push an new intersector clone transform to the new local coordinates
     push_clone();
 
-    traverse(transform);
+    if (!traverseBoundingVolumeHierarchy(transform)) traverse(transform);
 
     // pop the clone.
     pop_clone();
@@ -13,15 +13,25 @@
 */
 
 #include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
 #include <limits>
 
 #include <algorithm>
+#include <map>
 #include <vector>
 
 #include <iostream>
 
+#include <osg/Billboard>
+#include <osg/CullFace>
+#include <osg/FrontFace>
 #include <osg/Geometry>
+#include <osg/KdTree>
 #include <osg/Math>
+#include <osg/MatrixTransform>
+#include <osg/Polytope>
 #include <osg/PrimitiveSet>
 #include <osg/TriangleIndexFunctor>
 #include <osg/TriangleLinePointIndexFunctor>
@@ -93,44 +103,88 @@ struct GeometryArrayGatherer
     ArrayList _arrayList;
 };
 
-// Compare vertices in a mesh using all their attributes. The vertices
-// are identified by their index. Extracted from TriStripVisitor.cpp
-struct VertexAttribComparitor : public GeometryArrayGatherer
+inline unsigned int hashCombine(unsigned int seed, unsigned int value)
 {
-    VertexAttribComparitor(osg::Geometry& geometry)
-        : GeometryArrayGatherer(geometry)
-    {
-    }
+    return seed ^ (value + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+
+// Mix all the bits of a hash into its low bits, as the float values hashed
+// tend to differ only in their high bits.
+inline unsigned int hashMix(unsigned int hash)
+{
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35;
+    hash ^= hash >> 16;
+    return hash;
+}
 
-    bool operator() (unsigned int lhs, unsigned int rhs) const
+// Hash an element of an array, with -0 and +0 hashed the same as they
+// compare equal.
+unsigned int hashElement(const osg::Array& array, unsigned int i)
+{
+    const unsigned char* data = static_cast<const unsigned char*>(array.getDataPointer()) + i * array.getElementSize();
+    unsigned int hash = 0;
+    switch(array.getDataType())
     {
-        for(ArrayList::const_iterator itr=_arrayList.begin();
-            itr!=_arrayList.end();
-            ++itr)
-        {
-            int compare = (*itr)->compare(lhs,rhs);
-            if (compare==-1) return true;
-            if (compare==1) return false;
-        }
-        return false;
+        case(GL_FLOAT):
+            for(unsigned int c = 0; c < array.getElementSize() / sizeof(float); ++c)
+            {
+                float value;
+                memcpy(&value, data + c * sizeof(float), sizeof(float));
+                unsigned int bits = 0;
+                if (value != 0.0f) memcpy(&bits, &value, sizeof(float));
+                hash = hashCombine(hash, bits);
+            }
+            break;
+        case(GL_DOUBLE):
+            for(unsigned int c = 0; c < array.getElementSize() / sizeof(double); ++c)
+            {
+                double value;
+                memcpy(&value, data + c * sizeof(double), sizeof(double));
+                unsigned int bits[2] = { 0, 0 };
+                if (value != 0.0) memcpy(bits, &value, sizeof(double));
+                hash = hashCombine(hashCombine(hash, bits[0]), bits[1]);
+            }
+            break;
+        default:
+            for(unsigned int b = 0; b < array.getElementSize(); ++b)
+            {
+                hash = hashCombine(hash, data[b]);
+            }
+            break;
     }
+    return hash;
+}
 
-    int compare(unsigned int lhs, unsigned int rhs)
+inline bool equalElements(const GeometryArrayGatherer::ArrayList& arrays, unsigned int lhs, unsigned int rhs)
+{
+    for(GeometryArrayGatherer::ArrayList::const_iterator itr = arrays.begin(); itr != arrays.end(); ++itr)
     {
-        for(ArrayList::iterator itr=_arrayList.begin();
-            itr!=_arrayList.end();
-            ++itr)
-        {
-            int compare = (*itr)->compare(lhs,rhs);
-            if (compare==-1) return -1;
-            if (compare==1) return 1;
-        }
-        return 0;
+        if ((*itr)->compare(lhs, rhs) != 0) return false;
     }
+    return true;
+}
 
-protected:
-    VertexAttribComparitor& operator = (const VertexAttribComparitor&) { return *this; }
+struct GridCell
+{
+    long long x, y, z;
 
+    GridCell(const osg::Vec3d& position, double cellSize)
+        : x(static_cast<long long>(floor(position.x() / cellSize))),
+          y(static_cast<long long>(floor(position.y() / cellSize))),
+          z(static_cast<long long>(floor(position.z() / cellSize))) {}
+
+    GridCell(long long cx, long long cy, long long cz) : x(cx), y(cy), z(cz) {}
+
+    bool operator == (const GridCell& rhs) const { return x == rhs.x && y == rhs.y && z == rhs.z; }
+
+    unsigned int hash() const
+    {
+        return hashCombine(hashCombine(static_cast<unsigned int>(x * 73856093), static_cast<unsigned int>(y * 19349663)),
+                           static_cast<unsigned int>(z * 83492791));
+    }
 };
 
 // Compact the vertex attribute arrays. Also stolen from TriStripVisitor
@@ -217,6 +271,112 @@ struct MyTriangleOperator
 typedef osg::TriangleIndexFunctor<MyTriangleOperator> MyTriangleIndexFunctor;
 }
 
+unsigned int VertexWelder::computeRemapping(Geometry& geom, IndexList& remapping) const
+{
+    remapping.clear();
+    Array* vertices = geom.getVertexArray();
+    if (!vertices) return 0;
+    unsigned int numVertices = vertices->getNumElements();
+    remapping.resize(numVertices);
+
+    // positions are welded in a grid when there is an epsilon, otherwise
+    // they're compared along with the other attributes.
+    std::vector<Vec3d> positions;
+    if (_positionEpsilon > 0.0f)
+    {
+        if (Vec3Array* vec3Array = dynamic_cast<Vec3Array*>(vertices)) positions.assign(vec3Array->begin(), vec3Array->end());
+        else if (Vec3dArray* vec3dArray = dynamic_cast<Vec3dArray*>(vertices)) positions.assign(vec3dArray->begin(), vec3dArray->end());
+    }
+    bool useGrid = !positions.empty();
+    double cellSize = _positionEpsilon;
+    double epsilon2 = cellSize * cellSize;
+
+    GeometryArrayGatherer::ArrayList arrays;
+    if (!useGrid) arrays.push_back(vertices);
+    if (_compareAttributes)
+    {
+        GeometryArrayGatherer gatherer(geom);
+        for(GeometryArrayGatherer::ArrayList::iterator itr = gatherer._arrayList.begin();
+            itr != gatherer._arrayList.end();
+            ++itr)
+        {
+            if (*itr == vertices) continue;
+            if ((*itr)->getNumElements() < numVertices) return 0;
+            arrays.push_back(*itr);
+        }
+    }
+
+    IndexList attributeHashes(numVertices, 0);
+    for(GeometryArrayGatherer::ArrayList::iterator itr = arrays.begin(); itr != arrays.end(); ++itr)
+    {
+        for(unsigned int i = 0; i < numVertices; ++i)
+        {
+            attributeHashes[i] = hashCombine(attributeHashes[i], hashElement(**itr, i));
+        }
+    }
+
+    // chained hash table of the vertices kept, keyed on their cell and attributes.
+    unsigned int tableSize = 1;
+    while (tableSize < numVertices * 2) tableSize <<= 1;
+    unsigned int mask = tableSize - 1;
+    std::vector<int> buckets(tableSize, -1);
+    std::vector<int> next(numVertices, -1);
+
+    unsigned int numUnique = 0;
+    for(unsigned int i = 0; i < numVertices; ++i)
+    {
+        int found = -1;
+        if (useGrid)
+        {
+            GridCell cell(positions[i], cellSize);
+            for(int dx = -1; dx <= 1 && found < 0; ++dx)
+            for(int dy = -1; dy <= 1 && found < 0; ++dy)
+            for(int dz = -1; dz <= 1 && found < 0; ++dz)
+            {
+                GridCell neighbour(cell.x + dx, cell.y + dy, cell.z + dz);
+                unsigned int bucket = hashMix(hashCombine(neighbour.hash(), attributeHashes[i])) & mask;
+                for(int j = buckets[bucket]; j >= 0; j = next[j])
+                {
+                    if (attributeHashes[j] == attributeHashes[i] &&
+                        GridCell(positions[j], cellSize) == neighbour &&
+                        (positions[j] - positions[i]).length2() <= epsilon2 &&
+                        equalElements(arrays, j, i))
+                    {
+                        found = j;
+                        break;
+                    }
+                }
+            }
+        }
+        else
+        {
+            unsigned int bucket = hashMix(attributeHashes[i]) & mask;
+            for(int j = buckets[bucket]; j >= 0; j = next[j])
+            {
+                if (attributeHashes[j] == attributeHashes[i] && equalElements(arrays, j, i))
+                {
+                    found = j;
+                    break;
+                }
+            }
+        }
+
+        if (found >= 0)
+        {
+            remapping[i] = found;
+        }
+        else
+        {
+            remapping[i] = i;
+            unsigned int bucket = hashMix(useGrid ? hashCombine(GridCell(positions[i], cellSize).hash(), attributeHashes[i]) : attributeHashes[i]) & mask;
+            next[i] = buckets[bucket];
+            buckets[bucket] = i;
+            ++numUnique;
+        }
+    }
+    return numUnique;
+}
+
 void IndexMeshVisitor::makeMesh(Geometry& geom)
 {
     if (geom.containsDeprecatedData()) geom.fixDeprecatedData();
@@ -267,67 +427,18 @@ void IndexMeshVisitor::makeMesh(Geometry& geom)
     // duplicate shared arrays as it isn't safe to rearrange vertices when arrays are shared.
     if (geom.containsSharedArrays()) geom.duplicateSharedArrays();
 
-    // compute duplicate vertices
-    typedef std::vector<unsigned int> IndexList;
+    // compute duplicate vertices, each being mapped to the first of them.
     unsigned int numVertices = geom.getVertexArray()->getNumElements();
-    IndexList indices(numVertices);
-    unsigned int i,j;
-    for(i=0;i<numVertices;++i)
-    {
-        indices[i] = i;
-    }
-
-    VertexAttribComparitor arrayComparitor(geom);
-    std::sort(indices.begin(),indices.end(),arrayComparitor);
-
-    unsigned int lastUnique = 0;
-    unsigned int numUnique = 1;
-    for(i=1;i<numVertices;++i)
-    {
-        if (arrayComparitor.compare(indices[lastUnique],indices[i]) != 0)
-        {
-            lastUnique = i;
-            ++numUnique;
-        }
-
-    }
-    IndexList remapDuplicatesToOrignals(numVertices);
-    lastUnique = 0;
-    for(i=1;i<numVertices;++i)
-    {
-        if (arrayComparitor.compare(indices[lastUnique],indices[i])!=0)
-        {
-            // found a new vertex entry, so previous run of duplicates needs
-            // to be put together.
-            unsigned int min_index = indices[lastUnique];
-            for(j=lastUnique+1;j<i;++j)
-            {
-                min_index = osg::minimum(min_index,indices[j]);
-            }
-            for(j=lastUnique;j<i;++j)
-            {
-                remapDuplicatesToOrignals[indices[j]]=min_index;
-            }
-            lastUnique = i;
-        }
-
-    }
-    unsigned int min_index = indices[lastUnique];
-    for(j=lastUnique+1;j<i;++j)
-    {
-        min_index = osg::minimum(min_index,indices[j]);
-    }
-    for(j=lastUnique;j<i;++j)
-    {
-        remapDuplicatesToOrignals[indices[j]]=min_index;
-    }
-
+    IndexList remapDuplicatesToOrignals;
+    unsigned int numUnique = VertexWelder(_positionEpsilon).computeRemapping(geom, remapDuplicatesToOrignals);
+    if (numUnique == 0) return;
 
     // copy the arrays.
     IndexList finalMapping(numVertices);
     IndexList copyMapping;
     copyMapping.reserve(numUnique);
     unsigned int currentIndex=0;
+    unsigned int i;
     for(i=0;i<numVertices;++i)
     {
         if (remapDuplicatesToOrignals[i]==i)
@@ -364,7 +475,8 @@ void IndexMeshVisitor::makeMesh(Geometry& geom)
 
     // remap any shared vertex attributes
     RemapArray ra(copyMapping);
-    arrayComparitor.accept(ra);
+    GeometryArrayGatherer gatherer(geom);
+    gatherer.accept(ra);
     if (taf._in_indices.size() < 65536)
     {
         osg::DrawElementsUShort* elements = new DrawElementsUShort(GL_TRIANGLES);
@@ -874,6 +986,226 @@ void VertexCacheVisitor::optimizeVertices()
     }
 }
 
+namespace
+{
+// Simulates a FIFO post-transform cache by recording when each vertex was
+// last added to it, a vertex is in the cache if fewer than cacheSize
+// vertices have been added since.
+struct TimestampCache
+{
+    TimestampCache(unsigned numVertices, unsigned cacheSize_)
+        : timestamps(numVertices, 0), timestamp(cacheSize_ + 1), cacheSize(cacheSize_)
+    {
+    }
+
+    unsigned addTriangle(const unsigned* tri)
+    {
+        unsigned triMisses = 0;
+        for (int i = 0; i < 3; ++i)
+        {
+            if (timestamp - timestamps[tri[i]] > cacheSize)
+            {
+                timestamps[tri[i]] = timestamp++;
+                ++triMisses;
+            }
+        }
+        return triMisses;
+    }
+
+    void flush()
+    {
+        timestamp += cacheSize + 1;
+    }
+
+    std::vector<unsigned> timestamps;
+    unsigned timestamp;
+    unsigned cacheSize;
+};
+
+struct OverdrawCluster
+{
+    unsigned start;
+    unsigned end;
+    float sortKey;
+};
+
+struct CompareOverdrawCluster
+{
+    bool operator()(const OverdrawCluster& lhs, const OverdrawCluster& rhs) const
+    {
+        return lhs.sortKey > rhs.sortKey;
+    }
+};
+
+template<class DE>
+void reorderTriangles(DE& drawElements, const IndexList& newIndices)
+{
+    for (unsigned i = 0; i < newIndices.size(); ++i)
+        drawElements[i] = static_cast<typename DE::value_type>(newIndices[i]);
+    drawElements.dirty();
+}
+}
+
+void OverdrawVisitor::optimizeOverdraw(Geometry& geom)
+{
+    Vec3Array* vertices = dynamic_cast<Vec3Array*>(geom.getVertexArray());
+    if (!vertices || vertices->empty())
+        return;
+    const unsigned numVertices = vertices->size();
+
+    // the occlusion potential of each cluster is measured relative to the
+    // centre of the mesh.
+    Vec3 meshCentre;
+    for (Vec3Array::iterator itr = vertices->begin(); itr != vertices->end(); ++itr)
+        meshCentre += *itr;
+    meshCentre /= static_cast<float>(numVertices);
+
+    Geometry::PrimitiveSetList& primSets = geom.getPrimitiveSetList();
+    for (Geometry::PrimitiveSetList::iterator itr = primSets.begin(),
+             end = primSets.end();
+         itr != end;
+         ++itr)
+    {
+        PrimitiveSet* ps = itr->get();
+        PrimitiveSet::Type type = ps->getType();
+        if (ps->getMode() != PrimitiveSet::TRIANGLES || ps->getNumInstances() > 0
+            || (type != PrimitiveSet::DrawElementsUBytePrimitiveType
+                && type != PrimitiveSet::DrawElementsUShortPrimitiveType
+                && type != PrimitiveSet::DrawElementsUIntPrimitiveType))
+            continue;
+        DrawElements* drawElements = ps->getDrawElements();
+        const unsigned numTriangles = drawElements->getNumIndices() / 3;
+        if (numTriangles < 2)
+            continue;
+
+        IndexList indices(numTriangles * 3);
+        bool validIndices = true;
+        for (unsigned i = 0; i < indices.size(); ++i)
+        {
+            indices[i] = drawElements->index(i);
+            if (indices[i] >= numVertices)
+                validIndices = false;
+        }
+        if (!validIndices)
+            continue;
+
+        // Hard boundaries, where a triangle misses the cache on all its vertices.
+        IndexList hardBoundaries;
+        {
+            TimestampCache cache(numVertices, _cacheSize);
+            for (unsigned t = 0; t < numTriangles; ++t)
+            {
+                if (cache.addTriangle(&indices[t * 3]) == 3 || t == 0)
+                    hardBoundaries.push_back(t);
+            }
+            hardBoundaries.push_back(numTriangles);
+        }
+
+        // Soft boundaries, splitting each hard cluster wherever the cache miss
+        // ratio up to that point is within the threshold of the cluster's.
+        std::vector<OverdrawCluster> clusters;
+        {
+            TimestampCache cache(numVertices, _cacheSize);
+            for (unsigned h = 0; h + 1 < hardBoundaries.size(); ++h)
+            {
+                unsigned start = hardBoundaries[h];
+                unsigned clusterEnd = hardBoundaries[h + 1];
+
+                cache.flush();
+                unsigned clusterMisses = 0;
+                for (unsigned t = start; t < clusterEnd; ++t)
+                    clusterMisses += cache.addTriangle(&indices[t * 3]);
+                float clusterThreshold = _threshold * static_cast<float>(clusterMisses) / static_cast<float>(clusterEnd - start);
+
+                cache.flush();
+                unsigned runningMisses = 0;
+                unsigned runningTriangles = 0;
+                unsigned clusterStart = start;
+                for (unsigned t = start; t < clusterEnd; ++t)
+                {
+                    runningMisses += cache.addTriangle(&indices[t * 3]);
+                    ++runningTriangles;
+                    if (static_cast<float>(runningMisses) / static_cast<float>(runningTriangles) <= clusterThreshold)
+                    {
+                        OverdrawCluster cluster;
+                        cluster.start = clusterStart;
+                        cluster.end = t + 1;
+                        clusters.push_back(cluster);
+                        clusterStart = t + 1;
+                        runningMisses = 0;
+                        runningTriangles = 0;
+                        cache.flush();
+                    }
+                }
+                if (clusterStart < clusterEnd)
+                {
+                    OverdrawCluster cluster;
+                    cluster.start = clusterStart;
+                    cluster.end = clusterEnd;
+                    clusters.push_back(cluster);
+                }
+            }
+        }
+        if (clusters.size() < 2)
+            continue;
+
+        // Sort the clusters by their occlusion potential, the distance of
+        // their area weighted centroid in front of the mesh centre along
+        // their average normal.
+        for (std::vector<OverdrawCluster>::iterator citr = clusters.begin(); citr != clusters.end(); ++citr)
+        {
+            Vec3 centroid;
+            Vec3 normal;
+            float area = 0.0f;
+            for (unsigned t = citr->start; t < citr->end; ++t)
+            {
+                const Vec3& v0 = (*vertices)[indices[t * 3]];
+                const Vec3& v1 = (*vertices)[indices[t * 3 + 1]];
+                const Vec3& v2 = (*vertices)[indices[t * 3 + 2]];
+                Vec3 n = (v1 - v0) ^ (v2 - v0);
+                float a = n.length();
+                centroid += (v0 + v1 + v2) * (a / 3.0f);
+                normal += n;
+                area += a;
+            }
+            if (area > 0.0f)
+                centroid /= area;
+            normal.normalize();
+            citr->sortKey = (centroid - meshCentre) * normal;
+        }
+        std::stable_sort(clusters.begin(), clusters.end(), CompareOverdrawCluster());
+
+        IndexList newIndices;
+        newIndices.reserve(indices.size());
+        for (std::vector<OverdrawCluster>::iterator citr = clusters.begin(); citr != clusters.end(); ++citr)
+            newIndices.insert(newIndices.end(), indices.begin() + citr->start * 3, indices.begin() + citr->end * 3);
+
+        switch (type)
+        {
+        case PrimitiveSet::DrawElementsUBytePrimitiveType:
+            reorderTriangles(*static_cast<DrawElementsUByte*>(ps), newIndices);
+            break;
+        case PrimitiveSet::DrawElementsUShortPrimitiveType:
+            reorderTriangles(*static_cast<DrawElementsUShort*>(ps), newIndices);
+            break;
+        default:
+            reorderTriangles(*static_cast<DrawElementsUInt*>(ps), newIndices);
+            break;
+        }
+    }
+    geom.dirtyGLObjects();
+}
+
+void OverdrawVisitor::optimizeOverdraw()
+{
+    for(GeometryList::iterator itr=_geometryList.begin();
+        itr!=_geometryList.end();
+        ++itr)
+    {
+        optimizeOverdraw(*(*itr));
+    }
+}
+
 VertexCacheMissVisitor::VertexCacheMissVisitor(unsigned cacheSize)
     : osg::NodeVisitor(NodeVisitor::TRAVERSE_ALL_CHILDREN), misses(0),
       triangles(0), _cacheSize(cacheSize)
@@ -979,6 +1311,172 @@ void VertexCacheMissVisitor::doGeometry(Geometry& geom)
     triangles += recorder.triangles;
 }
 
+namespace
+{
+struct OverdrawTriangleOperator
+{
+    OverdrawTriangleOperator() : _indices(0) {}
+
+    void operator()(unsigned int p1, unsigned int p2, unsigned int p3)
+    {
+        _indices->push_back(p1);
+        _indices->push_back(p2);
+        _indices->push_back(p3);
+    }
+
+    IndexList* _indices;
+};
+
+typedef TriangleIndexFunctor<OverdrawTriangleOperator> OverdrawTriangleCollector;
+
+// Depth buffered rasterizer for measuring overdraw, sampling at pixel centres.
+struct OverdrawRasterizer
+{
+    OverdrawRasterizer(unsigned resolution_)
+        : resolution(resolution_), depth(resolution_ * resolution_, FLT_MAX), shaded(0)
+    {
+    }
+
+    void clear()
+    {
+        std::fill(depth.begin(), depth.end(), FLT_MAX);
+    }
+
+    // Vertices are in pixel coordinates with the depth in z.
+    void rasterize(const Vec3& v0, const Vec3& v1_, const Vec3& v2_)
+    {
+        Vec3 v1 = v1_;
+        Vec3 v2 = v2_;
+        float area = (v1.x() - v0.x()) * (v2.y() - v0.y()) - (v2.x() - v0.x()) * (v1.y() - v0.y());
+        if (area == 0.0f)
+            return;
+        if (area < 0.0f)
+        {
+            std::swap(v1, v2);
+            area = -area;
+        }
+        int x0 = osg::maximum(static_cast<int>(ceilf(osg::minimum(v0.x(), osg::minimum(v1.x(), v2.x())) - 0.5f)), 0);
+        int y0 = osg::maximum(static_cast<int>(ceilf(osg::minimum(v0.y(), osg::minimum(v1.y(), v2.y())) - 0.5f)), 0);
+        int x1 = osg::minimum(static_cast<int>(floorf(osg::maximum(v0.x(), osg::maximum(v1.x(), v2.x())) - 0.5f)), static_cast<int>(resolution) - 1);
+        int y1 = osg::minimum(static_cast<int>(floorf(osg::maximum(v0.y(), osg::maximum(v1.y(), v2.y())) - 0.5f)), static_cast<int>(resolution) - 1);
+        for (int y = y0; y <= y1; ++y)
+        {
+            float py = static_cast<float>(y) + 0.5f;
+            for (int x = x0; x <= x1; ++x)
+            {
+                float px = static_cast<float>(x) + 0.5f;
+                float w0 = (v2.x() - v1.x()) * (py - v1.y()) - (v2.y() - v1.y()) * (px - v1.x());
+                float w1 = (v0.x() - v2.x()) * (py - v2.y()) - (v0.y() - v2.y()) * (px - v2.x());
+                float w2 = (v1.x() - v0.x()) * (py - v0.y()) - (v1.y() - v0.y()) * (px - v0.x());
+                if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+                    continue;
+                float z = (w0 * v0.z() + w1 * v1.z() + w2 * v2.z()) / area;
+                float& d = depth[y * resolution + x];
+                if (z < d)
+                {
+                    d = z;
+                    ++shaded;
+                }
+            }
+        }
+    }
+
+    unsigned covered() const
+    {
+        unsigned count = 0;
+        for (std::vector<float>::const_iterator itr = depth.begin(); itr != depth.end(); ++itr)
+            if (*itr != FLT_MAX)
+                ++count;
+        return count;
+    }
+
+    unsigned resolution;
+    std::vector<float> depth;
+    unsigned shaded;
+};
+}
+
+OverdrawStatsVisitor::OverdrawStatsVisitor(unsigned cacheSize, unsigned resolution)
+    : VertexCacheMissVisitor(cacheSize), pixelsShaded(0.0), pixelsCovered(0.0),
+      _resolution(resolution)
+{
+}
+
+void OverdrawStatsVisitor::reset()
+{
+    VertexCacheMissVisitor::reset();
+    pixelsShaded = 0.0;
+    pixelsCovered = 0.0;
+}
+
+void OverdrawStatsVisitor::apply(Geometry& geom)
+{
+    doGeometry(geom);
+}
+
+void OverdrawStatsVisitor::doGeometry(Geometry& geom)
+{
+    VertexCacheMissVisitor::doGeometry(geom);
+
+    Vec3Array* vertices = dynamic_cast<Vec3Array*>(geom.getVertexArray());
+    if (!vertices || vertices->empty() || _resolution == 0)
+        return;
+
+    IndexList indices;
+    OverdrawTriangleCollector collector;
+    collector._indices = &indices;
+    Geometry::PrimitiveSetList& primSets = geom.getPrimitiveSetList();
+    for (Geometry::PrimitiveSetList::iterator itr = primSets.begin(),
+             end = primSets.end();
+         itr != end;
+         ++itr)
+    {
+        (*itr)->accept(collector);
+    }
+    if (indices.empty())
+        return;
+
+    BoundingBox bb;
+    for (Vec3Array::iterator itr = vertices->begin(); itr != vertices->end(); ++itr)
+        bb.expandBy(*itr);
+    float extent = osg::maximum(bb.xMax() - bb.xMin(), osg::maximum(bb.yMax() - bb.yMin(), bb.zMax() - bb.zMin()));
+    if (extent <= 0.0f)
+        return;
+    float scale = static_cast<float>(_resolution) / extent;
+
+    // look along each axis in both directions, with the other two axes
+    // mapped onto the pixels.
+    OverdrawRasterizer rasterizer(_resolution);
+    std::vector<Vec3> projected(vertices->size());
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        int u = (axis + 1) % 3;
+        int v = (axis + 2) % 3;
+        for (int direction = -1; direction <= 1; direction += 2)
+        {
+            Vec3 viewDirection;
+            viewDirection[axis] = static_cast<float>(direction);
+            for (unsigned i = 0; i < vertices->size(); ++i)
+            {
+                Vec3 p = ((*vertices)[i] - bb._min) * scale;
+                projected[i].set(p[u], p[v], p * viewDirection);
+            }
+            rasterizer.clear();
+            rasterizer.shaded = 0;
+            for (unsigned i = 0; i + 2 < indices.size(); i += 3)
+            {
+                const Vec3& v0 = (*vertices)[indices[i]];
+                Vec3 normal = ((*vertices)[indices[i + 1]] - v0) ^ ((*vertices)[indices[i + 2]] - v0);
+                if (normal * viewDirection >= 0.0f)
+                    continue;
+                rasterizer.rasterize(projected[indices[i]], projected[indices[i + 1]], projected[indices[i + 2]]);
+            }
+            pixelsShaded += rasterizer.shaded;
+            pixelsCovered += rasterizer.covered();
+        }
+    }
+}
+
 namespace
 {
 // Move the values in an array to new positions, based on the
@@ -1179,6 +1677,732 @@ void VertexAccessOrderVisitor::optimizeOrder(Geometry& geom)
     geom.dirtyGLObjects();
 }
 
+namespace
+{
+struct ClusterTriangleOperator
+{
+    ClusterTriangleOperator() : _indices(0) {}
+
+    void operator()(unsigned int p1, unsigned int p2, unsigned int p3)
+    {
+        // skip degenerate triangles, they add nothing to the clusters.
+        if (p1 == p2 || p2 == p3 || p1 == p3)
+            return;
+        _indices->push_back(p1);
+        _indices->push_back(p2);
+        _indices->push_back(p3);
+    }
+
+    IndexList* _indices;
+};
+
+typedef TriangleIndexFunctor<ClusterTriangleOperator> ClusterTriangleCollector;
+
+inline unsigned int spreadBits(unsigned int v)
+{
+    v = (v | (v << 16)) & 0x030000FF;
+    v = (v | (v << 8)) & 0x0300F00F;
+    v = (v | (v << 4)) & 0x030C30C3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+struct CompareMortonCode
+{
+    CompareMortonCode(const std::vector<unsigned int>& codes) : _codes(codes) {}
+    bool operator()(unsigned int lhs, unsigned int rhs) const
+    {
+        return _codes[lhs] < _codes[rhs];
+    }
+    const std::vector<unsigned int>& _codes;
+};
+
+// Limit on the candidate triangles considered while growing a cluster, so
+// that clusters around vertices of very high valence stay cheap to build.
+const unsigned int MAX_CLUSTER_CANDIDATES = 512;
+}
+
+void ClusterMeshVisitor::buildClusters(Geometry& geom)
+{
+    if (geom.containsDeprecatedData() || geom.getDrawCallback())
+        return;
+    Vec3Array* vertices = dynamic_cast<Vec3Array*>(geom.getVertexArray());
+    if (!vertices || vertices->size() < 3 || _maximumNumTrianglesPerCluster == 0)
+        return;
+    const unsigned numVertices = vertices->size();
+
+    // Gather the triangles of the indexed polygon primitives, any others are
+    // kept as they are.
+    IndexList triangles;
+    ClusterTriangleCollector collector;
+    collector._indices = &triangles;
+    Geometry::PrimitiveSetList keptPrims;
+    Geometry::PrimitiveSetList& primSets = geom.getPrimitiveSetList();
+    for (Geometry::PrimitiveSetList::iterator itr = primSets.begin(),
+             end = primSets.end();
+         itr != end;
+         ++itr)
+    {
+        PrimitiveSet* ps = itr->get();
+        if (ps->getNumInstances() > 0)
+            return;
+        PrimitiveSet::Type type = ps->getType();
+        bool indexed = type == PrimitiveSet::DrawElementsUBytePrimitiveType
+            || type == PrimitiveSet::DrawElementsUShortPrimitiveType
+            || type == PrimitiveSet::DrawElementsUIntPrimitiveType;
+        switch (ps->getMode())
+        {
+        case(PrimitiveSet::TRIANGLES):
+        case(PrimitiveSet::TRIANGLE_STRIP):
+        case(PrimitiveSet::TRIANGLE_FAN):
+        case(PrimitiveSet::QUADS):
+        case(PrimitiveSet::QUAD_STRIP):
+        case(PrimitiveSet::POLYGON):
+            // non indexed polygons are left alone.
+            if (indexed)
+                ps->accept(collector);
+            else
+                keptPrims.push_back(ps);
+            break;
+        default:
+            keptPrims.push_back(ps);
+            break;
+        }
+    }
+    const unsigned numTriangles = triangles.size() / 3;
+    if (numTriangles < _minimumNumTriangles || numTriangles <= _maximumNumTrianglesPerCluster)
+        return;
+
+    // Per triangle normals and centroids.
+    std::vector<Vec3> normals(numTriangles);
+    std::vector<Vec3> centroids(numTriangles);
+    BoundingBox centroidBound;
+    for (unsigned t = 0; t < numTriangles; ++t)
+    {
+        const Vec3& v0 = (*vertices)[triangles[t * 3]];
+        const Vec3& v1 = (*vertices)[triangles[t * 3 + 1]];
+        const Vec3& v2 = (*vertices)[triangles[t * 3 + 2]];
+        Vec3 n = (v1 - v0) ^ (v2 - v0);
+        n.normalize();
+        normals[t] = n;
+        centroids[t] = (v0 + v1 + v2) / 3.0f;
+        centroidBound.expandBy(centroids[t]);
+    }
+
+    // Seed the clusters in Morton order of the triangle centroids so that
+    // consecutive clusters are close together.
+    std::vector<unsigned int> codes(numTriangles);
+    Vec3 extent = centroidBound._max - centroidBound._min;
+    for (unsigned t = 0; t < numTriangles; ++t)
+    {
+        Vec3 p = centroids[t] - centroidBound._min;
+        unsigned int q[3];
+        for (int i = 0; i < 3; ++i)
+            q[i] = extent[i] > 0.0f ? osg::minimum(static_cast<unsigned int>(p[i] / extent[i] * 1023.0f), 1023u) : 0u;
+        codes[t] = (spreadBits(q[0]) << 2) | (spreadBits(q[1]) << 1) | spreadBits(q[2]);
+    }
+    IndexList seeds(numTriangles);
+    for (unsigned t = 0; t < numTriangles; ++t)
+        seeds[t] = t;
+    std::stable_sort(seeds.begin(), seeds.end(), CompareMortonCode(codes));
+
+    // Vertex to triangle adjacency.
+    IndexList vertexTriangleOffsets(numVertices + 1, 0);
+    for (unsigned i = 0; i < triangles.size(); ++i)
+        ++vertexTriangleOffsets[triangles[i] + 1];
+    for (unsigned v = 0; v < numVertices; ++v)
+        vertexTriangleOffsets[v + 1] += vertexTriangleOffsets[v];
+    IndexList vertexTriangles(triangles.size());
+    {
+        IndexList fill(vertexTriangleOffsets.begin(), vertexTriangleOffsets.end() - 1);
+        for (unsigned i = 0; i < triangles.size(); ++i)
+            vertexTriangles[fill[triangles[i]]++] = i / 3;
+    }
+
+    // Grow each cluster from its seed, preferring neighbouring triangles that
+    // add the fewest new vertices, face the same way as the cluster and lie
+    // close to its centre.
+    const unsigned noCluster = std::numeric_limits<unsigned>::max();
+    std::vector<bool> emitted(numTriangles, false);
+    IndexList vertexCluster(numVertices, noCluster);
+    IndexList candidateCluster(numTriangles, noCluster);
+    IndexList candidates;
+    IndexList clusteredIndices;
+    clusteredIndices.reserve(triangles.size());
+    ClusterCullDrawCallback::ClusterList clusters;
+
+    for (IndexList::iterator sitr = seeds.begin(); sitr != seeds.end(); ++sitr)
+    {
+        if (emitted[*sitr])
+            continue;
+        const unsigned clusterNum = clusters.size();
+        ClusterCullDrawCallback::Cluster cluster;
+        cluster.first = clusteredIndices.size();
+        Vec3 normalSum;
+        Vec3 centroidSum;
+        float radius = 0.0f;
+        candidates.clear();
+
+        unsigned next = *sitr;
+        while (true)
+        {
+            // add the triangle and its neighbours to the candidates
+            emitted[next] = true;
+            ++cluster.count;
+            normalSum += normals[next];
+            centroidSum += centroids[next];
+            for (unsigned i = 0; i < 3; ++i)
+            {
+                unsigned v = triangles[next * 3 + i];
+                clusteredIndices.push_back(v);
+                vertexCluster[v] = clusterNum;
+                for (unsigned j = vertexTriangleOffsets[v]; j < vertexTriangleOffsets[v + 1]; ++j)
+                {
+                    unsigned t = vertexTriangles[j];
+                    if (!emitted[t] && candidateCluster[t] != clusterNum
+                        && candidates.size() < MAX_CLUSTER_CANDIDATES)
+                    {
+                        candidateCluster[t] = clusterNum;
+                        candidates.push_back(t);
+                    }
+                }
+            }
+            if (cluster.count >= _maximumNumTrianglesPerCluster)
+                break;
+
+            Vec3 centre = centroidSum / static_cast<float>(cluster.count);
+            Vec3 axis = normalSum;
+            axis.normalize();
+            radius = osg::maximum(radius, (centroids[next] - centre).length());
+
+            float bestScore = FLT_MAX;
+            unsigned best = noCluster;
+            for (unsigned c = 0; c < candidates.size();)
+            {
+                unsigned t = candidates[c];
+                if (emitted[t])
+                {
+                    candidates[c] = candidates.back();
+                    candidates.pop_back();
+                    continue;
+                }
+                unsigned newVertices = 0;
+                for (unsigned i = 0; i < 3; ++i)
+                    if (vertexCluster[triangles[t * 3 + i]] != clusterNum)
+                        ++newVertices;
+                float score = static_cast<float>(newVertices)
+                    + 2.0f * (1.0f - normals[t] * axis)
+                    + (centroids[t] - centre).length() / (radius + FLT_EPSILON);
+                if (score < bestScore)
+                {
+                    bestScore = score;
+                    best = t;
+                }
+                ++c;
+            }
+            if (best == noCluster)
+                break;
+            next = best;
+        }
+        cluster.count *= 3;
+
+        // Bounding sphere of the cluster's vertices, and the cone bounding its
+        // normals, as described by Arseny Kapoulkine for meshoptimizer.
+        BoundingBox bb;
+        for (unsigned i = cluster.first; i < cluster.first + cluster.count; ++i)
+            bb.expandBy((*vertices)[clusteredIndices[i]]);
+        cluster.bound._center = bb.center();
+        cluster.bound._radius = 0.0f;
+        for (unsigned i = cluster.first; i < cluster.first + cluster.count; ++i)
+            cluster.bound._radius = osg::maximum(cluster.bound._radius, ((*vertices)[clusteredIndices[i]] - cluster.bound._center).length());
+
+        Vec3 axis = normalSum;
+        if (axis.normalize() > 0.0f)
+        {
+            float minDot = 1.0f;
+            for (unsigned i = cluster.first; i < cluster.first + cluster.count; i += 3)
+            {
+                const Vec3& v0 = (*vertices)[clusteredIndices[i]];
+                Vec3 n = ((*vertices)[clusteredIndices[i + 1]] - v0) ^ ((*vertices)[clusteredIndices[i + 2]] - v0);
+                if (n.normalize() > 0.0f)
+                    minDot = osg::minimum(minDot, n * axis);
+            }
+            cluster.coneAxis = axis;
+            // cones wider than ~84 degrees either side can't usefully be culled.
+            cluster.coneCutoff = minDot > 0.1f ? sqrtf(1.0f - minDot * minDot) : 1.0f;
+        }
+        clusters.push_back(cluster);
+    }
+
+    DrawElements* elements;
+    if (numVertices < 65536)
+    {
+        DrawElementsUShort* ushortElements = new DrawElementsUShort(GL_TRIANGLES);
+        ushortElements->reserve(clusteredIndices.size());
+        for (IndexList::iterator itr = clusteredIndices.begin(); itr != clusteredIndices.end(); ++itr)
+            ushortElements->push_back(static_cast<GLushort>(*itr));
+        elements = ushortElements;
+    }
+    else
+    {
+        elements = new DrawElementsUInt(GL_TRIANGLES, clusteredIndices.begin(), clusteredIndices.end());
+    }
+
+    // the clusters are drawn as ranges of their own element buffer.
+    geom.setUseDisplayList(false);
+    geom.setUseVertexBufferObjects(true);
+    elements->setElementBufferObject(new ElementBufferObject);
+
+    Geometry::PrimitiveSetList newPrims;
+    newPrims.push_back(elements);
+    newPrims.insert(newPrims.end(), keptPrims.begin(), keptPrims.end());
+    geom.setPrimitiveSetList(newPrims);
+    geom.setDrawCallback(new ClusterCullDrawCallback(elements, clusters));
+    geom.dirtyGLObjects();
+}
+
+void ClusterMeshVisitor::buildClusters()
+{
+    for(GeometryList::iterator itr=_geometryList.begin();
+        itr!=_geometryList.end();
+        ++itr)
+    {
+        buildClusters(*(*itr));
+    }
+}
+
+ClusterCullDrawCallback::ClusterCullDrawCallback()
+    : _numIndices(0), _frustumCulling(true), _backFaceCulling(true)
+{
+}
+
+ClusterCullDrawCallback::ClusterCullDrawCallback(DrawElements* drawElements, const ClusterList& clusters)
+    : _drawElements(drawElements),
+      _numIndices(drawElements ? drawElements->getNumIndices() : 0),
+      _clusters(clusters),
+      _frustumCulling(true),
+      _backFaceCulling(true)
+{
+}
+
+ClusterCullDrawCallback::ClusterCullDrawCallback(const ClusterCullDrawCallback& rhs, const CopyOp& copyop)
+    : Object(rhs, copyop),
+      Drawable::DrawCallback(rhs, copyop),
+      _drawElements(rhs._drawElements),
+      _numIndices(rhs._numIndices),
+      _clusters(rhs._clusters),
+      _frustumCulling(rhs._frustumCulling),
+      _backFaceCulling(rhs._backFaceCulling)
+{
+}
+
+void ClusterCullDrawCallback::drawImplementation(RenderInfo& renderInfo, const Drawable* drawable) const
+{
+    const Geometry* geom = drawable->asGeometry();
+    // fall back to drawing everything if the geometry has been modified since the clusters were built.
+    if (!geom || !_drawElements || _drawElements->getNumIndices() != _numIndices
+        || geom->getPrimitiveSetIndex(_drawElements.get()) == geom->getNumPrimitiveSets())
+    {
+        drawable->drawImplementation(renderInfo);
+        return;
+    }
+
+    State& state = *renderInfo.getState();
+    const Matrix& modelView = state.getModelViewMatrix();
+    const Matrix& projection = state.getProjectionMatrix();
+
+    Polytope frustum;
+    if (_frustumCulling)
+    {
+        frustum.setToUnitFrustum(true, true);
+        frustum.transformProvidingInverse(modelView * projection);
+    }
+
+    // back faces can only be culled if OpenGL is culling them, the winding
+    // isn't flipped, and the projection is perspective so there is an eye point.
+    bool backFaceCulling = _backFaceCulling && projection(3,3) == 0.0 && state.getLastAppliedMode(GL_CULL_FACE);
+    if (backFaceCulling)
+    {
+        const CullFace* cullFace = dynamic_cast<const CullFace*>(state.getLastAppliedAttribute(StateAttribute::CULLFACE));
+        const FrontFace* frontFace = dynamic_cast<const FrontFace*>(state.getLastAppliedAttribute(StateAttribute::FRONTFACE));
+        Matrix3 rotation(modelView(0,0), modelView(0,1), modelView(0,2),
+                         modelView(1,0), modelView(1,1), modelView(1,2),
+                         modelView(2,0), modelView(2,1), modelView(2,2));
+        double det = rotation(0,0) * (rotation(1,1) * rotation(2,2) - rotation(1,2) * rotation(2,1))
+            - rotation(0,1) * (rotation(1,0) * rotation(2,2) - rotation(1,2) * rotation(2,0))
+            + rotation(0,2) * (rotation(1,0) * rotation(2,1) - rotation(1,1) * rotation(2,0));
+        backFaceCulling = (!cullFace || cullFace->getMode() == CullFace::BACK)
+            && (!frontFace || frontFace->getMode() == FrontFace::COUNTER_CLOCKWISE)
+            && det > 0.0;
+    }
+    Vec3 eye;
+    if (backFaceCulling)
+        eye = Matrix::inverse(modelView).getTrans();
+
+    // gather the visible clusters, merging neighbouring ones into a single range.
+    typedef std::pair<unsigned, unsigned> Range;
+    std::vector<Range> ranges;
+    for (ClusterList::const_iterator itr = _clusters.begin(); itr != _clusters.end(); ++itr)
+    {
+        if (_frustumCulling && !frustum.contains(itr->bound))
+            continue;
+        if (backFaceCulling)
+        {
+            Vec3 toCentre = itr->bound._center - eye;
+            if (toCentre * itr->coneAxis >= itr->coneCutoff * toCentre.length() + itr->bound._radius)
+                continue;
+        }
+        if (!ranges.empty() && ranges.back().first + ranges.back().second == itr->first)
+            ranges.back().second += itr->count;
+        else
+            ranges.push_back(Range(itr->first, itr->count));
+    }
+
+    geom->drawVertexArraysImplementation(renderInfo);
+
+    AttributeDispatchers& attributeDispatchers = state.getAttributeDispatchers();
+    bool usingVertexBufferObjects = state.useVertexBufferObject(geom->getUseVertexBufferObjects());
+    bool usingVertexArrayObjects = usingVertexBufferObjects && state.useVertexArrayObject(geom->getUseVertexArrayObject());
+    bool bindPerPrimitiveSetActive = attributeDispatchers.active();
+
+    for (unsigned primitiveSetNum = 0; primitiveSetNum != geom->getNumPrimitiveSets(); ++primitiveSetNum)
+    {
+        if (bindPerPrimitiveSetActive) attributeDispatchers.dispatch(primitiveSetNum);
+
+        const PrimitiveSet* primitiveSet = geom->getPrimitiveSet(primitiveSetNum);
+        if (primitiveSet != _drawElements.get())
+        {
+            primitiveSet->draw(state, usingVertexBufferObjects);
+            continue;
+        }
+        if (ranges.empty())
+            continue;
+
+        const GLvoid* indices = _drawElements->getDataPointer();
+        GLBufferObject* ebo = usingVertexBufferObjects ? _drawElements->getOrCreateGLBufferObject(state.getContextID()) : 0;
+        if (ebo)
+        {
+            state.getCurrentVertexArrayState()->bindElementBufferObject(ebo);
+            indices = reinterpret_cast<const GLvoid*>(ebo->getOffset(_drawElements->getBufferIndex()));
+        }
+        else if (usingVertexBufferObjects)
+        {
+            state.getCurrentVertexArrayState()->unbindElementBufferObject();
+        }
+
+        GLenum type = _drawElements->getDataType();
+        unsigned indexSize = type == GL_UNSIGNED_BYTE ? 1 : (type == GL_UNSIGNED_SHORT ? 2 : 4);
+        for (std::vector<Range>::iterator itr = ranges.begin(); itr != ranges.end(); ++itr)
+        {
+            glDrawElements(_drawElements->getMode(), itr->second, type,
+                           reinterpret_cast<const GLvoid*>(reinterpret_cast<const char*>(indices) + itr->first * indexSize));
+        }
+    }
+
+    if (usingVertexBufferObjects && !usingVertexArrayObjects)
+    {
+        // unbind the VBO's if any are used, as Geometry::drawImplementation() does.
+        VertexArrayState* vas = state.getCurrentVertexArrayState();
+        vas->unbindVertexBufferObject();
+        vas->unbindElementBufferObject();
+    }
+}
+
+namespace
+{
+// Octahedral projection of a unit vector onto the [-1,1] square.
+Vec2 encodeOctahedral(const Vec3& n)
+{
+    float l1 = fabsf(n.x()) + fabsf(n.y()) + fabsf(n.z());
+    if (l1 <= 0.0f)
+        return Vec2(0.0f, 0.0f);
+    float x = n.x() / l1;
+    float y = n.y() / l1;
+    if (n.z() < 0.0f)
+    {
+        float ox = x;
+        x = (1.0f - fabsf(y)) * (ox >= 0.0f ? 1.0f : -1.0f);
+        y = (1.0f - fabsf(ox)) * (y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return Vec2(x, y);
+}
+
+Vec3 decodeOctahedral(float x, float y)
+{
+    Vec3 n(x, y, 1.0f - fabsf(x) - fabsf(y));
+    float t = osg::maximum(-n.z(), 0.0f);
+    n.x() += n.x() >= 0.0f ? -t : t;
+    n.y() += n.y() >= 0.0f ? -t : t;
+    n.normalize();
+    return n;
+}
+
+// Value of a normalized signed byte as OpenGL maps it, -128 and -127 both
+// giving -1.0.
+inline float snorm8(int v)
+{
+    return osg::maximum(float(v) / 127.0f, -1.0f);
+}
+
+// Quantize each component of value to a normalized signed byte, rounding
+// each up or down so as to point closest to the unit vector n.
+template<unsigned N>
+void quantizeSnorm8(const float* value, const Vec3& n, int* best)
+{
+    int lower[N];
+    for (unsigned i = 0; i < N; ++i)
+        lower[i] = osg::clampBetween((int)floorf(value[i] * 127.0f), -127, 126);
+    float bestDot = -FLT_MAX;
+    for (unsigned combination = 0; combination < (1u << N); ++combination)
+    {
+        int q[N];
+        float v[3] = {0.0f, 0.0f, 0.0f};
+        for (unsigned i = 0; i < N; ++i)
+        {
+            q[i] = lower[i] + ((combination >> i) & 1);
+            v[i] = snorm8(q[i]);
+        }
+        Vec3 decoded = N == 2 ? decodeOctahedral(v[0], v[1]) : Vec3(v[0], v[1], v[2]);
+        decoded.normalize();
+        float d = decoded * n;
+        if (d > bestDot)
+        {
+            bestDot = d;
+            for (unsigned i = 0; i < N; ++i)
+                best[i] = q[i];
+        }
+    }
+}
+}
+
+const char* QuantizeVertexAttributesVisitor::getOctahedralNormalDecodeShaderSource()
+{
+    return
+        "vec3 decodeOctahedralNormal(vec2 e)\n"
+        "{\n"
+        "    vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));\n"
+        "    float t = max(-n.z, 0.0);\n"
+        "    n.x += n.x >= 0.0 ? -t : t;\n"
+        "    n.y += n.y >= 0.0 ? -t : t;\n"
+        "    return normalize(n);\n"
+        "}\n";
+}
+
+bool QuantizeVertexAttributesVisitor::quantizePositions(const std::vector<Geometry*>& geometries, Node* node)
+{
+    BoundingBox bb;
+    for (std::vector<Geometry*>::const_iterator itr = geometries.begin(); itr != geometries.end(); ++itr)
+    {
+        const Vec3Array& vertices = static_cast<const Vec3Array&>(*(*itr)->getVertexArray());
+        for (Vec3Array::const_iterator vitr = vertices.begin(); vitr != vertices.end(); ++vitr)
+            bb.expandBy(*vitr);
+    }
+    if (!bb.valid())
+        return false;
+
+    // Map the largest side of the box onto [-32767,32767], using the same
+    // scale on each axis so that the transform keeps the normals' directions.
+    float extent = osg::maximum(bb.xMax() - bb.xMin(), osg::maximum(bb.yMax() - bb.yMin(), bb.zMax() - bb.zMin()));
+    float scale = extent > 0.0f ? extent / 65534.0f : 1.0f;
+    Vec3 centre = bb.center();
+    Matrix matrix = Matrix::scale(scale, scale, scale) * Matrix::translate(centre);
+    double maxError = _positionTolerance * extent;
+
+    std::vector<ref_ptr<Vec3sArray> > quantizedArrays;
+    for (std::vector<Geometry*>::const_iterator itr = geometries.begin(); itr != geometries.end(); ++itr)
+    {
+        const Vec3Array& vertices = static_cast<const Vec3Array&>(*(*itr)->getVertexArray());
+        ref_ptr<Vec3sArray> quantized = new Vec3sArray(vertices.size());
+        quantized->setBinding(vertices.getBinding());
+        for (unsigned i = 0; i < vertices.size(); ++i)
+        {
+            Vec3s& q = (*quantized)[i];
+            for (unsigned j = 0; j < 3; ++j)
+                q[j] = (short)osg::clampBetween((int)floorf((vertices[i][j] - centre[j]) / scale + 0.5f), -32767, 32767);
+            Vec3d error = Vec3d(q.x(), q.y(), q.z()) * matrix - Vec3d(vertices[i]);
+            if (fabs(error.x()) > maxError || fabs(error.y()) > maxError || fabs(error.z()) > maxError)
+                return false;
+        }
+        quantizedArrays.push_back(quantized);
+    }
+
+    ref_ptr<MatrixTransform> transform = new MatrixTransform(matrix);
+    // The vertices can't be transformed back to floats by flattening the
+    // transform, so it's marked as dynamic to keep it.
+    transform->setDataVariance(Object::DYNAMIC);
+    transform->getOrCreateStateSet()->setMode(GL_NORMALIZE, StateAttribute::ON);
+
+    ref_ptr<Node> child = node;
+    Node::ParentList parents = node->getParents();
+    for (Node::ParentList::iterator itr = parents.begin(); itr != parents.end(); ++itr)
+        (*itr)->replaceChild(node, transform.get());
+    transform->addChild(node);
+
+    for (unsigned i = 0; i < geometries.size(); ++i)
+    {
+        Geometry& geom = *geometries[i];
+        geom.setVertexArray(quantizedArrays[i].get());
+        geom.dirtyBound();
+
+        // A KdTree holds the float vertices so can't be used any more.
+        if (dynamic_cast<KdTree*>(geom.getShape()))
+            geom.setShape(0);
+
+        // Move the cluster bounds into the quantized coordinates.
+        ClusterCullDrawCallback* clusterCull = dynamic_cast<ClusterCullDrawCallback*>(geom.getDrawCallback());
+        if (clusterCull)
+        {
+            ClusterCullDrawCallback::ClusterList clusters = clusterCull->getClusters();
+            for (ClusterCullDrawCallback::ClusterList::iterator citr = clusters.begin(); citr != clusters.end(); ++citr)
+                citr->bound.set((citr->bound.center() - centre) / scale, citr->bound.radius() / scale);
+            ref_ptr<ClusterCullDrawCallback> quantizedClusterCull = new ClusterCullDrawCallback(clusterCull->getDrawElements(), clusters);
+            quantizedClusterCull->setFrustumCulling(clusterCull->getFrustumCulling());
+            quantizedClusterCull->setBackFaceCulling(clusterCull->getBackFaceCulling());
+            geom.setDrawCallback(quantizedClusterCull.get());
+        }
+    }
+    return true;
+}
+
+Array* QuantizeVertexAttributesVisitor::quantizeNormals(const Vec3Array& normals) const
+{
+    float minCosine = cosf(osg::DegreesToRadians(_normalTolerance));
+    ref_ptr<Array> quantizedArray;
+    if (_normalEncoding == OCTAHEDRAL_VEC2B_NORMALS)
+    {
+        ref_ptr<Vec2bArray> quantized = new Vec2bArray(normals.size());
+        for (unsigned i = 0; i < normals.size(); ++i)
+        {
+            Vec3 n = normals[i];
+            if (n.normalize() == 0.0f)
+                continue;
+            Vec2 e = encodeOctahedral(n);
+            int q[2];
+            quantizeSnorm8<2>(e.ptr(), n, q);
+            if (decodeOctahedral(snorm8(q[0]), snorm8(q[1])) * n < minCosine)
+                return 0;
+            (*quantized)[i].set((signed char)q[0], (signed char)q[1]);
+        }
+        quantizedArray = quantized;
+    }
+    else
+    {
+        ref_ptr<Vec3bArray> quantized = new Vec3bArray(normals.size());
+        for (unsigned i = 0; i < normals.size(); ++i)
+        {
+            Vec3 n = normals[i];
+            if (n.normalize() == 0.0f)
+                continue;
+            int q[3];
+            quantizeSnorm8<3>(n.ptr(), n, q);
+            Vec3 decoded(snorm8(q[0]), snorm8(q[1]), snorm8(q[2]));
+            decoded.normalize();
+            if (decoded * n < minCosine)
+                return 0;
+            (*quantized)[i].set((signed char)q[0], (signed char)q[1], (signed char)q[2]);
+        }
+        quantizedArray = quantized;
+    }
+    quantizedArray->setBinding(normals.getBinding());
+    quantizedArray->setNormalize(true);
+    return quantizedArray.release();
+}
+
+Array* QuantizeVertexAttributesVisitor::quantizeTexCoords(const Vec2Array& texCoords) const
+{
+    ref_ptr<Vec2usArray> quantized = new Vec2usArray(texCoords.size());
+    for (unsigned i = 0; i < texCoords.size(); ++i)
+    {
+        for (unsigned j = 0; j < 2; ++j)
+        {
+            float t = texCoords[i][j];
+            if (!(t >= 0.0f && t <= 1.0f))
+                return 0;
+            unsigned q = (unsigned)floorf(t * 65535.0f + 0.5f);
+            if (fabsf(float(q) / 65535.0f - t) > _texCoordTolerance)
+                return 0;
+            (*quantized)[i][j] = (unsigned short)q;
+        }
+    }
+    quantized->setBinding(texCoords.getBinding());
+    quantized->setNormalize(true);
+    return quantized.release();
+}
+
+void QuantizeVertexAttributesVisitor::quantize()
+{
+    if (_quantizePositions)
+    {
+        // Gather the geometries to share each transform, geometries with
+        // more than one parent can't be given their own.
+        typedef std::map<Node*, std::vector<Geometry*> > GeometryMap;
+        GeometryMap transformedNodes;
+        for (GeometryList::iterator itr = _geometryList.begin(); itr != _geometryList.end(); ++itr)
+        {
+            Geometry* geom = *itr;
+            if (!dynamic_cast<Vec3Array*>(geom->getVertexArray()) || geom->getNumParents() != 1 ||
+                geom->getDataVariance() == Object::DYNAMIC || !isOperationPermissibleForObject(geom))
+                continue;
+            Geode* geode = geom->getParent(0)->asGeode();
+            if (geode)
+            {
+                if (!dynamic_cast<Billboard*>(geode))
+                    transformedNodes[geode].push_back(geom);
+            }
+            else
+            {
+                transformedNodes[geom].push_back(geom);
+            }
+        }
+
+        for (GeometryMap::iterator itr = transformedNodes.begin(); itr != transformedNodes.end(); ++itr)
+        {
+            Node* node = itr->first;
+            if (node->getNumParents() == 0 || !isOperationPermissibleForObject(node))
+                continue;
+            // All the children of a Geode have to be in the new coordinates.
+            if (node->asGeode() && node->asGeode()->getNumChildren() != itr->second.size())
+                continue;
+            quantizePositions(itr->second, node);
+        }
+    }
+
+    // Arrays shared by several geometries stay shared.
+    typedef std::map<Array*, ref_ptr<Array> > ArrayMap;
+    ArrayMap quantizedArrays;
+    for (GeometryList::iterator itr = _geometryList.begin(); itr != _geometryList.end(); ++itr)
+    {
+        Geometry& geom = *(*itr);
+        if (geom.getDataVariance() == Object::DYNAMIC || !isOperationPermissibleForObject(&geom))
+            continue;
+
+        Vec3Array* normals = dynamic_cast<Vec3Array*>(geom.getNormalArray());
+        if (normals && _normalEncoding != NO_NORMAL_QUANTIZATION)
+        {
+            ArrayMap::iterator aitr = quantizedArrays.find(normals);
+            if (aitr == quantizedArrays.end())
+                aitr = quantizedArrays.insert(ArrayMap::value_type(normals, quantizeNormals(*normals))).first;
+            if (aitr->second.valid())
+                geom.setNormalArray(aitr->second.get());
+        }
+
+        if (_quantizeTexCoords)
+        {
+            for (unsigned unit = 0; unit < geom.getNumTexCoordArrays(); ++unit)
+            {
+                Vec2Array* texCoords = dynamic_cast<Vec2Array*>(geom.getTexCoordArray(unit));
+                if (!texCoords)
+                    continue;
+                ArrayMap::iterator aitr = quantizedArrays.find(texCoords);
+                if (aitr == quantizedArrays.end())
+                    aitr = quantizedArrays.insert(ArrayMap::value_type(texCoords, quantizeTexCoords(*texCoords))).first;
+                if (aitr->second.valid())
+                    geom.setTexCoordArray(unit, aitr->second.get());
+            }
+        }
+    }
+}
+
 void SharedArrayOptimizer::findDuplicatedUVs(const osg::Geometry& geometry)
 {
     _deduplicateUvs.clear();
@@ -54,7 +54,7 @@ void Optimizer::reset()
 {
 }
 
-static osg::ApplicationUsageProxy Optimizer_e0(osg::ApplicationUsage::ENVIRONMENTAL_VARIABLE,"OSG_OPTIMIZER \"<type> [<type>]\"","OFF | DEFAULT | FLATTEN_STATIC_TRANSFORMS | FLATTEN_STATIC_TRANSFORMS_DUPLICATING_SHARED_SUBGRAPHS | REMOVE_REDUNDANT_NODES | COMBINE_ADJACENT_LODS | SHARE_DUPLICATE_STATE | MERGE_GEOMETRY | MERGE_GEODES | SPATIALIZE_GROUPS  | COPY_SHARED_NODES  | TRISTRIP_GEOMETRY | OPTIMIZE_TEXTURE_SETTINGS | REMOVE_LOADED_PROXY_NODES | TESSELLATE_GEOMETRY | CHECK_GEOMETRY |  FLATTEN_BILLBOARDS | TEXTURE_ATLAS_BUILDER | STATIC_OBJECT_DETECTION | INDEX_MESH | VERTEX_POSTTRANSFORM | VERTEX_PRETRANSFORM | BUFFER_OBJECT_SETTINGS");
+static osg::ApplicationUsageProxy Optimizer_e0(osg::ApplicationUsage::ENVIRONMENTAL_VARIABLE,"OSG_OPTIMIZER \"<type> [<type>]\"","OFF | DEFAULT | FLATTEN_STATIC_TRANSFORMS | FLATTEN_STATIC_TRANSFORMS_DUPLICATING_SHARED_SUBGRAPHS | REMOVE_REDUNDANT_NODES | COMBINE_ADJACENT_LODS | SHARE_DUPLICATE_STATE | MERGE_GEOMETRY | MERGE_GEODES | SPATIALIZE_GROUPS  | COPY_SHARED_NODES  | TRISTRIP_GEOMETRY | OPTIMIZE_TEXTURE_SETTINGS | REMOVE_LOADED_PROXY_NODES | TESSELLATE_GEOMETRY | CHECK_GEOMETRY |  FLATTEN_BILLBOARDS | TEXTURE_ATLAS_BUILDER | STATIC_OBJECT_DETECTION | INDEX_MESH | VERTEX_POSTTRANSFORM | VERTEX_PRETRANSFORM | BUFFER_OBJECT_SETTINGS | CLUSTER_MESH | REDUCE_OVERDRAW | QUANTIZE_VERTEX_ATTRIBUTES");
 
 void Optimizer::optimize(osg::Node* node)
 {
@@ -136,6 +136,15 @@ void Optimizer::optimize(osg::Node* node)
 
         if(str.find("~BUFFER_OBJECT_SETTINGS")!=std::string::npos) options ^= BUFFER_OBJECT_SETTINGS;
         else if(str.find("BUFFER_OBJECT_SETTINGS")!=std::string::npos) options |= BUFFER_OBJECT_SETTINGS;
+
+        if(str.find("~CLUSTER_MESH")!=std::string::npos) options ^= CLUSTER_MESH;
+        else if(str.find("CLUSTER_MESH")!=std::string::npos) options |= CLUSTER_MESH;
+
+        if(str.find("~REDUCE_OVERDRAW")!=std::string::npos) options ^= REDUCE_OVERDRAW;
+        else if(str.find("REDUCE_OVERDRAW")!=std::string::npos) options |= REDUCE_OVERDRAW;
+
+        if(str.find("~QUANTIZE_VERTEX_ATTRIBUTES")!=std::string::npos) options ^= QUANTIZE_VERTEX_ATTRIBUTES;
+        else if(str.find("QUANTIZE_VERTEX_ATTRIBUTES")!=std::string::npos) options |= QUANTIZE_VERTEX_ATTRIBUTES;
     }
     else
     {
@@ -358,7 +367,8 @@ void Optimizer::optimize(osg::Node* node, unsigned int options)
         imv.makeMesh();
     }
 
-    if (options & VERTEX_POSTTRANSFORM)
+    // the overdraw reordering works on the clusters of the vertex cache optimized order.
+    if (options & (VERTEX_POSTTRANSFORM | REDUCE_OVERDRAW))
     {
         OSG_INFO<<"Optimizer::optimize() doing VERTEX_POSTTRANSFORM"<<std::endl;
         VertexCacheVisitor vcv;
@@ -366,6 +376,14 @@ void Optimizer::optimize(osg::Node* node, unsigned int options)
         vcv.optimizeVertices();
     }
 
+    if (options & REDUCE_OVERDRAW)
+    {
+        OSG_INFO<<"Optimizer::optimize() doing REDUCE_OVERDRAW"<<std::endl;
+        OverdrawVisitor odv(this);
+        node->accept(odv);
+        odv.optimizeOverdraw();
+    }
+
     if (options & VERTEX_PRETRANSFORM)
     {
         OSG_INFO<<"Optimizer::optimize() doing VERTEX_PRETRANSFORM"<<std::endl;
@@ -374,6 +392,23 @@ void Optimizer::optimize(osg::Node* node, unsigned int options)
         vaov.optimizeOrder();
     }
 
+    if (options & CLUSTER_MESH)
+    {
+        OSG_INFO<<"Optimizer::optimize() doing CLUSTER_MESH"<<std::endl;
+        ClusterMeshVisitor cmv(this);
+        node->accept(cmv);
+        cmv.buildClusters();
+    }
+
+    // the other mesh optimizations only handle float arrays so quantize last.
+    if (options & QUANTIZE_VERTEX_ATTRIBUTES)
+    {
+        OSG_INFO<<"Optimizer::optimize() doing QUANTIZE_VERTEX_ATTRIBUTES"<<std::endl;
+        QuantizeVertexAttributesVisitor qvav(this);
+        node->accept(qvav);
+        qvav.quantize();
+    }
+
     if (options & BUFFER_OBJECT_SETTINGS)
     {
         OSG_INFO<<"Optimizer::optimize() doing BUFFER_OBJECT_SETTINGS"<<std::endl;
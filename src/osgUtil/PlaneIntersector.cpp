@@ -18,6 +18,7 @@
 #include <osg/Notify>
 #include <osg/io_utils>
 #include <osg/TriangleFunctor>
+#include <osg/KdTree>
 
 using namespace osgUtil;
 
@@ -437,6 +438,22 @@ namespace PlaneIntersectorUtils
             }
         }
 
+        // KdTree primitive callbacks, only triangles and quads can intersect the plane.
+        inline void intersect(const osg::Vec3Array*, unsigned int, unsigned int) {}
+        inline void intersect(const osg::Vec3Array*, unsigned int, unsigned int, unsigned int) {}
+
+        inline void intersect(const osg::Vec3Array* vertices, unsigned int, unsigned int p0, unsigned int p1, unsigned int p2)
+        {
+            operator()((*vertices)[p0], (*vertices)[p1], (*vertices)[p2]);
+        }
+
+        inline void intersect(const osg::Vec3Array* vertices, unsigned int, unsigned int p0, unsigned int p1, unsigned int p2, unsigned int p3)
+        {
+            // split quads the same way as TriangleFunctor.
+            operator()((*vertices)[p0], (*vertices)[p1], (*vertices)[p2]);
+            operator()((*vertices)[p0], (*vertices)[p2], (*vertices)[p3]);
+        }
+
         inline void operator () (const osg::Vec3& v1,const osg::Vec3& v2,const osg::Vec3& v3)
         {
 
@@ -664,7 +681,31 @@ void PlaneIntersector::intersect(osgUtil::IntersectionVisitor& iv, osg::Drawable
     osg::TriangleFunctor<PlaneIntersectorUtils::TriangleIntersector> ti;
     ti.set(_plane, _polytope, iv.getModelMatrix(), _recordHeightsAsAttributes, _em.get());
     ti._limitOneIntersection = (_intersectionLimit == LIMIT_ONE_PER_DRAWABLE || _intersectionLimit == LIMIT_ONE);
-    drawable->accept(ti);
+
+    osg::KdTree* kdTree = iv.getUseKdTreeWhenAvailable() ? dynamic_cast<osg::KdTree*>(drawable->getShape()) : 0;
+    if (kdTree)
+    {
+        if (_polytope.getPlaneList().empty())
+        {
+            kdTree->intersect(ti, _plane);
+        }
+        else
+        {
+            // a box straddles the plane when it isn't wholly behind either the plane or the flipped plane,
+            // so adding both to the bounding polytope culls the KdTree against the plane and polytope in one pass.
+            osg::Polytope polytope(_polytope);
+            osg::Plane flippedPlane(_plane);
+            flippedPlane.flip();
+            polytope.add(_plane);
+            polytope.add(flippedPlane);
+
+            kdTree->intersect(ti, polytope);
+        }
+    }
+    else
+    {
+        drawable->accept(ti);
+    }
 
     ti._polylineConnector.consolidatePolylineLists();
 
@@ -64,25 +64,6 @@ struct IntersectFunctor
         dest.reserve(10);
     }
 
-    bool enter(const osg::BoundingBox& bb)
-    {
-        if (_settings->_polytopeIntersector->getPolytope().contains(bb))
-        {
-            _settings->_polytopeIntersector->getPolytope().pushCurrentMask();
-
-            return true;
-        }
-        else
-        {
-            return false;
-        }
-    }
-
-    void leave()
-    {
-        _settings->_polytopeIntersector->getPolytope().popCurrentMask();
-    }
-
     void addIntersection()
     {
 
@@ -564,7 +545,7 @@ void PolytopeIntersector::intersect(osgUtil::IntersectionVisitor& iv, osg::Drawa
         osg::TemplatePrimitiveFunctor<PolytopeIntersectorUtils::IntersectFunctor<osg::Vec3d> > intersector;
         intersector._settings = settings;
 
-        if (kdTree) kdTree->intersect(intersector, kdTree->getNode(0));
+        if (kdTree) kdTree->intersect(intersector, _polytope);
         else drawable->accept(intersector);
     }
     else
@@ -572,7 +553,7 @@ void PolytopeIntersector::intersect(osgUtil::IntersectionVisitor& iv, osg::Drawa
         osg::TemplatePrimitiveFunctor<PolytopeIntersectorUtils::IntersectFunctor<osg::Vec3f> > intersector;
         intersector._settings = settings;
 
-        if (kdTree) kdTree->intersect(intersector, kdTree->getNode(0));
+        if (kdTree) kdTree->intersect(intersector, _polytope);
         else drawable->accept(intersector);
     }
 }
@@ -0,0 +1,976 @@
+/* -*-c++-*- OpenSceneGraph - Copyright (C) 1998-2006 Robert Osfield
+ *
+ * This library is open source and may be redistributed and/or modified under
+ * the terms of the OpenSceneGraph Public License (OSGPL) version 0.0 or
+ * (at your option) any later version.  The full license is in LICENSE file
+ * included with this distribution, and on the openscenegraph.org website.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * OpenSceneGraph Public License for more details.
+*/
+
+#include <osgUtil/QuadricSimplifier>
+#include <osgUtil/MeshOptimizers>
+#include <osgUtil/TaskThreadPool>
+
+#include <osg/KdTree>
+#include <osg/Notify>
+#include <osg/OperationThread>
+#include <osg/TriangleIndexFunctor>
+
+#include <OpenThreads/Thread>
+
+#include <algorithm>
+#include <map>
+
+#include <float.h>
+
+using namespace osgUtil;
+
+namespace QuadricSimplifierImplementation
+{
+
+typedef QuadricSimplifier::IndexList IndexList;
+typedef QuadricSimplifier::SampleRatioList SampleRatioList;
+
+const unsigned int NO_EDGE = ~0u;
+const unsigned int MULTIPLE_EDGES = ~0u - 1;
+
+/** Sum of squared distances to a set of weighted planes.*/
+struct Quadric
+{
+    Quadric() : a00(0.0), a11(0.0), a22(0.0), a10(0.0), a20(0.0), a21(0.0), b0(0.0), b1(0.0), b2(0.0), c(0.0), w(0.0) {}
+
+    void addPlane(const osg::Vec3d& n, double d, double weight)
+    {
+        a00 += weight * n.x() * n.x();
+        a11 += weight * n.y() * n.y();
+        a22 += weight * n.z() * n.z();
+        a10 += weight * n.y() * n.x();
+        a20 += weight * n.z() * n.x();
+        a21 += weight * n.z() * n.y();
+        b0 += weight * n.x() * d;
+        b1 += weight * n.y() * d;
+        b2 += weight * n.z() * d;
+        c += weight * d * d;
+        w += weight;
+    }
+
+    Quadric& operator += (const Quadric& rhs)
+    {
+        a00 += rhs.a00; a11 += rhs.a11; a22 += rhs.a22;
+        a10 += rhs.a10; a20 += rhs.a20; a21 += rhs.a21;
+        b0 += rhs.b0; b1 += rhs.b1; b2 += rhs.b2;
+        c += rhs.c;
+        w += rhs.w;
+        return *this;
+    }
+
+    /** Root mean square distance of v to the planes.*/
+    double error(const osg::Vec3d& v) const
+    {
+        double rx = a00 * v.x() + a10 * v.y() + a20 * v.z() + 2.0 * b0;
+        double ry = a10 * v.x() + a11 * v.y() + a21 * v.z() + 2.0 * b1;
+        double rz = a20 * v.x() + a21 * v.y() + a22 * v.z() + 2.0 * b2;
+        double r = rx * v.x() + ry * v.y() + rz * v.z() + c;
+        return w > 0.0 ? sqrt(fabs(r) / w) : 0.0;
+    }
+
+    double a00, a11, a22, a10, a20, a21;
+    double b0, b1, b2;
+    double c;
+    double w;
+};
+
+enum VertexKind
+{
+    MANIFOLD,
+    BORDER,
+    SEAM,
+    LOCKED
+};
+
+/** The half edges leaving each vertex.*/
+struct EdgeAdjacency
+{
+    void build(const IndexList& triangles, unsigned int numVertices)
+    {
+        offsets.assign(numVertices + 1, 0);
+        for (IndexList::const_iterator itr = triangles.begin(); itr != triangles.end(); ++itr)
+            ++offsets[*itr + 1];
+        for (unsigned int i = 0; i < numVertices; ++i)
+            offsets[i + 1] += offsets[i];
+
+        targets.resize(triangles.size());
+        std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+        for (unsigned int i = 0; i < triangles.size(); i += 3)
+        {
+            targets[fill[triangles[i]]++] = triangles[i + 1];
+            targets[fill[triangles[i + 1]]++] = triangles[i + 2];
+            targets[fill[triangles[i + 2]]++] = triangles[i];
+        }
+    }
+
+    bool hasEdge(unsigned int a, unsigned int b) const
+    {
+        for (unsigned int i = offsets[a]; i < offsets[a + 1]; ++i)
+            if (targets[i] == b)
+                return true;
+        return false;
+    }
+
+    std::vector<unsigned int> offsets;
+    std::vector<unsigned int> targets;
+};
+
+struct Collapse
+{
+    unsigned int v0;
+    unsigned int v1;
+    double error;
+
+    bool operator < (const Collapse& rhs) const { return error < rhs.error; }
+};
+
+/** Edge collapse simplification of a triangle list, collapsing batches of independent edges in order of increasing
+  * error and then removing the degenerate triangles, in passes until the target is reached.*/
+class MeshSimplifier
+{
+    public:
+
+        MeshSimplifier(const osg::Vec3Array& vertices, const IndexList& triangles, bool lockBorders) :
+            _vertices(vertices),
+            _numVertices(vertices.size()),
+            _triangles(triangles),
+            _error(0.0)
+        {
+            buildPositionRemap();
+            _adjacency.build(_triangles, _numVertices);
+            classifyVertices(lockBorders);
+            computeQuadrics();
+        }
+
+        const IndexList& getTriangles() const { return _triangles; }
+
+        double getError() const { return _error; }
+
+        /** Simplify until no more than targetNumIndices remain, returning false if simplification stopped short of the
+          * target because of the maximum error or the topology of the mesh.*/
+        bool simplify(unsigned int targetNumIndices, double maximumError)
+        {
+            while (_triangles.size() > targetNumIndices)
+            {
+                unsigned int goal = (_triangles.size() - targetNumIndices) / 3;
+                if (goal == 0)
+                    return true;
+                if (!simplifyPass(goal, maximumError))
+                    return false;
+            }
+            return true;
+        }
+
+    protected:
+
+        /** Link the vertices of the same position into cycles with the first as the position's representative.*/
+        void buildPositionRemap()
+        {
+            std::vector<unsigned int> order(_numVertices);
+            for (unsigned int i = 0; i < _numVertices; ++i)
+                order[i] = i;
+            std::sort(order.begin(), order.end(), LessPosition(_vertices));
+
+            _remap.resize(_numVertices);
+            _wedge.resize(_numVertices);
+            unsigned int start = 0;
+            while (start < _numVertices)
+            {
+                unsigned int end = start + 1;
+                while (end < _numVertices && _vertices[order[end]] == _vertices[order[start]])
+                    ++end;
+
+                unsigned int representative = *std::min_element(order.begin() + start, order.begin() + end);
+                for (unsigned int i = start; i < end; ++i)
+                {
+                    _remap[order[i]] = representative;
+                    _wedge[order[i]] = order[i + 1 < end ? i + 1 : start];
+                }
+                start = end;
+            }
+        }
+
+        struct LessPosition
+        {
+            LessPosition(const osg::Vec3Array& vertices) : _vertices(vertices) {}
+
+            bool operator() (unsigned int lhs, unsigned int rhs) const
+            {
+                if (_vertices[lhs] < _vertices[rhs]) return true;
+                if (_vertices[rhs] < _vertices[lhs]) return false;
+                return lhs < rhs;
+            }
+
+            const osg::Vec3Array& _vertices;
+        };
+
+        void findOpenEdges(std::vector<unsigned int>& openOut, std::vector<unsigned int>& openIn) const
+        {
+            openOut.assign(_numVertices, NO_EDGE);
+            openIn.assign(_numVertices, NO_EDGE);
+            for (unsigned int v = 0; v < _numVertices; ++v)
+            {
+                for (unsigned int i = _adjacency.offsets[v]; i < _adjacency.offsets[v + 1]; ++i)
+                {
+                    unsigned int t = _adjacency.targets[i];
+                    if (_adjacency.hasEdge(t, v))
+                        continue;
+                    openOut[v] = openOut[v] == NO_EDGE ? t : MULTIPLE_EDGES;
+                    openIn[t] = openIn[t] == NO_EDGE ? v : MULTIPLE_EDGES;
+                }
+            }
+        }
+
+        static bool isSingle(unsigned int edge) { return edge != NO_EDGE && edge != MULTIPLE_EDGES; }
+
+        void classifyVertices(bool lockBorders)
+        {
+            std::vector<unsigned int> openOut, openIn;
+            findOpenEdges(openOut, openIn);
+
+            _kind.assign(_numVertices, LOCKED);
+            for (unsigned int v = 0; v < _numVertices; ++v)
+            {
+                if (_remap[v] != v)
+                    continue;
+
+                VertexKind kind = LOCKED;
+                unsigned int w = _wedge[v];
+                if (w == v)
+                {
+                    if (openOut[v] == NO_EDGE && openIn[v] == NO_EDGE)
+                        kind = MANIFOLD;
+                    else if (isSingle(openOut[v]) && isSingle(openIn[v]))
+                        kind = lockBorders ? LOCKED : BORDER;
+                }
+                else if (_wedge[w] == v)
+                {
+                    // the two wedges meet along a seam running in opposite directions on either side.
+                    if (isSingle(openOut[v]) && isSingle(openIn[v]) && isSingle(openOut[w]) && isSingle(openIn[w]) &&
+                        _remap[openOut[v]] == _remap[openIn[w]] && _remap[openOut[w]] == _remap[openIn[v]])
+                        kind = SEAM;
+                }
+                _kind[v] = kind;
+            }
+
+            for (unsigned int v = 0; v < _numVertices; ++v)
+                _kind[v] = _kind[_remap[v]];
+        }
+
+        osg::Vec3d position(unsigned int v) const { return osg::Vec3d(_vertices[v]); }
+
+        void computeQuadrics()
+        {
+            _quadrics.assign(_numVertices, Quadric());
+            for (unsigned int i = 0; i < _triangles.size(); i += 3)
+            {
+                osg::Vec3d p0 = position(_triangles[i]);
+                osg::Vec3d p1 = position(_triangles[i + 1]);
+                osg::Vec3d p2 = position(_triangles[i + 2]);
+                osg::Vec3d normal = (p1 - p0) ^ (p2 - p0);
+                double length = normal.normalize();
+                if (length == 0.0)
+                    continue;
+
+                Quadric q;
+                q.addPlane(normal, -(normal * p0), length * 0.5);
+                for (unsigned int e = 0; e < 3; ++e)
+                    _quadrics[_remap[_triangles[i + e]]] += q;
+
+                // planes at right angles to the open edges keep borders and seams in place.
+                for (unsigned int e = 0; e < 3; ++e)
+                {
+                    unsigned int i0 = _triangles[i + e];
+                    unsigned int i1 = _triangles[i + (e + 1) % 3];
+                    if ((_kind[i0] != BORDER && _kind[i0] != SEAM && _kind[i1] != BORDER && _kind[i1] != SEAM) ||
+                        _adjacency.hasEdge(i1, i0))
+                        continue;
+
+                    osg::Vec3d edge = position(i1) - position(i0);
+                    double edgeLength2 = edge.length2();
+                    osg::Vec3d edgeNormal = edge ^ normal;
+                    if (edgeNormal.normalize() == 0.0)
+                        continue;
+
+                    Quadric edgeQuadric;
+                    edgeQuadric.addPlane(edgeNormal, -(edgeNormal * position(i0)), edgeLength2 * 10.0);
+                    _quadrics[_remap[i0]] += edgeQuadric;
+                    _quadrics[_remap[i1]] += edgeQuadric;
+                }
+            }
+        }
+
+        /** Return the wedge of b's position joined to the other wedge of a seam vertex a by an open edge.*/
+        unsigned int findSeamPartner(unsigned int a, unsigned int b) const
+        {
+            unsigned int s0 = _wedge[a];
+            unsigned int s1 = _wedge[b];
+            if (s1 == b)
+                return NO_EDGE;
+            bool forward = _adjacency.hasEdge(s0, s1);
+            bool backward = _adjacency.hasEdge(s1, s0);
+            return forward != backward ? s1 : NO_EDGE;
+        }
+
+        bool canCollapse(unsigned int a, unsigned int b, bool open) const
+        {
+            switch (_kind[a])
+            {
+                case MANIFOLD:
+                    return true;
+                case BORDER:
+                    return open && _kind[b] == BORDER;
+                case SEAM:
+                    return open && _kind[b] == SEAM && findSeamPartner(a, b) != NO_EDGE;
+                default:
+                    return false;
+            }
+        }
+
+        void pickCollapses(std::vector<Collapse>& collapses) const
+        {
+            collapses.clear();
+            for (unsigned int i = 0; i < _triangles.size(); i += 3)
+            {
+                for (unsigned int e = 0; e < 3; ++e)
+                {
+                    unsigned int i0 = _triangles[i + e];
+                    unsigned int i1 = _triangles[i + (e + 1) % 3];
+                    if (_remap[i0] == _remap[i1])
+                        continue;
+
+                    // interior edges are seen from the triangles on both sides, only take them once.
+                    bool open = !_adjacency.hasEdge(i1, i0);
+                    if (!open && i0 > i1)
+                        continue;
+
+                    Collapse collapse;
+                    collapse.error = DBL_MAX;
+                    if (canCollapse(i0, i1, open))
+                    {
+                        collapse.v0 = i0;
+                        collapse.v1 = i1;
+                        collapse.error = _quadrics[_remap[i0]].error(position(i1));
+                    }
+                    if (canCollapse(i1, i0, open))
+                    {
+                        double error = _quadrics[_remap[i1]].error(position(i0));
+                        if (error < collapse.error)
+                        {
+                            collapse.v0 = i1;
+                            collapse.v1 = i0;
+                            collapse.error = error;
+                        }
+                    }
+                    if (collapse.error != DBL_MAX)
+                        collapses.push_back(collapse);
+                }
+            }
+        }
+
+        /** Build the lists of triangles around each position.*/
+        void buildVertexTriangles()
+        {
+            _vertexTriangleOffsets.assign(_numVertices + 1, 0);
+            for (IndexList::const_iterator itr = _triangles.begin(); itr != _triangles.end(); ++itr)
+                ++_vertexTriangleOffsets[_remap[*itr] + 1];
+            for (unsigned int i = 0; i < _numVertices; ++i)
+                _vertexTriangleOffsets[i + 1] += _vertexTriangleOffsets[i];
+
+            _vertexTriangles.resize(_triangles.size());
+            std::vector<unsigned int> fill(_vertexTriangleOffsets.begin(), _vertexTriangleOffsets.end() - 1);
+            for (unsigned int i = 0; i < _triangles.size(); ++i)
+                _vertexTriangles[fill[_remap[_triangles[i]]]++] = i / 3;
+        }
+
+        /** Return true if moving the position r0 onto v1 would turn any of the triangles around it by more than about 75
+          * degrees, which also stops triangles collapsing into slivers on edge.*/
+        bool hasTriangleFlips(unsigned int r0, unsigned int v1) const
+        {
+            unsigned int r1 = _remap[v1];
+            osg::Vec3d p1 = position(v1);
+            for (unsigned int i = _vertexTriangleOffsets[r0]; i < _vertexTriangleOffsets[r0 + 1]; ++i)
+            {
+                unsigned int t = _vertexTriangles[i] * 3;
+                unsigned int c[3] = { _collapseRemap[_triangles[t]], _collapseRemap[_triangles[t + 1]], _collapseRemap[_triangles[t + 2]] };
+                unsigned int r[3] = { _remap[c[0]], _remap[c[1]], _remap[c[2]] };
+
+                // triangles along the edge are removed by the collapse.
+                if (r[0] == r1 || r[1] == r1 || r[2] == r1)
+                    continue;
+
+                unsigned int e = r[0] == r0 ? 0 : (r[1] == r0 ? 1 : 2);
+                osg::Vec3d p0 = position(c[e]);
+                osg::Vec3d pb = position(c[(e + 1) % 3]);
+                osg::Vec3d pc = position(c[(e + 2) % 3]);
+                osg::Vec3d before = (pb - p0) ^ (pc - p0);
+                osg::Vec3d after = (pb - p1) ^ (pc - p1);
+                if (before * after <= 0.25 * sqrt(before.length2() * after.length2()))
+                    return true;
+            }
+            return false;
+        }
+
+        bool simplifyPass(unsigned int goal, double maximumError)
+        {
+            _adjacency.build(_triangles, _numVertices);
+
+            std::vector<Collapse> collapses;
+            pickCollapses(collapses);
+            if (collapses.empty())
+                return false;
+            std::sort(collapses.begin(), collapses.end());
+
+            buildVertexTriangles();
+            _collapseRemap.resize(_numVertices);
+            for (unsigned int i = 0; i < _numVertices; ++i)
+                _collapseRemap[i] = i;
+            std::vector<unsigned char> locked(_numVertices, 0);
+
+            // each collapse removes about two triangles, so collapses with errors well beyond those needed to reach
+            // the goal are left for later passes in which they may be cheaper, unless none of the cheaper ones can be
+            // done.
+            unsigned int boundIndex = std::min<unsigned int>(collapses.size() - 1, goal * 3 / 4);
+            double errorLimit = collapses[boundIndex].error;
+
+            unsigned int numRemoved = 0;
+            unsigned int numCollapsed = 0;
+            for (std::vector<Collapse>::const_iterator itr = collapses.begin(); itr != collapses.end() && numRemoved < goal; ++itr)
+            {
+                const Collapse& collapse = *itr;
+                if (collapse.error > maximumError || (collapse.error > errorLimit && numCollapsed > 0))
+                    break;
+
+                unsigned int r0 = _remap[collapse.v0];
+                unsigned int r1 = _remap[collapse.v1];
+                if (locked[r0] || locked[r1])
+                    continue;
+                if (hasTriangleFlips(r0, collapse.v1))
+                    continue;
+
+                if (_kind[collapse.v0] == SEAM)
+                {
+                    _collapseRemap[_wedge[collapse.v0]] = findSeamPartner(collapse.v0, collapse.v1);
+                }
+                _collapseRemap[collapse.v0] = collapse.v1;
+                _quadrics[r1] += _quadrics[r0];
+
+                locked[r0] = 1;
+                locked[r1] = 1;
+                numRemoved += _kind[collapse.v0] == BORDER ? 1 : 2;
+                ++numCollapsed;
+                _error = std::max(_error, collapse.error);
+            }
+
+            if (numCollapsed == 0)
+                return false;
+
+            // remove the triangles that have collapsed to a line or a point.
+            unsigned int numIndices = 0;
+            for (unsigned int i = 0; i < _triangles.size(); i += 3)
+            {
+                unsigned int v0 = _collapseRemap[_triangles[i]];
+                unsigned int v1 = _collapseRemap[_triangles[i + 1]];
+                unsigned int v2 = _collapseRemap[_triangles[i + 2]];
+                if (_remap[v0] == _remap[v1] || _remap[v1] == _remap[v2] || _remap[v2] == _remap[v0])
+                    continue;
+                _triangles[numIndices++] = v0;
+                _triangles[numIndices++] = v1;
+                _triangles[numIndices++] = v2;
+            }
+            _triangles.resize(numIndices);
+            return true;
+        }
+
+        const osg::Vec3Array&       _vertices;
+        unsigned int                _numVertices;
+        IndexList                   _triangles;
+        double                      _error;
+
+        std::vector<unsigned int>   _remap;
+        std::vector<unsigned int>   _wedge;
+        std::vector<VertexKind>     _kind;
+        std::vector<Quadric>        _quadrics;
+        EdgeAdjacency               _adjacency;
+
+        std::vector<unsigned int>   _vertexTriangleOffsets;
+        std::vector<unsigned int>   _vertexTriangles;
+        std::vector<unsigned int>   _collapseRemap;
+};
+
+struct CollectTriangleOperator
+{
+    CollectTriangleOperator() : _triangles(0) {}
+
+    void setTriangles(IndexList* triangles) { _triangles = triangles; }
+
+    inline void operator()(unsigned int p1, unsigned int p2, unsigned int p3)
+    {
+        if (p1 == p2 || p2 == p3 || p3 == p1)
+            return;
+        _triangles->push_back(p1);
+        _triangles->push_back(p2);
+        _triangles->push_back(p3);
+    }
+
+    IndexList* _triangles;
+};
+
+bool isTrianglePrimitiveSet(const osg::PrimitiveSet& primitiveSet)
+{
+    switch (primitiveSet.getMode())
+    {
+        case osg::PrimitiveSet::TRIANGLES:
+        case osg::PrimitiveSet::TRIANGLE_STRIP:
+        case osg::PrimitiveSet::TRIANGLE_FAN:
+        case osg::PrimitiveSet::QUADS:
+        case osg::PrimitiveSet::QUAD_STRIP:
+        case osg::PrimitiveSet::POLYGON:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/** Return true if the triangles of the geometry can be replaced, which needs float vertices and no arrays bound
+  * per primitive set.*/
+bool isSimplifiable(const osg::Geometry& geometry)
+{
+    if (!dynamic_cast<const osg::Vec3Array*>(geometry.getVertexArray()))
+        return false;
+
+    osg::Geometry::ArrayList arrays;
+    geometry.getArrayList(arrays);
+    for (osg::Geometry::ArrayList::const_iterator itr = arrays.begin(); itr != arrays.end(); ++itr)
+    {
+        if ((*itr)->getBinding() == osg::Array::BIND_PER_PRIMITIVE_SET)
+            return false;
+    }
+
+    for (unsigned int i = 0; i < geometry.getNumPrimitiveSets(); ++i)
+    {
+        if (isTrianglePrimitiveSet(*geometry.getPrimitiveSet(i)))
+            return true;
+    }
+    return false;
+}
+
+void collectTriangles(const osg::Geometry& geometry, IndexList& triangles)
+{
+    osg::TriangleIndexFunctor<CollectTriangleOperator> collector;
+    collector.setTriangles(&triangles);
+    for (unsigned int i = 0; i < geometry.getNumPrimitiveSets(); ++i)
+    {
+        const osg::PrimitiveSet* primitiveSet = geometry.getPrimitiveSet(i);
+        if (isTrianglePrimitiveSet(*primitiveSet))
+            primitiveSet->accept(collector);
+    }
+}
+
+osg::PrimitiveSet* createTrianglePrimitiveSet(const IndexList& triangles)
+{
+    unsigned int maxIndex = triangles.empty() ? 0 : *std::max_element(triangles.begin(), triangles.end());
+    if (maxIndex < 65536)
+        return new osg::DrawElementsUShort(GL_TRIANGLES, triangles.begin(), triangles.end());
+    return new osg::DrawElementsUInt(GL_TRIANGLES, triangles.begin(), triangles.end());
+}
+
+/** Replace the triangle primitive sets of the geometry, keeping its lines and points.*/
+void replaceTriangles(osg::Geometry& geometry, osg::PrimitiveSet* triangles)
+{
+    osg::Geometry::PrimitiveSetList primitiveSets;
+    for (unsigned int i = 0; i < geometry.getNumPrimitiveSets(); ++i)
+    {
+        if (!isTrianglePrimitiveSet(*geometry.getPrimitiveSet(i)))
+            primitiveSets.push_back(geometry.getPrimitiveSet(i));
+    }
+    if (triangles->getNumIndices() > 0)
+        primitiveSets.push_back(triangles);
+    geometry.setPrimitiveSetList(primitiveSets);
+    geometry.dirtyGLObjects();
+
+    // a KdTree would still hold the original triangles.
+    if (dynamic_cast<osg::KdTree*>(geometry.getShape()))
+        geometry.setShape(0);
+}
+
+class SimplifyTask : public osg::Operation
+{
+    public:
+
+        SimplifyTask(const osg::Vec3Array* vertices, const SampleRatioList& sampleRatios, double maximumError, bool lockBorders) :
+            osg::Operation("QuadricSimplifierTask", false),
+            _vertices(vertices),
+            _sampleRatios(sampleRatios),
+            _maximumError(maximumError),
+            _lockBorders(lockBorders) {}
+
+        virtual void operator () (osg::Object*)
+        {
+            QuadricSimplifier::simplify(*_vertices, _triangles, _sampleRatios, _maximumError, _lockBorders, _levels, _errors);
+        }
+
+        osg::ref_ptr<const osg::Vec3Array>  _vertices;
+        IndexList                           _triangles;
+        SampleRatioList                     _sampleRatios;
+        double                              _maximumError;
+        bool                                _lockBorders;
+
+        std::vector<IndexList>              _levels;
+        std::vector<double>                 _errors;
+};
+
+typedef std::vector< osg::ref_ptr<SimplifyTask> > SimplifyTaskList;
+
+void runTasks(SimplifyTaskList& tasks, unsigned int numThreads)
+{
+    TaskThreadPool::Tasks poolTasks(tasks.begin(), tasks.end());
+    TaskThreadPool::instance()->run(poolTasks, numThreads);
+}
+
+inline unsigned int spreadBits(unsigned int v)
+{
+    v = (v | (v << 16)) & 0x030000FF;
+    v = (v | (v << 8)) & 0x0300F00F;
+    v = (v | (v << 4)) & 0x030C30C3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+/** Split the triangles into spatially coherent partitions of roughly partitionSize triangles by sorting them along a
+  * Morton curve through their centres.*/
+void partitionTriangles(const osg::Vec3Array& vertices, const IndexList& triangles, unsigned int partitionSize, std::vector<IndexList>& partitions)
+{
+    unsigned int numTriangles = triangles.size() / 3;
+    osg::BoundingBox bb;
+    for (IndexList::const_iterator itr = triangles.begin(); itr != triangles.end(); ++itr)
+        bb.expandBy(vertices[*itr]);
+
+    osg::Vec3 size = bb._max - bb._min;
+    osg::Vec3 scale(size.x() > 0.0f ? 1023.0f / size.x() : 0.0f,
+                    size.y() > 0.0f ? 1023.0f / size.y() : 0.0f,
+                    size.z() > 0.0f ? 1023.0f / size.z() : 0.0f);
+
+    std::vector< std::pair<unsigned int, unsigned int> > codes(numTriangles);
+    for (unsigned int t = 0; t < numTriangles; ++t)
+    {
+        osg::Vec3 centre = (vertices[triangles[t * 3]] + vertices[triangles[t * 3 + 1]] + vertices[triangles[t * 3 + 2]]) / 3.0f - bb._min;
+        unsigned int x = (unsigned int)(centre.x() * scale.x());
+        unsigned int y = (unsigned int)(centre.y() * scale.y());
+        unsigned int z = (unsigned int)(centre.z() * scale.z());
+        codes[t] = std::make_pair(spreadBits(x) | (spreadBits(y) << 1) | (spreadBits(z) << 2), t);
+    }
+    std::sort(codes.begin(), codes.end());
+
+    unsigned int numPartitions = (numTriangles + partitionSize - 1) / partitionSize;
+    partitions.resize(numPartitions);
+    for (unsigned int p = 0; p < numPartitions; ++p)
+    {
+        unsigned int begin = (numTriangles * p) / numPartitions;
+        unsigned int end = (numTriangles * (p + 1)) / numPartitions;
+        IndexList& partition = partitions[p];
+        partition.reserve((end - begin) * 3);
+        for (unsigned int i = begin; i < end; ++i)
+        {
+            unsigned int t = codes[i].second * 3;
+            partition.push_back(triangles[t]);
+            partition.push_back(triangles[t + 1]);
+            partition.push_back(triangles[t + 2]);
+        }
+    }
+}
+
+class CollectGeometriesVisitor : public osg::NodeVisitor
+{
+    public:
+
+        CollectGeometriesVisitor() : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN) {}
+
+        virtual void apply(osg::Geometry& geometry) { _geometries.push_back(&geometry); }
+
+        std::vector<osg::Geometry*> _geometries;
+};
+
+}
+
+using namespace QuadricSimplifierImplementation;
+
+QuadricSimplifier::QuadricSimplifier(double sampleRatio, double maximumError):
+    osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN),
+    _sampleRatio(sampleRatio),
+    _maximumError(maximumError),
+    _lockBorders(false),
+    _numThreads(0),
+    _partitionSize(65536),
+    _lodErrorScale(1000.0)
+{
+}
+
+void QuadricSimplifier::simplify(const osg::Vec3Array& vertices, const IndexList& triangles, const SampleRatioList& sampleRatios,
+                                 double maximumError, bool lockBorders, std::vector<IndexList>& levels, std::vector<double>& errors)
+{
+    levels.clear();
+    errors.clear();
+
+    // work on just the vertices used by the triangles, which may only be a small part of the vertex array.
+    std::vector<unsigned int> localIndices(vertices.size(), NO_EDGE);
+    std::vector<unsigned int> globalIndices;
+    osg::ref_ptr<osg::Vec3Array> localVertices = new osg::Vec3Array;
+    IndexList localTriangles(triangles.size());
+    for (unsigned int i = 0; i < triangles.size(); ++i)
+    {
+        unsigned int& index = localIndices[triangles[i]];
+        if (index == NO_EDGE)
+        {
+            index = globalIndices.size();
+            globalIndices.push_back(triangles[i]);
+            localVertices->push_back(vertices[triangles[i]]);
+        }
+        localTriangles[i] = index;
+    }
+
+    MeshSimplifier simplifier(*localVertices, localTriangles, lockBorders);
+    unsigned int numTriangles = triangles.size() / 3;
+    bool complete = true;
+    for (SampleRatioList::const_iterator itr = sampleRatios.begin(); itr != sampleRatios.end(); ++itr)
+    {
+        if (complete)
+        {
+            unsigned int targetNumTriangles = (unsigned int)(osg::clampBetween(*itr, 0.0, 1.0) * numTriangles + 0.5);
+            complete = simplifier.simplify(targetNumTriangles * 3, maximumError);
+        }
+
+        const IndexList& simplified = simplifier.getTriangles();
+        levels.push_back(IndexList(simplified.size()));
+        for (unsigned int i = 0; i < simplified.size(); ++i)
+            levels.back()[i] = globalIndices[simplified[i]];
+        errors.push_back(simplifier.getError());
+    }
+}
+
+void QuadricSimplifier::apply(osg::Geometry& geometry)
+{
+    if (std::find(_geometries.begin(), _geometries.end(), &geometry) == _geometries.end())
+        _geometries.push_back(&geometry);
+}
+
+void QuadricSimplifier::simplify(const GeometryList& geometries, const SampleRatioList& sampleRatios,
+                                 std::vector< std::vector< osg::ref_ptr<osg::PrimitiveSet> > >& levels, std::vector< std::vector<double> >& errors)
+{
+    unsigned int numThreads = _numThreads > 0 ? _numThreads : OpenThreads::GetNumberOfProcessors();
+
+    levels.clear();
+    levels.resize(geometries.size());
+    errors.clear();
+    errors.resize(geometries.size());
+
+    // the tasks of each geometry, more than one for a partitioned geometry.
+    SimplifyTaskList tasks;
+    std::vector<unsigned int> firstTask(geometries.size() + 1, 0);
+    std::vector<unsigned int> numTriangles(geometries.size(), 0);
+    for (unsigned int g = 0; g < geometries.size(); ++g)
+    {
+        firstTask[g] = tasks.size();
+        const osg::Geometry& geometry = *geometries[g];
+        if (!isSimplifiable(geometry))
+            continue;
+
+        const osg::Vec3Array* vertices = static_cast<const osg::Vec3Array*>(geometry.getVertexArray());
+        IndexList triangles;
+        collectTriangles(geometry, triangles);
+        numTriangles[g] = triangles.size() / 3;
+
+        if (numThreads > 1 && _partitionSize > 0 && numTriangles[g] > _partitionSize)
+        {
+            // the cuts between the partitions are open borders which are locked until they're joined up again.
+            std::vector<IndexList> partitions;
+            partitionTriangles(*vertices, triangles, _partitionSize, partitions);
+            for (std::vector<IndexList>::iterator itr = partitions.begin(); itr != partitions.end(); ++itr)
+            {
+                osg::ref_ptr<SimplifyTask> task = new SimplifyTask(vertices, sampleRatios, _maximumError, true);
+                task->_triangles.swap(*itr);
+                tasks.push_back(task);
+            }
+        }
+        else
+        {
+            osg::ref_ptr<SimplifyTask> task = new SimplifyTask(vertices, sampleRatios, _maximumError, _lockBorders);
+            task->_triangles.swap(triangles);
+            tasks.push_back(task);
+        }
+    }
+    firstTask[geometries.size()] = tasks.size();
+
+    runTasks(tasks, numThreads);
+
+    // join up the levels of the partitioned geometries and simplify them again to their targets.
+    SimplifyTaskList joinTasks;
+    std::vector< std::pair<unsigned int, unsigned int> > joinLevels;
+    for (unsigned int g = 0; g < geometries.size(); ++g)
+    {
+        unsigned int begin = firstTask[g];
+        unsigned int end = firstTask[g + 1];
+        if (begin == end)
+            continue;
+
+        for (unsigned int level = 0; level < sampleRatios.size(); ++level)
+        {
+            if (end - begin == 1)
+            {
+                levels[g].push_back(createTrianglePrimitiveSet(tasks[begin]->_levels[level]));
+                errors[g].push_back(tasks[begin]->_errors[level]);
+                continue;
+            }
+
+            osg::ref_ptr<SimplifyTask> task = new SimplifyTask(tasks[begin]->_vertices.get(), SampleRatioList(1, 1.0), _maximumError, _lockBorders);
+            double error = 0.0;
+            for (unsigned int t = begin; t < end; ++t)
+            {
+                task->_triangles.insert(task->_triangles.end(), tasks[t]->_levels[level].begin(), tasks[t]->_levels[level].end());
+                error = std::max(error, tasks[t]->_errors[level]);
+            }
+            unsigned int numJoinedTriangles = task->_triangles.size() / 3;
+            double target = osg::clampBetween(sampleRatios[level], 0.0, 1.0) * numTriangles[g];
+            task->_sampleRatios[0] = numJoinedTriangles > 0 ? std::min(1.0, target / numJoinedTriangles) : 1.0;
+
+            levels[g].push_back(0);
+            errors[g].push_back(error);
+            joinTasks.push_back(task);
+            joinLevels.push_back(std::make_pair(g, level));
+        }
+    }
+
+    runTasks(joinTasks, numThreads);
+
+    for (unsigned int i = 0; i < joinTasks.size(); ++i)
+    {
+        unsigned int g = joinLevels[i].first;
+        unsigned int level = joinLevels[i].second;
+        levels[g][level] = createTrianglePrimitiveSet(joinTasks[i]->_levels[0]);
+        errors[g][level] = std::max(errors[g][level], joinTasks[i]->_errors[0]);
+    }
+}
+
+void QuadricSimplifier::simplify()
+{
+    std::vector< std::vector< osg::ref_ptr<osg::PrimitiveSet> > > levels;
+    std::vector< std::vector<double> > errors;
+    simplify(_geometries, SampleRatioList(1, _sampleRatio), levels, errors);
+
+    for (unsigned int g = 0; g < _geometries.size(); ++g)
+    {
+        if (!levels[g].empty())
+            replaceTriangles(*_geometries[g], levels[g][0].get());
+    }
+    _geometries.clear();
+}
+
+double QuadricSimplifier::simplify(osg::Geometry& geometry)
+{
+    std::vector< std::vector< osg::ref_ptr<osg::PrimitiveSet> > > levels;
+    std::vector< std::vector<double> > errors;
+    simplify(GeometryList(1, &geometry), SampleRatioList(1, _sampleRatio), levels, errors);
+
+    if (levels[0].empty())
+        return 0.0;
+
+    replaceTriangles(geometry, levels[0][0].get());
+    return errors[0][0];
+}
+
+QuadricSimplifier::LODLevelList QuadricSimplifier::createLODLevels(osg::Node* node, const SampleRatioList& sampleRatios, bool compactVertices)
+{
+    LODLevelList lodLevels;
+    if (!node)
+        return lodLevels;
+
+    CollectGeometriesVisitor cgv;
+    node->accept(cgv);
+
+    // geometries shared between parents are only simplified once.
+    GeometryList geometries;
+    std::map<osg::Geometry*, unsigned int> geometryIndices;
+    for (std::vector<osg::Geometry*>::iterator itr = cgv._geometries.begin(); itr != cgv._geometries.end(); ++itr)
+    {
+        if (geometryIndices.insert(std::make_pair(*itr, geometries.size())).second)
+            geometries.push_back(*itr);
+    }
+
+    std::vector< std::vector< osg::ref_ptr<osg::PrimitiveSet> > > levels;
+    std::vector< std::vector<double> > errors;
+    simplify(geometries, sampleRatios, levels, errors);
+
+    LODLevel original;
+    original.node = node;
+    lodLevels.push_back(original);
+
+    // compacting reindexes the kept line and point primitives and the arrays in place, so they are
+    // duplicated rather than shared with the original.
+    unsigned int copyFlags = osg::CopyOp::DEEP_COPY_NODES | osg::CopyOp::DEEP_COPY_DRAWABLES;
+    if (compactVertices) copyFlags |= osg::CopyOp::DEEP_COPY_PRIMITIVES | osg::CopyOp::DEEP_COPY_ARRAYS;
+    osg::CopyOp copyop(copyFlags);
+
+    for (unsigned int level = 0; level < sampleRatios.size(); ++level)
+    {
+        LODLevel lodLevel;
+        lodLevel.node = static_cast<osg::Node*>(node->clone(copyop));
+        lodLevel.sampleRatio = sampleRatios[level];
+
+        // the copy's geometries are visited in the same order as those of the original.
+        CollectGeometriesVisitor copies;
+        lodLevel.node->accept(copies);
+        for (unsigned int i = 0; i < copies._geometries.size() && i < cgv._geometries.size(); ++i)
+        {
+            unsigned int g = geometryIndices[cgv._geometries[i]];
+            if (levels[g].empty())
+                continue;
+
+            osg::Geometry& copy = *copies._geometries[i];
+            if (compactVertices)
+            {
+                replaceTriangles(copy, osg::clone(levels[g][level].get(), osg::CopyOp::DEEP_COPY_ALL));
+                VertexAccessOrderVisitor vaov;
+                vaov.optimizeOrder(copy);
+                copy.dirtyBound();
+            }
+            else
+            {
+                replaceTriangles(copy, levels[g][level].get());
+            }
+            lodLevel.error = std::max(lodLevel.error, errors[g][level]);
+        }
+        lodLevels.push_back(lodLevel);
+    }
+
+    // switch to each level at the distance its error is small enough for.
+    for (unsigned int i = 1; i < lodLevels.size(); ++i)
+    {
+        float range = std::max(lodLevels[i - 1].minRange, float(lodLevels[i].error * _lodErrorScale));
+        lodLevels[i].minRange = range;
+        lodLevels[i - 1].maxRange = range;
+    }
+
+    return lodLevels;
+}
+
+osg::LOD* QuadricSimplifier::createLOD(osg::Node* node, const SampleRatioList& sampleRatios)
+{
+    LODLevelList levels = createLODLevels(node, sampleRatios);
+
+    osg::LOD* lod = new osg::LOD;
+    for (LODLevelList::iterator itr = levels.begin(); itr != levels.end(); ++itr)
+    {
+        lod->addChild(itr->node.get(), itr->minRange, itr->maxRange);
+    }
+    return lod;
+}
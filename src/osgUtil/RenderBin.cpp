@@ -113,7 +113,7 @@ void RenderBin::removeRenderBinPrototype(RenderBin* proto)
 
 static bool s_defaultBinSortModeInitialized = false;
 static RenderBin::SortMode s_defaultBinSortMode = RenderBin::SORT_BY_STATE;
-static osg::ApplicationUsageProxy RenderBin_e0(osg::ApplicationUsage::ENVIRONMENTAL_VARIABLE,"OSG_DEFAULT_BIN_SORT_MODE <type>","SORT_BY_STATE | SORT_BY_STATE_THEN_FRONT_TO_BACK | SORT_FRONT_TO_BACK | SORT_BACK_TO_FRONT");
+static osg::ApplicationUsageProxy RenderBin_e0(osg::ApplicationUsage::ENVIRONMENTAL_VARIABLE,"OSG_DEFAULT_BIN_SORT_MODE <type>","SORT_BY_STATE | SORT_BY_STATE_THEN_FRONT_TO_BACK | SORT_FRONT_TO_BACK | SORT_BACK_TO_FRONT | SORT_FRONT_TO_BACK_BY_KEY | SORT_BACK_TO_FRONT_BY_KEY");
 
 void RenderBin::setDefaultRenderBinSortMode(RenderBin::SortMode mode)
 {
@@ -136,6 +136,8 @@ RenderBin::SortMode RenderBin::getDefaultRenderBinSortMode()
             else if (strcmp(str,"SORT_FRONT_TO_BACK")==0) s_defaultBinSortMode = RenderBin::SORT_FRONT_TO_BACK;
             else if (strcmp(str,"SORT_BACK_TO_FRONT")==0) s_defaultBinSortMode = RenderBin::SORT_BACK_TO_FRONT;
             else if (strcmp(str,"TRAVERSAL_ORDER")==0) s_defaultBinSortMode = RenderBin::TRAVERSAL_ORDER;
+            else if (strcmp(str,"SORT_FRONT_TO_BACK_BY_KEY")==0) s_defaultBinSortMode = RenderBin::SORT_FRONT_TO_BACK_BY_KEY;
+            else if (strcmp(str,"SORT_BACK_TO_FRONT_BY_KEY")==0) s_defaultBinSortMode = RenderBin::SORT_BACK_TO_FRONT_BY_KEY;
         }
     }
 
@@ -160,7 +162,7 @@ RenderBin::RenderBin(SortMode mode)
     _sortMode = mode;
 
 #if 1
-    if (_sortMode==SORT_BACK_TO_FRONT)
+    if (_sortMode==SORT_BACK_TO_FRONT || _sortMode==SORT_BACK_TO_FRONT_BY_KEY)
     {
         _stateset  = new osg::StateSet;
         _stateset->setThreadSafeRefUnref(true);
@@ -250,6 +252,12 @@ void RenderBin::sortImplementation()
         case(TRAVERSAL_ORDER):
             sortTraversalOrder();
             break;
+        case(SORT_FRONT_TO_BACK_BY_KEY):
+            sortFrontToBackByKey();
+            break;
+        case(SORT_BACK_TO_FRONT_BY_KEY):
+            sortBackToFrontByKey();
+            break;
     }
 }
 
@@ -346,6 +354,159 @@ void RenderBin::sortTraversalOrder()
     std::sort(_renderLeafList.begin(),_renderLeafList.end(),TraversalOrderFunctor());
 }
 
+void RenderBin::sortFrontToBackByKey()
+{
+    copyLeavesFromStateGraphListToRenderLeafList();
+
+    sortRenderLeafListByKey();
+}
+
+void RenderBin::sortBackToFrontByKey()
+{
+    copyLeavesFromStateGraphListToRenderLeafList();
+
+    // reverse the depth in the upper 32 bits but keep the StateGraph ordering for leaves of the same depth.
+    sortRenderLeafListByKey(0xffffffff00000000ull);
+}
+
+struct SortKeyEntryLessFunctor
+{
+    template<class T>
+    bool operator() (const T& lhs, const T& rhs) const
+    {
+        return lhs.key<rhs.key;
+    }
+};
+
+void RenderBin::sortRenderLeafListByKey(uint64_t keyMask)
+{
+    unsigned int numLeaves = _renderLeafList.size();
+    if (numLeaves<2) return;
+
+    _sortKeyEntries.resize(numLeaves);
+    for(unsigned int i=0; i<numLeaves; ++i)
+    {
+        _sortKeyEntries[i].key = _renderLeafList[i]->_sortKey ^ keyMask;
+        _sortKeyEntries[i].leaf = _renderLeafList[i];
+    }
+
+    // the radix sort has a fixed cost per pass so for short lists a comparison sort is faster.
+    if (numLeaves<256)
+    {
+        std::stable_sort(_sortKeyEntries.begin(), _sortKeyEntries.end(), SortKeyEntryLessFunctor());
+    }
+    else
+    {
+        // LSD radix sort with 8 bit digits, building the histograms for all the digits in a single pass.
+        const unsigned int numPasses = 8;
+        unsigned int histograms[numPasses][256];
+        memset(histograms, 0, sizeof(histograms));
+
+        for(unsigned int i=0; i<numLeaves; ++i)
+        {
+            uint64_t key = _sortKeyEntries[i].key;
+            for(unsigned int pass=0; pass<numPasses; ++pass)
+            {
+                ++histograms[pass][(key>>(pass*8)) & 0xff];
+            }
+        }
+
+        _sortKeyEntriesScratch.resize(numLeaves);
+
+        SortKeyEntry* source = &_sortKeyEntries.front();
+        SortKeyEntry* destination = &_sortKeyEntriesScratch.front();
+
+        for(unsigned int pass=0; pass<numPasses; ++pass)
+        {
+            unsigned int* histogram = histograms[pass];
+            unsigned int shift = pass*8;
+
+            // all the keys have the same digit so this pass wouldn't change the order.
+            if (histogram[(source[0].key>>shift) & 0xff]==numLeaves) continue;
+
+            unsigned int offsets[256];
+            unsigned int total = 0;
+            for(unsigned int i=0; i<256; ++i)
+            {
+                offsets[i] = total;
+                total += histogram[i];
+            }
+
+            for(unsigned int i=0; i<numLeaves; ++i)
+            {
+                destination[offsets[(source[i].key>>shift) & 0xff]++] = source[i];
+            }
+
+            std::swap(source, destination);
+        }
+
+        if (source!=&_sortKeyEntries.front()) _sortKeyEntries.swap(_sortKeyEntriesScratch);
+    }
+
+    for(unsigned int i=0; i<numLeaves; ++i)
+    {
+        _renderLeafList[i] = _sortKeyEntries[i].leaf;
+    }
+}
+
+void RenderBin::setStage(RenderStage* stage)
+{
+    _stage = stage;
+
+    for(RenderBinList::iterator itr = _bins.begin();
+        itr != _bins.end();
+        ++itr)
+    {
+        itr->second->setStage(stage);
+    }
+}
+
+void RenderBin::merge(RenderBin* bin)
+{
+    if (!bin || bin==this) return;
+
+    _stateGraphList.reserve(_stateGraphList.size()+bin->_stateGraphList.size());
+    for(StateGraphList::iterator itr = bin->_stateGraphList.begin();
+        itr != bin->_stateGraphList.end();
+        ++itr)
+    {
+        StateGraph* sg = *itr;
+
+        // the StateGraph's position in this bin replaces its position in the merged bin.
+        sg->_sortKeyID = _stateGraphList.size();
+        for(StateGraph::LeafList::iterator leaf_itr = sg->_leaves.begin();
+            leaf_itr != sg->_leaves.end();
+            ++leaf_itr)
+        {
+            (*leaf_itr)->_sortKey = ((*leaf_itr)->_sortKey & 0xffffffff00000000ull) | sg->_sortKeyID;
+        }
+
+        _stateGraphList.push_back(sg);
+    }
+    bin->_stateGraphList.clear();
+
+    for(RenderBinList::iterator itr = bin->_bins.begin();
+        itr != bin->_bins.end();
+        ++itr)
+    {
+        RenderBinList::iterator found_itr = _bins.find(itr->first);
+        if (found_itr!=_bins.end())
+        {
+            found_itr->second->merge(itr->second.get());
+        }
+        else
+        {
+            RenderBin* rb = itr->second.get();
+            rb->_parent = this;
+            rb->setStage(_stage);
+            _bins[itr->first] = rb;
+        }
+    }
+    bin->_bins.clear();
+
+    _sorted = false;
+}
+
 void RenderBin::copyLeavesFromStateGraphListToRenderLeafList()
 {
     _renderLeafList.clear();
@@ -210,6 +210,59 @@ void RenderStage::addPostRenderStage(RenderStage* rs, int order)
     }
 }
 
+void RenderStage::merge(RenderBin* bin)
+{
+    if (!bin || bin==this) return;
+
+    RenderStage* rs = dynamic_cast<RenderStage*>(bin);
+    if (rs)
+    {
+        for(RenderStageList::iterator itr = rs->_preRenderList.begin();
+            itr != rs->_preRenderList.end();
+            ++itr)
+        {
+            addPreRenderStage(itr->second.get(), itr->first);
+        }
+        rs->_preRenderList.clear();
+
+        for(RenderStageList::iterator itr = rs->_postRenderList.begin();
+            itr != rs->_postRenderList.end();
+            ++itr)
+        {
+            addPostRenderStage(itr->second.get(), itr->first);
+        }
+        rs->_postRenderList.clear();
+
+        if (rs->_renderStageLighting.valid())
+        {
+            PositionalStateContainer::AttrMatrixList& attrList = rs->_renderStageLighting->getAttrMatrixList();
+            for(PositionalStateContainer::AttrMatrixList::iterator itr = attrList.begin();
+                itr != attrList.end();
+                ++itr)
+            {
+                addPositionedAttribute(itr->second.get(), itr->first.get());
+            }
+
+            PositionalStateContainer::TexUnitAttrMatrixListMap& texAttrListMap = rs->_renderStageLighting->getTexUnitAttrMatrixListMap();
+            for(PositionalStateContainer::TexUnitAttrMatrixListMap::iterator map_itr = texAttrListMap.begin();
+                map_itr != texAttrListMap.end();
+                ++map_itr)
+            {
+                for(PositionalStateContainer::AttrMatrixList::iterator itr = map_itr->second.begin();
+                    itr != map_itr->second.end();
+                    ++itr)
+                {
+                    addPositionedTextureAttribute(map_itr->first, itr->second.get(), itr->first.get());
+                }
+            }
+
+            rs->_renderStageLighting->reset();
+        }
+    }
+
+    RenderBin::merge(bin);
+}
+
 void RenderStage::drawPreRenderStages(osg::RenderInfo& renderInfo,RenderLeaf*& previous)
 {
     if (_preRenderList.empty()) return;
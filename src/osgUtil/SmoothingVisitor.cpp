@@ -13,8 +13,12 @@
 #include <osg/TriangleFunctor>
 #include <osg/TriangleIndexFunctor>
 #include <osg/io_utils>
+#include <osg/OperationThread>
+
+#include <OpenThreads/Thread>
 
 #include <osgUtil/SmoothingVisitor>
+#include <osgUtil/TaskThreadPool>
 
 #include <stdio.h>
 #include <list>
@@ -28,67 +32,144 @@ using namespace osgUtil;
 namespace Smoother
 {
 
-struct LessPtr
+typedef std::vector<unsigned int> IndexList;
+
+// collects the indices of the triangles of a geometry.
+struct CollectTriangleIndices
 {
-    inline bool operator() (const osg::Vec3* lhs,const osg::Vec3* rhs) const
+    CollectTriangleIndices():
+        _indices(0) {}
+
+    inline void operator() (unsigned int p1, unsigned int p2, unsigned int p3)
     {
-        return *lhs<*rhs;
+        _indices->push_back(p1);
+        _indices->push_back(p2);
+        _indices->push_back(p3);
     }
+
+    IndexList* _indices;
 };
 
-// triangle functor.
-struct SmoothTriangleFunctor
+// Accumulates the normals of a range of triangles into an array of its own, each added to the vertex its
+// vertices are welded to, so that ranges can be accumulated in parallel. Normals are either weighted by the
+// area of the triangles, or of unit length with degenerate triangles skipped.
+class AccumulateNormalsOperation : public osg::Operation
 {
+    public:
+
+        AccumulateNormalsOperation(const osg::Vec3Array& vertices, const IndexList& triangles, const IndexList& remapping,
+                                   bool unitNormals, unsigned int begin, unsigned int end, osg::Vec3* normals):
+            osg::Operation("AccumulateNormalsOperation", false),
+            _vertices(vertices),
+            _triangles(triangles),
+            _remapping(remapping),
+            _unitNormals(unitNormals),
+            _begin(begin),
+            _end(end),
+            _normals(normals) {}
+
+        virtual void operator () (osg::Object*)
+        {
+            for(unsigned int i=_begin; i<_end; i+=3)
+            {
+                unsigned int p1 = _triangles[i];
+                unsigned int p2 = _triangles[i+1];
+                unsigned int p3 = _triangles[i+2];
+                if (_unitNormals && (p1==p2 || p2==p3 || p1==p3)) continue;
+
+                const osg::Vec3& v1 = _vertices[p1];
+                osg::Vec3 normal( (_vertices[p2]-v1)^(_vertices[p3]-v1) );
+                if (_unitNormals) normal.normalize();
+
+                if (!_remapping.empty())
+                {
+                    p1 = _remapping[p1];
+                    p2 = _remapping[p2];
+                    p3 = _remapping[p3];
+                }
+                _normals[p1] += normal;
+                _normals[p2] += normal;
+                _normals[p3] += normal;
+            }
+        }
 
-    osg::Vec3* _coordBase;
-    osg::Vec3* _normalBase;
+    protected:
 
-    typedef std::multiset<const osg::Vec3*,LessPtr> CoordinateSet;
-    CoordinateSet _coordSet;
+        const osg::Vec3Array&               _vertices;
+        const IndexList&                    _triangles;
+        const IndexList&                    _remapping;
+        bool                                _unitNormals;
+        unsigned int                        _begin;
+        unsigned int                        _end;
+        osg::Vec3*                          _normals;
+};
 
-    SmoothTriangleFunctor():
-         _coordBase(0),
-         _normalBase(0) {}
+// fewest triangles worth giving a thread of their own.
+static const unsigned int s_minTrianglesPerThread = 65536;
 
-    void set(osg::Vec3 *cb,int noVertices, osg::Vec3 *nb)
+// Set normals to the sum of the normals of the triangles, each added to the vertex its vertices are welded
+// to, if remapping isn't empty. Large meshes are split into ranges of triangles accumulated in parallel.
+static void accumulateNormals(const osg::Vec3Array& vertices, const IndexList& triangles, const IndexList& remapping,
+                              bool unitNormals, osg::Vec3Array& normals, unsigned int numThreads)
+{
+    for(osg::Vec3Array::iterator itr = normals.begin();
+        itr != normals.end();
+        ++itr)
     {
-        _coordBase=cb;
-        _normalBase=nb;
+        (*itr).set(0.0f,0.0f,0.0f);
+    }
+    if (normals.empty()) return;
 
-        osg::Vec3* vptr = cb;
-        for(int i=0;i<noVertices;++i)
-        {
-            _coordSet.insert(vptr++);
-        }
+    unsigned int numTriangles = triangles.size()/3;
+    numThreads = osg::minimum(numThreads, numTriangles/s_minTrianglesPerThread);
+    if (numThreads <= 1)
+    {
+        AccumulateNormalsOperation operation(vertices, triangles, remapping, unitNormals, 0, triangles.size(), &normals.front());
+        operation(0);
+        return;
     }
 
-    inline void updateNormal(const osg::Vec3& normal,const osg::Vec3* vptr)
+    // the first range accumulates straight into the normals, the others into their own arrays summed afterwards.
+    std::vector< std::vector<osg::Vec3> > threadNormals(numThreads-1, std::vector<osg::Vec3>(normals.size()));
+
+    TaskThreadPool::Tasks tasks;
+    for(unsigned int i=0; i<numThreads; ++i)
     {
-        std::pair<CoordinateSet::iterator,CoordinateSet::iterator> p =
-            _coordSet.equal_range(vptr);
+        unsigned int begin = 3*(numTriangles*i/numThreads);
+        unsigned int end = 3*(numTriangles*(i+1)/numThreads);
+        osg::Vec3* output = i==0 ? &normals.front() : &(threadNormals[i-1].front());
+        tasks.push_back(new AccumulateNormalsOperation(vertices, triangles, remapping, unitNormals, begin, end, output));
+    }
 
-        for(CoordinateSet::iterator itr=p.first;
-            itr!=p.second;
-            ++itr)
+    TaskThreadPool::instance()->run(tasks, numThreads);
+
+    for(unsigned int i=0; i<threadNormals.size(); ++i)
+    {
+        for(unsigned int v=0; v<normals.size(); ++v)
         {
-            osg::Vec3* nptr = _normalBase + (*itr-_coordBase);
-            (*nptr) += normal;
+            normals[v] += threadNormals[i][v];
         }
     }
+}
 
-    inline void operator() ( const osg::Vec3 &v1, const osg::Vec3 &v2, const osg::Vec3 &v3)
-    {
-        // calc orientation of triangle.
-        osg::Vec3 normal = (v2-v1)^(v3-v1);
-        // normal.normalize();
+static void collectTriangles(osg::Geometry& geom, IndexList& triangles)
+{
+    osg::TriangleIndexFunctor<CollectTriangleIndices> ctif;
+    ctif._indices = &triangles;
+    geom.accept(ctif);
+}
 
-        updateNormal(normal,&v1);
-        updateNormal(normal,&v2);
-        updateNormal(normal,&v3);
+static void normalizeNormals(osg::Vec3Array& normals)
+{
+    for(osg::Vec3Array::iterator itr = normals.begin();
+        itr != normals.end();
+        ++itr)
+    {
+        (*itr).normalize();
     }
-};
+}
 
-static void smooth_old(osg::Geometry& geom)
+static void smooth_old(osg::Geometry& geom, float positionEpsilon)
 {
     OSG_INFO<<"smooth_old("<<&geom<<")"<<std::endl;
     Geometry::PrimitiveSetList& primitives = geom.getPrimitiveSetList();
@@ -118,26 +199,20 @@ static void smooth_old(osg::Geometry& geom)
     osg::Vec3Array *coords = dynamic_cast<osg::Vec3Array*>(geom.getVertexArray());
     if (!coords || !coords->size()) return;
 
-    osg::Vec3Array *normals = new osg::Vec3Array(coords->size());
-
-    osg::Vec3Array::iterator nitr;
-    for(nitr = normals->begin();
-        nitr!=normals->end();
-        ++nitr)
-    {
-        nitr->set(0.0f,0.0f,0.0f);
-    }
+    // vertices at the same position share their normals.
+    IndexList remapping;
+    osgUtil::VertexWelder(positionEpsilon, false).computeRemapping(geom, remapping);
 
-    TriangleFunctor<SmoothTriangleFunctor> stf;
-    stf.set(&(coords->front()),coords->size(),&(normals->front()));
+    IndexList triangles;
+    collectTriangles(geom, triangles);
 
-    geom.accept(stf);
+    osg::Vec3Array *normals = new osg::Vec3Array(coords->size());
+    accumulateNormals(*coords, triangles, remapping, false, *normals, OpenThreads::GetNumberOfProcessors());
 
-    for(nitr= normals->begin();
-        nitr!=normals->end();
-        ++nitr)
+    for(unsigned int i=0; i<normals->size(); ++i)
     {
-        nitr->normalize();
+        if (remapping[i]==i) (*normals)[i].normalize();
+        else (*normals)[i] = (*normals)[remapping[i]];
     }
     geom.setNormalArray( normals, osg::Array::BIND_PER_VERTEX);
 
@@ -145,77 +220,6 @@ static void smooth_old(osg::Geometry& geom)
 }
 
 
-struct SmoothTriangleIndexFunctor
-{
-    SmoothTriangleIndexFunctor():
-        _vertices(0),
-        _normals(0)
-    {
-    }
-
-    bool set(osg::Vec3Array* vertices, osg::Vec3Array* normals)
-    {
-        _vertices = vertices;
-        _normals = normals;
-
-        if (!_vertices)
-        {
-            OSG_NOTICE<<"Warning: SmoothTriangleIndexFunctor::set(..) requires a valid vertex arrays."<<std::endl;
-            return false;
-        }
-
-        if (!_normals)
-        {
-            OSG_NOTICE<<"Warning: SmoothTriangleIndexFunctor::set(..) requires a valid normal arrays."<<std::endl;
-            return false;
-        }
-
-        for(osg::Vec3Array::iterator itr = _normals->begin();
-            itr != _normals->end();
-            ++itr)
-        {
-            (*itr).set(0.0f,0.0f,0.0f);
-        }
-
-        return true;
-    }
-
-    void normalize()
-    {
-        if (!_normals) return;
-
-        for(osg::Vec3Array::iterator itr = _normals->begin();
-            itr != _normals->end();
-            ++itr)
-        {
-            (*itr).normalize();
-        }
-    }
-
-    void operator() (unsigned int p1, unsigned int p2, unsigned int p3)
-    {
-        if (p1==p2 || p2==p3 || p1==p3)
-        {
-            return;
-        }
-
-        const osg::Vec3& v1 = (*_vertices)[p1];
-        const osg::Vec3& v2 = (*_vertices)[p2];
-        const osg::Vec3& v3 = (*_vertices)[p3];
-        osg::Vec3 normal( (v2-v1)^(v3-v1) );
-
-        normal.normalize();
-
-        (*_normals)[p1] += normal;
-        (*_normals)[p2] += normal;
-        (*_normals)[p3] += normal;
-    }
-
-    osg::Vec3Array*     _vertices;
-    osg::Vec3Array*     _normals;
-};
-
-
 
 struct FindSharpEdgesFunctor
 {
@@ -623,15 +627,11 @@ static void smooth_new(osg::Geometry& geom, double creaseAngle)
         geom.setNormalArray(normals, osg::Array::BIND_PER_VERTEX);
     }
 
-    osg::TriangleIndexFunctor<SmoothTriangleIndexFunctor> stif;
-    if (stif.set(vertices, normals))
-    {
-        // accumulate all the normals
-        geom.accept(stif);
-
-        // normalize the normals
-        stif.normalize();
-    }
+    // accumulate all the normals, then normalize them
+    IndexList triangles;
+    collectTriangles(geom, triangles);
+    accumulateNormals(*vertices, triangles, IndexList(), true, *normals, OpenThreads::GetNumberOfProcessors());
+    normalizeNormals(*normals);
 
     osg::TriangleIndexFunctor<FindSharpEdgesFunctor> fsef;
 
@@ -657,14 +657,13 @@ static void smooth_new(osg::Geometry& geom, double creaseAngle)
 
         vertices = dynamic_cast<osg::Vec3Array*>(geom.getVertexArray());
         normals = dynamic_cast<osg::Vec3Array*>(geom.getNormalArray());
-        osg::TriangleIndexFunctor<SmoothTriangleIndexFunctor> stif2;
-        if (stif2.set(vertices, normals))
+        if (vertices && normals)
         {
-            // accumulate all the normals
-            geom.accept(stif2);
-
-            // normalize the normals
-            stif2.normalize();
+            // accumulate all the normals of the duplicated vertices, then normalize them
+            triangles.clear();
+            collectTriangles(geom, triangles);
+            accumulateNormals(*vertices, triangles, IndexList(), true, *normals, OpenThreads::GetNumberOfProcessors());
+            normalizeNormals(*normals);
         }
 
     }
@@ -676,7 +675,8 @@ static void smooth_new(osg::Geometry& geom, double creaseAngle)
 
 
 SmoothingVisitor::SmoothingVisitor():
-    _creaseAngle(osg::PI)
+    _creaseAngle(osg::PI),
+    _positionEpsilon(0.0f)
 {
     setTraversalMode(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN);
 }
@@ -685,11 +685,11 @@ SmoothingVisitor::~SmoothingVisitor()
 {
 }
 
-void SmoothingVisitor::smooth(osg::Geometry& geom, double creaseAngle)
+void SmoothingVisitor::smooth(osg::Geometry& geom, double creaseAngle, float positionEpsilon)
 {
     if (creaseAngle==osg::PI)
     {
-        Smoother::smooth_old(geom);
+        Smoother::smooth_old(geom, positionEpsilon);
     }
     else
     {
@@ -700,5 +700,5 @@ void SmoothingVisitor::smooth(osg::Geometry& geom, double creaseAngle)
 
 void SmoothingVisitor::apply(osg::Geometry& geom)
 {
-    smooth(geom, _creaseAngle);
+    smooth(geom, _creaseAngle, _positionEpsilon);
 }
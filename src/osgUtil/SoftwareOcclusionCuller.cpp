@@ -0,0 +1,437 @@
+/* -*-c++-*- OpenSceneGraph - Copyright (C) 1998-2006 Robert Osfield
+ *
+ * This library is open source and may be redistributed and/or modified under
+ * the terms of the OpenSceneGraph Public License (OSGPL) version 0.0 or
+ * (at your option) any later version.  The full license is in LICENSE file
+ * included with this distribution, and on the openscenegraph.org website.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * OpenSceneGraph Public License for more details.
+*/
+
+#include <osgUtil/SoftwareOcclusionCuller>
+
+#include <osg/Transform>
+#include <osg/Drawable>
+#include <osg/TriangleFunctor>
+#include <osg/NodeVisitor>
+
+#include <OpenThreads/ScopedLock>
+
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2)
+    #include <emmintrin.h>
+    #define SOFTWAREOCCLUSIONCULLER_USE_SSE2
+#endif
+
+using namespace osgUtil;
+
+namespace
+{
+
+struct CollectTriangles
+{
+    CollectTriangles(): _triangles(0), _matrix(0) {}
+
+    inline void operator () (const osg::Vec3& v1, const osg::Vec3& v2, const osg::Vec3& v3)
+    {
+        _triangles->push_back(v1 * (*_matrix));
+        _triangles->push_back(v2 * (*_matrix));
+        _triangles->push_back(v3 * (*_matrix));
+    }
+
+    osg::Vec3Array*     _triangles;
+    const osg::Matrix*  _matrix;
+};
+
+/** Collect the triangles of a subgraph in the coordinate frame of its root.*/
+class CollectTrianglesVisitor : public osg::NodeVisitor
+{
+    public:
+
+        CollectTrianglesVisitor(osg::Vec3Array* triangles):
+            osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ACTIVE_CHILDREN),
+            _triangles(triangles)
+        {
+            setNodeMaskOverride(~0u);
+        }
+
+        virtual void apply(osg::Transform& transform)
+        {
+            osg::Matrix previous = _matrix;
+            transform.computeLocalToWorldMatrix(_matrix, this);
+            traverse(transform);
+            _matrix = previous;
+        }
+
+        virtual void apply(osg::Drawable& drawable)
+        {
+            osg::TriangleFunctor<CollectTriangles> tf;
+            tf._triangles = _triangles;
+            tf._matrix = &_matrix;
+            drawable.accept(tf);
+        }
+
+    protected:
+
+        osg::Vec3Array* _triangles;
+        osg::Matrix     _matrix;
+};
+
+typedef std::vector<osg::Vec4d> ClipPolygon;
+
+/** Clip a polygon in clip space against the plane plane.x*x + plane.y*y + plane.z*z + plane.w*w >= 0.*/
+void clip(const ClipPolygon& in, const osg::Vec4d& plane, ClipPolygon& out)
+{
+    out.clear();
+    for(unsigned int i=0; i<in.size(); ++i)
+    {
+        const osg::Vec4d& a = in[i];
+        const osg::Vec4d& b = in[(i+1)%in.size()];
+        double da = a*plane;
+        double db = b*plane;
+        if (da>=0.0) out.push_back(a);
+        if ((da>=0.0) != (db>=0.0)) out.push_back(a + (b-a)*(da/(da-db)));
+    }
+}
+
+}
+
+SoftwareOcclusionCuller::SoftwareOcclusionCuller(unsigned int width, unsigned int height):
+    _occluders(new Occluders),
+    _numRasterizedTriangles(0)
+{
+    setResolution(width, height);
+}
+
+SoftwareOcclusionCuller::SoftwareOcclusionCuller(const SoftwareOcclusionCuller& soc):
+    osg::Referenced(),
+    _occluders(soc._occluders),
+    _numRasterizedTriangles(0)
+{
+    setResolution(soc._width, soc._height);
+}
+
+SoftwareOcclusionCuller::~SoftwareOcclusionCuller()
+{
+}
+
+void SoftwareOcclusionCuller::setResolution(unsigned int width, unsigned int height)
+{
+    _numTilesX = osg::maximum((width+TILE_SIZE-1)/TILE_SIZE, 1u);
+    _numTilesY = osg::maximum((height+TILE_SIZE-1)/TILE_SIZE, 1u);
+    _width = _numTilesX*TILE_SIZE;
+    _height = _numTilesY*TILE_SIZE;
+
+    _numRasterizedTriangles = 0;
+    _depthBuffer.clear();
+    _tileDepthBuffer.clear();
+}
+
+void SoftwareOcclusionCuller::addOccluder(osg::Node* node, osg::Node* proxy)
+{
+    if (!node) return;
+
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_occluders->mutex);
+
+    Occluder occluder;
+    occluder.node = node;
+    occluder.proxy = proxy;
+    _occluders->occluders.push_back(occluder);
+}
+
+void SoftwareOcclusionCuller::removeOccluder(osg::Node* node)
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_occluders->mutex);
+
+    OccluderList& occluders = _occluders->occluders;
+    for(OccluderList::iterator itr = occluders.begin(); itr != occluders.end();)
+    {
+        if (itr->node==node) itr = occluders.erase(itr);
+        else ++itr;
+    }
+}
+
+void SoftwareOcclusionCuller::removeAllOccluders()
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_occluders->mutex);
+    _occluders->occluders.clear();
+}
+
+unsigned int SoftwareOcclusionCuller::getNumOccluders() const
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_occluders->mutex);
+    return static_cast<unsigned int>(_occluders->occluders.size());
+}
+
+void SoftwareOcclusionCuller::dirtyOccluders()
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_occluders->mutex);
+
+    OccluderList& occluders = _occluders->occluders;
+    for(OccluderList::iterator itr = occluders.begin(); itr != occluders.end(); ++itr)
+    {
+        itr->triangles = 0;
+    }
+}
+
+void SoftwareOcclusionCuller::rasterize(const osg::Matrix& view, const osg::Matrix& projection)
+{
+    _numRasterizedTriangles = 0;
+    _depthBuffer.assign(_width*_height, FLT_MAX);
+
+    // take a copy of the occluders, reading the triangles of any new or dirtied ones, so the lock isn't held while rasterizing.
+    OccluderList occluders;
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_occluders->mutex);
+
+        for(OccluderList::iterator itr = _occluders->occluders.begin(); itr != _occluders->occluders.end(); ++itr)
+        {
+            if (!itr->triangles)
+            {
+                itr->triangles = new osg::Vec3Array;
+                CollectTrianglesVisitor ctv(itr->triangles.get());
+                if (itr->proxy.valid()) itr->proxy->accept(ctv);
+                else itr->node->accept(ctv);
+            }
+        }
+
+        occluders = _occluders->occluders;
+    }
+
+    osg::Matrix viewProjection = view * projection;
+
+    for(OccluderList::iterator itr = occluders.begin(); itr != occluders.end(); ++itr)
+    {
+        if (itr->triangles->empty()) continue;
+
+        // instanced occluders are drawn once for each of their parental paths, a proxy is placed in the local
+        // coordinate frame of its node, otherwise the node's own transform was applied when collecting the triangles.
+        osg::NodePathList nodePaths = itr->node->getParentalNodePaths();
+        for(osg::NodePathList::iterator pitr = nodePaths.begin(); pitr != nodePaths.end(); ++pitr)
+        {
+            if (!itr->proxy) pitr->pop_back();
+            rasterizeTriangles(*(itr->triangles), osg::computeLocalToWorld(*pitr) * viewProjection);
+        }
+    }
+
+    updateTileDepthBuffer();
+}
+
+void SoftwareOcclusionCuller::rasterizeTriangles(const osg::Vec3Array& triangles, const osg::Matrix& matrix)
+{
+    // clip against the near plane, and w>0 for projections that don't already ensure it, as parts of occluders
+    // in front of the near plane aren't drawn.
+    const osg::Vec4d nearPlane(0.0, 0.0, 1.0, 1.0);
+    const osg::Vec4d positiveW(0.0, 0.0, 0.0, 1.0);
+    const double minimumW = 1e-6;
+
+    ClipPolygon polygon, clipped;
+    std::vector<osg::Vec3d> screen;
+    for(unsigned int i=0; i+2<triangles.size(); i+=3)
+    {
+        polygon.clear();
+        for(unsigned int j=0; j<3; ++j)
+        {
+            polygon.push_back(osg::Vec4d(osg::Vec3d(triangles[i+j]), 1.0) * matrix);
+        }
+
+        clip(polygon, nearPlane, clipped);
+        for(ClipPolygon::iterator itr = clipped.begin(); itr != clipped.end(); ++itr) itr->w() -= minimumW;
+        clip(clipped, positiveW, polygon);
+        if (polygon.size()<3) continue;
+
+        screen.clear();
+        for(ClipPolygon::iterator itr = polygon.begin(); itr != polygon.end(); ++itr)
+        {
+            double w = itr->w() + minimumW;
+            screen.push_back(osg::Vec3d((itr->x()/w*0.5+0.5)*double(_width), (itr->y()/w*0.5+0.5)*double(_height), itr->z()/w));
+        }
+
+        for(unsigned int j=2; j<screen.size(); ++j)
+        {
+            rasterizeTriangle(screen[0], screen[j-1], screen[j]);
+        }
+    }
+}
+
+void SoftwareOcclusionCuller::rasterizeTriangle(const osg::Vec3d& v0, const osg::Vec3d& v1_in, const osg::Vec3d& v2_in)
+{
+    osg::Vec3d v1 = v1_in;
+    osg::Vec3d v2 = v2_in;
+
+    double area = (v1.x()-v0.x())*(v2.y()-v0.y()) - (v2.x()-v0.x())*(v1.y()-v0.y());
+    if (!(fabs(area)>1e-12)) return;
+    if (area<0.0)
+    {
+        std::swap(v1, v2);
+        area = -area;
+    }
+
+    // pixels are covered when their centres are inside the triangle.
+    int px0 = static_cast<int>(ceil(osg::maximum(osg::minimum(v0.x(), osg::minimum(v1.x(), v2.x()))-0.5, 0.0)));
+    int py0 = static_cast<int>(ceil(osg::maximum(osg::minimum(v0.y(), osg::minimum(v1.y(), v2.y()))-0.5, 0.0)));
+    int px1 = static_cast<int>(floor(osg::minimum(osg::maximum(v0.x(), osg::maximum(v1.x(), v2.x()))-0.5, double(_width-1))));
+    int py1 = static_cast<int>(floor(osg::minimum(osg::maximum(v0.y(), osg::maximum(v1.y(), v2.y()))-0.5, double(_height-1))));
+    if (px0>px1 || py0>py1) return;
+
+    ++_numRasterizedTriangles;
+
+    // edge functions relative to the centre of pixel (px0,py0), with a small margin for the rounding of the float
+    // evaluation so that centres on the edges shared by neighbouring triangles are never missed by both.
+    const osg::Vec3d* vertices[3] = { &v0, &v1, &v2 };
+    float ea[3], eb[3], ec[3];
+    for(unsigned int i=0; i<3; ++i)
+    {
+        const osg::Vec3d& a = *vertices[i];
+        const osg::Vec3d& b = *vertices[(i+1)%3];
+        double A = a.y()-b.y();
+        double B = b.x()-a.x();
+        double C = A*(double(px0)+0.5-a.x()) + B*(double(py0)+0.5-a.y());
+        ea[i] = static_cast<float>(A);
+        eb[i] = static_cast<float>(B);
+        ec[i] = static_cast<float>(C + (fabs(A)+fabs(B))*1e-4);
+    }
+
+    // depth plane, again relative to the centre of pixel (px0,py0), offset to give the farthest depth over each pixel
+    // and clamped to the farthest vertex where the pixel extends beyond the triangle.
+    double zA = ((v1.z()-v0.z())*(v2.y()-v0.y()) - (v2.z()-v0.z())*(v1.y()-v0.y()))/area;
+    double zB = ((v2.z()-v0.z())*(v1.x()-v0.x()) - (v1.z()-v0.z())*(v2.x()-v0.x()))/area;
+    double zC = v0.z() + zA*(double(px0)+0.5-v0.x()) + zB*(double(py0)+0.5-v0.y());
+    zC += (fabs(zA)+fabs(zB))*0.501 + (fabs(zC)+1.0)*1e-6;
+    float za = static_cast<float>(zA);
+    float zb = static_cast<float>(zB);
+    float zc = static_cast<float>(zC);
+    float zmax = static_cast<float>(osg::maximum(v0.z(), osg::maximum(v1.z(), v2.z())));
+    zmax = nextafterf(zmax, FLT_MAX);
+
+    for(int py=py0; py<=py1; ++py)
+    {
+        float ry = float(py-py0);
+        float e0 = eb[0]*ry + ec[0];
+        float e1 = eb[1]*ry + ec[1];
+        float e2 = eb[2]*ry + ec[2];
+        float z = zb*ry + zc;
+
+        float* row = &_depthBuffer[py*_width];
+        int px = px0;
+
+#ifdef SOFTWAREOCCLUSIONCULLER_USE_SSE2
+        const __m128 offsets = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+        for(; px+4<=px1+1; px+=4)
+        {
+            __m128 rx = _mm_add_ps(_mm_set1_ps(float(px-px0)), offsets);
+            __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(ea[0]), rx), _mm_set1_ps(e0)), _mm_setzero_ps());
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(ea[1]), rx), _mm_set1_ps(e1)), _mm_setzero_ps()));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(ea[2]), rx), _mm_set1_ps(e2)), _mm_setzero_ps()));
+            if (_mm_movemask_ps(inside)==0) continue;
+
+            __m128 depth = _mm_min_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(za), rx), _mm_set1_ps(z)), _mm_set1_ps(zmax));
+            __m128 current = _mm_loadu_ps(row+px);
+            __m128 nearest = _mm_min_ps(current, depth);
+            _mm_storeu_ps(row+px, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, current)));
+        }
+#endif
+
+        for(; px<=px1; ++px)
+        {
+            float rx = float(px-px0);
+            if (ea[0]*rx+e0>=0.0f && ea[1]*rx+e1>=0.0f && ea[2]*rx+e2>=0.0f)
+            {
+                float depth = osg::minimum(za*rx + z, zmax);
+                if (depth<row[px]) row[px] = depth;
+            }
+        }
+    }
+}
+
+void SoftwareOcclusionCuller::updateTileDepthBuffer()
+{
+    _tileDepthBuffer.resize(_numTilesX*_numTilesY);
+
+    for(unsigned int ty=0; ty<_numTilesY; ++ty)
+    {
+        for(unsigned int tx=0; tx<_numTilesX; ++tx)
+        {
+            const float* tile = &_depthBuffer[ty*TILE_SIZE*_width + tx*TILE_SIZE];
+            float farthest = -FLT_MAX;
+
+#ifdef SOFTWAREOCCLUSIONCULLER_USE_SSE2
+            __m128 m = _mm_set1_ps(-FLT_MAX);
+            for(unsigned int y=0; y<TILE_SIZE; ++y)
+            {
+                const float* row = tile + y*_width;
+                m = _mm_max_ps(m, _mm_max_ps(_mm_loadu_ps(row), _mm_loadu_ps(row+4)));
+            }
+            float values[4];
+            _mm_storeu_ps(values, m);
+            farthest = osg::maximum(osg::maximum(values[0], values[1]), osg::maximum(values[2], values[3]));
+#else
+            for(unsigned int y=0; y<TILE_SIZE; ++y)
+            {
+                const float* row = tile + y*_width;
+                for(unsigned int x=0; x<TILE_SIZE; ++x) farthest = osg::maximum(farthest, row[x]);
+            }
+#endif
+
+            _tileDepthBuffer[ty*_numTilesX+tx] = farthest;
+        }
+    }
+}
+
+bool SoftwareOcclusionCuller::isOccluded(const osg::BoundingBox& bb, const osg::Matrix& modelViewProjection) const
+{
+    if (_numRasterizedTriangles==0 || !bb.valid()) return false;
+
+    double xmin = DBL_MAX, xmax = -DBL_MAX, ymin = DBL_MAX, ymax = -DBL_MAX, zmin = DBL_MAX;
+    for(unsigned int i=0; i<8; ++i)
+    {
+        osg::Vec4d c = osg::Vec4d(osg::Vec3d(bb.corner(i)), 1.0) * modelViewProjection;
+        if (c.w()<=0.0 || c.z()<-c.w()) return false;
+
+        double x = (c.x()/c.w()*0.5+0.5)*double(_width);
+        double y = (c.y()/c.w()*0.5+0.5)*double(_height);
+        double z = c.z()/c.w();
+        xmin = osg::minimum(xmin, x); xmax = osg::maximum(xmax, x);
+        ymin = osg::minimum(ymin, y); ymax = osg::maximum(ymax, y);
+        zmin = osg::minimum(zmin, z);
+    }
+
+    // boxes outside the depth buffer are left to the view frustum culling.
+    if (xmax<0.0 || ymax<0.0 || xmin>=double(_width) || ymin>=double(_height)) return false;
+
+    int x0 = static_cast<int>(osg::maximum(floor(xmin), 0.0));
+    int y0 = static_cast<int>(osg::maximum(floor(ymin), 0.0));
+    int x1 = static_cast<int>(osg::minimum(floor(xmax), double(_width-1)));
+    int y1 = static_cast<int>(osg::minimum(floor(ymax), double(_height-1)));
+
+    float nearest = static_cast<float>(zmin);
+    if (double(nearest)>zmin) nearest = nextafterf(nearest, -FLT_MAX);
+
+    for(int ty=y0/int(TILE_SIZE); ty<=y1/int(TILE_SIZE); ++ty)
+    {
+        for(int tx=x0/int(TILE_SIZE); tx<=x1/int(TILE_SIZE); ++tx)
+        {
+            // the whole tile is in front of the box.
+            if (_tileDepthBuffer[ty*_numTilesX+tx]<nearest) continue;
+
+            int ys = osg::maximum(y0, ty*int(TILE_SIZE)), ye = osg::minimum(y1, ty*int(TILE_SIZE)+int(TILE_SIZE)-1);
+            int xs = osg::maximum(x0, tx*int(TILE_SIZE)), xe = osg::minimum(x1, tx*int(TILE_SIZE)+int(TILE_SIZE)-1);
+            for(int y=ys; y<=ye; ++y)
+            {
+                const float* row = &_depthBuffer[y*_width];
+                for(int x=xs; x<=xe; ++x)
+                {
+                    if (row[x]>=nearest) return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,127 @@
+/* -*-c++-*- OpenSceneGraph - Copyright (C) 1998-2006 Robert Osfield
+ *
+ * This library is open source and may be redistributed and/or modified under
+ * the terms of the OpenSceneGraph Public License (OSGPL) version 0.0 or
+ * (at your option) any later version.  The full license is in LICENSE file
+ * included with this distribution, and on the openscenegraph.org website.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * OpenSceneGraph Public License for more details.
+*/
+
+#include <osgUtil/TaskThreadPool>
+
+#include <osg/Math>
+
+#include <OpenThreads/Atomic>
+#include <OpenThreads/Block>
+
+using namespace osgUtil;
+
+namespace
+{
+
+// The tasks of a call to TaskThreadPool::run(), taken in turn by the calling thread and the worker threads helping it.
+// Workers that only start once all the tasks have been taken find nothing left to do.
+class TaskBatch : public osg::Referenced
+{
+public:
+    TaskBatch(const TaskThreadPool::Tasks& tasks):
+        _tasks(tasks),
+        _blockCount(static_cast<unsigned int>(tasks.size()))
+    {
+        _blockCount.reset();
+    }
+
+    void runTasks()
+    {
+        for(unsigned int i = (++_next)-1; i < _tasks.size(); i = (++_next)-1)
+        {
+            (*_tasks[i])(0);
+            _blockCount.completed();
+        }
+    }
+
+    void block() { _blockCount.block(); }
+
+protected:
+    TaskThreadPool::Tasks   _tasks;
+    OpenThreads::Atomic     _next;
+    OpenThreads::BlockCount _blockCount;
+};
+
+class RunTasksOperation : public osg::Operation
+{
+public:
+    RunTasksOperation(TaskBatch* batch):
+        osg::Operation("RunTasksOperation", false),
+        _batch(batch) {}
+
+    virtual void operator () (osg::Object*)
+    {
+        _batch->runTasks();
+    }
+
+    osg::ref_ptr<TaskBatch> _batch;
+};
+
+}
+
+TaskThreadPool::TaskThreadPool(unsigned int numThreads)
+{
+    if (numThreads==0) numThreads = OpenThreads::GetNumberOfProcessors();
+
+    _operationQueue = new osg::OperationQueue;
+
+    for(unsigned int i=0; i<numThreads; ++i)
+    {
+        osg::ref_ptr<osg::OperationThread> thread = new osg::OperationThread;
+        thread->setOperationQueue(_operationQueue.get());
+        thread->startThread();
+        _threads.push_back(thread);
+    }
+}
+
+TaskThreadPool::~TaskThreadPool()
+{
+    for(Threads::iterator itr = _threads.begin();
+        itr != _threads.end();
+        ++itr)
+    {
+        (*itr)->cancel();
+    }
+}
+
+osg::ref_ptr<TaskThreadPool>& TaskThreadPool::instance()
+{
+    static osg::ref_ptr<TaskThreadPool> s_taskThreadPool = new TaskThreadPool;
+    return s_taskThreadPool;
+}
+
+void TaskThreadPool::run(const Tasks& tasks, unsigned int maxNumThreads, osg::Operation* callerTask)
+{
+    if (tasks.empty())
+    {
+        if (callerTask) (*callerTask)(0);
+        return;
+    }
+
+    // the caller's own task counts as one of the tasks sharing the threads.
+    unsigned int numTasks = static_cast<unsigned int>(tasks.size()) + (callerTask ? 1 : 0);
+    unsigned int numThreads = maxNumThreads>0 ? maxNumThreads : getNumThreads()+1;
+    numThreads = osg::minimum(numThreads, numTasks);
+    unsigned int numWorkers = osg::minimum(numThreads-1, getNumThreads());
+
+    osg::ref_ptr<TaskBatch> batch = new TaskBatch(tasks);
+    for(unsigned int i=0; i<numWorkers; ++i)
+    {
+        _operationQueue->add(new RunTasksOperation(batch.get()));
+    }
+
+    if (callerTask) (*callerTask)(0);
+
+    batch->runTasks();
+    batch->block();
+}
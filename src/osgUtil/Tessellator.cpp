@@ -17,16 +17,915 @@
 #include <osg/io_utils>
 #include <osgUtil/Tessellator>
 
+#include <algorithm>
+
+#include <float.h>
+
 using namespace osg;
 using namespace osgUtil;
 
+namespace EarClipping
+{
+
+/** a vertex of a contour projected onto the plane of the tessellation, linked into a ring with the other vertices of
+  * the polygon being clipped, and into a list sorted along a z-order curve so that the vertices inside an ear of a
+  * large polygon can be found without visiting them all. */
+struct Node
+{
+    osg::Vec3*      vertex;
+    double          x;
+    double          y;
+    unsigned int    z;
+    Node*           prev;
+    Node*           next;
+    Node*           prevZ;
+    Node*           nextZ;
+};
+
+/** twice the signed area of the triangle a, b, c, positive when it winds counter clockwise. */
+inline double cross(const Node* a, const Node* b, const Node* c)
+{
+    return (b->x-a->x)*(c->y-a->y) - (b->y-a->y)*(c->x-a->x);
+}
+
+inline int orientation(const Node* a, const Node* b, const Node* c)
+{
+    double d = cross(a, b, c);
+    return d>0.0 ? 1 : (d<0.0 ? -1 : 0);
+}
+
+inline bool equals(const Node* a, const Node* b)
+{
+    return a->x==b->x && a->y==b->y;
+}
+
+/** whether q, collinear with p and r, lies on the segment between them. */
+inline bool onSegment(const Node* p, const Node* q, const Node* r)
+{
+    return q->x<=std::max(p->x, r->x) && q->x>=std::min(p->x, r->x) &&
+           q->y<=std::max(p->y, r->y) && q->y>=std::min(p->y, r->y);
+}
+
+/** whether the segments p1-q1 and p2-q2 cross or touch. */
+inline bool intersects(const Node* p1, const Node* q1, const Node* p2, const Node* q2)
+{
+    int o1 = orientation(p1, q1, p2);
+    int o2 = orientation(p1, q1, q2);
+    int o3 = orientation(p2, q2, p1);
+    int o4 = orientation(p2, q2, q1);
+
+    if (o1!=o2 && o3!=o4) return true;
+
+    if (o1==0 && onSegment(p1, p2, q1)) return true;
+    if (o2==0 && onSegment(p1, q2, q1)) return true;
+    if (o3==0 && onSegment(p2, p1, q2)) return true;
+    if (o4==0 && onSegment(p2, q1, q2)) return true;
+
+    return false;
+}
+
+/** whether p lies inside the triangle a, b, c or on its edges, whichever way it winds. */
+inline bool pointInTriangle(double ax, double ay, double bx, double by, double cx, double cy, double px, double py)
+{
+    double d1 = (bx-ax)*(py-ay) - (by-ay)*(px-ax);
+    double d2 = (cx-bx)*(py-by) - (cy-by)*(px-bx);
+    double d3 = (ax-cx)*(py-cy) - (ay-cy)*(px-cx);
+    bool negative = d1<0.0 || d2<0.0 || d3<0.0;
+    bool positive = d1>0.0 || d2>0.0 || d3>0.0;
+    return !(negative && positive);
+}
+
+/** whether the diagonal from a to b starts off inside the polygon. */
+inline bool locallyInside(const Node* a, const Node* b)
+{
+    return cross(a->prev, a, a->next)>0.0 ?
+        cross(a, b, a->next)<=0.0 && cross(a, a->prev, b)<=0.0 :
+        cross(a, b, a->prev)>0.0 || cross(a, a->next, b)>0.0;
+}
+
+/** whether the wedge between the edges at m contains the wedge between the edges at p, where m and p coincide. */
+inline bool sectorContainsSector(const Node* m, const Node* p)
+{
+    return cross(m->prev, m, p->prev)>0.0 && cross(p->next, m, m->next)>0.0;
+}
+
+inline unsigned int zOrder(double x, double y, double minX, double minY, double invSize)
+{
+    unsigned int ix = static_cast<unsigned int>((x-minX)*invSize);
+    unsigned int iy = static_cast<unsigned int>((y-minY)*invSize);
+
+    ix = (ix | (ix << 8)) & 0x00FF00FF;
+    ix = (ix | (ix << 4)) & 0x0F0F0F0F;
+    ix = (ix | (ix << 2)) & 0x33333333;
+    ix = (ix | (ix << 1)) & 0x55555555;
+
+    iy = (iy | (iy << 8)) & 0x00FF00FF;
+    iy = (iy | (iy << 4)) & 0x0F0F0F0F;
+    iy = (iy | (iy << 2)) & 0x33333333;
+    iy = (iy | (iy << 1)) & 0x55555555;
+
+    return ix | (iy << 1);
+}
+
+inline void removeNode(Node* p)
+{
+    p->next->prev = p->prev;
+    p->prev->next = p->next;
+
+    if (p->prevZ) p->prevZ->nextZ = p->nextZ;
+    if (p->nextZ) p->nextZ->prevZ = p->prevZ;
+}
+
+struct LessXY
+{
+    bool operator() (const Node* lhs, const Node* rhs) const { return lhs->x<rhs->x || (lhs->x==rhs->x && lhs->y<rhs->y); }
+};
+
+struct LessZ
+{
+    bool operator() (const Node* lhs, const Node* rhs) const { return lhs->z<rhs->z; }
+};
+
+/** The edges of a polygon listed by the horizontal strips they cross, each edge by the node it starts from, so that
+  * rays cast along the x axis only visit the edges near them.*/
+class EdgeStrips
+{
+    public:
+
+        EdgeStrips():
+            _minY(0.0),
+            _invHeight(0.0) {}
+
+        void reset(double minY, double maxY, unsigned int numEdges)
+        {
+            unsigned int numStrips = numEdges/8 + 1;
+            _minY = minY;
+            _invHeight = maxY>minY ? static_cast<double>(numStrips)/(maxY-minY) : 0.0;
+            _strips.resize(numStrips);
+            for(StripList::iterator itr = _strips.begin(); itr != _strips.end(); ++itr)
+            {
+                itr->clear();
+            }
+        }
+
+        unsigned int getStripIndex(double y) const
+        {
+            double s = (y-_minY)*_invHeight;
+            if (s<=0.0) return 0;
+            return std::min(static_cast<unsigned int>(s), static_cast<unsigned int>(_strips.size()-1));
+        }
+
+        void addEdge(Node* p)
+        {
+            unsigned int s0 = getStripIndex(std::min(p->y, p->next->y));
+            unsigned int s1 = getStripIndex(std::max(p->y, p->next->y));
+            for(unsigned int si=s0; si<=s1; ++si)
+            {
+                _strips[si].push_back(p);
+            }
+        }
+
+        typedef std::vector<Node*> Strip;
+
+        const Strip& getStrip(unsigned int si) const { return _strips[si]; }
+
+    protected:
+
+        typedef std::vector<Strip> StripList;
+
+        double      _minY;
+        double      _invHeight;
+        StripList   _strips;
+};
+
+/** Triangulates polygons with holes by ear clipping, after checking that the contours neither touch nor cross and
+  * working out which contours are holes from how they nest. Polygons of more than a few dozen vertices use a z-order
+  * curve to find the vertices that might lie inside an ear, so that large polygons aren't clipped in quadratic time.*/
+class EarClipper
+{
+    public:
+
+        typedef Tessellator::Prim::VecList VecList;
+        typedef std::vector<VecList> ContourList;
+
+        EarClipper(Tessellator::WindingType windingType, const osg::Vec3& normal):
+            _windingType(windingType),
+            _normal(normal) {}
+
+        /** triangulate the contours, appending the triangles, which wind counter clockwise about the normal, to
+          * triangles. Returns false if the contours touch or cross, or the winding rule would give a different
+          * result from the odd rule, in which case they must be passed to the GLU tessellator. */
+        bool triangulate(const ContourList& contours, VecList& triangles);
+
+    protected:
+
+        struct Ring
+        {
+            Node*           start;
+            unsigned int    size;
+            double          area;
+            double          minY;
+            double          maxY;
+            unsigned int    depth;
+            int             parent;
+        };
+
+        struct Edge
+        {
+            Node*   node;
+            double  minX;
+            double  maxX;
+
+            bool operator < (const Edge& rhs) const { return minX<rhs.minX; }
+        };
+
+        bool project(const ContourList& contours);
+        bool checkIntersections();
+        bool classifyRings();
+        bool isConvex(const Ring& ring) const;
+        void reverseRing(Ring& ring);
+
+        Node* findHoleBridge(Node* hole);
+        void splitPolygon(Node* a, Node* b);
+        Node* filterPoints(Node* start);
+
+        void indexCurve(Node* start);
+        bool isEar(const Node* ear) const;
+        bool isEarHashed(const Node* ear) const;
+        bool clip(Node* ear, unsigned int size, VecList& triangles);
+
+        Tessellator::WindingType    _windingType;
+        osg::Vec3d                  _normal;
+
+        std::vector<Node>           _nodes;
+        std::vector<Ring>           _rings;
+        std::vector<Edge>           _edges;
+        std::vector<Node*>          _zOrder;
+        std::vector<unsigned int>   _nodeRings;
+        EdgeStrips                  _strips;
+
+        double                      _minX;
+        double                      _minY;
+        double                      _invSize;
+};
+
+bool EarClipper::triangulate(const ContourList& contours, VecList& triangles)
+{
+    if (!project(contours)) return false;
+
+    if (_rings.empty()) return true;
+
+    // a single convex contour, the commonest case, is triangulated as a fan
+    if (_rings.size()==1 && isConvex(_rings.front()))
+    {
+        if (!classifyRings()) return false;
+
+        Ring& ring = _rings.front();
+        if (ring.area<0.0) reverseRing(ring);
+
+        for(Node* p = ring.start->next; p->next!=ring.start; p = p->next)
+        {
+            triangles.push_back(ring.start->vertex);
+            triangles.push_back(p->vertex);
+            triangles.push_back(p->next->vertex);
+        }
+
+        return true;
+    }
+
+    if (!checkIntersections() || !classifyRings()) return false;
+
+    // wind the outer contours counter clockwise and the holes clockwise, so that the polygon is always on the left
+    for(std::vector<Ring>::iterator itr = _rings.begin(); itr != _rings.end(); ++itr)
+    {
+        if ((itr->area>0.0) != (itr->depth%2==0)) reverseRing(*itr);
+    }
+
+    std::vector<Node*> holes;
+    for(unsigned int ri=0; ri<_rings.size(); ++ri)
+    {
+        Ring& outer = _rings[ri];
+        if (outer.depth%2!=0) continue;
+
+        // bridge the holes to the outer contour from left to right, each from its leftmost vertex
+        holes.clear();
+        unsigned int size = outer.size;
+        for(unsigned int hi=0; hi<_rings.size(); ++hi)
+        {
+            const Ring& hole = _rings[hi];
+            if (hole.parent!=static_cast<int>(ri)) continue;
+
+            Node* leftmost = hole.start;
+            Node* p = hole.start;
+            do
+            {
+                if (LessXY()(p, leftmost)) leftmost = p;
+                p = p->next;
+            } while(p!=hole.start);
+
+            holes.push_back(leftmost);
+            size += hole.size + 2;
+        }
+
+        if (!holes.empty())
+        {
+            std::sort(holes.begin(), holes.end(), LessXY());
+
+            _strips.reset(outer.minY, outer.maxY, size);
+            for(unsigned int hi=0; hi<_rings.size(); ++hi)
+            {
+                const Ring& ring = _rings[hi];
+                if (hi!=ri && ring.parent!=static_cast<int>(ri)) continue;
+
+                Node* p = ring.start;
+                do
+                {
+                    _strips.addEdge(p);
+                    p = p->next;
+                } while(p!=ring.start);
+            }
+
+            for(std::vector<Node*>::iterator itr = holes.begin(); itr != holes.end(); ++itr)
+            {
+                Node* bridge = findHoleBridge(*itr);
+                if (!bridge) return false;
+
+                splitPolygon(bridge, *itr);
+            }
+        }
+
+        if (!clip(outer.start, size, triangles)) return false;
+    }
+
+    return true;
+}
+
+bool EarClipper::project(const ContourList& contours)
+{
+    // project onto the plane of the normal by dropping its largest component, as the GLU tessellator does, computing
+    // the normal from the contours if none is given so that they enclose a positive area about it
+    osg::Vec3d normal = _normal;
+    if (normal.length2()==0.0)
+    {
+        for(ContourList::const_iterator citr = contours.begin(); citr != contours.end(); ++citr)
+        {
+            const VecList& contour = *citr;
+            for(unsigned int i=0; i<contour.size(); ++i)
+            {
+                osg::Vec3d a(*contour[i]);
+                osg::Vec3d b(*contour[(i+1)%contour.size()]);
+                normal.x() += (a.y()-b.y())*(a.z()+b.z());
+                normal.y() += (a.z()-b.z())*(a.x()+b.x());
+                normal.z() += (a.x()-b.x())*(a.y()+b.y());
+            }
+        }
+        if (normal.length2()==0.0) return false;
+    }
+
+    unsigned int axis = 0;
+    if (fabs(normal.y())>fabs(normal.x())) axis = 1;
+    if (fabs(normal.z())>fabs(normal[axis])) axis = 2;
+
+    unsigned int xAxis = (axis+1)%3;
+    unsigned int yAxis = (axis+2)%3;
+    double ySign = normal[axis]>0.0 ? 1.0 : -1.0;
+
+    unsigned int numVertices = 0;
+    for(ContourList::const_iterator citr = contours.begin(); citr != contours.end(); ++citr)
+    {
+        numVertices += citr->size();
+    }
+
+    // each bridge between a hole and its outer contour adds two vertices, so the nodes never need reallocating
+    _nodes.clear();
+    _nodes.reserve(numVertices + 2*contours.size());
+    _rings.clear();
+
+    for(ContourList::const_iterator citr = contours.begin(); citr != contours.end(); ++citr)
+    {
+        const VecList& contour = *citr;
+
+        Ring ring;
+        ring.start = 0;
+        ring.size = 0;
+        ring.area = 0.0;
+        ring.minY = DBL_MAX;
+        ring.maxY = -DBL_MAX;
+        ring.depth = 0;
+        ring.parent = -1;
+
+        Node* last = 0;
+        for(VecList::const_iterator vitr = contour.begin(); vitr != contour.end(); ++vitr)
+        {
+            osg::Vec3* vertex = *vitr;
+
+            Node node;
+            node.vertex = vertex;
+            node.x = (*vertex)[xAxis];
+            node.y = (*vertex)[yAxis]*ySign;
+            node.z = 0;
+            node.prevZ = 0;
+            node.nextZ = 0;
+
+            // drop repeated vertices, including a last vertex closing the contour onto its first
+            if (last && equals(last, &node)) continue;
+            if (vitr+1==contour.end() && ring.start && equals(ring.start, &node)) continue;
+
+            _nodes.push_back(node);
+            Node* p = &_nodes.back();
+            if (last)
+            {
+                p->prev = last;
+                last->next = p;
+            }
+            else
+            {
+                ring.start = p;
+            }
+            last = p;
+            ++ring.size;
+
+            ring.minY = std::min(ring.minY, p->y);
+            ring.maxY = std::max(ring.maxY, p->y);
+        }
+
+        // contours of fewer than three distinct vertices enclose nothing
+        if (ring.size<3) continue;
+
+        last->next = ring.start;
+        ring.start->prev = last;
+
+        Node* p = ring.start;
+        do
+        {
+            ring.area += (p->x - p->next->x)*(p->y + p->next->y);
+            p = p->next;
+        } while(p!=ring.start);
+
+        if (ring.area==0.0) return false;
+
+        _rings.push_back(ring);
+    }
+
+    return true;
+}
+
+bool EarClipper::checkIntersections()
+{
+    // sweep the edges in order of their left ends, testing each against those that overlap it horizontally
+    _edges.clear();
+    for(std::vector<Ring>::iterator itr = _rings.begin(); itr != _rings.end(); ++itr)
+    {
+        Node* p = itr->start;
+        do
+        {
+            Edge edge;
+            edge.node = p;
+            edge.minX = std::min(p->x, p->next->x);
+            edge.maxX = std::max(p->x, p->next->x);
+            _edges.push_back(edge);
+            p = p->next;
+        } while(p!=itr->start);
+    }
+
+    std::sort(_edges.begin(), _edges.end());
+
+    for(unsigned int i=0; i<_edges.size(); ++i)
+    {
+        const Node* a = _edges[i].node;
+        const Node* b = a->next;
+        double minY = std::min(a->y, b->y);
+        double maxY = std::max(a->y, b->y);
+
+        for(unsigned int j=i+1; j<_edges.size() && _edges[j].minX<=_edges[i].maxX; ++j)
+        {
+            const Node* c = _edges[j].node;
+            const Node* d = c->next;
+            if (std::max(c->y, d->y)<minY || std::min(c->y, d->y)>maxY) continue;
+
+            // adjacent edges only meet at their shared vertex, unless the contour doubles back on itself
+            if (b==c)
+            {
+                if (cross(a, b, d)==0.0 && (a->x-b->x)*(d->x-b->x) + (a->y-b->y)*(d->y-b->y)>0.0) return false;
+            }
+            else if (d==a)
+            {
+                if (cross(c, a, b)==0.0 && (c->x-a->x)*(b->x-a->x) + (c->y-a->y)*(b->y-a->y)>0.0) return false;
+            }
+            else if (intersects(a, b, c, d))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool EarClipper::classifyRings()
+{
+    if (_rings.size()>1)
+    {
+        // as the contours don't touch, those crossed an odd number of times by a ray cast from a vertex of a contour
+        // enclose it, the depth to which it is nested being their number and its parent the smallest of them
+        double minY = DBL_MAX;
+        double maxY = -DBL_MAX;
+        unsigned int numEdges = 0;
+        _nodeRings.resize(_nodes.size());
+        for(unsigned int ri=0; ri<_rings.size(); ++ri)
+        {
+            const Ring& ring = _rings[ri];
+            minY = std::min(minY, ring.minY);
+            maxY = std::max(maxY, ring.maxY);
+            numEdges += ring.size;
+
+            Node* p = ring.start;
+            do
+            {
+                _nodeRings[p-&_nodes.front()] = ri;
+                p = p->next;
+            } while(p!=ring.start);
+        }
+
+        _strips.reset(minY, maxY, numEdges);
+        for(std::vector<Ring>::iterator itr = _rings.begin(); itr != _rings.end(); ++itr)
+        {
+            Node* p = itr->start;
+            do
+            {
+                _strips.addEdge(p);
+                p = p->next;
+            } while(p!=itr->start);
+        }
+
+        std::vector<unsigned int> crossings(_rings.size(), 0);
+        std::vector<unsigned int> crossed;
+        for(unsigned int ri=0; ri<_rings.size(); ++ri)
+        {
+            Ring& ring = _rings[ri];
+            const Node* point = ring.start;
+
+            const EdgeStrips::Strip& strip = _strips.getStrip(_strips.getStripIndex(point->y));
+            for(EdgeStrips::Strip::const_iterator itr = strip.begin(); itr != strip.end(); ++itr)
+            {
+                const Node* p = *itr;
+                const Node* q = p->next;
+                unsigned int rj = _nodeRings[p-&_nodes.front()];
+                if (rj!=ri &&
+                    (p->y>point->y) != (q->y>point->y) &&
+                    point->x < (q->x-p->x)*(point->y-p->y)/(q->y-p->y) + p->x)
+                {
+                    if (crossings[rj]++==0) crossed.push_back(rj);
+                }
+            }
+
+            for(std::vector<unsigned int>::iterator itr = crossed.begin(); itr != crossed.end(); ++itr)
+            {
+                unsigned int rj = *itr;
+                if (crossings[rj]%2==1)
+                {
+                    ++ring.depth;
+                    if (ring.parent<0 || fabs(_rings[rj].area)<fabs(_rings[ring.parent].area)) ring.parent = rj;
+                }
+                crossings[rj] = 0;
+            }
+            crossed.clear();
+        }
+    }
+
+    if (_windingType==Tessellator::TESS_WINDING_ODD) return true;
+
+    if (_windingType!=Tessellator::TESS_WINDING_NONZERO &&
+        _windingType!=Tessellator::TESS_WINDING_POSITIVE &&
+        _windingType!=Tessellator::TESS_WINDING_NEGATIVE) return false;
+
+    // the other rules give the same result as the odd rule when the contours alternate in orientation as they nest,
+    // and for the positive and negative rules the outermost contours wind the right way about the normal
+    for(std::vector<Ring>::const_iterator itr = _rings.begin(); itr != _rings.end(); ++itr)
+    {
+        if (itr->parent>=0)
+        {
+            if ((itr->area>0.0) == (_rings[itr->parent].area>0.0)) return false;
+        }
+        else if (_windingType==Tessellator::TESS_WINDING_POSITIVE)
+        {
+            if (itr->area<0.0) return false;
+        }
+        else if (_windingType==Tessellator::TESS_WINDING_NEGATIVE)
+        {
+            if (itr->area>0.0) return false;
+        }
+    }
+
+    return true;
+}
+
+bool EarClipper::isConvex(const Ring& ring) const
+{
+    // every corner turns the same way and the edges only reverse direction along the x axis twice, so that the
+    // contour doesn't wind round more than once
+    double sign = ring.area>0.0 ? 1.0 : -1.0;
+    double firstDx = 0.0;
+    double lastDx = 0.0;
+    unsigned int reversals = 0;
+
+    const Node* p = ring.start;
+    do
+    {
+        if (cross(p->prev, p, p->next)*sign<0.0) return false;
+
+        double dx = p->next->x - p->x;
+        if (dx!=0.0)
+        {
+            if (firstDx==0.0) firstDx = dx;
+            else if ((dx>0.0) != (lastDx>0.0)) ++reversals;
+            lastDx = dx;
+        }
+        p = p->next;
+    } while(p!=ring.start);
+
+    if ((firstDx>0.0) != (lastDx>0.0)) ++reversals;
+
+    return reversals<=2;
+}
+
+void EarClipper::reverseRing(Ring& ring)
+{
+    Node* p = ring.start;
+    do
+    {
+        Node* next = p->next;
+        p->next = p->prev;
+        p->prev = next;
+        p = next;
+    } while(p!=ring.start);
+    ring.area = -ring.area;
+}
+
+Node* EarClipper::findHoleBridge(Node* hole)
+{
+    // find the nearest edge crossed by a ray from the leftmost vertex of the hole to the left, taking the end of it
+    // furthest left as the vertex to bridge to. The holes still to be bridged all lie to the right of the ray.
+    double hx = hole->x;
+    double hy = hole->y;
+    double qx = -DBL_MAX;
+    Node* m = 0;
+
+    const EdgeStrips::Strip& strip = _strips.getStrip(_strips.getStripIndex(hy));
+    for(EdgeStrips::Strip::const_iterator itr = strip.begin(); itr != strip.end(); ++itr)
+    {
+        Node* p = *itr;
+        if (hy<=p->y && hy>=p->next->y && p->next->y!=p->y)
+        {
+            double x = p->x + (hy-p->y)*(p->next->x-p->x)/(p->next->y-p->y);
+            if (x<hx && x>qx)
+            {
+                qx = x;
+                m = p->x<p->next->x ? p : p->next;
+            }
+        }
+    }
+
+    if (!m) return 0;
+
+    // any vertices inside the triangle between the hole vertex, the crossing and that end of the edge might hide it
+    // from the hole, in which case bridge to the one making the smallest angle with the ray
+    double mx = m->x;
+    double my = m->y;
+    double tanMin = DBL_MAX;
+
+    unsigned int s0 = _strips.getStripIndex(std::min(hy, my));
+    unsigned int s1 = _strips.getStripIndex(std::max(hy, my));
+    for(unsigned int si=s0; si<=s1; ++si)
+    {
+        const EdgeStrips::Strip& triangleStrip = _strips.getStrip(si);
+        for(EdgeStrips::Strip::const_iterator itr = triangleStrip.begin(); itr != triangleStrip.end(); ++itr)
+        {
+            Node* p = *itr;
+            if (hx>=p->x && p->x>=mx && hx!=p->x &&
+                pointInTriangle(hy<my ? hx : qx, hy, mx, my, hy<my ? qx : hx, hy, p->x, p->y))
+            {
+                double tan = fabs(hy-p->y)/(hx-p->x);
+
+                if (locallyInside(p, hole) &&
+                    (tan<tanMin || (tan==tanMin && (p->x>m->x || (p->x==m->x && sectorContainsSector(m, p))))))
+                {
+                    m = p;
+                    tanMin = tan;
+                }
+            }
+        }
+    }
+
+    return m;
+}
+
+void EarClipper::splitPolygon(Node* a, Node* b)
+{
+    // join a to b with a pair of coincident edges, duplicating both so that the ring runs from a into b's ring and
+    // back out again
+    _nodes.push_back(*a);
+    Node* a2 = &_nodes.back();
+    _nodes.push_back(*b);
+    Node* b2 = &_nodes.back();
+
+    Node* an = a->next;
+    Node* bp = b->prev;
+
+    a->next = b;
+    b->prev = a;
+
+    a2->next = an;
+    an->prev = a2;
+
+    b2->next = a2;
+    a2->prev = b2;
+
+    bp->next = b2;
+    b2->prev = bp;
+
+    // a now starts the bridge, and its copies the bridge back and the edge a started
+    _strips.addEdge(a);
+    _strips.addEdge(a2);
+    _strips.addEdge(b2);
+}
+
+Node* EarClipper::filterPoints(Node* start)
+{
+    // remove repeated and collinear vertices, which can leave no ears in polygons made degenerate by bridging
+    Node* end = start;
+    Node* p = start;
+    bool again;
+    do
+    {
+        again = false;
+        if (equals(p, p->next) || cross(p->prev, p, p->next)==0.0)
+        {
+            removeNode(p);
+            p = end = p->prev;
+            if (p==p->next) break;
+            again = true;
+        }
+        else
+        {
+            p = p->next;
+        }
+    } while(again || p!=end);
+
+    return end;
+}
+
+void EarClipper::indexCurve(Node* start)
+{
+    _minX = _minY = DBL_MAX;
+    double maxX = -DBL_MAX;
+    double maxY = -DBL_MAX;
+
+    _zOrder.clear();
+    Node* p = start;
+    do
+    {
+        _minX = std::min(_minX, p->x);
+        _minY = std::min(_minY, p->y);
+        maxX = std::max(maxX, p->x);
+        maxY = std::max(maxY, p->y);
+        _zOrder.push_back(p);
+        p = p->next;
+    } while(p!=start);
+
+    double size = std::max(maxX-_minX, maxY-_minY);
+    _invSize = size>0.0 ? 32767.0/size : 0.0;
+
+    for(std::vector<Node*>::iterator itr = _zOrder.begin(); itr != _zOrder.end(); ++itr)
+    {
+        (*itr)->z = zOrder((*itr)->x, (*itr)->y, _minX, _minY, _invSize);
+    }
+
+    std::sort(_zOrder.begin(), _zOrder.end(), LessZ());
+
+    for(unsigned int i=0; i<_zOrder.size(); ++i)
+    {
+        _zOrder[i]->prevZ = i>0 ? _zOrder[i-1] : 0;
+        _zOrder[i]->nextZ = i+1<_zOrder.size() ? _zOrder[i+1] : 0;
+    }
+}
+
+bool EarClipper::isEar(const Node* ear) const
+{
+    const Node* a = ear->prev;
+    const Node* b = ear;
+    const Node* c = ear->next;
+
+    // reflex and degenerate corners can't be ears
+    if (cross(a, b, c)<=0.0) return false;
+
+    double x0 = std::min(a->x, std::min(b->x, c->x));
+    double y0 = std::min(a->y, std::min(b->y, c->y));
+    double x1 = std::max(a->x, std::max(b->x, c->x));
+    double y1 = std::max(a->y, std::max(b->y, c->y));
+
+    // only a reflex vertex inside the ear can have the rest of the polygon cross it
+    const Node* p = c->next;
+    while(p!=a)
+    {
+        if (p->x>=x0 && p->x<=x1 && p->y>=y0 && p->y<=y1 &&
+            !equals(p, a) &&
+            pointInTriangle(a->x, a->y, b->x, b->y, c->x, c->y, p->x, p->y) &&
+            cross(p->prev, p, p->next)<=0.0) return false;
+        p = p->next;
+    }
+
+    return true;
+}
+
+bool EarClipper::isEarHashed(const Node* ear) const
+{
+    const Node* a = ear->prev;
+    const Node* b = ear;
+    const Node* c = ear->next;
+
+    if (cross(a, b, c)<=0.0) return false;
+
+    double x0 = std::min(a->x, std::min(b->x, c->x));
+    double y0 = std::min(a->y, std::min(b->y, c->y));
+    double x1 = std::max(a->x, std::max(b->x, c->x));
+    double y1 = std::max(a->y, std::max(b->y, c->y));
+
+    // only the vertices whose z-order lies within that of the corners of the ear's bounds can be inside it
+    unsigned int minZ = zOrder(x0, y0, _minX, _minY, _invSize);
+    unsigned int maxZ = zOrder(x1, y1, _minX, _minY, _invSize);
+
+    for(const Node* p = ear->prevZ; p && p->z>=minZ; p = p->prevZ)
+    {
+        if (p->x>=x0 && p->x<=x1 && p->y>=y0 && p->y<=y1 &&
+            p!=a && p!=c && !equals(p, a) &&
+            pointInTriangle(a->x, a->y, b->x, b->y, c->x, c->y, p->x, p->y) &&
+            cross(p->prev, p, p->next)<=0.0) return false;
+    }
+
+    for(const Node* n = ear->nextZ; n && n->z<=maxZ; n = n->nextZ)
+    {
+        if (n->x>=x0 && n->x<=x1 && n->y>=y0 && n->y<=y1 &&
+            n!=a && n!=c && !equals(n, a) &&
+            pointInTriangle(a->x, a->y, b->x, b->y, c->x, c->y, n->x, n->y) &&
+            cross(n->prev, n, n->next)<=0.0) return false;
+    }
+
+    return true;
+}
+
+bool EarClipper::clip(Node* ear, unsigned int size, VecList& triangles)
+{
+    bool hashed = size>80;
+    if (hashed) indexCurve(ear);
+
+    // if a pass around the polygon finds no ears, try again once with the collinear vertices removed
+    bool filtered = false;
+    Node* stop = ear;
+    while(ear->prev!=ear->next)
+    {
+        Node* prev = ear->prev;
+        Node* next = ear->next;
+
+        if (hashed ? isEarHashed(ear) : isEar(ear))
+        {
+            triangles.push_back(prev->vertex);
+            triangles.push_back(ear->vertex);
+            triangles.push_back(next->vertex);
+
+            removeNode(ear);
+
+            // skipping the next vertex leaves fewer slivers
+            ear = next->next;
+            stop = next->next;
+            continue;
+        }
+
+        ear = next;
+
+        if (ear==stop)
+        {
+            if (filtered) return false;
+
+            ear = stop = filterPoints(ear);
+            filtered = true;
+        }
+    }
+
+    return true;
+}
+
+}
+
+
 
 Tessellator::Tessellator() :
     _wtype(TESS_WINDING_ODD),
     _ttype(TESS_TYPE_POLYGONS),
     _boundaryOnly(false),
     _numberVerts(0),
-    _extraPrimitives(0)
+    _extraPrimitives(0),
+    _useEarClipping(true)
 {
     _tobj = gluNewTess();
     if (_tobj)
@@ -53,64 +952,65 @@ Tessellator::~Tessellator()
 void Tessellator::beginTessellation()
 {
     reset();
-
-    if (_tobj)
-    {
-        gluTessProperty(_tobj, GLU_TESS_WINDING_RULE, _wtype);
-        gluTessProperty(_tobj, GLU_TESS_BOUNDARY_ONLY, _boundaryOnly);
-
-        if (tessNormal.length()>0.0) gluTessNormal(_tobj, tessNormal.x(), tessNormal.y(), tessNormal.z());
-
-        gluTessBeginPolygon(_tobj,this);
-    }
 }
 
 void Tessellator::beginContour()
 {
-    if (_tobj)
-    {
-        gluTessBeginContour(_tobj);
-    }
+    _contourList.push_back(Prim::VecList());
 }
 
 void Tessellator::addVertex(osg::Vec3* vertex)
 {
-    if (_tobj)
+    if (vertex && vertex->valid())
     {
-        if (vertex && vertex->valid())
-        {
-            Vec3d* data = new Vec3d;
-            _coordData.push_back(data);
-            (*data)._v[0]=(*vertex)[0];
-            (*data)._v[1]=(*vertex)[1];
-            (*data)._v[2]=(*vertex)[2];
-            gluTessVertex(_tobj,data->_v,vertex);
+        if (_contourList.empty()) _contourList.push_back(Prim::VecList());
+        _contourList.back().push_back(vertex);
+    }
+    else
+    {
+        if (vertex) {
+            OSG_INFO << "Tessellator::addVertex(" << *vertex << ") detected NaN, ignoring vertex." << std::endl;
         }
         else
         {
-            if (vertex) {
-                OSG_INFO << "Tessellator::addVertex(" << *vertex << ") detected NaN, ignoring vertex." << std::endl;
-            }
-            else
-            {
-                OSG_INFO<<"Tessellator::addVertex(NULL) detected Nullpointer, ignoring vertex."<<std::endl;
-            }
+            OSG_INFO<<"Tessellator::addVertex(NULL) detected Nullpointer, ignoring vertex."<<std::endl;
         }
     }
 }
 
 void Tessellator::endContour()
 {
-    if (_tobj)
-    {
-        gluTessEndContour(_tobj);
-    }
 }
 
 void Tessellator::endTessellation()
 {
+    if (_useEarClipping && earClipContours()) return;
+
     if (_tobj)
     {
+        gluTessProperty(_tobj, GLU_TESS_WINDING_RULE, _wtype);
+        gluTessProperty(_tobj, GLU_TESS_BOUNDARY_ONLY, _boundaryOnly);
+
+        if (tessNormal.length()>0.0) gluTessNormal(_tobj, tessNormal.x(), tessNormal.y(), tessNormal.z());
+
+        gluTessBeginPolygon(_tobj,this);
+
+        for(ContourList::iterator citr=_contourList.begin(); citr!=_contourList.end(); ++citr)
+        {
+            gluTessBeginContour(_tobj);
+            for(Prim::VecList::iterator vitr=citr->begin(); vitr!=citr->end(); ++vitr)
+            {
+                osg::Vec3* vertex = *vitr;
+                Vec3d* data = new Vec3d;
+                _coordData.push_back(data);
+                (*data)._v[0]=(*vertex)[0];
+                (*data)._v[1]=(*vertex)[1];
+                (*data)._v[2]=(*vertex)[2];
+                gluTessVertex(_tobj,data->_v,vertex);
+            }
+            gluTessEndContour(_tobj);
+        }
+
         gluTessEndPolygon(_tobj);
 
         if (_errorCode!=0)
@@ -121,6 +1021,24 @@ void Tessellator::endTessellation()
     }
 }
 
+bool Tessellator::earClipContours()
+{
+    if (_boundaryOnly) return false;
+
+    Prim::VecList triangles;
+    EarClipping::EarClipper earClipper(_wtype, tessNormal);
+    if (!earClipper.triangulate(_contourList, triangles)) return false;
+
+    if (!triangles.empty())
+    {
+        Prim* prim = new Prim(GL_TRIANGLES);
+        prim->_vertices.swap(triangles);
+        _primList.push_back(prim);
+    }
+
+    return true;
+}
+
 void Tessellator::reset()
 {
     for (Vec3dList::iterator i = _coordData.begin(); i != _coordData.end(); ++i)
@@ -139,6 +1057,7 @@ void Tessellator::reset()
     _coordData.clear();
     _newVertexList.clear();
     _primList.clear();
+    _contourList.clear();
     _errorCode = 0;
 }
 
@@ -626,18 +1545,29 @@ void Tessellator::collectTessellation(osg::Geometry &geom, unsigned int /*origin
     if (geom.containsDeprecatedData()) geom.fixDeprecatedData();
 
     osg::Vec3Array* vertices = dynamic_cast<osg::Vec3Array*>(geom.getVertexArray());
-    if (!vertices) return;
+    if (!vertices || vertices->empty()) return;
+
 
+    // when the tessellation added no vertices, as ear clipping never does, the indices follow from the positions of
+    // the vertices in the array without mapping every vertex of the geometry for each polygon tessellated.
+    const osg::Vec3* firstVertex = &(vertices->front());
+    bool mapVertices = !_newVertexList.empty();
 
     VertexPtrToIndexMap vertexPtrToIndexMap;
 
-    // populate the VertexPtrToIndexMap.
-    for(unsigned int vi=0;vi<vertices->size();++vi)
+    if (mapVertices)
     {
-        vertexPtrToIndexMap[&((*vertices)[vi])] = vi;
+        // populate the VertexPtrToIndexMap.
+        for(unsigned int vi=0;vi<vertices->size();++vi)
+        {
+            vertexPtrToIndexMap[&((*vertices)[vi])] = vi;
+        }
+
+        handleNewVertices(geom, vertexPtrToIndexMap);
     }
 
-    handleNewVertices(geom, vertexPtrToIndexMap);
+    unsigned int numVertices = vertices->size();
+    std::vector<unsigned int> indices;
 
     // we don't properly handle per primitive and per primitive_set bindings yet
     // will need to address this soon. Robert Oct 2002.
@@ -679,29 +1609,32 @@ void Tessellator::collectTessellation(osg::Geometry &geom, unsigned int /*origin
               Prim* prim=primItr->get();
               int ntris=0;
 
-              if(vertexPtrToIndexMap.size() <= 255)
+              indices.clear();
+              for(Prim::VecList::iterator vitr=prim->_vertices.begin();
+                vitr!=prim->_vertices.end();
+                ++vitr)
+              {
+                  indices.push_back(mapVertices ? vertexPtrToIndexMap[*vitr] : static_cast<unsigned int>(*vitr - firstVertex));
+              }
+
+              if(numVertices <= 255)
               {
                   osg::DrawElementsUByte* elements = new osg::DrawElementsUByte(prim->_mode);
-                  for(Prim::VecList::iterator vitr=prim->_vertices.begin();
-                  vitr!=prim->_vertices.end();
-                  ++vitr)
-                {
-                    elements->push_back(vertexPtrToIndexMap[*vitr]);
-                }
+                  elements->reserve(indices.size());
+                  for(std::vector<unsigned int>::iterator iitr=indices.begin();
+                    iitr!=indices.end();
+                    ++iitr)
+                  {
+                    elements->push_back(*iitr);
+                  }
 
                   // add to the drawn primitive list.
                   geom.addPrimitiveSet(elements);
                   ntris=elements->getNumIndices()/3;
               }
-              else if(vertexPtrToIndexMap.size() > 255 && vertexPtrToIndexMap.size() <= 65535)
+              else if(numVertices <= 65535)
               {
-                  osg::DrawElementsUShort* elements = new osg::DrawElementsUShort(prim->_mode);
-                  for(Prim::VecList::iterator vitr=prim->_vertices.begin();
-                    vitr!=prim->_vertices.end();
-                    ++vitr)
-                  {
-                    elements->push_back(vertexPtrToIndexMap[*vitr]);
-                  }
+                  osg::DrawElementsUShort* elements = new osg::DrawElementsUShort(prim->_mode, indices.begin(), indices.end());
 
                   // add to the drawn primitive list.
                   geom.addPrimitiveSet(elements);
@@ -709,13 +1642,7 @@ void Tessellator::collectTessellation(osg::Geometry &geom, unsigned int /*origin
               }
               else
               {
-                  osg::DrawElementsUInt* elements = new osg::DrawElementsUInt(prim->_mode);
-                  for(Prim::VecList::iterator vitr=prim->_vertices.begin();
-                    vitr!=prim->_vertices.end();
-                    ++vitr)
-                  {
-                    elements->push_back(vertexPtrToIndexMap[*vitr]);
-                  }
+                  osg::DrawElementsUInt* elements = new osg::DrawElementsUInt(prim->_mode, indices.begin(), indices.end());
 
                   // add to the drawn primitive list.
                   geom.addPrimitiveSet(elements);
@@ -594,6 +594,16 @@ void Renderer::compile()
     sceneView->getState()->checkGLErrors("After Renderer::compile");
 }
 
+static void prefetchSceneView(osgUtil::SceneView* sceneView)
+{
+    // updateSceneView() has assigned the view's DatabasePager to the cull visitor.
+    osgDB::DatabasePager* databasePager = dynamic_cast<osgDB::DatabasePager*>(sceneView->getCullVisitor()->getDatabaseRequestHandler());
+    if (databasePager && databasePager->getPrefetchHorizon()>0.0)
+    {
+        databasePager->prefetch(sceneView->getCamera(), sceneView->getSceneData(), sceneView->getFrameStamp());
+    }
+}
+
 static void collectSceneViewStats(unsigned int frameNumber, osgUtil::SceneView* sceneView, osg::Stats* stats)
 {
     osgUtil::Statistics sceneStats;
@@ -659,6 +669,8 @@ void Renderer::cull()
         sceneView->inheritCullSettings(*(sceneView->getCamera()));
         sceneView->cull();
 
+        prefetchSceneView(sceneView);
+
         osg::Timer_t afterCullTick = osg::Timer::instance()->tick();
 
 #if 0
@@ -847,6 +859,8 @@ void Renderer::cull_draw()
     sceneView->inheritCullSettings(*(sceneView->getCamera()));
     sceneView->cull();
 
+    prefetchSceneView(sceneView);
+
     osg::Timer_t afterCullTick = osg::Timer::instance()->tick();
 
     if (stats && stats->collectStats("scene"))
@@ -76,6 +76,63 @@ static void readContainer2( osgDB::InputStream& is, ContainerType* container )
         continue; \
     }
 
+// packed keys are read and written as they are stored, the Vec3 keys relative to the bounding box of the channel
+
+static void readPackedContainer( osgDB::InputStream& is, osgAnimation::Vec3PackedKeyframeContainer* container )
+{
+    typedef osgAnimation::Vec3PackedKeyframeContainer::KeyType KeyType;
+    bool hasContainer = false;
+    is >> is.PROPERTY("KeyFrameContainer") >> hasContainer;
+    if ( hasContainer )
+    {
+        osg::Vec3f min, scale;
+        is >> is.PROPERTY("Min") >> min;
+        is >> is.PROPERTY("Scale") >> scale;
+        container->init( min, scale );
+
+        unsigned int size = 0;
+        size = is.readSize(); is >> is.BEGIN_BRACKET;
+        for ( unsigned int i=0; i<size; ++i )
+        {
+            double time = 0.0f;
+            unsigned int bits = 0;
+            is >> time >> bits;
+            container->push_back( KeyType(time, osgAnimation::Vec3Packed(bits)) );
+        }
+        is >> is.END_BRACKET;
+    }
+}
+
+static void readPackedContainer( osgDB::InputStream& is, osgAnimation::QuatPackedKeyframeContainer* container )
+{
+    typedef osgAnimation::QuatPackedKeyframeContainer::KeyType KeyType;
+    bool hasContainer = false;
+    is >> is.PROPERTY("KeyFrameContainer") >> hasContainer;
+    if ( hasContainer )
+    {
+        unsigned int size = 0;
+        size = is.readSize(); is >> is.BEGIN_BRACKET;
+        for ( unsigned int i=0; i<size; ++i )
+        {
+            double time = 0.0f;
+            unsigned short v0 = 0, v1 = 0, v2 = 0;
+            is >> time >> v0 >> v1 >> v2;
+            container->push_back( KeyType(time, osgAnimation::QuatPacked(v0, v1, v2)) );
+        }
+        is >> is.END_BRACKET;
+    }
+}
+
+#define READ_PACKED_CHANNEL_FUNC( NAME, CHANNEL ) \
+    if ( type==#NAME ) { \
+        CHANNEL* ch = new CHANNEL; \
+        readChannel( is, ch ); \
+        readPackedContainer( is, ch->getOrCreateSampler()->getOrCreateKeyframeContainer() ); \
+        is >> is.END_BRACKET; \
+        if ( ch ) ani.addChannel( ch ); \
+        continue; \
+    }
+
 // writing channel helpers
 
 static void writeChannel( osgDB::OutputStream& os, osgAnimation::Channel* ch )
@@ -120,6 +177,49 @@ static void writeContainer2( osgDB::OutputStream& os, ContainerType* container )
     os << std::endl;
 }
 
+static void writePackedContainer( osgDB::OutputStream& os, osgAnimation::Vec3PackedKeyframeContainer* container )
+{
+    os << os.PROPERTY("KeyFrameContainer") << (container!=NULL);
+    if ( container!=NULL )
+    {
+        os << os.PROPERTY("Min") << container->_min;
+        os << os.PROPERTY("Scale") << container->_scale;
+        os.writeSize(container->size()); os << os.BEGIN_BRACKET << std::endl;
+        for ( unsigned int i=0; i<container->size(); ++i )
+        {
+            os << (*container)[i].getTime() << (*container)[i].getValue().m32bits << std::endl;
+        }
+        os << os.END_BRACKET;
+    }
+    os << std::endl;
+}
+
+static void writePackedContainer( osgDB::OutputStream& os, osgAnimation::QuatPackedKeyframeContainer* container )
+{
+    os << os.PROPERTY("KeyFrameContainer") << (container!=NULL);
+    if ( container!=NULL )
+    {
+        os.writeSize(container->size()); os << os.BEGIN_BRACKET << std::endl;
+        for ( unsigned int i=0; i<container->size(); ++i )
+        {
+            const osgAnimation::QuatPacked& value = (*container)[i].getValue();
+            os << (*container)[i].getTime() << value.m48bits[0] << value.m48bits[1] << value.m48bits[2] << std::endl;
+        }
+        os << os.END_BRACKET;
+    }
+    os << std::endl;
+}
+
+#define WRITE_PACKED_CHANNEL_FUNC( NAME, CHANNEL ) \
+    CHANNEL* ch_##NAME = dynamic_cast<CHANNEL*>(ch); \
+    if ( ch_##NAME ) { \
+        os << os.PROPERTY("Type") << std::string(#NAME) << os.BEGIN_BRACKET << std::endl; \
+        writeChannel( os, ch_##NAME ); \
+        writePackedContainer( os, ch_##NAME ->getSamplerTyped()->getKeyframeContainerTyped() ); \
+        os << os.END_BRACKET << std::endl; \
+        continue; \
+    }
+
 #define WRITE_CHANNEL_FUNC( NAME, CHANNEL, CONTAINER ) \
     CHANNEL* ch_##NAME = dynamic_cast<CHANNEL*>(ch); \
     if ( ch_##NAME ) { \
@@ -170,6 +270,8 @@ static bool readChannels( osgDB::InputStream& is, osgAnimation::Animation& ani )
                                                        osgAnimation::QuatKeyframeContainer, osg::Quat );
         READ_CHANNEL_FUNC( MatrixLinearChannel, osgAnimation::MatrixLinearChannel,
                                                 osgAnimation::MatrixKeyframeContainer, osg::Matrix );
+        READ_PACKED_CHANNEL_FUNC( Vec3PackedLinearChannel, osgAnimation::Vec3PackedLinearChannel );
+        READ_PACKED_CHANNEL_FUNC( QuatPackedSphericalLinearChannel, osgAnimation::QuatPackedSphericalLinearChannel );
         READ_CHANNEL_FUNC2( FloatCubicBezierChannel, osgAnimation::FloatCubicBezierChannel,
                                                      osgAnimation::FloatCubicBezierKeyframeContainer,
                                                      osgAnimation::FloatCubicBezier, float );
@@ -214,6 +316,8 @@ static bool writeChannels( osgDB::OutputStream& os, const osgAnimation::Animatio
                                                          osgAnimation::QuatKeyframeContainer );
         WRITE_CHANNEL_FUNC( MatrixLinearChannel, osgAnimation::MatrixLinearChannel,
                                                  osgAnimation::MatrixKeyframeContainer );
+        WRITE_PACKED_CHANNEL_FUNC( Vec3PackedLinearChannel, osgAnimation::Vec3PackedLinearChannel );
+        WRITE_PACKED_CHANNEL_FUNC( QuatPackedSphericalLinearChannel, osgAnimation::QuatPackedSphericalLinearChannel );
         WRITE_CHANNEL_FUNC2( FloatCubicBezierChannel, osgAnimation::FloatCubicBezierChannel,
                                                       osgAnimation::FloatCubicBezierKeyframeContainer );
         WRITE_CHANNEL_FUNC2( DoubleCubicBezierChannel, osgAnimation::DoubleCubicBezierChannel,
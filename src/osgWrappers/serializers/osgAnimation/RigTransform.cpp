@@ -1,6 +1,8 @@
 
 #include <osgAnimation/RigTransformHardware>
 #include <osgAnimation/RigTransformSoftware>
+#include <osgAnimation/RigTransformDualQuaternionHardware>
+#include <osgAnimation/RigTransformDualQuaternionSoftware>
 #include <osgAnimation/MorphTransformSoftware>
     #include <osgAnimation/MorphTransformHardware>
     #include <osgDB/ObjectWrapper>
@@ -38,6 +40,22 @@ namespace wrap_osgAnimationRigTransformHardWare
      }
 }
 
+namespace wrap_osgAnimationRigTransformDualQuaternionSoftware
+{
+    REGISTER_OBJECT_WRAPPER( osgAnimation_RigTransformDualQuaternionSoftware,
+                             new osgAnimation::RigTransformDualQuaternionSoftware,
+                             osgAnimation::RigTransformDualQuaternionSoftware,
+                             "osg::Object osgAnimation::RigTransform osgAnimation::RigTransformSoftware osgAnimation::RigTransformDualQuaternionSoftware" ){}
+}
+
+namespace wrap_osgAnimationRigTransformDualQuaternionHardware
+{
+    REGISTER_OBJECT_WRAPPER( osgAnimation_RigTransformDualQuaternionHardware,
+                             new osgAnimation::RigTransformDualQuaternionHardware,
+                             osgAnimation::RigTransformDualQuaternionHardware,
+                             "osg::Object osgAnimation::RigTransform osgAnimation::RigTransformHardware osgAnimation::RigTransformDualQuaternionHardware" ){}
+}
+
 namespace wrap_osgAnimationMorphTransform
 {
     REGISTER_OBJECT_WRAPPER( osgAnimation_MorphTransform,